@@ -0,0 +1,122 @@
+#ifndef COMPRESSED_COLUMNS_HPP
+#define COMPRESSED_COLUMNS_HPP
+
+#include "query5.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// ---------------- Compressed lineitem columns ----------------
+// Lineitem chunks for LineItemLayout::Compressed. Rows are encoded in blocks of
+// COMPRESSED_BLOCK_ROWS, the zone map block size, so a skipped zone map block is never decoded:
+//   L_ORDERKEY        run-length encoded; run values as bit-packed deltas from the previous run
+//   L_SUPPKEY         frame of reference: bit-packed offsets from the block minimum
+//   L_EXTENDEDPRICE   frame of reference, like L_SUPPKEY
+//   L_DISCOUNT        bit-packed codes into a dictionary shared by the chunk
+// Every stream of a block uses the fewest bits its values need. A probe decodes the order key
+// runs of a block with decodeOrderKeyRuns(), looks each run up once and reads the other columns
+// of the rows that joined with the accessors below, each a single unaligned load, shift and mask.
+constexpr size_t COMPRESSED_BLOCK_ROWS = ZONE_MAP_BLOCK_ROWS;
+
+class CompressedLineItems {
+public:
+    // Rows are buffered and encoded one full block at a time; finish() encodes the last
+    // partial block and must be called before the chunk is read
+    void push_back(const LineItem& row) {
+        pending_.push_back(row);
+        if (pending_.size() == COMPRESSED_BLOCK_ROWS)
+            encodePending();
+    }
+
+    void reserve(size_t rows) { pending_.reserve(std::min(rows, COMPRESSED_BLOCK_ROWS)); }
+
+    void finish();
+
+    size_t size() const { return rows_; }
+    size_t numBlocks() const { return blocks_.size(); }
+    size_t blockRows(size_t block) const { return blocks_[block].rows; }
+
+    // Bytes held by the encoded chunk
+    size_t memoryBytes() const {
+        return data_.capacity() + blocks_.capacity() * sizeof(Block) + dictionary_.capacity() * sizeof(int16_t);
+    }
+
+    // Expand the L_ORDERKEY runs of block into out[0 .. blockRows(block))
+    void decodeOrderKeys(size_t block, int* out) const;
+
+    // Store the value and length of every L_ORDERKEY run of block into run_keys and
+    // run_lengths (COMPRESSED_BLOCK_ROWS entries each) and return the number of runs
+    size_t decodeOrderKeyRuns(size_t block, int* run_keys, uint32_t* run_lengths) const;
+
+    // Columns of row `row` of block
+    int suppKey(size_t block, size_t row) const {
+        const Block& b = blocks_[block];
+        return int(int64_t(b.supp_base) + int64_t(readBits(b.data_offset + b.supp_offset, row, b.supp_width)));
+    }
+
+    int64_t price(size_t block, size_t row) const {
+        const Block& b = blocks_[block];
+        return b.price_base + int64_t(readBits(b.data_offset + b.price_offset, row, b.price_width));
+    }
+
+    int16_t discount(size_t block, size_t row) const {
+        const Block& b = blocks_[block];
+        return dictionary_[readBits(b.data_offset + b.discount_offset, row, b.discount_width)];
+    }
+
+    LineItem row(size_t block, size_t row, int order_key) const {
+        return LineItem{order_key, suppKey(block, row), price(block, row), discount(block, row)};
+    }
+
+private:
+    // Padding after the last stream, so every readBits load stays inside data_
+    static constexpr size_t READ_PADDING = 16;
+
+    struct Block {
+        size_t data_offset;         // First byte of the block's streams in data_
+        uint32_t lengths_offset;    // Stream offsets relative to data_offset; run values start at 0
+        uint32_t supp_offset;
+        uint32_t price_offset;
+        uint32_t discount_offset;
+        uint16_t rows;
+        uint16_t runs;
+        int32_t first_key;          // Value of the first run
+        int32_t supp_base;
+        int64_t delta_base;         // Smallest difference between consecutive run values
+        int64_t price_base;
+        uint8_t delta_width;
+        uint8_t length_width;       // Run lengths are stored minus one
+        uint8_t supp_width;
+        uint8_t price_width;
+        uint8_t discount_width;
+    };
+
+    // Value `index` of a stream of width bit values starting at data_[offset]
+    uint64_t readBits(size_t offset, size_t index, int width) const {
+        size_t bit = index * size_t(width);
+        const uint8_t* bytes = data_.data() + offset + bit / 8;
+        int shift = int(bit % 8);
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        uint64_t value = word >> shift;
+        if (width > 56 && shift != 0) {       // Does not fit the first load
+            uint64_t next;
+            std::memcpy(&next, bytes + 8, sizeof(next));
+            value |= next << (64 - shift);
+        }
+        return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+    }
+
+    void encodePending();
+
+    size_t rows_ = 0;
+    std::vector<LineItem> pending_;         // Rows of the block being filled
+    std::vector<Block> blocks_;
+    std::vector<uint8_t> data_;             // Bit streams of every block, then READ_PADDING bytes
+    std::vector<int16_t> dictionary_;       // L_DISCOUNT values in order of first appearance
+};
+
+#endif // COMPRESSED_COLUMNS_HPP
@@ -0,0 +1,26 @@
+#ifndef CPU_TOPOLOGY_HPP
+#define CPU_TOPOLOGY_HPP
+
+#include <string>
+#include <vector>
+
+
+// ---------------- CPU affinity and NUMA topology ----------------
+// Picks the CPUs pool workers are pinned to for --affinity and tells which NUMA node a CPU
+// belongs to. Node numbers come from libnuma when the build found it (TPCH_HAVE_LIBNUMA);
+// without it every CPU counts as node 0, so pinning still works and nothing is replicated.
+
+// CPUs for an --affinity value, worker i is pinned to cpus[i % cpus.size()]:
+//   compact     every CPU this process may run on, in ascending order
+//   scatter     the same CPUs taken round robin across NUMA nodes
+//   0-3,8,10    an explicit CPU list
+// Returns false for a malformed value or a listed CPU the process may not run on
+bool affinityCpus(const std::string& affinity, std::vector<int>& cpus);
+
+// NUMA node of cpu, 0 without libnuma or for an unknown CPU
+int numaNodeOfCpu(int cpu);
+
+// Pin the calling thread to cpu, false if the system refuses
+bool pinCurrentThread(int cpu);
+
+#endif // CPU_TOPOLOGY_HPP
@@ -0,0 +1,96 @@
+#ifndef GROUP_AGGREGATE_HPP
+#define GROUP_AGGREGATE_HPP
+
+#include "thread_pool.hpp"
+#include "tpch_decimal.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+// ---------------- Group-by revenue aggregation ----------------
+// Sums revenue per integer group ID over the workers of a ThreadPool. Every worker only
+// adds into its own accumulators and merge() combines them once at the end, so names or
+// keys are attached to the group IDs by the caller after the merge instead of per row.
+//
+// Up to DENSE_GROUP_LIMIT groups each worker owns a flat array indexed by group ID, padded
+// to whole cache lines so no two workers ever write the same line. Larger group counts
+// (per customer, per order) switch to a partitioned hash aggregation: each worker hashes
+// into RADIX_PARTITIONS small open addressing tables picked by the top hash bits, and
+// merge() combines partition p of every worker independently of the other partitions.
+class GroupAggregate {
+public:
+    static constexpr uint64_t DENSE_GROUP_LIMIT = uint64_t(1) << 16;
+    static constexpr int RADIX_BITS = 6;
+    static constexpr size_t RADIX_PARTITIONS = size_t(1) << RADIX_BITS;
+
+    // Accumulators for num_workers workers and group IDs in [0, num_groups)
+    GroupAggregate(int num_workers, uint64_t num_groups);
+
+    bool isDense() const { return dense_; }
+    uint64_t numGroups() const { return num_groups_; }
+
+    // The flat accumulators of worker, numGroups() entries; dense mode only.
+    // Hot loops add into this array directly instead of calling add()
+    RevenueSum* denseSums(int worker) {
+        return reinterpret_cast<RevenueSum*>(dense_lines_.data() + size_t(worker) * lines_per_worker_);
+    }
+
+    void add(int worker, uint64_t group, RevenueSum revenue) {
+        if (dense_) {
+            denseSums(worker)[group] += revenue;
+            return;
+        }
+        uint64_t hash = group * 0x9E3779B97F4A7C15ull;
+        hash_partitions_[size_t(worker) * RADIX_PARTITIONS + (hash >> (64 - RADIX_BITS))].add(group, hash, revenue);
+    }
+
+    // Combine the workers into one (group, sum) pair per group with a non zero sum, on pool
+    // when given. Dense mode returns the groups by ID; hash mode by ID within each partition.
+    void merge(ThreadPool* pool, std::vector<std::pair<uint64_t, RevenueSum>>& groups) const;
+
+private:
+    // Dense accumulators are allocated in whole cache lines
+    struct alignas(64) CacheLine {
+        RevenueSum sums[64 / sizeof(RevenueSum)];
+    };
+
+    // Linear probing table of one worker and partition, at most half full
+    struct alignas(64) HashPartition {
+        static constexpr uint64_t EMPTY_KEY = UINT64_MAX;
+
+        std::vector<uint64_t> keys;
+        std::vector<RevenueSum> sums;
+        size_t used = 0;
+
+        void add(uint64_t key, uint64_t hash, RevenueSum revenue) {
+            if (2 * (used + 1) > keys.size())
+                grow();
+            size_t mask = keys.size() - 1;
+            for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+                if (keys[slot] == key) {
+                    sums[slot] += revenue;
+                    return;
+                }
+                if (keys[slot] == EMPTY_KEY) {
+                    keys[slot] = key;
+                    sums[slot] = revenue;
+                    ++used;
+                    return;
+                }
+            }
+        }
+
+        void grow();
+    };
+
+    bool dense_;
+    int num_workers_;
+    uint64_t num_groups_;
+    size_t lines_per_worker_ = 0;
+    std::vector<CacheLine> dense_lines_;            // Worker w owns lines [w * lines_per_worker_, ...)
+    std::vector<HashPartition> hash_partitions_;    // [worker * RADIX_PARTITIONS + partition]
+};
+
+#endif // GROUP_AGGREGATE_HPP
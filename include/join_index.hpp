@@ -0,0 +1,96 @@
+#ifndef JOIN_INDEX_HPP
+#define JOIN_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// ---------------- Join index: integer key -> small code ----------------
+// Maps join keys (orderkey, suppkey, custkey, ...) to a small code such as a nation slot.
+// TPC-H keys are dense integers, so the index is normally a direct addressed byte array
+// indexed by key - min_key where a probe is a single load. When the keys are too sparse
+// for that to be reasonable it falls back to an open addressing (linear probing) flat
+// hash table. Keys that were never inserted read as NOT_FOUND.
+// Code is int8_t for nation codes (JoinIndex); int32_t carries a key such as O_CUSTKEY
+// through a join. Codes must not be negative. Both instantiations live in join_index.cpp.
+template <typename Code>
+class BasicJoinIndex {
+public:
+    static constexpr Code NOT_FOUND = -1;
+
+    struct Entry {
+        int key;
+        Code code;
+    };
+
+    // Build the index from entries. domain_keys is the number of distinct keys the key column
+    // can hold (e.g. the row count of the table the key belongs to); a byte array is used when
+    // the key range is at most DENSE_RANGE_FACTOR times that, even if only a few keys qualify.
+    // With a pool, entries are inserted concurrently in BUILD_MORSEL_ENTRIES sized ranges; keys
+    // must then be unique (as primary keys are), otherwise which duplicate wins is unspecified.
+    void build(const std::vector<Entry>& entries, size_t domain_keys, ThreadPool* pool = nullptr);
+
+    static constexpr size_t BUILD_MORSEL_ENTRIES = size_t(1) << 16;
+
+    // Smallest and largest key of a non empty entries vector, scanned on pool when given
+    static void keyRange(const std::vector<Entry>& entries, ThreadPool* pool, int& min_key, int& max_key);
+
+    // Code stored for key, or NOT_FOUND
+    Code find(int key) const {
+        if (dense_) {
+            uint32_t slot = uint32_t(key) - uint32_t(min_key_);
+            return slot < dense_size_ ? codes_[slot] : NOT_FOUND;
+        }
+        return findHashed(key);
+    }
+
+    bool isDense() const { return dense_; }
+    size_t size() const { return entry_count_; }
+    size_t memoryBytes() const { return codes_.size() * sizeof(Code) + slots_.size() * sizeof(Slot); }
+
+    // Dense layout only: base key, number of addressable keys and the code array, for kernels
+    // that probe the array directly. The array is followed by DENSE_PADDING readable entries so
+    // a 4 byte gather at the last key stays inside the allocation.
+    static constexpr size_t DENSE_PADDING = 3;
+    int minKey() const { return min_key_; }
+    uint32_t denseSize() const { return dense_size_; }
+    const Code* denseCodes() const { return codes_.data(); }
+
+private:
+    static constexpr size_t DENSE_RANGE_FACTOR = 16 / sizeof(Code);    // Code array vs ~16 bytes per hash entry
+    static constexpr int EMPTY_KEY = INT32_MIN;        // Marks unused hash slots
+
+    struct Slot {
+        int32_t key;
+        Code code;
+    };
+
+    static uint32_t hashKey(int key) {
+        return uint32_t(key) * 0x9E3779B1u;             // Fibonacci hashing, top bits are used
+    }
+
+    Code findHashed(int key) const {
+        uint32_t slot = hashKey(key) >> hash_shift_;
+        while (true) {
+            const Slot& candidate = slots_[slot];
+            if (candidate.key == key) return candidate.code;
+            if (candidate.key == EMPTY_KEY) return NOT_FOUND;
+            slot = (slot + 1) & hash_mask_;
+        }
+    }
+
+    bool dense_ = true;
+    int min_key_ = 0;
+    uint32_t dense_size_ = 0;       // Keys [min_key_, min_key_ + dense_size_) are addressable
+    size_t entry_count_ = 0;
+    std::vector<Code> codes_;       // Dense layout: code per key - min_key_, plus DENSE_PADDING entries
+    std::vector<Slot> slots_;       // Hash layout: power of two sized slot array
+    uint32_t hash_shift_ = 32;
+    uint32_t hash_mask_ = 0;
+};
+
+using JoinIndex = BasicJoinIndex<int8_t>;
+
+#endif // JOIN_INDEX_HPP
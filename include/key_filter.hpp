@@ -0,0 +1,59 @@
+#ifndef KEY_FILTER_HPP
+#define KEY_FILTER_HPP
+
+#include "join_index.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// ---------------- Semi-join key filter ----------------
+// Compact approximate set of the join keys that survived preprocess, cheap enough to
+// test inside the lineitem parser before the remaining columns are parsed.
+// Dense key ranges use an exact bitmap (1 bit per possible key, 8x smaller than the
+// JoinIndex byte array); sparse ranges use a register-blocked Bloom filter where all
+// probe bits of a key live in one 64-bit word. mayContain() never returns false for
+// an inserted key; a Bloom filter can return true for a few keys that were not inserted.
+class KeyFilter {
+public:
+    // Build from the same entries and domain size as the matching JoinIndex, on pool when given
+    void build(const std::vector<JoinIndex::Entry>& entries, size_t domain_keys, ThreadPool* pool = nullptr);
+
+    bool mayContain(int key) const {
+        if (bitmap_) {
+            uint32_t slot = uint32_t(key) - uint32_t(min_key_);
+            return slot < key_range_ && (words_[slot >> 6] >> (slot & 63) & 1);
+        }
+        uint64_t hash = uint64_t(uint32_t(key)) * 0x9E3779B97F4A7C15ull;
+        uint64_t mask = bloomMask(hash);
+        return (words_[hash >> word_shift_] & mask) == mask;
+    }
+
+    bool isBitmap() const { return bitmap_; }
+    size_t memoryBytes() const { return words_.size() * sizeof(uint64_t); }
+
+private:
+    static constexpr size_t BITMAP_RANGE_FACTOR = 64;   // Bitmap bits per domain key before switching to Bloom
+    static constexpr size_t BLOOM_BITS_PER_KEY = 16;    // Well under 1% false positives with 4 probe bits per word
+
+    // Four bit positions taken from hash bits 8..31; the top bits pick the word
+    static uint64_t bloomMask(uint64_t hash) {
+        return (uint64_t(1) << (hash >> 8 & 63)) | (uint64_t(1) << (hash >> 14 & 63))
+             | (uint64_t(1) << (hash >> 20 & 63)) | (uint64_t(1) << (hash >> 26 & 63));
+    }
+
+    bool bitmap_ = true;
+    int min_key_ = 0;
+    uint64_t key_range_ = 0;
+    uint32_t word_shift_ = 64;
+    std::vector<uint64_t> words_;
+};
+
+// Filters pushed into the lineitem loader: a row is only kept if its order and its
+// supplier may both qualify
+struct LineItemFilter {
+    KeyFilter orders;       // L_ORDERKEY values with a qualifying order
+    KeyFilter suppliers;    // L_SUPPKEY values with a qualifying supplier
+};
+
+#endif // KEY_FILTER_HPP
@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+
+// ---------------- Read-only memory mapped file ----------------
+// Maps a whole file into the address space so loaders can scan it in place
+// without copying lines into std::string buffers.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map the file at the given path, returns false if it cannot be opened or mapped
+    bool open(const std::string& filepath);
+
+    // Unmap the file (safe to call on an unopened object)
+    void close();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr || opened_empty_; }
+
+private:
+    const char* data_ = nullptr;   // Start of mapping (nullptr for empty files)
+    size_t size_ = 0;              // Mapped length in bytes
+    bool opened_empty_ = false;    // Zero length files cannot be mapped but are still valid
+};
+
+#endif // MAPPED_FILE_HPP
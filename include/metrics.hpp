@@ -0,0 +1,154 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// ---------------- Run instrumentation ----------------
+// Wall and CPU time per phase and per thread, row counters of the loaders and the probe,
+// and hardware counters from perf_event_open (cycles, last level cache misses, branch
+// misses) where the kernel allows them. Everything is written as one JSON document.
+//
+// Instrumentation is off unless a Metrics object is enabled. Hot paths fetch
+// activeMetrics() once per morsel and skip all recording when it is null, so a disabled
+// run pays one pointer test per morsel.
+//
+// Phases are exclusive: a phase started inside another (the pushdown preprocess inside
+// load) pauses the outer one, so the phases of a run add up to its instrumented time.
+
+enum class MetricsPhase {
+    Load,
+    Preprocess,
+    Probe,
+    Merge,
+    Count
+};
+
+enum class MetricsCounter {
+    OrdersLines,                // Lines read from orders.tbl
+    OrdersMalformed,            // Orders lines with missing or non numeric columns
+    LineItemLines,              // Lines read from lineitem.tbl
+    LineItemMalformed,          // Lineitem lines with missing or non numeric columns
+    LineItemPushdownRejected,   // Lineitem lines dropped by the semi-join key filters while parsing
+    ProbeRows,                  // Lineitem rows reaching the probe
+    ProbeZoneMapSkipped,        // Probe rows skipped with their whole zone map block
+    ProbeOrderRejected,         // Probe rows whose order is not in the region and date range
+    ProbeNationMismatch,        // Probe rows whose supplier is not in the customer's nation
+    ProbeAggregated,            // Probe rows added to a nation's revenue
+    Count
+};
+
+// Hardware counters of one thread, zero where unavailable
+struct PerfSample {
+    uint64_t cycles = 0;
+    uint64_t llc_misses = 0;
+    uint64_t branch_misses = 0;
+};
+
+class Metrics {
+public:
+    Metrics();
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // Make this the active instance until disable(); only one instance can be active
+    void enable();
+    void disable();
+
+    void add(MetricsCounter counter, uint64_t value) {
+        counters_[int(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // Called by the main thread around phases, see MetricsPhaseScope
+    void beginPhase(MetricsPhase phase);
+    void endPhase();
+
+    // Called by a pool worker around one job with the samples taken before and after it;
+    // the time is charged to the phase running at that moment
+    struct ThreadSample {
+        int64_t wall_ns = 0;
+        int64_t cpu_ns = 0;
+        PerfSample perf;
+    };
+    static ThreadSample sampleThread();
+    void addWorkerJob(int worker, const ThreadSample& start, const ThreadSample& end);
+
+    bool perfAvailable() const;
+
+    // Write the JSON document, false if path cannot be written
+    bool writeJson(const std::string& path) const;
+
+private:
+    struct PhaseTotals {
+        uint64_t calls = 0;
+        int64_t wall_ns = 0;
+        int64_t cpu_ns = 0;
+        PerfSample perf;
+    };
+
+    // Phase totals of one thread
+    struct ThreadTotals {
+        PhaseTotals phases[int(MetricsPhase::Count)];
+    };
+
+    void closeInterval();
+    void openInterval();
+
+    std::atomic<uint64_t> counters_[int(MetricsCounter::Count)];
+
+    // Main thread state, only touched by the thread that runs the phases
+    std::vector<MetricsPhase> phase_stack_;
+    ThreadSample interval_start_;
+    int64_t interval_process_cpu_ns_ = 0;
+    PhaseTotals phases_[int(MetricsPhase::Count)];      // Wall and process wide CPU time per phase
+    ThreadTotals main_thread_;
+    std::atomic<int> current_phase_{-1};                // Phase workers charge their jobs to
+
+    std::mutex workers_mutex_;
+    std::vector<ThreadTotals> workers_;
+};
+
+namespace metrics_detail {
+extern Metrics* active;
+}
+
+// The enabled Metrics instance, nullptr when instrumentation is off
+inline Metrics* activeMetrics() {
+    return metrics_detail::active;
+}
+
+// Runs the enclosing block as one phase of the active Metrics, if any. next() ends the
+// current phase and starts another without leaving the scope.
+class MetricsPhaseScope {
+public:
+    explicit MetricsPhaseScope(MetricsPhase phase) : metrics_(activeMetrics()) {
+        if (metrics_)
+            metrics_->beginPhase(phase);
+    }
+
+    ~MetricsPhaseScope() {
+        if (metrics_)
+            metrics_->endPhase();
+    }
+
+    void next(MetricsPhase phase) {
+        if (metrics_) {
+            metrics_->endPhase();
+            metrics_->beginPhase(phase);
+        }
+    }
+
+    MetricsPhaseScope(const MetricsPhaseScope&) = delete;
+    MetricsPhaseScope& operator=(const MetricsPhaseScope&) = delete;
+
+private:
+    Metrics* metrics_;
+};
+
+#endif // METRICS_HPP
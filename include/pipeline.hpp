@@ -0,0 +1,191 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "group_aggregate.hpp"
+#include "join_index.hpp"
+#include "table_scan.hpp"
+#include "tbl_parser.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// ---------------- Push-based operator pipelines ----------------
+// A query is written as chains of operators. The source of a chain parses one row at a time
+// and pushes it into the first operator, which pushes it on to the next:
+//
+//     scanRows(begin, end, start_offset, end_offset, parseLineItem,
+//              probe(supplier_index, [](const Row& r) { return r.suppkey; }, [](Row& r, int8_t code) { r.supp_code = code; },
+//                    filter([](const Row& r) { return r.discount > 5; },
+//                           aggregate(revenue, worker, group_of, value_of))));
+//
+// Operators are small structs holding the next operator by value, and their lambdas are
+// template parameters, so the chain compiles into one loop like a hand-written probe.
+// A row is a mutable struct of the query; a probe stores what it found into it before
+// pushing it on. Chains are built per morsel for the worker running it, so sinks write
+// worker-local state only.
+namespace pipeline {
+
+// Keep rows for which predicate(row) holds
+template <typename Predicate, typename Next>
+struct Filter {
+    Predicate predicate;
+    Next next;
+
+    template <typename Row>
+    void push(Row& row) {
+        if (predicate(static_cast<const Row&>(row)))
+            next.push(row);
+    }
+};
+
+// Probe side of a hash join: look key_of(row) up in an index built before, store the code it
+// maps to with store(row, code) and push the row on. Rows without a match stop here
+template <typename Index, typename KeyOf, typename Store, typename Next>
+struct Probe {
+    const Index& index;
+    KeyOf key_of;
+    Store store;
+    Next next;
+
+    template <typename Row>
+    void push(Row& row) {
+        auto code = index.find(key_of(static_cast<const Row&>(row)));
+        if (code == Index::NOT_FOUND)
+            return;
+        store(row, code);
+        next.push(row);
+    }
+};
+
+// Count the rows passing through into *counter, nothing when counter is nullptr (metrics off)
+template <typename Next>
+struct Count {
+    uint64_t* counter;
+    Next next;
+
+    template <typename Row>
+    void push(Row& row) {
+        if (counter)
+            ++*counter;
+        next.push(row);
+    }
+};
+
+// Sink: add value_of(row) to group group_of(row) of the worker's accumulators
+template <typename GroupOf, typename ValueOf>
+struct Aggregate {
+    GroupAggregate& target;
+    int worker;
+    GroupOf group_of;
+    ValueOf value_of;
+
+    template <typename Row>
+    void push(Row& row) {
+        target.add(worker, group_of(static_cast<const Row&>(row)), value_of(static_cast<const Row&>(row)));
+    }
+};
+
+// Entries of the build side of a hash join, collected per worker while a chain runs and
+// turned into an index afterwards
+template <typename Index>
+class JoinBuild {
+public:
+    explicit JoinBuild(const ThreadPool& pool) : parts_(pool.size()) {}
+
+    void add(int worker, int key, decltype(Index::Entry::code) code) { parts_[worker].push_back({key, code}); }
+
+    // All collected entries, the per-worker parts are released
+    std::vector<typename Index::Entry> entries(ThreadPool& pool) {
+        std::vector<typename Index::Entry> all;
+        appendConcatenated(&pool, parts_, all);
+        std::vector<std::vector<typename Index::Entry>>(parts_.size()).swap(parts_);
+        return all;
+    }
+
+private:
+    std::vector<std::vector<typename Index::Entry>> parts_;     // [worker]
+};
+
+// Sink: insert {key_of(row), code_of(row)} into the build side of a join
+template <typename Index, typename KeyOf, typename CodeOf>
+struct Insert {
+    JoinBuild<Index>& build;
+    int worker;
+    KeyOf key_of;
+    CodeOf code_of;
+
+    template <typename Row>
+    void push(Row& row) {
+        build.add(worker, key_of(static_cast<const Row&>(row)), code_of(static_cast<const Row&>(row)));
+    }
+};
+
+// Operator factories, so chains are written inside out without spelling the types
+template <typename Predicate, typename Next>
+Filter<Predicate, Next> filter(Predicate predicate, Next next) {
+    return {predicate, next};
+}
+
+template <typename Index, typename KeyOf, typename Store, typename Next>
+Probe<Index, KeyOf, Store, Next> probe(const Index& index, KeyOf key_of, Store store, Next next) {
+    return {index, key_of, store, next};
+}
+
+template <typename Next>
+Count<Next> count(uint64_t* counter, Next next) {
+    return {counter, next};
+}
+
+template <typename GroupOf, typename ValueOf>
+Aggregate<GroupOf, ValueOf> aggregate(GroupAggregate& target, int worker, GroupOf group_of, ValueOf value_of) {
+    return {target, worker, group_of, value_of};
+}
+
+template <typename Index, typename KeyOf, typename CodeOf>
+Insert<Index, KeyOf, CodeOf> insert(JoinBuild<Index>& build, int worker, KeyOf key_of, CodeOf code_of) {
+    return {build, worker, key_of, code_of};
+}
+
+// Source: parse the rows whose first byte lies in [start_offset, end_offset) of the table text
+// [begin, end) with parse(cursor, line_end, row) and push those it accepts into chain.
+// Returns the number of lines read
+template <typename Row, typename Parse, typename Chain>
+size_t scanRows(const char* begin, const char* end, size_t start_offset, size_t end_offset, Parse parse, Chain chain) {
+    const char* cursor = alignToLineStart(begin, begin + start_offset, end);
+    const char* chunk_end = begin + end_offset;
+
+    size_t lines = 0;
+    Row row;
+    while (cursor < chunk_end) {
+        const char* line_end = findLineEnd(cursor, end);
+        if (parse(cursor, line_end, row))
+            chain.push(row);
+        ++lines;
+        cursor = line_end + 1;
+    }
+    return lines;
+}
+
+// Run body(begin, end, start_offset, end_offset, worker) on pool for every morsel of the table
+// stored in paths, cut like the loaders cut it (see forEachTableMorsel). body returns the lines it
+// read; their total is stored in lines, e.g. as the domain_keys of an index built from the scan.
+// Returns false if the table can not be read
+template <typename Body>
+bool forEachMorsel(ThreadPool& pool, const std::vector<std::string>& paths, size_t& lines, Body body) {
+    std::atomic<size_t> total{0};
+    bool read = forEachTableMorsel(pool, paths,
+        [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+            total.fetch_add(body(begin, end, start_offset, end_offset, worker), std::memory_order_relaxed);
+        });
+    lines = total.load();
+    return read;
+}
+
+} // namespace pipeline
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,95 @@
+#ifndef PREPROCESS_HPP
+#define PREPROCESS_HPP
+
+#include "join_index.hpp"
+#include "key_filter.hpp"
+#include "query5.hpp"
+#include "thread_pool.hpp"
+#include <string>
+#include <vector>
+
+
+// Stores filtered keys and mappings for efficient query processing.
+// Selected nations are numbered 0..k-1 in nation table order ("nation codes"); every join
+// index maps a key to the nation code of the row it joins with, NOT_FOUND if filtered out.
+struct PreprocessedData {
+    int startDay;                                           // Order date filter as day numbers: [startDay, endDay)
+    int endDay;
+    std::vector<int> regionKeys;                            // Region keys matching filter
+    std::vector<std::string> nationNames;                   // Nation code -> Nation name
+    JoinIndex nationCodes;                                  // Nation key -> Nation code (nations within selected regions)
+    JoinIndex customerToNation;                             // Customer key -> Nation code (customers in selected nations)
+    JoinIndex orderToCustomerNation;                        // Order key -> Customer's nation code (filtered by date and customer)
+    JoinIndex supplierToNation;                             // Supplier key -> Nation code (suppliers in selected nations)
+    LineItemFilter lineitemFilter;                          // Key filters of the two indexes above, for the lineitem parser
+    bool ordersIndexed = false;                             // Built by a successful preprocess with index_orders
+};
+
+// Preprocess involved tables to filter and create lookup structures for efficient query execution.
+// The customer, orders and supplier scans and the index builds run on pool when one is given.
+// Without index_orders the orders scan is skipped and orderToCustomerNation and
+// lineitemFilter.orders stay empty, for joins that select the orders themselves (merge, radix).
+// Returns false if a date is not in YYYY-MM-DD form
+bool preprocess(
+    const std::string& regionName,                           // Region filter name
+    const std::string& startDate,                            // Start date filter for orders (inclusive)
+    const std::string& endDate,                              // End date filter for orders (exclusive)
+    const std::vector<Customer>& customer_data,
+    const std::vector<Orders>& orders_data,
+    const std::vector<Supplier>& supplier_data,
+    const std::vector<Nation>& nation_data,
+    const std::vector<Region>& region_data,
+    const DateZoneMap* orders_zone_map,                      // Optional block min/max of O_ORDERDATE
+    PreprocessedData& processed_data,
+    ThreadPool* pool = nullptr,
+    bool index_orders = true);
+
+
+// ---------------- Shared-scan batch annotation ----------------
+// Most queries a single lineitem scan can answer: one bit per query in a 64-bit mask
+constexpr size_t MAX_BATCH_QUERIES = 64;
+
+// Join indexes for up to MAX_BATCH_QUERIES Q5 parameter sets at once. Nation codes number the
+// union of the nations of every queried region. The sorted distinct start/end days of all
+// queries cut the date axis into segments, and queryMasks tells for each (nation code, date
+// segment) pair which queries a lineitem row with that customer nation and order date belongs to.
+struct BatchPreprocessedData {
+    int minDay;                                             // Union of all date ranges: [minDay, maxDay)
+    int maxDay;
+    std::vector<std::string> nationNames;                   // Nation code -> Nation name
+    std::vector<int> segmentStarts;                         // Sorted distinct query boundaries, segment s = [starts[s], starts[s + 1])
+    std::vector<uint64_t> queryMasks;                       // [code * numSegments() + segment] -> bit per matching query
+    JoinIndex orderToCustomerNation;                        // Order key -> Customer's nation code (orders matching any query)
+    JoinIndex orderToDateSegment;                           // Order key -> date segment of O_ORDERDATE
+    JoinIndex supplierToNation;                             // Supplier key -> Nation code
+
+    size_t numSegments() const { return segmentStarts.empty() ? 0 : segmentStarts.size() - 1; }
+    uint64_t queryMask(int8_t code, int8_t segment) const { return queryMasks[size_t(code) * numSegments() + segment]; }
+};
+
+// Build the batch join indexes for at most MAX_BATCH_QUERIES queries.
+// Returns false if a date is not in YYYY-MM-DD form
+bool preprocessBatch(
+    const std::vector<Query5Parameters>& queries,
+    const std::vector<Customer>& customer_data,
+    const std::vector<Orders>& orders_data,
+    const std::vector<Supplier>& supplier_data,
+    const std::vector<Nation>& nation_data,
+    const std::vector<Region>& region_data,
+    const DateZoneMap* orders_zone_map,                      // Optional block min/max of O_ORDERDATE
+    BatchPreprocessedData& batch_data,
+    ThreadPool* pool = nullptr);
+
+
+// ---------------- Zone map block tests ----------------
+// True if no date of a block with the given bounds lies in [start_day, end_day)
+inline bool blockOutsideRange(const DateZoneMap &zone_map, size_t block, int start_day, int end_day) {
+    return zone_map.max_date[block] < start_day || zone_map.min_date[block] >= end_day;
+}
+
+// True if every date of a block with the given bounds lies in [start_day, end_day)
+inline bool blockInsideRange(const DateZoneMap &zone_map, size_t block, int start_day, int end_day) {
+    return zone_map.min_date[block] >= start_day && zone_map.max_date[block] < end_day;
+}
+
+#endif // PREPROCESS_HPP
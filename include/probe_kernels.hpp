@@ -0,0 +1,61 @@
+#ifndef PROBE_KERNELS_HPP
+#define PROBE_KERNELS_HPP
+
+#include "tpch_decimal.hpp"
+#include <cstddef>
+#include <cstdint>
+
+
+// ---------------- Vectorized probe-and-aggregate kernels ----------------
+// Kernels for the Q5 inner loop over structure-of-arrays lineitem columns: look up the
+// customer nation code of every L_ORDERKEY and the supplier nation code of every
+// L_SUPPKEY in direct addressed code arrays, keep rows where both codes are equal and
+// valid, and add L_EXTENDEDPRICE * (1 - L_DISCOUNT) to that code's revenue. Revenue is
+// fixed-point (tpch_decimal.hpp), so every level returns exactly the same sums.
+// The implementation is picked once at runtime from CPUID, so the same binary runs
+// the AVX-512 kernel where available, the AVX2 kernel otherwise and a scalar loop on
+// anything else.
+
+enum class SimdLevel {
+    Auto,       // Best level supported by the CPU
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+// A dense JoinIndex viewed as a plain array: code of key k is codes[k - min_key] for
+// k - min_key < size, NOT_FOUND (-1) otherwise. codes must be readable 3 bytes past size.
+struct DenseCodeArray {
+    const int8_t* codes;
+    int min_key;
+    uint32_t size;
+};
+
+// One range of lineitem columns
+struct LineItemColumnRange {
+    const int* order_keys;
+    const int* supp_keys;
+    const int64_t* prices;          // cents
+    const int16_t* discounts;       // hundredths
+    size_t rows;
+};
+
+// Highest level the running CPU (and this build) supports
+SimdLevel detectSimdLevel();
+
+// Resolve Auto and clamp an explicit request to what the CPU supports
+SimdLevel resolveSimdLevel(SimdLevel requested);
+
+const char* simdLevelName(SimdLevel level);
+
+// Add the revenue of every qualifying row of columns to revenue_by_code[code];
+// revenue_by_code must have num_codes entries and every code in the arrays must be < num_codes
+void probeAggregate(
+    SimdLevel level,
+    const DenseCodeArray& order_codes,
+    const DenseCodeArray& supplier_codes,
+    const LineItemColumnRange& columns,
+    int num_codes,
+    RevenueSum* revenue_by_code);
+
+#endif // PROBE_KERNELS_HPP
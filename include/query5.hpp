@@ -1,6 +1,9 @@
 #ifndef QUERY5_HPP
 #define QUERY5_HPP
 
+#include "probe_kernels.hpp"
+#include "tpch_decimal.hpp"
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -30,24 +33,152 @@ struct Supplier {
 struct Orders {
     int O_ORDERKEY;
     int O_CUSTKEY;
-    std::string O_ORDERDATE; // stored as string for easy lexicographic date range compare
+    int O_ORDERDATE;         // days since 1970-01-01 (see tpch_date.hpp), compared as an integer
 };
 
 struct LineItem {
     int L_ORDERKEY;
     int L_SUPPKEY;
-    double L_EXTENDEDPRICE;
-    double L_DISCOUNT;
+    int64_t L_EXTENDEDPRICE;    // cents (see tpch_decimal.hpp)
+    int16_t L_DISCOUNT;         // hundredths, 0.04 is 4
 };
 
+// ---------------- Zone maps ----------------
+// Rows are grouped into blocks of ZONE_MAP_BLOCK_ROWS consecutive rows; a zone map keeps the
+// smallest and largest date of every block so a date filter can skip whole blocks
+constexpr size_t ZONE_MAP_BLOCK_ROWS = 4096;
+
+struct DateZoneMap {
+    std::vector<int> min_date;      // Per block, INT_MAX for a block without dates
+    std::vector<int> max_date;      // Per block, INT_MIN for a block without dates
+};
+
+struct ZoneMaps {
+    DateZoneMap orders;                 // O_ORDERDATE per block of orders_data
+    std::vector<DateZoneMap> lineitem;  // Joined O_ORDERDATE per block of each lineitem chunk, empty if not built
+    bool sorted_by_orderkey = false;    // orders_data and the lineitem chunks, in order, ascend by order key
+};
+
+// Structure-of-arrays storage of the same lineitem columns, one array per column
+struct LineItemColumns {
+    std::vector<int> L_ORDERKEY;
+    std::vector<int> L_SUPPKEY;
+    std::vector<int64_t> L_EXTENDEDPRICE;
+    std::vector<int16_t> L_DISCOUNT;
+
+    size_t size() const { return L_ORDERKEY.size(); }
+
+    void push_back(const LineItem& row) {
+        L_ORDERKEY.push_back(row.L_ORDERKEY);
+        L_SUPPKEY.push_back(row.L_SUPPKEY);
+        L_EXTENDEDPRICE.push_back(row.L_EXTENDEDPRICE);
+        L_DISCOUNT.push_back(row.L_DISCOUNT);
+    }
+
+    void reserve(size_t rows) {
+        L_ORDERKEY.reserve(rows);
+        L_SUPPKEY.reserve(rows);
+        L_EXTENDEDPRICE.reserve(rows);
+        L_DISCOUNT.reserve(rows);
+    }
+};
+
+// Lineitem chunks encoded with lightweight compression, see compressed_columns.hpp
+class CompressedLineItems;
+
+// Filters and join indexes of one Q5 parameter set, see preprocess.hpp
+struct PreprocessedData;
+
 struct Nation_Revenue{
     std::string NATION;
     double REVENUE;
 };
 
+// Revenue of one nation as the exact sum in units of 1e-4 (see tpch_decimal.hpp), before it is
+// rounded into a Nation_Revenue
+struct NationRevenueSum {
+    std::string NATION;
+    RevenueSum REVENUE;
+};
+
+// One Q5 parameter set, e.g. one line of a --batch_file
+struct Query5Parameters {
+    std::string r_name;
+    std::string start_date;
+    std::string end_date;
+};
+
+
+// ---------------- Execution options ----------------
+// How .tbl files are read by the loaders
+enum class LoaderMode {
+    Stream,     // std::ifstream + std::getline, one std::string per line and field
+    Mmap,       // memory mapped, parsed in place with std::from_chars
+    Async       // lineitem read into buffers by io_uring (or pread) while earlier buffers are parsed; other tables as Mmap
+};
+
+// Whether lineitem is loaded into memory before the query runs
+enum class ExecutionMode {
+    Materialize,    // readTPCHData loads every table, then executeQuery5 probes the chunks
+    Streaming       // executeQuery5Streaming probes lineitem rows while parsing them
+};
+
+// In-memory layout of loaded lineitem chunks
+enum class LineItemLayout {
+    Rows,       // std::vector<LineItem>, probed one row at a time
+    Columns,    // LineItemColumns, probed by the SIMD kernels in probe_kernels.hpp
+    Compressed  // CompressedLineItems, bit-packed blocks decoded while they are probed
+};
+
+// How executeQuery5 joins lineitem with the qualifying orders
+enum class JoinStrategy {
+    Auto,       // Merge on input sorted by order key, Radix when the orders index would not fit the last level cache, else Index
+    Index,      // Probe one orders join index built by preprocess over all of lineitem
+    Merge,      // Merge every lineitem morsel with the orders of its key range; needs ZoneMaps::sorted_by_orderkey
+    Radix       // Partition both sides on the high bits of the order key, then join partition by partition
+};
+
+// Optional settings besides the Q5 parameters: how a query runs, or which other query runs instead
+struct ExecutionOptions {
+    LoaderMode loader_mode = LoaderMode::Mmap;
+    ExecutionMode execution_mode = ExecutionMode::Materialize;
+    LineItemLayout lineitem_layout = LineItemLayout::Rows;
+    SimdLevel simd_level = SimdLevel::Auto;    // Kernel used for the Columns layout
+    JoinStrategy join_strategy = JoinStrategy::Auto;    // Orders-lineitem join of a materialized query
+    std::string cache_dir;      // Directory for binary table snapshots, empty disables them
+    bool pushdown_filter = true;    // Drop lineitem rows whose keys can not join while parsing
+    std::string serve_path;     // Run as a resident query server on this Unix socket, "-" for stdin/stdout
+    std::string batch_file;     // Answer every REGION|START_DATE|END_DATE line of this file in one lineitem scan
+    std::string cube_path;      // Answer from the pre-aggregated revenue cube stored in this file
+    std::string result_cache;   // Directory of cached Q5 results and per-month partials, see result_cache.hpp; empty disables it
+    int refresh_set = 0;        // Apply TPC-H refresh set N (orders.tbl.uN, lineitem.tbl.uN, delete.N) to the cube, 0 for none
+    std::string metrics_path;   // Write per-phase timers, row counters and hardware counters as JSON here, empty disables them
+    std::string affinity;       // Pin pool workers: "compact", "scatter" or a CPU list, see cpu_topology.hpp; empty leaves them unpinned
+    size_t memory_limit = 0;    // Memory budget in bytes of a single query, 0 for none; past it the query runs out of core
+    std::string spill_dir;      // Directory for the out-of-core spill files, empty for the system temporary directory
+    int query = 5;              // TPC-H query to run: 5, 7 or 10 (see tpch_queries.hpp)
+    std::string nation1 = "FRANCE";     // Q7 nation pair
+    std::string nation2 = "GERMANY";
+};
+
+// Wall clock time of the phases of one executeQuery5 call, in milliseconds
+struct QueryPhaseTimings {
+    double preprocess_ms = 0;   // Filters and join indexes
+    double probe_ms = 0;        // Parallel scan over lineitem
+    double merge_ms = 0;        // Merging the workers' sums into named, sorted results
+};
+
+// Query parameters readTPCHData may use to load only the lineitem rows that can join
+struct LineItemPushdown {
+    std::string r_name;
+    std::string start_date;
+    std::string end_date;
+    PreprocessedData *processed = nullptr;  // Receives the join indexes built for the filter, for executeQuery5 to reuse
+};
+
 
 // Function to parse command line arguments
-bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path);
+bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path, ExecutionOptions& options);
 
 // Function to read TPCH data from the specified paths
 bool readTPCHData(
@@ -58,7 +189,59 @@ bool readTPCHData(
     std::vector<Supplier> &supplier_data,
     std::vector<Nation> &nation_data,
     std::vector<Region> &region_data,
-    const int num_threads);
+    const int num_threads,
+    const ExecutionOptions &options = ExecutionOptions{},
+    ZoneMaps *zone_maps = nullptr,          // Filled with date zone maps of orders and lineitem when given
+    const LineItemPushdown *pushdown = nullptr);    // Filter lineitem on load, ignored when options.pushdown_filter is off
+
+// Load every table except lineitem
+bool readDimensionTables(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    int num_threads,
+    const ExecutionOptions &options = ExecutionOptions{});
+
+// Load region, nation, customer and supplier, return false if any fail
+bool readSmallTables(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const ExecutionOptions &options = ExecutionOptions{});
+
+// Same as readTPCHData above with lineitem loaded into structure-of-arrays chunks
+bool readTPCHData(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<LineItemColumns> &lineitem_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const int num_threads,
+    const ExecutionOptions &options = ExecutionOptions{},
+    ZoneMaps *zone_maps = nullptr,
+    const LineItemPushdown *pushdown = nullptr);
+
+// Same as readTPCHData above with lineitem encoded into compressed chunks. Lineitem is always
+// parsed from lineitem.tbl, options.cache_dir only applies to the other tables
+bool readTPCHData(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<CompressedLineItems> &lineitem_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const int num_threads,
+    const ExecutionOptions &options = ExecutionOptions{},
+    ZoneMaps *zone_maps = nullptr,
+    const LineItemPushdown *pushdown = nullptr);
 
 // Function to execute TPCH Query 5 using multithreading
 bool executeQuery5(
@@ -72,9 +255,147 @@ bool executeQuery5(
     const std::vector<Supplier> &supplier_data,
     const std::vector<Nation> &nation_data,
     const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps = nullptr,    // Zone maps from readTPCHData, used to skip blocks outside the date range
+    QueryPhaseTimings *timings = nullptr,   // Filled with per phase times when given
+    JoinStrategy join_strategy = JoinStrategy::Auto,    // Merge falls back to Auto without sorted zone maps
+    const PreprocessedData *preprocessed = nullptr);    // Join indexes readTPCHData built for these parameters
+                                                        // (LineItemPushdown::processed); built here if null or unbuilt
+
+// Same as above over structure-of-arrays chunks, probed with the vectorized kernel for simd_level
+bool executeQuery5(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<LineItemColumns> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps = nullptr,
+    SimdLevel simd_level = SimdLevel::Auto,     // Kernel of the Index join
+    QueryPhaseTimings *timings = nullptr,
+    JoinStrategy join_strategy = JoinStrategy::Auto,
+    const PreprocessedData *preprocessed = nullptr);
+
+// Same as above over compressed chunks, decoded block by block during the probe
+bool executeQuery5(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<CompressedLineItems> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps = nullptr,
+    QueryPhaseTimings *timings = nullptr,
+    JoinStrategy join_strategy = JoinStrategy::Auto,
+    const PreprocessedData *preprocessed = nullptr);
+
+// Function to execute TPCH Query 5 in one fused pass over lineitem.tbl without loading it into memory
+bool executeQuery5Streaming(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
     std::vector<Nation_Revenue> &results);
 
+// Estimated peak bytes of a single query run in memory with these options, from the sizes of
+// the .tbl files, compressed ones by their decompressed size (see tableTextBytes): the loaded
+// tables plus their join indexes, without any pushdown filtering
+size_t estimateQueryMemory(const std::string &table_path, const ExecutionOptions &options);
+
+// Function to execute TPCH Query 5 within options.memory_limit bytes at any data size: the
+// qualifying orders and lineitem rows are hash partitioned by order key into spill files under
+// options.spill_dir, then the partitions are joined and aggregated in memory one at a time.
+// Returns false if the budget cannot even hold the dimension tables or a spill file fails
+bool executeQuery5OutOfCore(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Nation_Revenue> &results);
+
+// Read refresh set set_number of dbgen from table_path: RF1 rows from orders.tbl.u<N> and
+// lineitem.tbl.u<N>, RF2 order keys from delete.<N>. Missing files count as empty;
+// returns false if none of the three exists
+bool readRefreshSet(
+    const std::string& table_path,
+    int set_number,
+    std::vector<Orders> &new_orders,
+    std::vector<LineItem> &new_lineitems,
+    std::vector<int> &deleted_orderkeys);
+
+// Parse a REGION|START_DATE|END_DATE line (dates are checked by the query), false if it has another shape
+bool parseQueryParameters(const std::string& line, Query5Parameters& query);
+
+// Read a file of REGION|START_DATE|END_DATE lines; blank lines and lines starting with '#' are
+// skipped. Returns false if the file cannot be opened or a line has another shape
+bool readQueryBatch(const std::string& filepath, std::vector<Query5Parameters>& queries);
+
+// Function to execute many Q5 parameter sets with one scan over lineitem: results[i] receives
+// the result of queries[i], and exact_results[i] its unrounded sums when exact_results is given.
+// Returns false if any date is not in YYYY-MM-DD form
+bool executeQuery5Batch(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<std::vector<LineItem>> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps = nullptr,
+    std::vector<std::vector<NationRevenueSum>> *exact_results = nullptr);
+
+// Same as above over structure-of-arrays chunks
+bool executeQuery5Batch(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<LineItemColumns> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps = nullptr,
+    std::vector<std::vector<NationRevenueSum>> *exact_results = nullptr);
+// Same as above over compressed chunks
+bool executeQuery5Batch(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<CompressedLineItems> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps = nullptr,
+    std::vector<std::vector<NationRevenueSum>> *exact_results = nullptr);
+
+// Round exact per-nation sums into a Q5 result: nations without revenue are left out and the
+// rest ordered by revenue descending, ties by nation
+void roundNationRevenue(const std::vector<NationRevenueSum>& sums, std::vector<Nation_Revenue>& results);
+
 // Function to output results to the specified path
 bool outputResults(const std::string& result_path, const std::vector<Nation_Revenue>& results);
 
+// Batch results, one REGION|START_DATE|END_DATE|NATION|REVENUE line per result row
+bool outputBatchResults(const std::string& result_path, const std::vector<Query5Parameters>& queries,
+                        const std::vector<std::vector<Nation_Revenue>>& results);
+
 #endif // QUERY5_HPP 
\ No newline at end of file
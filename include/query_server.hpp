@@ -0,0 +1,61 @@
+#ifndef QUERY_SERVER_HPP
+#define QUERY_SERVER_HPP
+
+#include "compressed_columns.hpp"
+#include "query5.hpp"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+// ---------------- Resident query server ----------------
+// Loads every table once and then answers any number of Q5 requests against the data
+// kept in memory, so each request only pays for preprocess and the probe.
+//
+// Line protocol, one request per line:
+//     REGION|START_DATE|END_DATE        e.g. ASIA|1994-01-01|1995-01-01
+//     QUIT                              end this session
+//     SHUTDOWN                          stop the server (socket mode)
+// Each request is answered by its NATION|REVENUE rows, highest revenue first, and then
+//     OK <rows> <latency_ms>
+// or by a single line
+//     ERROR <reason>
+class QueryServer {
+public:
+    QueryServer(int num_threads, const ExecutionOptions& options);
+
+    // Load all tables from table_path, returns false if any fail
+    bool load(const std::string& table_path);
+
+    // Answer one request line, appending the response lines to response.
+    // Returns false for QUIT and SHUTDOWN, which end the session.
+    bool handleRequest(const std::string& line, std::string& response);
+
+    // Answer requests read from in until QUIT or end of input
+    void serveStream(std::istream& in, std::ostream& out);
+
+    // Answer requests from clients of a Unix domain socket at socket_path, one client at a
+    // time, until a client sends SHUTDOWN. Returns false if the socket cannot be set up or
+    // accepting clients fails for a reason other than a temporary lack of resources.
+    bool serveSocket(const std::string& socket_path);
+
+private:
+    bool execute(const std::string& r_name, const std::string& start_date, const std::string& end_date,
+                 std::vector<Nation_Revenue>& results);
+
+    int num_threads_;
+    ExecutionOptions options_;
+    bool shutdown_ = false;
+
+    std::vector<Customer> customer_data_;
+    std::vector<Orders> orders_data_;
+    std::vector<Supplier> supplier_data_;
+    std::vector<Nation> nation_data_;
+    std::vector<Region> region_data_;
+    std::vector<std::vector<LineItem>> lineitem_rows_;       // Filled for LineItemLayout::Rows
+    std::vector<LineItemColumns> lineitem_columns_;          // Filled for LineItemLayout::Columns
+    std::vector<CompressedLineItems> lineitem_compressed_;   // Filled for LineItemLayout::Compressed
+    ZoneMaps zone_maps_;
+};
+
+#endif // QUERY_SERVER_HPP
@@ -0,0 +1,63 @@
+#ifndef READ_AHEAD_FILE_HPP
+#define READ_AHEAD_FILE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// ---------------- Read-ahead file reader ----------------
+// Reads a file front to back in fixed size buffers while keeping the reads of the next
+// buffers in flight, so the caller parses one buffer while the following ones are read.
+// Reads are queued on an io_uring when the kernel allows it. Otherwise each buffer is read
+// with pread after posix_fadvise(WILLNEED) has asked the kernel to fetch the ones behind it.
+class ReadAheadFile {
+public:
+    ReadAheadFile();
+    ~ReadAheadFile();
+
+    ReadAheadFile(const ReadAheadFile&) = delete;
+    ReadAheadFile& operator=(const ReadAheadFile&) = delete;
+
+    // Open the file and start reading its first depth buffers of buffer_bytes each;
+    // returns false if it cannot be opened
+    bool open(const std::string& filepath, size_t buffer_bytes, int depth);
+
+    // Wait for the next buffer in file order and point data at its size bytes. The buffer
+    // stays valid until the following call, which hands it back for the next read.
+    // Returns false at the end of the file or after a read error (see failed())
+    bool next(const char*& data, size_t& size);
+
+    void close();
+
+    size_t size() const { return file_size_; }
+    bool failed() const { return failed_; }
+    bool usesIoUring() const { return ring_ != nullptr; }
+
+private:
+    struct Ring;
+
+    struct Buffer {
+        std::unique_ptr<char[]> data;
+        size_t offset = 0;          // File offset of the read this buffer holds
+        size_t bytes = 0;           // Bytes requested at offset
+        long result = 0;            // Bytes read, or -errno
+        bool pending = false;       // Read queued on the ring and not completed yet
+    };
+
+    void startRead(size_t buffer, size_t sequence);
+    bool finishRead(Buffer& buffer);
+
+    int fd_ = -1;
+    size_t file_size_ = 0;
+    size_t buffer_bytes_ = 0;
+    size_t num_reads_ = 0;          // Buffers needed to cover the file
+    size_t next_read_ = 0;          // Sequence number of the buffer next() returns
+    bool failed_ = false;
+    bool holding_ = false;          // The caller holds buffer (next_read_ - 1) % depth
+    std::vector<Buffer> buffers_;
+    std::unique_ptr<Ring> ring_;    // Null when reading with pread
+};
+
+#endif // READ_AHEAD_FILE_HPP
@@ -0,0 +1,56 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include "query5.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+
+// ---------------- Persistent Q5 result cache ----------------
+// Dashboards send the same Q5 parameter sets again and again, or date ranges that only differ
+// by whole months. The cache remembers the exact per-nation sums (units of 1e-4, see
+// tpch_decimal.hpp) of every range it answered, keyed by region and range.
+//
+// A range is also cut at month starts into pieces: the calendar months it covers completely,
+// and at its edges the parts of months it only covers partly. The sums of every piece are
+// kept too, so a new range is assembled from the pieces already known, and only the others
+// are computed, all in one shared batch scan (see executeQuery5Batch). Integer sums make an
+// assembled result bit identical to a full scan.
+//
+// Entries of one set of input tables live in cache_dir/q5-<fingerprint>.cache. The fingerprint
+// hashes the name, size and modification time of every table file, shards and compressed files
+// included, so changed tables start a new file and stale results are never read.
+class ResultCache {
+public:
+    // Open the cache for the tables in table_path and read the entries stored for them. Returns
+    // false if a table file is missing or cache_dir can not be created
+    bool open(const std::string& cache_dir, const std::string& table_path);
+
+    // Cut the range of query at month starts into its pieces, in date order; none for an empty
+    // range. Returns false if a date is not in YYYY-MM-DD form
+    static bool splitIntoPieces(const Query5Parameters& query, std::vector<Query5Parameters>& pieces);
+
+    // Sums stored for exactly this region and range, false if there are none
+    bool find(const Query5Parameters& query, std::vector<NationRevenueSum>& sums) const;
+
+    // Remember the sums of a region and range; ranges of regions a line can not hold are not kept
+    void store(const Query5Parameters& query, const std::vector<NationRevenueSum>& sums);
+
+    // Rewrite the cache file if anything was stored since open, false if it can not be written
+    bool save() const;
+
+private:
+    std::string path_;
+    std::map<std::string, std::vector<NationRevenueSum>> entries_;     // "REGION|START|END" -> sums
+    bool modified_ = false;
+};
+
+// Answer one Q5 query through the cache in options.result_cache: a stored range is returned as
+// is, otherwise the missing pieces are computed with one batch scan over the tables in table_path
+// in options.lineitem_layout and stored. Returns false if the tables can not be read or a date is
+// not in YYYY-MM-DD form; a cache file that can not be written only warns
+bool executeQuery5Cached(const Query5Parameters& query, int num_threads, const std::string& table_path,
+                         const ExecutionOptions& options, std::vector<Nation_Revenue>& results);
+
+#endif // RESULT_CACHE_HPP
@@ -0,0 +1,87 @@
+#ifndef REVENUE_CUBE_HPP
+#define REVENUE_CUBE_HPP
+
+#include "query5.hpp"
+#include "thread_pool.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// ---------------- Pre-aggregated Q5 revenue cube ----------------
+// Q5 only counts lineitems whose supplier is in the same nation as the order's customer,
+// and groups them by that nation. The cube therefore keeps one revenue cell per
+// (order date, nation) for those lineitems, which is the diagonal of a (date, customer
+// nation, supplier nation) cube and the only part any Q5 parameter set reads. A query
+// sums the cells of the nations of its region over its date range.
+//
+// The cube also remembers how much every order contributed, so TPC-H refresh sets can be
+// applied in place: RF1 (orders.tbl.uN + lineitem.tbl.uN) adds new orders and RF2
+// (delete.N) removes orders by key. It is saved to a single file together with the size
+// and modification time of the base tables, and is rebuilt when they change.
+class RevenueCube {
+public:
+    // Build from fully loaded tables
+    void build(const std::vector<Customer>& customer_data,
+               const std::vector<Orders>& orders_data,
+               const std::vector<std::vector<LineItem>>& lineitem_data,
+               const std::vector<Supplier>& supplier_data,
+               const std::vector<Nation>& nation_data,
+               const std::vector<Region>& region_data,
+               ThreadPool& pool);
+
+    // Answer Q5 from the cube, results sorted by revenue descending.
+    // Returns false if a date is not in YYYY-MM-DD form
+    bool query(const std::string& r_name, const std::string& start_date, const std::string& end_date,
+               std::vector<Nation_Revenue>& results) const;
+
+    // Apply refresh set number set_number: new orders and their lineitems (RF1), then deleted
+    // order keys (RF2). Customers and suppliers map the new orders and lineitems to nations.
+    void applyRefresh(int set_number,
+                      const std::vector<Orders>& new_orders,
+                      const std::vector<LineItem>& new_lineitems,
+                      const std::vector<int>& deleted_orderkeys,
+                      const std::vector<Customer>& customer_data,
+                      const std::vector<Supplier>& supplier_data);
+
+    // True if refresh set set_number has already been applied
+    bool hasRefresh(int set_number) const;
+
+    // Save to cube_path, stamped with the base tables in table_path
+    bool save(const std::string& cube_path, const std::string& table_path) const;
+
+    // Load from cube_path, false if it is missing, malformed or older than the base tables in table_path
+    bool load(const std::string& cube_path, const std::string& table_path);
+
+private:
+    // Revenue one order added to the cube
+    struct OrderRevenue {
+        int day;
+        int nation;         // Nation slot
+        int64_t revenue;    // Units of 1e-4, see tpch_decimal.hpp
+    };
+
+    void addRevenue(int day, int nation, int64_t revenue);
+    void ensureDay(int day);
+
+    std::vector<int> nation_keys_;                      // Slot -> N_NATIONKEY, slots follow the nation table
+    std::vector<std::string> nation_names_;
+    std::vector<int> nation_regions_;                   // Slot -> N_REGIONKEY
+    std::vector<int> region_keys_;
+    std::vector<std::string> region_names_;
+
+    int first_day_ = 0;                                 // Day of the first cell column
+    int num_days_ = 0;
+    std::vector<int64_t> cells_;                        // [nation slot * num_days_ + day - first_day_], units of 1e-4
+
+    std::unordered_map<int, OrderRevenue> order_revenue_;   // Orders with a non zero contribution
+    std::vector<int> refresh_sets_;                     // Applied refresh set numbers
+};
+
+// Load the cube from options.cube_path, or build it from the tables in table_path when the file
+// is missing or stale, then apply options.refresh_set unless it was applied before. The cube
+// file is rewritten whenever it changed. Returns false if the tables or the refresh set cannot be read
+bool openRevenueCube(const std::string& table_path, int num_threads, const ExecutionOptions& options, RevenueCube& cube);
+
+#endif // REVENUE_CUBE_HPP
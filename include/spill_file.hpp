@@ -0,0 +1,91 @@
+#ifndef SPILL_FILE_HPP
+#define SPILL_FILE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// ---------------- Partitioned spill files ----------------
+// A set of anonymous temporary files, one per partition, holding fixed size records. The
+// files are unlinked as soon as they are created, so nothing is left behind on disk when
+// the process exits, even after a crash. Appends to the same partition from several
+// threads are serialized per partition; reads use pread and may run concurrently.
+class SpillPartitions {
+public:
+    SpillPartitions() = default;
+    ~SpillPartitions();
+
+    SpillPartitions(const SpillPartitions&) = delete;
+    SpillPartitions& operator=(const SpillPartitions&) = delete;
+
+    // Create num_partitions empty files in directory, false if one cannot be created
+    bool open(const std::string& directory, size_t num_partitions);
+
+    size_t size() const { return partitions_.size(); }
+
+    // Append bytes to the end of partition; false on a write error
+    bool append(size_t partition, const void* data, size_t bytes);
+
+    // Bytes written to partition so far
+    size_t partitionBytes(size_t partition) const { return partitions_[partition].bytes; }
+
+    // Read bytes [offset, offset + bytes) of partition into out; false on a short read
+    bool read(size_t partition, size_t offset, void* out, size_t bytes) const;
+
+private:
+    struct Partition {
+        int fd = -1;
+        size_t bytes = 0;
+        std::mutex mutex;
+    };
+
+    std::vector<Partition> partitions_;
+};
+
+// Worker-local write buffers of Record for every partition of a SpillPartitions. Records are
+// collected per partition and appended in buffer_bytes sized writes, so a worker takes a
+// partition's lock once per buffer instead of once per row
+template <typename Record>
+class SpillBuffers {
+public:
+    SpillBuffers(SpillPartitions& spill, size_t buffer_bytes)
+        : spill_(spill), buffers_(spill.size()),
+          buffer_records_(std::max<size_t>(buffer_bytes / sizeof(Record), 1)) {}
+
+    ~SpillBuffers() { flush(); }
+
+    void add(size_t partition, const Record& record) {
+        std::vector<Record>& buffer = buffers_[partition];
+        if (buffer.capacity() == 0)
+            buffer.reserve(buffer_records_);
+        buffer.push_back(record);
+        if (buffer.size() == buffer_records_)
+            flushPartition(partition);
+    }
+
+    // Write every buffered record, false if any write failed since construction
+    bool flush() {
+        for (size_t partition = 0; partition < buffers_.size(); ++partition)
+            flushPartition(partition);
+        return ok_;
+    }
+
+private:
+    void flushPartition(size_t partition) {
+        std::vector<Record>& buffer = buffers_[partition];
+        if (buffer.empty())
+            return;
+        ok_ = spill_.append(partition, buffer.data(), buffer.size() * sizeof(Record)) && ok_;
+        buffer.clear();
+    }
+
+    SpillPartitions& spill_;
+    std::vector<std::vector<Record>> buffers_;
+    size_t buffer_records_;
+    bool ok_ = true;
+};
+
+#endif // SPILL_FILE_HPP
@@ -0,0 +1,114 @@
+#ifndef TABLE_INPUT_HPP
+#define TABLE_INPUT_HPP
+
+#include "read_ahead_file.hpp"
+#include <cstddef>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+
+// ---------------- Plain and compressed .tbl inputs ----------------
+// A table may be stored as name.tbl, name.tbl.gz or name.tbl.zst. Compressed tables are
+// decompressed in memory while they are parsed, nothing is written to disk. gzip needs zlib
+// (TPCH_HAVE_ZLIB) and zstd needs libzstd (TPCH_HAVE_ZSTD); both are optional in the build.
+enum class TableCompression {
+    None,
+    Gzip,
+    Zstd
+};
+
+// Path of table name (e.g. "lineitem") under table_path: the first of name.tbl, name.tbl.gz
+// and name.tbl.zst that exists, or name.tbl if none does
+std::string tableFilePath(const std::string& table_path, const std::string& name);
+
+// Files holding table name under table_path. A table stored in one file is just that file (see
+// tableFilePath); otherwise the shards dbgen -C writes, name.tbl.1 .. name.tbl.N numbered from 1
+// without gaps, each of which may be compressed as name.tbl.i.gz or name.tbl.i.zst. Never empty:
+// with neither it holds name.tbl, which then fails to open like an unsharded table
+std::vector<std::string> tableShardPaths(const std::string& table_path, const std::string& name);
+
+// Compression of the file at filepath, told from its magic bytes; None for plain text or a file that can not be read
+TableCompression detectTableCompression(const std::string& filepath);
+
+// Whether this build can decompress the given format
+bool tableCompressionSupported(TableCompression compression);
+
+// Bytes of text the table file at filepath holds once decompressed, without decompressing it:
+//   None   the file size
+//   Gzip   the ISIZE trailer, the text size modulo 4 GiB, lifted by the multiple of 4 GiB
+//          closest to COMPRESSED_TEXT_RATIO times the file size. Of several concatenated
+//          members only the last one records it there, so such files come out too small
+//   Zstd   the content sizes its frames record
+// A size the file does not record (a zstd frame without one, an ISIZE below the file size, zstd
+// without TPCH_HAVE_ZSTD) is estimated as COMPRESSED_TEXT_RATIO times the compressed bytes. 0 if
+// the file can not be read
+constexpr size_t COMPRESSED_TEXT_RATIO = 4;     // About what gzip and zstd achieve on dbgen text
+size_t tableTextBytes(const std::string& filepath);
+
+// Reads the text of a plain or compressed table front to back in buffers, with the same
+// next() contract as ReadAheadFile:
+//   None   read ahead by ReadAheadFile
+//   Gzip   zlib inflates the next buffer on its own thread while the caller parses the current one
+//   Zstd   frames that record a size of at most ZSTD_PARALLEL_FRAME_BYTES are decompressed in
+//          parallel on the pool, one frame per worker at a time. Larger frames, or frames
+//          without a recorded size, are decompressed as a stream one buffer at a time
+class TableTextReader {
+public:
+    TableTextReader();
+    ~TableTextReader();
+
+    TableTextReader(const TableTextReader&) = delete;
+    TableTextReader& operator=(const TableTextReader&) = delete;
+
+    // Open the table file, returns false if it cannot be opened or its compression is not
+    // supported by this build. Without a pool zstd frames are decompressed one at a time
+    bool open(const std::string& filepath, size_t buffer_bytes, ThreadPool* pool = nullptr);
+
+    // Point data at the next size bytes of text, valid until the following call. Returns false
+    // at the end of the text or after a read or decompression error (see failed())
+    bool next(const char*& data, size_t& size);
+
+    void close();
+
+    bool failed() const;
+    TableCompression compression() const { return compression_; }
+
+private:
+    struct Gzip;
+    struct Zstd;
+
+    TableCompression compression_ = TableCompression::None;
+    ReadAheadFile plain_;
+    std::unique_ptr<Gzip> gzip_;
+    std::unique_ptr<Zstd> zstd_;
+};
+
+// std::istream over the text of a plain or compressed table for the std::getline loaders;
+// plain files are read through a std::filebuf exactly like std::ifstream
+class TableTextStream : public std::istream {
+public:
+    explicit TableTextStream(const std::string& filepath);
+
+    bool is_open() const { return open_; }
+
+private:
+    class DecompressedBuffer : public std::streambuf {
+    public:
+        TableTextReader reader;
+
+    protected:
+        int_type underflow() override;
+    };
+
+    std::filebuf file_;
+    DecompressedBuffer decompressed_;
+    bool open_ = false;
+};
+
+#endif // TABLE_INPUT_HPP
@@ -0,0 +1,154 @@
+#ifndef TABLE_SCAN_HPP
+#define TABLE_SCAN_HPP
+
+#include "mapped_file.hpp"
+#include "table_input.hpp"
+#include "tbl_parser.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// ---------------- Morsels of table text ----------------
+// How the text of a table is cut into morsels for the shared pool, whatever it is stored as:
+// one plain file, one compressed file, or the shards dbgen -C writes, plain or compressed (see
+// tableShardPaths). The parallel loaders and the pipeline sources (pipeline.hpp) both read
+// tables through these, so every execution mode accepts the same inputs.
+
+// Text per morsel: loaders and scans take 1 MB of a plain file per morsel
+constexpr size_t TEXT_MORSEL_BYTES = size_t(1) << 20;
+
+// Text a compressed shard is decompressed into at a time
+constexpr size_t SHARD_BUFFER_BYTES = 4 * TEXT_MORSEL_BYTES;
+
+// Size of a file in bytes, 0 if it does not exist
+size_t fileSizeOrZero(const std::string& filepath);
+
+// Whether filepath is a compressed table; reports one this build can not decompress
+bool compressedTable(const std::string& filepath);
+
+// Text per reader buffer of a table read as one stream: one morsel per worker, at least four
+size_t textBufferBytes(const ThreadPool& pool);
+
+// Bytes [start_offset, end_offset) of shard shard; PADDING_SHARD marks a morsel without text
+constexpr size_t PADDING_SHARD = SIZE_MAX;
+struct ShardMorsel {
+    size_t shard;
+    size_t start_offset;
+    size_t end_offset;
+};
+
+// Load morsels of a table split into shards of the given sizes. Shard i belongs to worker
+// num_workers * i / num_shards; with fewer shards than workers a splittable shard is divided evenly
+// over its workers [num_workers * i / num_shards, num_workers * (i + 1) / num_shards). Each
+// worker's text is cut into TEXT_MORSEL_BYTES morsels, except that a shard which is not
+// splittable (a compressed one) is a single morsel, and every worker's morsels are padded to the
+// same count. parallelFor's equal shares then start worker w exactly on its own morsels, and a
+// loader filling one chunk per morsel leaves chunk c where probeWorkerStarts() expects it
+std::vector<ShardMorsel> shardMorsels(const std::vector<size_t>& shard_sizes, const std::vector<bool>& splittable,
+                                      int num_workers);
+
+// The shards of one table: plain shards are mapped (or only sized for the stream loader),
+// compressed shards are read front to back by whichever worker gets them
+struct TableShards {
+    std::vector<std::string> paths;
+    std::vector<MappedFile> files;
+    std::vector<size_t> sizes;
+    std::vector<bool> compressed;
+
+    // Returns false if a plain shard can not be mapped
+    bool open(const std::vector<std::string>& shard_paths, bool map_files);
+
+    std::vector<bool> splittable() const;
+};
+
+// Hand the text of reader to parse_lines(begin, end, carried) in runs of complete lines, in file
+// order. A line cut by the end of a buffer is copied out and handed over on its own with carried
+// set once the next buffer completes it; so is a last line without a newline
+template <typename ParseLines>
+bool forEachCompleteLines(TableTextReader& reader, ParseLines parse_lines) {
+    std::string carry;                                 // Start of the line cut by the end of the previous buffer
+    const char* data;
+    size_t size;
+    while (reader.next(data, size)) {
+        const char* end = data + size;
+        const char* cursor = data;
+        if (!carry.empty()) {
+            const char* line_end = findLineEnd(data, end);
+            carry.append(data, line_end);
+            if (line_end == end)
+                continue;                              // The line is longer than the buffer
+            parse_lines(carry.data(), carry.data() + carry.size(), true);
+            cursor = line_end + 1;
+        }
+
+        const char* last = end;                        // Lines starting from here continue in the next buffer
+        while (last > cursor && last[-1] != '\n')
+            --last;
+        carry.assign(last, end);
+        if (last > cursor)
+            parse_lines(cursor, last, false);
+    }
+
+    if (!carry.empty())                                // The last line has no newline
+        parse_lines(carry.data(), carry.data() + carry.size(), true);
+    return !reader.failed();
+}
+
+// Scan the text of the table stored in paths on pool: body(begin, end, start_offset, end_offset,
+// worker) is called for every morsel, the lines whose first byte lies in [start_offset, end_offset)
+// of the text [begin, end), in no particular order. Shards are cut by shardMorsels like the sharded
+// loaders cut them, and a compressed shard is decompressed by the worker it belongs to. A table in
+// a single compressed file is decompressed buffer by buffer, the pool scanning the complete lines
+// of one buffer while the next is decompressed; a line cut by a buffer end is scanned on the
+// calling thread between jobs, as worker 0. Returns false if a file can not be opened or read
+template <typename Body>
+bool forEachTableMorsel(ThreadPool& pool, const std::vector<std::string>& paths, Body body) {
+    TableShards shards;
+    if (!shards.open(paths, true))
+        return false;                                  // Error Opening File
+
+    if (paths.size() == 1 && shards.compressed[0]) {
+        TableTextReader reader;
+        if (!reader.open(paths[0], textBufferBytes(pool), &pool))
+            return false;
+        return forEachCompleteLines(reader, [&](const char* begin, const char* end, bool carried) {
+            size_t text_size = end - begin;
+            if (carried) {
+                body(begin, end, size_t(0), text_size, 0);
+                return;
+            }
+            size_t num_morsels = (text_size + TEXT_MORSEL_BYTES - 1) / TEXT_MORSEL_BYTES;
+            pool.parallelFor(num_morsels, [&](size_t morsel, int worker) {
+                size_t start_offset = morsel * TEXT_MORSEL_BYTES;
+                body(begin, end, start_offset, std::min(start_offset + TEXT_MORSEL_BYTES, text_size), worker);
+            });
+        });
+    }
+
+    std::vector<ShardMorsel> morsels = shardMorsels(shards.sizes, shards.splittable(), pool.size());
+    std::atomic<bool> read{true};
+    pool.parallelFor(morsels.size(), [&](size_t morsel, int worker) {
+        const ShardMorsel& text = morsels[morsel];
+        if (text.shard == PADDING_SHARD)
+            return;
+        if (shards.compressed[text.shard]) {
+            TableTextReader reader;
+            if (!reader.open(shards.paths[text.shard], SHARD_BUFFER_BYTES)
+                || !forEachCompleteLines(reader, [&](const char* begin, const char* end, bool) {
+                       body(begin, end, size_t(0), size_t(end - begin), worker);
+                   }))
+                read = false;
+            return;
+        }
+        const MappedFile& file = shards.files[text.shard];
+        body(file.data(), file.data() + file.size(), text.start_offset, text.end_offset, worker);
+    });
+    return read;
+}
+
+#endif // TABLE_SCAN_HPP
@@ -0,0 +1,47 @@
+#ifndef TABLE_SNAPSHOT_HPP
+#define TABLE_SNAPSHOT_HPP
+
+#include "query5.hpp"
+#include "thread_pool.hpp"
+#include <string>
+#include <vector>
+
+
+// ---------------- Binary columnar table snapshots ----------------
+// A snapshot stores one parsed table column by column in <cache_dir>/<table>.tbl.snap
+// together with the size and modification time of the .tbl file it was built from.
+// Reading maps the snapshot and copies the columns back into the row structs, which
+// skips text parsing entirely. A snapshot whose source changed, or which was written
+// by a different SNAPSHOT_VERSION, is treated as missing and rebuilt.
+
+// Bump whenever the layout of a snapshot or of a cached struct changes
+constexpr unsigned SNAPSHOT_VERSION = 3;
+
+// Snapshot file used for the given source table inside cache_dir
+std::string snapshotPath(const std::string& cache_dir, const std::string& source_path);
+
+// Load a table from its snapshot, returns false if there is no valid snapshot for source_path
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Region>& region_data);
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Nation>& nation_data);
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Customer>& customer_data);
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Supplier>& supplier_data);
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Orders>& orders_data);
+
+// Lineitem rows are rebuilt on the pool in chunks of SNAPSHOT_CHUNK_ROWS, whatever chunking they were written with
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path,
+                  std::vector<std::vector<LineItem>>& lineitem_data, ThreadPool& pool);
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path,
+                  std::vector<LineItemColumns>& lineitem_data, ThreadPool& pool);
+
+// Write a snapshot of a freshly parsed table, returns false if it could not be written
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Region>& region_data);
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Nation>& nation_data);
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Customer>& customer_data);
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Supplier>& supplier_data);
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Orders>& orders_data);
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path,
+                   const std::vector<std::vector<LineItem>>& lineitem_data);
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path,
+                   const std::vector<LineItemColumns>& lineitem_data);
+
+#endif // TABLE_SNAPSHOT_HPP
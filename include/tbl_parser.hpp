@@ -0,0 +1,97 @@
+#ifndef TBL_PARSER_HPP
+#define TBL_PARSER_HPP
+
+#include "tpch_date.hpp"
+#include "tpch_decimal.hpp"
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+
+// ---------------- In-place '|' delimited field cursor ----------------
+// Helpers used by the memory mapped loaders. A cursor always points at the first
+// byte of a field; every helper advances it past the field's trailing delimiter
+// and returns false when the field is missing or malformed. Nothing allocates.
+
+// Position of the next newline at or after cursor, or end if the last line has none
+inline const char* findLineEnd(const char* cursor, const char* end) {
+    const void* newline = std::memchr(cursor, '\n', end - cursor);
+    return newline ? static_cast<const char*>(newline) : end;
+}
+
+// Move the cursor to the first byte of the line that owns offset start within [begin, end).
+// A line belongs to the chunk in which its first byte lies, so a chunk starting exactly
+// on a line start keeps that line instead of discarding it.
+inline const char* alignToLineStart(const char* begin, const char* start, const char* end) {
+    if (start == begin || start[-1] == '\n')
+        return start;
+    const char* line_end = findLineEnd(start, end);
+    return line_end == end ? end : line_end + 1;
+}
+
+// Find the end of the line starting at cursor and the positions of its first max_fields '|'
+// delimiters in one pass; delimiters[0 .. found) are filled and the line end is returned like
+// findLineEnd() would. Where the CPU has AVX2, 32 bytes are compared against '|' and '\n' at a
+// time and the delimiters are read off the match bitmasks, so a parser can jump straight to the
+// fields it needs instead of searching past every field it skips (see tbl_parser.cpp)
+const char* findLineFields(const char* cursor, const char* end, const char** delimiters, int max_fields, int& found);
+
+// Skip count fields on the current line
+inline bool skipFields(const char*& cursor, const char* line_end, int count, char delim = '|') {
+    for (int field = 0; field < count; ++field) {
+        const void* delim_pos = std::memchr(cursor, delim, line_end - cursor);
+        if (!delim_pos)
+            return false;           // Fewer columns than expected
+        cursor = static_cast<const char*>(delim_pos) + 1;
+    }
+    return true;
+}
+
+// View of the current field without copying it
+inline bool readField(const char*& cursor, const char* line_end, std::string_view& field, char delim = '|') {
+    const void* delim_pos = std::memchr(cursor, delim, line_end - cursor);
+    if (!delim_pos)
+        return false;
+    const char* field_end = static_cast<const char*>(delim_pos);
+    field = std::string_view(cursor, field_end - cursor);
+    cursor = field_end + 1;
+    return true;
+}
+
+// Parse an unsigned integer field; like isNumber() only digits are accepted
+inline bool parseIntField(const char*& cursor, const char* line_end, int& value, char delim = '|') {
+    if (cursor >= line_end || *cursor < '0' || *cursor > '9')
+        return false;
+    std::from_chars_result parsed = std::from_chars(cursor, line_end, value);
+    if (parsed.ec != std::errc() || parsed.ptr >= line_end || *parsed.ptr != delim)
+        return false;
+    cursor = parsed.ptr + 1;
+    return true;
+}
+
+// Parse a non-negative decimal field such as 12345.67 into hundredths (see tpch_decimal.hpp);
+// fails if the value does not fit Int
+template <typename Int>
+inline bool parseDecimalField(const char*& cursor, const char* line_end, Int& value, char delim = '|') {
+    const char* field_cursor = cursor;
+    int64_t hundredths;
+    if (!parseHundredths(field_cursor, line_end, hundredths) || field_cursor >= line_end || *field_cursor != delim
+        || hundredths > int64_t(std::numeric_limits<Int>::max()))
+        return false;
+    value = Int(hundredths);
+    cursor = field_cursor + 1;
+    return true;
+}
+
+// Parse a YYYY-MM-DD field into a day number
+inline bool parseDateField(const char*& cursor, const char* line_end, int& days, char delim = '|') {
+    std::string_view field;
+    const char* field_cursor = cursor;
+    if (!readField(field_cursor, line_end, field, delim) || !parseDate(field, days))
+        return false;
+    cursor = field_cursor;
+    return true;
+}
+
+#endif // TBL_PARSER_HPP
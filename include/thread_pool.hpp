@@ -0,0 +1,164 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// ---------------- Persistent worker pool with morsel-driven scheduling ----------------
+// Work is expressed as a number of small independent morsels (a 1 MB slice of a file,
+// up to 64K rows of a chunk, ...). Each worker starts on its own contiguous share of the
+// morsels and, once that is exhausted, steals remaining morsels from the other workers'
+// shares, so a skewed morsel or a busy core never leaves the rest of the pool idle.
+//
+// Workers can be pinned to CPUs (--affinity). Memory a pinned worker touches first is then
+// placed on its NUMA node, so jobs that give the same worker the same data every time (see
+// the worker_starts form of parallelFor) keep reading node local memory.
+//
+// Jobs are serialized: parallelFor and forEachWorker may be called from several threads, and
+// each call waits until the pool is free. A job issued from inside a morsel of the same pool
+// does not wait (it would wait for itself) but runs all its morsels on the calling worker.
+class ThreadPool {
+public:
+    // Called once per morsel with the morsel index and the id (0..size()-1) of the running worker
+    using MorselFunction = std::function<void(size_t morsel, int worker)>;
+
+    // Worker i is pinned to cpus[i % cpus.size()]; an empty list leaves scheduling to the OS
+    explicit ThreadPool(int num_workers, std::vector<int> cpus = {});
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return int(workers_.size()); }
+    const std::vector<int>& cpus() const { return cpus_; }
+
+    // NUMA node worker runs on, 0 when the pool is not pinned
+    int workerNode(int worker) const { return worker_nodes_[worker]; }
+    // One more than the highest node of any worker
+    int numNodes() const { return num_nodes_; }
+    // Whether the workers run on more than one node
+    bool spansNodes() const {
+        return std::any_of(worker_nodes_.begin(), worker_nodes_.end(), [&](int node) { return node != worker_nodes_[0]; });
+    }
+
+    // Run body for every morsel in [0, num_morsels) and wait until all are done.
+    // The first exception thrown by body is rethrown here after the job has drained.
+    void parallelFor(size_t num_morsels, const MorselFunction& body);
+
+    // Same, but worker w starts on morsels [worker_starts[w], worker_starts[w + 1]) instead of
+    // an equal share; worker_starts has size() + 1 ascending entries ending at num_morsels
+    void parallelFor(size_t num_morsels, const std::vector<size_t>& worker_starts, const MorselFunction& body);
+
+    // Run body(worker) exactly once on every worker, without stealing
+    void forEachWorker(const std::function<void(int worker)>& body);
+
+private:
+    // One worker's share of the current job, padded so cursors never share a cache line
+    struct alignas(64) MorselRange {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+
+    void workerLoop(int worker);
+    void runMorsels(int worker);
+    void runJob(const MorselFunction& body, bool steal);
+    bool runNested(size_t num_morsels, const MorselFunction& body) const;
+
+    std::vector<std::thread> workers_;
+    std::unique_ptr<MorselRange[]> ranges_;
+    std::vector<int> cpus_;
+    std::vector<int> worker_nodes_;
+    int num_nodes_ = 1;
+
+    std::mutex job_mutex_;                   // Held for the whole of a job, one job at a time
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable job_done_;
+    const MorselFunction* body_ = nullptr;   // Current job, valid while a parallelFor is running
+    size_t generation_ = 0;                  // Incremented for every job so workers run each once
+    int active_workers_ = 0;                 // Workers still running the current job
+    bool steal_ = true;                      // Whether the current job lets workers steal morsels
+    bool stopping_ = false;
+    std::exception_ptr error_;
+};
+
+// Process wide pool shared by the loaders and the query. It is created on first use and
+// only rebuilt when a different worker count or CPU list is requested. Safe to call from
+// several threads, but a rebuild destroys the old pool, so callers asking for different
+// sizes must not still be running jobs on a pool returned earlier.
+ThreadPool& sharedThreadPool(int num_threads);
+
+// CPUs the shared pool's workers are pinned to from now on, empty for none
+void setSharedThreadPoolCpus(const std::vector<int>& cpus);
+
+// Split [0, count) into ranges of at most range_size items and call body(begin, end) for each.
+// The ranges run on pool when one is given and there is more than one range, otherwise on the
+// calling thread, so callers with small inputs pay nothing for the parallel path.
+template <typename Body>
+void forEachRange(ThreadPool* pool, size_t count, size_t range_size, Body&& body) {
+    if (!pool || count <= range_size) {
+        if (count > 0)
+            body(size_t(0), count);
+        return;
+    }
+    size_t num_ranges = (count + range_size - 1) / range_size;
+    pool->parallelFor(num_ranges, [&](size_t range, int) {
+        size_t begin = range * range_size;
+        body(begin, std::min(begin + range_size, count));
+    });
+}
+
+// Append parts to out in order, copying the parts concurrently on pool when given
+template <typename T>
+void appendConcatenated(ThreadPool* pool, const std::vector<std::vector<T>>& parts, std::vector<T>& out) {
+    std::vector<size_t> offsets(parts.size() + 1, out.size());
+    for (size_t part = 0; part < parts.size(); ++part)
+        offsets[part + 1] = offsets[part] + parts[part].size();
+    out.resize(offsets.back());
+    forEachRange(pool, parts.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t part = begin; part < end; ++part)
+            std::copy(parts[part].begin(), parts[part].end(), out.begin() + offsets[part]);
+    });
+}
+
+// One copy of a read-only structure per NUMA node the workers of a pool run on, each made by
+// a worker of that node so its pages are first touched there. On a pool spanning a single
+// node no copy is made and every worker reads the original.
+template <typename T>
+class NodeReplicas {
+public:
+    NodeReplicas(ThreadPool& pool, const T& original) : pool_(pool), original_(original) {
+        if (!pool.spansNodes())
+            return;
+        replicas_.resize(pool.numNodes());
+        pool.forEachWorker([&](int worker) {
+            int node = pool.workerNode(worker);
+            for (int other = 0; other < worker; ++other)
+                if (pool.workerNode(other) == node)
+                    return;                         // the node's first worker makes its copy
+            replicas_[node] = std::make_unique<T>(original);
+        });
+    }
+
+    const T& forWorker(int worker) const {
+        if (replicas_.empty())
+            return original_;
+        return *replicas_[pool_.workerNode(worker)];
+    }
+
+private:
+    ThreadPool& pool_;
+    const T& original_;
+    std::vector<std::unique_ptr<T>> replicas_;
+};
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,99 @@
+#ifndef TPCH_DATE_HPP
+#define TPCH_DATE_HPP
+
+#include <string>
+#include <string_view>
+
+
+// ---------------- Packed dates ----------------
+// Dates are stored as the number of days since 1970-01-01, so date filters become
+// integer comparisons and a date column costs 4 bytes instead of a std::string.
+
+// Day number of a proleptic Gregorian calendar date
+constexpr int daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int year_of_era = year - era * 400;
+    const int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Number of days in a month, February of leap years included
+constexpr int daysInMonth(int year, int month) {
+    if (month == 2)
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0 ? 29 : 28;
+    return month == 4 || month == 6 || month == 9 || month == 11 ? 30 : 31;
+}
+
+// Parse a YYYY-MM-DD date into its day number, returns false if text is not such a date
+inline bool parseDate(std::string_view text, int& days) {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-')
+        return false;
+    for (size_t i : {0, 1, 2, 3, 5, 6, 8, 9})
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+
+    int year = (text[0] - '0') * 1000 + (text[1] - '0') * 100 + (text[2] - '0') * 10 + (text[3] - '0');
+    int month = (text[5] - '0') * 10 + (text[6] - '0');
+    int day = (text[8] - '0') * 10 + (text[9] - '0');
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month))
+        return false;
+
+    days = daysFromCivil(year, month, day);
+    return true;
+}
+
+// Calendar date of a day number, the inverse of daysFromCivil
+constexpr void civilFromDays(int days, int& year, int& month, int& day) {
+    days += 719468;
+    const int era = (days >= 0 ? days : days - 146096) / 146097;
+    const int day_of_era = days - era * 146097;
+    const int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const int month_index = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * month_index + 2) / 5 + 1;
+    month = month_index < 10 ? month_index + 3 : month_index - 9;
+    year = year_of_era + era * 400 + (month <= 2);
+}
+
+// Year of a day number, as EXTRACT(YEAR FROM date)
+constexpr int yearOfDays(int days) {
+    int year = 0, month = 0, day = 0;
+    civilFromDays(days, year, month, day);
+    return year;
+}
+
+// Day number of date + INTERVAL 'months' MONTH, clamped to the end of a shorter month
+constexpr int addMonths(int days, int months) {
+    int year = 0, month = 0, day = 0;
+    civilFromDays(days, year, month, day);
+    const int month_number = year * 12 + (month - 1) + months;
+    year = month_number / 12;
+    month = month_number % 12 + 1;
+    const int next_month_start = month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, month + 1, 1);
+    const int target = daysFromCivil(year, month, 1) + day - 1;
+    return target < next_month_start ? target : next_month_start - 1;
+}
+
+// Format a day number back into YYYY-MM-DD
+inline std::string formatDate(int days) {
+    int year = 0, month = 0, day = 0;
+    civilFromDays(days, year, month, day);
+
+    char text[11];
+    text[0] = char('0' + year / 1000 % 10);
+    text[1] = char('0' + year / 100 % 10);
+    text[2] = char('0' + year / 10 % 10);
+    text[3] = char('0' + year % 10);
+    text[4] = '-';
+    text[5] = char('0' + month / 10);
+    text[6] = char('0' + month % 10);
+    text[7] = '-';
+    text[8] = char('0' + day / 10);
+    text[9] = char('0' + day % 10);
+    text[10] = '\0';
+    return text;
+}
+
+#endif // TPCH_DATE_HPP
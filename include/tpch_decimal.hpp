@@ -0,0 +1,70 @@
+#ifndef TPCH_DECIMAL_HPP
+#define TPCH_DECIMAL_HPP
+
+#include <cstdint>
+#include <string_view>
+
+
+// ---------------- Fixed-point decimals ----------------
+// L_EXTENDEDPRICE and L_DISCOUNT are DECIMAL(15,2), so they are stored as whole hundredths:
+// the price in cents and the discount in percent. The revenue of one lineitem,
+// L_EXTENDEDPRICE * (1 - L_DISCOUNT), is then the exact integer price * (100 - discount)
+// in units of 1e-4. Integer sums do not depend on the order of the additions, so every
+// thread count, morsel size and kernel produces bit identical results.
+
+constexpr int DECIMAL_SCALE = 100;                                      // Stored units per whole unit
+constexpr int64_t REVENUE_SCALE = int64_t(DECIMAL_SCALE) * DECIMAL_SCALE;  // Revenue units per whole unit
+
+// Sum of lineitem revenues in units of 1e-4. A single revenue fits in 64 bits for any
+// DECIMAL(15,2) price; 128 bits leave room for any number of them.
+using RevenueSum = __int128;
+
+// Parse a non-negative decimal with at most two fractional digits, such as 12345.67, 0.04 or 7,
+// into hundredths. Stops at the first byte that is not part of the number; returns false if
+// there is no digit, more than two fractional digits or the value does not fit
+inline bool parseHundredths(const char*& cursor, const char* end, int64_t& value) {
+    const char* start = cursor;
+    int64_t whole = 0;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        if (whole > ((INT64_MAX - 99) / DECIMAL_SCALE - 9) / 10)
+            return false;
+        whole = whole * 10 + (*cursor++ - '0');
+    }
+    bool has_digits = cursor != start;
+
+    int64_t fraction = 0;
+    if (cursor < end && *cursor == '.') {
+        ++cursor;
+        int fraction_digits = 0;
+        for (; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor, ++fraction_digits)
+            fraction = fraction * 10 + (*cursor - '0');
+        if (fraction_digits > 2)
+            return false;
+        if (fraction_digits == 1)
+            fraction *= 10;
+        has_digits = has_digits || fraction_digits > 0;
+    }
+    if (!has_digits)
+        return false;
+
+    value = whole * DECIMAL_SCALE + fraction;
+    return true;
+}
+
+// Whole-string form of parseHundredths
+inline bool parseHundredths(std::string_view text, int64_t& value) {
+    const char* cursor = text.data();
+    return parseHundredths(cursor, text.data() + text.size(), value) && cursor == text.data() + text.size();
+}
+
+// Revenue of one lineitem in units of 1e-4
+inline int64_t lineItemRevenue(int64_t price, int discount) {
+    return price * (DECIMAL_SCALE - discount);
+}
+
+// Final conversion for output; the only place revenue is rounded
+inline double revenueToDouble(RevenueSum revenue) {
+    return double(revenue) / double(REVENUE_SCALE);
+}
+
+#endif // TPCH_DECIMAL_HPP
@@ -0,0 +1,26 @@
+#ifndef TPCH_GENERATOR_HPP
+#define TPCH_GENERATOR_HPP
+
+#include <cstdint>
+#include <string>
+
+
+// ---------------- Deterministic TPC-H data generator ----------------
+// Writes region.tbl, nation.tbl, customer.tbl, supplier.tbl, orders.tbl and lineitem.tbl
+// in dbgen's format and with dbgen's cardinalities for a scale factor, so benchmarks can
+// run anywhere without an external dbgen. The same scale factor and seed always produce
+// the same bytes. The columns Q5 reads follow the specification (sparse order keys,
+// customer and supplier nations, order dates, extended prices and discounts); the other
+// columns hold short placeholder values of the right shape.
+
+// Rows per unit of scale factor
+constexpr int64_t GENERATOR_CUSTOMERS_PER_SF = 150000;
+constexpr int64_t GENERATOR_SUPPLIERS_PER_SF = 10000;
+constexpr int64_t GENERATOR_PARTS_PER_SF = 200000;
+constexpr int64_t GENERATOR_ORDERS_PER_SF = 1500000;
+
+// Generate all six tables into the existing directory table_path, replacing files of the
+// same name. Returns false if scale_factor is not positive or a file cannot be written
+bool generateTPCHData(const std::string& table_path, double scale_factor, uint64_t seed = 1);
+
+#endif // TPCH_GENERATOR_HPP
@@ -0,0 +1,62 @@
+#ifndef TPCH_QUERIES_HPP
+#define TPCH_QUERIES_HPP
+
+#include "query5.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// ---------------- TPC-H queries besides Q5 ----------------
+// Run as pipelines (see pipeline.hpp) over the mapped orders.tbl and lineitem.tbl after the
+// small tables are loaded, like executeQuery5Streaming; options.execution_mode, layout and
+// memory_limit do not apply.
+
+// One Q7 (volume shipping) result row
+struct Query7Result {
+    std::string SUPP_NATION;
+    std::string CUST_NATION;
+    int L_YEAR;
+    double REVENUE;
+};
+
+// One Q10 (returned item reporting) result row; the descriptive columns are copied from the .tbl text
+struct Query10Result {
+    int C_CUSTKEY;
+    std::string C_NAME;
+    double REVENUE;
+    std::string C_ACCTBAL;
+    std::string N_NAME;
+    std::string C_ADDRESS;
+    std::string C_PHONE;
+    std::string C_COMMENT;
+};
+
+// TPC-H Q7: revenue of lineitems shipped in 1995 and 1996 between suppliers and customers of
+// the two nations, in either direction, by supplier nation, customer nation and ship year
+bool executeQuery7(
+    const std::string &nation1,
+    const std::string &nation2,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Query7Result> &results);
+
+// TPC-H Q10: the 20 customers with the most revenue lost to returned items ('R') of orders
+// placed in the three months from start_date. Returns false if the date is not in YYYY-MM-DD form
+bool executeQuery10(
+    const std::string &start_date,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Query10Result> &results);
+
+// Q7 results as SUPP_NATION|CUST_NATION|L_YEAR|REVENUE lines
+void writeQuery7Results(std::ostream& out, const std::vector<Query7Result>& results);
+bool outputQuery7Results(const std::string& result_path, const std::vector<Query7Result>& results);
+
+// Q10 results as C_CUSTKEY|C_NAME|REVENUE|C_ACCTBAL|N_NAME|C_ADDRESS|C_PHONE|C_COMMENT lines
+void writeQuery10Results(std::ostream& out, const std::vector<Query10Result>& results);
+bool outputQuery10Results(const std::string& result_path, const std::vector<Query10Result>& results);
+
+#endif // TPCH_QUERIES_HPP
@@ -0,0 +1,311 @@
+#include "compressed_columns.hpp"
+#include "cpu_topology.hpp"
+#include "query5.hpp"
+#include "thread_pool.hpp"
+#include "tpch_generator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+// ---------------- Benchmark suite ----------------
+// Generates TPC-H data with the built-in generator (once per table_path, scale factor and
+// seed), then for every thread count of the sweep loads the tables and runs Q5 repeat
+// times, reporting the median and p95 of each phase and the lineitem rows per second.
+//
+// Usage:
+//   tpch_query5_bench --table_path /tmp/bench_sf1 --scale 1 --threads 1,2,4,8 --repeat 5
+// Optional: --warmup N --seed N --format csv|json --output /path (default stdout)
+// and any option of tpch_query5 (--r_name, --start_date, --end_date, --layout, --loader, --simd, ...)
+
+namespace {
+
+struct BenchSettings {
+    double scale_factor = 0.1;
+    uint64_t seed = 1;
+    std::vector<int> thread_counts{1, 2, 4};
+    int repeat = 5;
+    int warmup = 1;
+    std::string format = "csv";
+    std::string output_path;
+};
+
+// One measured phase of one thread count
+struct PhaseSamples {
+    int threads;
+    std::string phase;
+    bool scans_lineitem;        // The phase goes over every lineitem row, so rows_per_sec means something
+    std::vector<double> ms;
+};
+
+// Parse a comma separated list of positive thread counts
+bool parseThreadCounts(const std::string& text, std::vector<int>& thread_counts) {
+    thread_counts.clear();
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        thread_counts.push_back(std::stoi(item));
+        if (thread_counts.back() < 1)
+            return false;
+    }
+    return !thread_counts.empty();
+}
+
+// Take the benchmark's own options out of argv and leave the rest for parseArgs
+bool parseBenchArgs(int argc, char* argv[], BenchSettings& settings, std::vector<char*>& query_args) {
+    query_args.assign(argv, argv + 1);
+    for (int argument_index = 1; argument_index < argc; argument_index += 2) {
+        if (argument_index + 1 >= argc)
+            return false;                            // option without a value
+        std::string key = argv[argument_index];
+        std::string val = argv[argument_index + 1];
+        char* end = nullptr;
+
+        if (key == "--scale") {
+            settings.scale_factor = std::strtod(val.c_str(), &end);
+            if (*end != '\0' || !(settings.scale_factor > 0)) return false;
+        }
+        else if (key == "--seed") {
+            settings.seed = std::strtoull(val.c_str(), &end, 10);
+            if (*end != '\0') return false;
+        }
+        else if (key == "--threads") {
+            if (!parseThreadCounts(val, settings.thread_counts)) return false;
+        }
+        else if (key == "--repeat") {
+            settings.repeat = std::atoi(val.c_str());
+            if (settings.repeat < 1) return false;
+        }
+        else if (key == "--warmup") {
+            settings.warmup = std::atoi(val.c_str());
+            if (settings.warmup < 0) return false;
+        }
+        else if (key == "--format") {
+            if (val != "csv" && val != "json") return false;
+            settings.format = val;
+        }
+        else if (key == "--output")
+            settings.output_path = val;
+        else {
+            query_args.push_back(argv[argument_index]);
+            query_args.push_back(argv[argument_index + 1]);
+        }
+    }
+    return true;
+}
+
+// Generate the tables unless table_path already holds them for this scale factor and seed
+bool prepareData(const std::string& table_path, const BenchSettings& settings) {
+    std::ostringstream stamp;
+    stamp << settings.scale_factor << " " << settings.seed << "\n";
+    const std::string stamp_path = table_path + "/generator.stamp";
+
+    std::ifstream existing(stamp_path);
+    std::string existing_stamp((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+    if (existing_stamp == stamp.str())
+        return true;
+
+    std::error_code error;
+    std::filesystem::create_directories(table_path, error);
+    std::cerr << "Generating scale factor " << settings.scale_factor << " into " << table_path << std::endl;
+    if (!generateTPCHData(table_path, settings.scale_factor, settings.seed))
+        return false;
+    std::ofstream(stamp_path) << stamp.str();
+    return true;
+}
+
+double medianOf(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// Nearest rank percentile
+double percentileOf(std::vector<double> values, double percentile) {
+    std::sort(values.begin(), values.end());
+    size_t rank = size_t(std::ceil(percentile / 100 * double(values.size())));
+    return values[std::max<size_t>(rank, 1) - 1];
+}
+
+// Measured phases; query is preprocess + probe + merge
+constexpr int PHASE_COUNT = 5;
+const char* const PHASE_NAMES[PHASE_COUNT] = {"load", "preprocess", "probe", "merge", "query"};
+const bool PHASE_SCANS_LINEITEM[PHASE_COUNT] = {true, false, true, false, true};
+
+// Load every table and run the query once, storing the time of every phase of PHASE_NAMES in phase_ms
+template <typename Chunk>
+bool runOnce(const std::string& r_name, const std::string& start_date, const std::string& end_date,
+             int num_threads, const std::string& table_path, const ExecutionOptions& options,
+             std::vector<Nation_Revenue>& results, size_t& lineitem_rows, double (&phase_ms)[PHASE_COUNT])
+{
+    std::vector<Customer> customer_data;
+    std::vector<Orders> orders_data;
+    std::vector<Chunk> lineitem_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    ZoneMaps zone_maps;
+
+    // The whole of lineitem is loaded so the probe always sees every row
+    auto start = std::chrono::steady_clock::now();
+    if (!readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data,
+                      nation_data, region_data, num_threads, options, &zone_maps))
+        return false;
+    phase_ms[0] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    lineitem_rows = 0;
+    for (const Chunk& chunk : lineitem_data)
+        lineitem_rows += chunk.size();
+
+    QueryPhaseTimings timings;
+    bool executed;
+    if constexpr (std::is_same_v<Chunk, LineItemColumns>)
+        executed = executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                                 supplier_data, nation_data, region_data, results, &zone_maps, options.simd_level, &timings, options.join_strategy);
+    else
+        executed = executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                                 supplier_data, nation_data, region_data, results, &zone_maps, &timings, options.join_strategy);
+    phase_ms[1] = timings.preprocess_ms;
+    phase_ms[2] = timings.probe_ms;
+    phase_ms[3] = timings.merge_ms;
+    phase_ms[4] = timings.preprocess_ms + timings.probe_ms + timings.merge_ms;
+    return executed;
+}
+
+bool sameResults(const std::vector<Nation_Revenue>& a, const std::vector<Nation_Revenue>& b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t row = 0; row < a.size(); ++row)
+        if (a[row].NATION != b[row].NATION || a[row].REVENUE != b[row].REVENUE)
+            return false;
+    return true;
+}
+
+// Lineitem rows per second of a phase that scans lineitem, empty for the others
+std::string rowsPerSecond(const PhaseSamples& phase, size_t lineitem_rows) {
+    if (!phase.scans_lineitem)
+        return "";
+    double median = medianOf(phase.ms);
+    std::ostringstream text;
+    text.precision(6);
+    text << std::fixed << (median > 0 ? double(lineitem_rows) / (median / 1000) : 0.0);
+    return text.str();
+}
+
+void writeReport(std::ostream& out, const BenchSettings& settings, const ExecutionOptions& options,
+                 size_t lineitem_rows, const std::vector<PhaseSamples>& samples)
+{
+    const char* layout = options.lineitem_layout == LineItemLayout::Columns ? "columns"
+                       : options.lineitem_layout == LineItemLayout::Compressed ? "compressed" : "rows";
+    out.precision(6);
+    out << std::fixed;
+
+    if (settings.format == "csv") {
+        out << "scale_factor,layout,lineitem_rows,threads,phase,runs,median_ms,p95_ms,rows_per_sec\n";
+        for (const PhaseSamples& phase : samples) {
+            double median = medianOf(phase.ms);
+            out << settings.scale_factor << "," << layout << "," << lineitem_rows << "," << phase.threads << ","
+                << phase.phase << "," << phase.ms.size() << "," << median << "," << percentileOf(phase.ms, 95) << ","
+                << rowsPerSecond(phase, lineitem_rows) << "\n";
+        }
+        return;
+    }
+
+    out << "{\n  \"scale_factor\": " << settings.scale_factor << ",\n  \"layout\": \"" << layout
+        << "\",\n  \"lineitem_rows\": " << lineitem_rows << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const PhaseSamples& phase = samples[i];
+        double median = medianOf(phase.ms);
+        std::string rows_per_sec = rowsPerSecond(phase, lineitem_rows);
+        out << "    {\"threads\": " << phase.threads << ", \"phase\": \"" << phase.phase << "\", \"runs\": " << phase.ms.size()
+            << ", \"median_ms\": " << median << ", \"p95_ms\": " << percentileOf(phase.ms, 95)
+            << ", \"rows_per_sec\": " << (rows_per_sec.empty() ? "null" : rows_per_sec) << "}"
+            << (i + 1 < samples.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+    BenchSettings settings;
+    std::vector<char*> query_args;
+    std::string r_name = "ASIA", start_date = "1994-01-01", end_date = "1995-01-01", table_path = "bench_data", result_path;
+    int num_threads = 1;
+    ExecutionOptions options;
+
+    if (!parseBenchArgs(argc, argv, settings, query_args)
+        || !parseArgs(int(query_args.size()), query_args.data(), r_name, start_date, end_date,
+                      num_threads, table_path, result_path, options)) {
+        std::cerr << "Failed to parse command line arguments." << std::endl;
+        return 1;
+    }
+
+    std::vector<int> cpus;
+    if (!options.affinity.empty() && affinityCpus(options.affinity, cpus))
+        setSharedThreadPoolCpus(cpus);
+
+    if (!prepareData(table_path, settings)) {
+        std::cerr << "Failed to generate TPCH data in " << table_path << "." << std::endl;
+        return 1;
+    }
+
+    std::vector<PhaseSamples> samples;
+    std::vector<Nation_Revenue> reference;
+    size_t lineitem_rows = 0;
+    for (int threads : settings.thread_counts) {
+        size_t first = samples.size();
+        for (int phase = 0; phase < PHASE_COUNT; ++phase)
+            samples.push_back({threads, PHASE_NAMES[phase], PHASE_SCANS_LINEITEM[phase], {}});
+
+        for (int run = 0; run < settings.warmup + settings.repeat; ++run) {
+            std::vector<Nation_Revenue> results;
+            double phase_ms[PHASE_COUNT];
+            bool ok = options.lineitem_layout == LineItemLayout::Columns
+                ? runOnce<LineItemColumns>(r_name, start_date, end_date, threads, table_path, options, results, lineitem_rows, phase_ms)
+                : options.lineitem_layout == LineItemLayout::Compressed
+                ? runOnce<CompressedLineItems>(r_name, start_date, end_date, threads, table_path, options, results, lineitem_rows, phase_ms)
+                : runOnce<std::vector<LineItem>>(r_name, start_date, end_date, threads, table_path, options, results, lineitem_rows, phase_ms);
+            if (!ok) {
+                std::cerr << "Failed to run TPCH Query 5 with " << threads << " threads." << std::endl;
+                return 1;
+            }
+
+            // Revenue is summed exactly, so every run at every thread count must agree bit for bit
+            if (reference.empty())
+                reference = results;
+            else if (!sameResults(reference, results)) {
+                std::cerr << "Results with " << threads << " threads differ from the first run." << std::endl;
+                return 1;
+            }
+
+            if (run >= settings.warmup)
+                for (int phase = 0; phase < PHASE_COUNT; ++phase)
+                    samples[first + phase].ms.push_back(phase_ms[phase]);
+        }
+    }
+
+    if (settings.output_path.empty()) {
+        writeReport(std::cout, settings, options, lineitem_rows, samples);
+        return 0;
+    }
+    std::ofstream output(settings.output_path);
+    writeReport(output, settings, options, lineitem_rows, samples);
+    if (!output) {
+        std::cerr << "Failed to write " << settings.output_path << "." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "compressed_columns.hpp"
+#include <bit>
+#include <limits>
+
+
+namespace {
+
+// Bits needed to store every value in [0, max_value]
+int bitsFor(uint64_t max_value) {
+    return int(std::bit_width(max_value));
+}
+
+// Appends values of a fixed bit width to a byte stream, least significant bits first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void put(uint64_t value, int width) {
+        pending_ |= static_cast<unsigned __int128>(value) << pending_bits_;
+        pending_bits_ += width;
+        while (pending_bits_ >= 8) {
+            out_.push_back(uint8_t(pending_));
+            pending_ >>= 8;
+            pending_bits_ -= 8;
+        }
+    }
+
+    // Write out the last partial byte, so the next stream starts on a byte boundary
+    void finish() {
+        if (pending_bits_ > 0)
+            out_.push_back(uint8_t(pending_));
+        pending_ = 0;
+        pending_bits_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    unsigned __int128 pending_ = 0;
+    int pending_bits_ = 0;
+};
+
+} // namespace
+
+void CompressedLineItems::encodePending() {
+    if (pending_.empty())
+        return;
+
+    Block block{};
+    block.data_offset = data_.size();
+    block.rows = uint16_t(pending_.size());
+
+    // L_ORDERKEY runs
+    std::vector<int> run_values;
+    std::vector<uint32_t> run_lengths;
+    for (const LineItem& row : pending_) {
+        if (!run_values.empty() && run_values.back() == row.L_ORDERKEY) {
+            ++run_lengths.back();
+        } else {
+            run_values.push_back(row.L_ORDERKEY);
+            run_lengths.push_back(1);
+        }
+    }
+    block.runs = uint16_t(run_values.size());
+    block.first_key = run_values[0];
+
+    int64_t min_delta = std::numeric_limits<int64_t>::max(), max_delta = std::numeric_limits<int64_t>::min();
+    for (size_t run = 1; run < run_values.size(); ++run) {
+        int64_t delta = int64_t(run_values[run]) - run_values[run - 1];
+        min_delta = std::min(min_delta, delta);
+        max_delta = std::max(max_delta, delta);
+    }
+    uint32_t max_length = *std::max_element(run_lengths.begin(), run_lengths.end());
+
+    // Frames of the other columns
+    int32_t min_supp = pending_[0].L_SUPPKEY, max_supp = min_supp;
+    int64_t min_price = pending_[0].L_EXTENDEDPRICE, max_price = min_price;
+    for (const LineItem& row : pending_) {
+        min_supp = std::min(min_supp, int32_t(row.L_SUPPKEY));
+        max_supp = std::max(max_supp, int32_t(row.L_SUPPKEY));
+        min_price = std::min(min_price, row.L_EXTENDEDPRICE);
+        max_price = std::max(max_price, row.L_EXTENDEDPRICE);
+    }
+
+    // Dictionary codes, new discounts are appended so the codes of earlier blocks stay valid
+    std::vector<uint32_t> discount_codes(pending_.size());
+    uint32_t last_code = 0;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        int16_t discount = pending_[i].L_DISCOUNT;
+        if (dictionary_.empty() || dictionary_[last_code] != discount) {
+            auto found = std::find(dictionary_.begin(), dictionary_.end(), discount);
+            if (found == dictionary_.end())
+                found = dictionary_.insert(found, discount);
+            last_code = uint32_t(found - dictionary_.begin());
+        }
+        discount_codes[i] = last_code;
+    }
+
+    BitWriter writer(data_);
+    if (run_values.size() > 1) {
+        block.delta_base = min_delta;
+        block.delta_width = uint8_t(bitsFor(uint64_t(max_delta - min_delta)));
+        for (size_t run = 1; run < run_values.size(); ++run)
+            writer.put(uint64_t(int64_t(run_values[run]) - run_values[run - 1] - min_delta), block.delta_width);
+        writer.finish();
+    }
+
+    block.lengths_offset = uint32_t(data_.size() - block.data_offset);
+    block.length_width = uint8_t(bitsFor(max_length - 1));
+    for (uint32_t length : run_lengths)
+        writer.put(length - 1, block.length_width);
+    writer.finish();
+
+    block.supp_offset = uint32_t(data_.size() - block.data_offset);
+    block.supp_base = min_supp;
+    block.supp_width = uint8_t(bitsFor(uint64_t(int64_t(max_supp) - min_supp)));
+    for (const LineItem& row : pending_)
+        writer.put(uint64_t(int64_t(row.L_SUPPKEY) - min_supp), block.supp_width);
+    writer.finish();
+
+    block.price_offset = uint32_t(data_.size() - block.data_offset);
+    block.price_base = min_price;
+    block.price_width = uint8_t(bitsFor(uint64_t(max_price) - uint64_t(min_price)));
+    for (const LineItem& row : pending_)
+        writer.put(uint64_t(row.L_EXTENDEDPRICE) - uint64_t(min_price), block.price_width);
+    writer.finish();
+
+    block.discount_offset = uint32_t(data_.size() - block.data_offset);
+    block.discount_width = uint8_t(bitsFor(dictionary_.size() - 1));
+    for (uint32_t code : discount_codes)
+        writer.put(code, block.discount_width);
+    writer.finish();
+
+    blocks_.push_back(block);
+    rows_ += pending_.size();
+    pending_.clear();
+}
+
+void CompressedLineItems::finish() {
+    encodePending();
+    std::vector<LineItem>().swap(pending_);
+    data_.resize(data_.size() + READ_PADDING);
+    data_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+}
+
+void CompressedLineItems::decodeOrderKeys(size_t block, int* out) const {
+    int run_keys[COMPRESSED_BLOCK_ROWS];
+    uint32_t run_lengths[COMPRESSED_BLOCK_ROWS];
+    size_t runs = decodeOrderKeyRuns(block, run_keys, run_lengths);
+    for (size_t run = 0; run < runs; ++run)
+        for (uint32_t i = 0; i < run_lengths[run]; ++i)
+            *out++ = run_keys[run];
+}
+
+size_t CompressedLineItems::decodeOrderKeyRuns(size_t block, int* run_keys, uint32_t* run_lengths) const {
+    const Block& b = blocks_[block];
+    size_t lengths_offset = b.data_offset + b.lengths_offset;
+    int64_t key = b.first_key;
+    for (size_t run = 0; run < b.runs; ++run) {
+        if (run > 0)
+            key += b.delta_base + int64_t(readBits(b.data_offset, run - 1, b.delta_width));
+        run_keys[run] = int(key);
+        run_lengths[run] = uint32_t(readBits(lengths_offset, run, b.length_width)) + 1;
+    }
+    return b.runs;
+}
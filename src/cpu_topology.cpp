@@ -0,0 +1,104 @@
+#include "cpu_topology.hpp"
+#include <algorithm>
+#include <charconv>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef TPCH_HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+
+namespace {
+
+// CPUs the process may run on, ascending
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    return cpus;
+}
+
+bool parseCpu(const char*& cursor, const char* end, int& cpu) {
+    std::from_chars_result parsed = std::from_chars(cursor, end, cpu);
+    if (parsed.ec != std::errc() || cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cursor = parsed.ptr;
+    return true;
+}
+
+// "0-3,8,10-11" -> 0 1 2 3 8 10 11, in the order given
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    const char* cursor = text.data();
+    const char* end = cursor + text.size();
+    while (cursor < end) {
+        int first, last;
+        if (!parseCpu(cursor, end, first))
+            return false;
+        last = first;
+        if (cursor < end && *cursor == '-' && !parseCpu(++cursor, end, last))
+            return false;
+        if (last < first)
+            return false;
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+        if (cursor < end && (*cursor++ != ',' || cursor == end))
+            return false;
+    }
+    return !cpus.empty();
+}
+
+} // namespace
+
+
+bool affinityCpus(const std::string& affinity, std::vector<int>& cpus) {
+    cpus.clear();
+    std::vector<int> allowed = allowedCpus();
+    if (allowed.empty())
+        return false;
+
+    if (affinity == "compact") {
+        cpus = allowed;
+        return true;
+    }
+
+    if (affinity == "scatter") {
+        // One CPU of every node in turn, so consecutive workers land on different nodes
+        std::map<int, std::vector<int>> node_cpus;
+        for (int cpu : allowed)
+            node_cpus[numaNodeOfCpu(cpu)].push_back(cpu);
+        for (size_t index = 0; cpus.size() < allowed.size(); ++index)
+            for (const auto& [node, node_list] : node_cpus)
+                if (index < node_list.size())
+                    cpus.push_back(node_list[index]);
+        return true;
+    }
+
+    if (!parseCpuList(affinity, cpus))
+        return false;
+    return std::all_of(cpus.begin(), cpus.end(), [&](int cpu) {
+        return std::binary_search(allowed.begin(), allowed.end(), cpu);
+    });
+}
+
+int numaNodeOfCpu(int cpu) {
+#ifdef TPCH_HAVE_LIBNUMA
+    if (numa_available() >= 0)
+        return std::max(numa_node_of_cpu(cpu), 0);
+#endif
+    (void)cpu;
+    return 0;
+}
+
+bool pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
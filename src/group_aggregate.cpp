@@ -0,0 +1,88 @@
+#include "group_aggregate.hpp"
+#include <algorithm>
+
+
+namespace {
+
+// Groups per morsel when the dense merge runs on the pool
+constexpr size_t MERGE_MORSEL_GROUPS = 4096;
+
+} // namespace
+
+
+GroupAggregate::GroupAggregate(int num_workers, uint64_t num_groups)
+    : dense_(num_groups <= DENSE_GROUP_LIMIT), num_workers_(num_workers), num_groups_(num_groups)
+{
+    if (dense_) {
+        const size_t sums_per_line = sizeof(CacheLine) / sizeof(RevenueSum);
+        lines_per_worker_ = (size_t(num_groups) + sums_per_line - 1) / sums_per_line;
+        dense_lines_.resize(lines_per_worker_ * size_t(num_workers));   // Value initialized to zero
+    }
+    else {
+        hash_partitions_.resize(size_t(num_workers) * RADIX_PARTITIONS);
+    }
+}
+
+void GroupAggregate::HashPartition::grow() {
+    std::vector<uint64_t> old_keys;
+    std::vector<RevenueSum> old_sums;
+    old_keys.swap(keys);
+    old_sums.swap(sums);
+    keys.assign(std::max<size_t>(16, old_keys.size() * 2), EMPTY_KEY);
+    sums.assign(keys.size(), 0);
+
+    size_t mask = keys.size() - 1;
+    for (size_t old_slot = 0; old_slot < old_keys.size(); ++old_slot) {
+        if (old_keys[old_slot] == EMPTY_KEY)
+            continue;
+        size_t slot = (old_keys[old_slot] * 0x9E3779B97F4A7C15ull) & mask;
+        while (keys[slot] != EMPTY_KEY)
+            slot = (slot + 1) & mask;
+        keys[slot] = old_keys[old_slot];
+        sums[slot] = old_sums[old_slot];
+    }
+}
+
+void GroupAggregate::merge(ThreadPool* pool, std::vector<std::pair<uint64_t, RevenueSum>>& groups) const {
+    groups.clear();
+
+    if (dense_) {
+        // One pass per worker over its flat array; each morsel owns a range of groups
+        std::vector<RevenueSum> totals(num_groups_, 0);
+        forEachRange(pool, num_groups_, MERGE_MORSEL_GROUPS, [&](size_t begin, size_t end) {
+            for (int worker = 0; worker < num_workers_; ++worker) {
+                const RevenueSum* sums = reinterpret_cast<const RevenueSum*>(
+                    dense_lines_.data() + size_t(worker) * lines_per_worker_);
+                for (size_t group = begin; group < end; ++group)
+                    totals[group] += sums[group];
+            }
+        });
+        for (uint64_t group = 0; group < num_groups_; ++group)
+            if (totals[group] != 0)
+                groups.emplace_back(group, totals[group]);
+        return;
+    }
+
+    // Partition p only ever holds keys whose top hash bits are p, so the partitions merge independently
+    std::vector<std::vector<std::pair<uint64_t, RevenueSum>>> parts(RADIX_PARTITIONS);
+    forEachRange(pool, RADIX_PARTITIONS, 1, [&](size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            HashPartition merged;
+            for (int worker = 0; worker < num_workers_; ++worker) {
+                const HashPartition& source = hash_partitions_[size_t(worker) * RADIX_PARTITIONS + partition];
+                for (size_t slot = 0; slot < source.keys.size(); ++slot)
+                    if (source.keys[slot] != HashPartition::EMPTY_KEY)
+                        merged.add(source.keys[slot], source.keys[slot] * 0x9E3779B97F4A7C15ull, source.sums[slot]);
+            }
+
+            std::vector<std::pair<uint64_t, RevenueSum>>& part = parts[partition];
+            part.reserve(merged.used);
+            for (size_t slot = 0; slot < merged.keys.size(); ++slot)
+                if (merged.keys[slot] != HashPartition::EMPTY_KEY && merged.sums[slot] != 0)
+                    part.emplace_back(merged.keys[slot], merged.sums[slot]);
+            std::sort(part.begin(), part.end(),
+                      [](const auto& a, const auto& b) { return a.first < b.first; });
+        }
+    });
+    appendConcatenated(pool, parts, groups);
+}
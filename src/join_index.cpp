@@ -0,0 +1,92 @@
+#include "join_index.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+
+template <typename Code>
+void BasicJoinIndex<Code>::keyRange(const std::vector<Entry>& entries, ThreadPool* pool, int& min_key, int& max_key) {
+    // One partial result per range, combined afterwards
+    size_t num_ranges = (entries.size() + BUILD_MORSEL_ENTRIES - 1) / BUILD_MORSEL_ENTRIES;
+    std::vector<int> range_min(num_ranges, entries.front().key);
+    std::vector<int> range_max(num_ranges, entries.front().key);
+    forEachRange(pool, entries.size(), BUILD_MORSEL_ENTRIES, [&](size_t begin, size_t end) {
+        int low = entries[begin].key;
+        int high = entries[begin].key;
+        for (size_t i = begin; i < end; ++i) {
+            low = std::min(low, entries[i].key);
+            high = std::max(high, entries[i].key);
+        }
+        range_min[begin / BUILD_MORSEL_ENTRIES] = low;
+        range_max[begin / BUILD_MORSEL_ENTRIES] = high;
+    });
+    min_key = *std::min_element(range_min.begin(), range_min.end());
+    max_key = *std::max_element(range_max.begin(), range_max.end());
+}
+
+template <typename Code>
+void BasicJoinIndex<Code>::build(const std::vector<Entry>& entries, size_t domain_keys, ThreadPool* pool) {
+    codes_.clear();
+    slots_.clear();
+    entry_count_ = entries.size();
+    min_key_ = 0;
+    dense_size_ = 0;
+    dense_ = true;
+
+    if (entries.empty())
+        return;                     // Every probe misses the bounds check
+
+    // Key range of the entries decides the layout
+    int min_key, max_key;
+    keyRange(entries, pool, min_key, max_key);
+    uint64_t key_range = uint64_t(int64_t(max_key) - min_key) + 1;
+
+    if (key_range <= DENSE_RANGE_FACTOR * std::max(domain_keys, entries.size())) {
+        // Direct addressed: one code per possible key. Distinct keys write distinct codes,
+        // so ranges of entries can be scattered concurrently
+        min_key_ = min_key;
+        dense_size_ = uint32_t(key_range);
+        codes_.assign(key_range + DENSE_PADDING, NOT_FOUND);
+        forEachRange(pool, entries.size(), BUILD_MORSEL_ENTRIES, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                std::atomic_ref<Code>(codes_[uint32_t(entries[i].key) - uint32_t(min_key)])
+                    .store(entries[i].code, std::memory_order_relaxed);
+        });
+        return;
+    }
+
+    // Sparse keys: linear probing table kept at most half full. A slot is claimed by a
+    // compare-and-swap on its key so ranges of entries can be inserted concurrently
+    dense_ = false;
+    size_t capacity = std::bit_ceil(std::max<size_t>(entries.size() * 2, 16));
+    slots_.assign(capacity, Slot{EMPTY_KEY, NOT_FOUND});
+    hash_shift_ = 32 - std::countr_zero(capacity);
+    hash_mask_ = capacity - 1;
+
+    std::atomic<size_t> entry_count{0};
+    forEachRange(pool, entries.size(), BUILD_MORSEL_ENTRIES, [&](size_t begin, size_t end) {
+        size_t inserted = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const Entry& entry = entries[i];
+            uint32_t slot = hashKey(entry.key) >> hash_shift_;
+            while (true) {
+                int32_t expected = EMPTY_KEY;
+                if (std::atomic_ref<int32_t>(slots_[slot].key)
+                        .compare_exchange_strong(expected, entry.key, std::memory_order_relaxed))
+                    ++inserted;
+                else if (expected != entry.key) {
+                    slot = (slot + 1) & hash_mask_;
+                    continue;
+                }
+                std::atomic_ref<Code>(slots_[slot].code).store(entry.code, std::memory_order_relaxed);
+                break;
+            }
+        }
+        entry_count.fetch_add(inserted, std::memory_order_relaxed);
+    });
+    entry_count_ = entry_count.load();
+}
+
+template class BasicJoinIndex<int8_t>;
+template class BasicJoinIndex<int32_t>;
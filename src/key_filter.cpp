@@ -0,0 +1,56 @@
+#include "key_filter.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+
+void KeyFilter::build(const std::vector<JoinIndex::Entry>& entries, size_t domain_keys, ThreadPool* pool) {
+    words_.clear();
+    bitmap_ = true;
+    min_key_ = 0;
+    key_range_ = 0;
+
+    if (entries.empty())
+        return;                     // Empty bitmap rejects every key
+
+    // Concurrent ranges may set bits of the same word, plain stores suffice otherwise
+    const bool concurrent = pool && entries.size() > JoinIndex::BUILD_MORSEL_ENTRIES;
+    auto setBits = [&](uint64_t& word, uint64_t bits) {
+        if (concurrent)
+            std::atomic_ref<uint64_t>(word).fetch_or(bits, std::memory_order_relaxed);
+        else
+            word |= bits;
+    };
+
+    int min_key, max_key;
+    JoinIndex::keyRange(entries, pool, min_key, max_key);
+    uint64_t key_range = uint64_t(int64_t(max_key) - min_key) + 1;
+
+    if (key_range <= BITMAP_RANGE_FACTOR * std::max(domain_keys, entries.size())) {
+        // Exact bitmap over [min_key, max_key]
+        min_key_ = min_key;
+        key_range_ = key_range;
+        words_.assign((key_range + 63) / 64, 0);
+        forEachRange(pool, entries.size(), JoinIndex::BUILD_MORSEL_ENTRIES, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t slot = uint32_t(entries[i].key) - uint32_t(min_key);
+                setBits(words_[slot >> 6], uint64_t(1) << (slot & 63));
+            }
+        });
+        return;
+    }
+
+    // Register-blocked Bloom filter with a power of two number of words (at least two, so the
+    // word index shift stays below 64, at most 2^30 so it never overlaps the probe bits)
+    bitmap_ = false;
+    size_t num_words = std::bit_ceil(std::clamp<size_t>(entries.size() * BLOOM_BITS_PER_KEY / 64, 2, size_t(1) << 30));
+    words_.assign(num_words, 0);
+    word_shift_ = 64 - std::countr_zero(num_words);
+    forEachRange(pool, entries.size(), JoinIndex::BUILD_MORSEL_ENTRIES, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t hash = uint64_t(uint32_t(entries[i].key)) * 0x9E3779B97F4A7C15ull;
+            setBits(words_[hash >> word_shift_], bloomMask(hash));
+        }
+    });
+}
@@ -1,37 +1,239 @@
+#include "compressed_columns.hpp"
+#include "cpu_topology.hpp"
+#include "metrics.hpp"
+#include "preprocess.hpp"
 #include "query5.hpp"
+#include "query_server.hpp"
+#include "result_cache.hpp"
+#include "revenue_cube.hpp"
+#include "tpch_queries.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
 
 // TODO: Include additional headers as needed
 
+// Instrumentation for --metrics_path, written when main returns on any path
+class MetricsReport {
+public:
+    explicit MetricsReport(const std::string& path) : path_(path) {
+        if (!path_.empty())
+            metrics_.enable();
+    }
+
+    ~MetricsReport() {
+        if (path_.empty())
+            return;
+        metrics_.disable();
+        if (!metrics_.writeJson(path_))
+            std::cerr << "Failed to write metrics to " << path_ << "." << std::endl;
+    }
+
+private:
+    std::string path_;
+    Metrics metrics_;
+};
+
 int main(int argc, char* argv[]) {
 
     // auto start = std::chrono::high_resolution_clock::now();//  Runtime Started
     std::string r_name, start_date, end_date, table_path, result_path;
-    int num_threads;
+    int num_threads = 1;
+    ExecutionOptions options;
 
-    if (!parseArgs(argc, argv, r_name, start_date, end_date, num_threads, table_path, result_path)) {
+    if (!parseArgs(argc, argv, r_name, start_date, end_date, num_threads, table_path, result_path, options)) {
         std::cerr << "Failed to parse command line arguments." << std::endl;
         return 1;
     }
 
-    std::vector<Customer> customer_data;
-    std::vector<Orders> orders_data;
-    std::vector<std::vector<LineItem>> lineitem_data;
-    std::vector<Supplier> supplier_data;
-    std::vector<Nation> nation_data;
-    std::vector<Region> region_data;
-    if (!readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data,num_threads)) {
-        std::cerr << "Failed to read TPCH data." << std::endl;
+    MetricsReport metrics_report(options.metrics_path);
+
+    // Pin the shared pool's workers before any table is loaded on it
+    std::vector<int> cpus;
+    if (!options.affinity.empty() && affinityCpus(options.affinity, cpus))
+        setSharedThreadPoolCpus(cpus);
+
+    if (options.query == 7 || options.query == 10) {
+        // Queries other than Q5 only run as a single query
+        std::vector<Query7Result> q7_results;
+        std::vector<Query10Result> q10_results;
+        bool executed = options.query == 7
+            ? executeQuery7(options.nation1, options.nation2, num_threads, table_path, options, q7_results)
+            : executeQuery10(start_date.empty() ? "1993-10-01" : start_date, num_threads, table_path, options, q10_results);
+        if (!executed) {
+            std::cerr << "Failed to execute TPCH Query " << options.query << "." << std::endl;
+            return 1;
+        }
+
+        options.query == 7 ? writeQuery7Results(std::cout, q7_results) : writeQuery10Results(std::cout, q10_results);
+        bool written = options.query == 7 ? outputQuery7Results(result_path, q7_results)
+                                          : outputQuery10Results(result_path, q10_results);
+        if (!written) {
+            std::cerr << "Failed to output results." << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!options.serve_path.empty()) {
+        // Load once, then answer requests until the input ends or a client shuts the server down
+        QueryServer server(num_threads, options);
+        if (!server.load(table_path)) {
+            std::cerr << "Failed to read TPCH data." << std::endl;
+            return 1;
+        }
+        if (options.serve_path == "-") {
+            server.serveStream(std::cin, std::cout);
+        }
+        else {
+            std::cerr << "Serving TPCH Query 5 on " << options.serve_path << std::endl;
+            if (!server.serveSocket(options.serve_path)) {
+                std::cerr << "Failed to serve queries on " << options.serve_path << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // Sum cube cells instead of scanning lineitem; the cube is only built on the first run
+    RevenueCube cube;
+    const bool use_cube = !options.cube_path.empty();
+    if (use_cube && !openRevenueCube(table_path, num_threads, options, cube)) {
+        std::cerr << "Failed to build or refresh the revenue cube." << std::endl;
         return 1;
     }
 
+    if (!options.batch_file.empty()) {
+        // Every query of the file is answered by the same scan over lineitem
+        std::vector<Query5Parameters> queries;
+        if (!readQueryBatch(options.batch_file, queries)) {
+            std::cerr << "Failed to read batch file " << options.batch_file << "." << std::endl;
+            return 1;
+        }
+
+        std::vector<std::vector<Nation_Revenue>> batch_results(queries.size());
+        bool loaded = true, executed = true;
+
+        if (use_cube) {
+            for (size_t query = 0; query < queries.size(); ++query)
+                executed = executed && cube.query(queries[query].r_name, queries[query].start_date, queries[query].end_date, batch_results[query]);
+        }
+        else {
+            std::vector<Customer> customer_data;
+            std::vector<Orders> orders_data;
+            std::vector<Supplier> supplier_data;
+            std::vector<Nation> nation_data;
+            std::vector<Region> region_data;
+            ZoneMaps zone_maps;
+
+            if (options.lineitem_layout == LineItemLayout::Columns) {
+                std::vector<LineItemColumns> lineitem_data;
+                loaded = readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, num_threads, options, &zone_maps);
+                executed = loaded && executeQuery5Batch(queries, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, batch_results, &zone_maps);
+            }
+            else if (options.lineitem_layout == LineItemLayout::Compressed) {
+                std::vector<CompressedLineItems> lineitem_data;
+                loaded = readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, num_threads, options, &zone_maps);
+                executed = loaded && executeQuery5Batch(queries, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, batch_results, &zone_maps);
+            }
+            else {
+                std::vector<std::vector<LineItem>> lineitem_data;
+                loaded = readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, num_threads, options, &zone_maps);
+                executed = loaded && executeQuery5Batch(queries, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, batch_results, &zone_maps);
+            }
+        }
+
+        if (!loaded) {
+            std::cerr << "Failed to read TPCH data." << std::endl;
+            return 1;
+        }
+        if (!executed) {
+            std::cerr << "Failed to execute TPCH Query 5 batch." << std::endl;
+            return 1;
+        }
+
+        std::cout.precision(13);
+        for (size_t query = 0; query < queries.size(); ++query)
+            for (const Nation_Revenue& nation_revenue : batch_results[query])
+                std::cout << queries[query].r_name << "|" << queries[query].start_date << "|" << queries[query].end_date
+                          << "|" << nation_revenue.NATION << "|" << nation_revenue.REVENUE << "\n";
+
+        if (!outputBatchResults(result_path, queries, batch_results)) {
+            std::cerr << "Failed to output results." << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     std::vector<Nation_Revenue> results;
-    if (!executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, results)) {
-        std::cerr << "Failed to execute TPCH Query 5." << std::endl;
-        return 1;
+    if (use_cube) {
+        if (!cube.query(r_name, start_date, end_date, results)) {
+            std::cerr << "Failed to execute TPCH Query 5." << std::endl;
+            return 1;
+        }
     }
+    else if (!options.result_cache.empty()) {
+        // Cached ranges and months are not scanned again, the rest share one batch scan
+        if (!executeQuery5Cached(Query5Parameters{r_name, start_date, end_date}, num_threads, table_path, options, results)) {
+            std::cerr << "Failed to execute TPCH Query 5." << std::endl;
+            return 1;
+        }
+    }
+    else if (options.memory_limit && estimateQueryMemory(table_path, options) > options.memory_limit) {
+        // The tables would not fit the budget, join them partition by partition from spill files
+        if (!executeQuery5OutOfCore(r_name, start_date, end_date, num_threads, table_path, options, results)) {
+            std::cerr << "Failed to execute TPCH Query 5." << std::endl;
+            return 1;
+        }
+    }
+    else if (options.execution_mode == ExecutionMode::Streaming) {
+        // Dimension tables only, lineitem is scanned once inside the query
+        if (!executeQuery5Streaming(r_name, start_date, end_date, num_threads, table_path, options, results)) {
+            std::cerr << "Failed to execute TPCH Query 5." << std::endl;
+            return 1;
+        }
+    }
+    else {
+        std::vector<Customer> customer_data;
+        std::vector<Orders> orders_data;
+        std::vector<Supplier> supplier_data;
+        std::vector<Nation> nation_data;
+        std::vector<Region> region_data;
+        ZoneMaps zone_maps;
+        PreprocessedData processed_data;           // Built by the loader for its filter, reused by the query
+        const LineItemPushdown pushdown{r_name, start_date, end_date, &processed_data};
+        bool loaded, executed;
+
+        if (options.lineitem_layout == LineItemLayout::Columns) {
+            std::vector<LineItemColumns> lineitem_data;
+            loaded = readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, num_threads, options, &zone_maps, &pushdown);
+            executed = loaded && executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, results, &zone_maps, options.simd_level, nullptr, options.join_strategy, &processed_data);
+        }
+        else if (options.lineitem_layout == LineItemLayout::Compressed) {
+            std::vector<CompressedLineItems> lineitem_data;
+            loaded = readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, num_threads, options, &zone_maps, &pushdown);
+            executed = loaded && executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, results, &zone_maps, nullptr, options.join_strategy, &processed_data);
+        }
+        else {
+            std::vector<std::vector<LineItem>> lineitem_data;
+            loaded = readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, num_threads, options, &zone_maps, &pushdown);
+            executed = loaded && executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data, results, &zone_maps, nullptr, options.join_strategy, &processed_data);
+        }
+
+        if (!loaded) {
+            std::cerr << "Failed to read TPCH data." << std::endl;
+            return 1;
+        }
+        if (!executed) {
+            std::cerr << "Failed to execute TPCH Query 5." << std::endl;
+            return 1;
+        }
+    }
+
+    // Output results with high precision
+    std::cout.precision(13);
+    for (const Nation_Revenue& nation_revenue : results)
+        std::cout << nation_revenue.NATION << "|" << nation_revenue.REVENUE << "\n";
 
     if (!outputResults(result_path, results)) {
         std::cerr << "Failed to output results." << std::endl;
@@ -0,0 +1,67 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      opened_empty_(std::exchange(other.opened_empty_, false)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        opened_empty_ = std::exchange(other.opened_empty_, false);
+    }
+    return *this;
+}
+
+// Map the whole file read-only; the descriptor is closed right away since the mapping keeps the file alive
+bool MappedFile::open(const std::string& filepath) {
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;               // Error Opening File
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (file_stat.st_size == 0) {   // mmap rejects zero length, treat as an empty table
+        ::close(fd);
+        opened_empty_ = true;
+        return true;
+    }
+
+    void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    // Loaders scan front to back, let the kernel read ahead aggressively
+    madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(mapping);
+    size_ = file_stat.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr)
+        munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    opened_empty_ = false;
+}
@@ -0,0 +1,249 @@
+#include "metrics.hpp"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace metrics_detail {
+Metrics* active = nullptr;
+}
+
+namespace {
+
+const char* const PHASE_NAMES[int(MetricsPhase::Count)] = {"load", "preprocess", "probe", "merge"};
+
+const char* const COUNTER_NAMES[int(MetricsCounter::Count)] = {
+    "orders_lines", "orders_malformed",
+    "lineitem_lines", "lineitem_malformed", "lineitem_pushdown_rejected",
+    "probe_rows", "probe_zone_map_skipped", "probe_order_rejected", "probe_nation_mismatch", "probe_aggregated",
+};
+
+int64_t clockNs(clockid_t clock) {
+    timespec now;
+    clock_gettime(clock, &now);
+    return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+int64_t wallNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Cycles, cache misses and branch misses of the calling thread, read as one group.
+// Opened on first use in every thread; kernels or containers that forbid perf_event_open
+// leave the group closed and every sample reads as zero
+class PerfGroup {
+public:
+    PerfGroup() {
+#ifdef __linux__
+        const uint64_t configs[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int counter = 0; counter < 3; ++counter) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[counter];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds_[counter] = int(syscall(SYS_perf_event_open, &attr, 0, -1, counter == 0 ? -1 : fds_[0], 0));
+            if (fds_[counter] < 0) {
+                close();
+                return;
+            }
+        }
+        available.store(true, std::memory_order_relaxed);
+#endif
+    }
+
+    ~PerfGroup() {
+        close();
+    }
+
+    PerfSample read() const {
+        PerfSample sample;
+#ifdef __linux__
+        uint64_t values[4];     // Counter count followed by the counters
+        if (fds_[0] >= 0 && ::read(fds_[0], values, sizeof(values)) == ssize_t(sizeof(values))) {
+            sample.cycles = values[1];
+            sample.llc_misses = values[2];
+            sample.branch_misses = values[3];
+        }
+#endif
+        return sample;
+    }
+
+    // Set once any thread managed to open its counters
+    static inline std::atomic<bool> available{false};
+
+private:
+    void close() {
+#ifdef __linux__
+        for (int& fd : fds_) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+    int fds_[3] = {-1, -1, -1};
+};
+
+PerfSample perfDelta(const PerfSample& start, const PerfSample& end) {
+    return {end.cycles - start.cycles, end.llc_misses - start.llc_misses, end.branch_misses - start.branch_misses};
+}
+
+void addPerf(PerfSample& total, const PerfSample& delta) {
+    total.cycles += delta.cycles;
+    total.llc_misses += delta.llc_misses;
+    total.branch_misses += delta.branch_misses;
+}
+
+void writePerf(std::ostream& out, const PerfSample& perf) {
+    out << ", \"cycles\": " << perf.cycles << ", \"llc_misses\": " << perf.llc_misses
+        << ", \"branch_misses\": " << perf.branch_misses;
+}
+
+} // namespace
+
+
+Metrics::Metrics() {
+    for (std::atomic<uint64_t>& counter : counters_)
+        counter.store(0, std::memory_order_relaxed);
+}
+
+Metrics::~Metrics() {
+    disable();
+}
+
+void Metrics::enable() {
+    metrics_detail::active = this;
+}
+
+void Metrics::disable() {
+    if (metrics_detail::active == this)
+        metrics_detail::active = nullptr;
+}
+
+Metrics::ThreadSample Metrics::sampleThread() {
+    thread_local PerfGroup perf_group;
+    ThreadSample sample;
+    sample.wall_ns = wallNs();
+    sample.cpu_ns = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    sample.perf = perf_group.read();
+    return sample;
+}
+
+// Charge the time since openInterval() to the innermost running phase
+void Metrics::closeInterval() {
+    ThreadSample now = sampleThread();
+    int64_t process_cpu_ns = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    int phase = int(phase_stack_.back());
+
+    PhaseTotals& totals = phases_[phase];
+    totals.wall_ns += now.wall_ns - interval_start_.wall_ns;
+    totals.cpu_ns += process_cpu_ns - interval_process_cpu_ns_;
+
+    PhaseTotals& main_totals = main_thread_.phases[phase];
+    PerfSample delta = perfDelta(interval_start_.perf, now.perf);
+    main_totals.wall_ns += now.wall_ns - interval_start_.wall_ns;
+    main_totals.cpu_ns += now.cpu_ns - interval_start_.cpu_ns;
+    addPerf(main_totals.perf, delta);
+}
+
+void Metrics::openInterval() {
+    current_phase_.store(int(phase_stack_.back()), std::memory_order_relaxed);
+    interval_process_cpu_ns_ = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    interval_start_ = sampleThread();
+}
+
+void Metrics::beginPhase(MetricsPhase phase) {
+    if (!phase_stack_.empty())
+        closeInterval();
+    phase_stack_.push_back(phase);
+    ++phases_[int(phase)].calls;
+    ++main_thread_.phases[int(phase)].calls;
+    openInterval();
+}
+
+void Metrics::endPhase() {
+    closeInterval();
+    phase_stack_.pop_back();
+    if (phase_stack_.empty())
+        current_phase_.store(-1, std::memory_order_relaxed);
+    else
+        openInterval();
+}
+
+void Metrics::addWorkerJob(int worker, const ThreadSample& start, const ThreadSample& end) {
+    int phase = current_phase_.load(std::memory_order_relaxed);
+    if (phase < 0)
+        return;                     // pool work outside any phase
+
+    PerfSample delta = perfDelta(start.perf, end.perf);
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    if (workers_.size() <= size_t(worker))
+        workers_.resize(size_t(worker) + 1);
+    PhaseTotals& totals = workers_[worker].phases[phase];
+    ++totals.calls;
+    totals.wall_ns += end.wall_ns - start.wall_ns;
+    totals.cpu_ns += end.cpu_ns - start.cpu_ns;
+    addPerf(totals.perf, delta);
+}
+
+bool Metrics::perfAvailable() const {
+    return PerfGroup::available.load(std::memory_order_relaxed);
+}
+
+bool Metrics::writeJson(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    out << std::fixed << std::setprecision(3);
+
+    // Phase totals: wall time of the main thread, CPU time of the whole process and
+    // hardware counters of the main thread plus the pool workers
+    out << "{\n  \"perf_counters_available\": " << (perfAvailable() ? "true" : "false") << ",\n  \"phases\": {\n";
+    for (int phase = 0; phase < int(MetricsPhase::Count); ++phase) {
+        const PhaseTotals& totals = phases_[phase];
+        PerfSample perf = main_thread_.phases[phase].perf;
+        for (const ThreadTotals& worker : workers_)
+            addPerf(perf, worker.phases[phase].perf);
+        out << "    \"" << PHASE_NAMES[phase] << "\": {\"calls\": " << totals.calls
+            << ", \"wall_ms\": " << double(totals.wall_ns) / 1e6 << ", \"cpu_ms\": " << double(totals.cpu_ns) / 1e6;
+        writePerf(out, perf);
+        out << "}" << (phase + 1 < int(MetricsPhase::Count) ? ",\n" : "\n");
+    }
+
+    out << "  },\n  \"threads\": [\n";
+    auto writeThread = [&](const std::string& name, const ThreadTotals& thread, bool last) {
+        out << "    {\"thread\": \"" << name << "\", \"phases\": {";
+        for (int phase = 0; phase < int(MetricsPhase::Count); ++phase) {
+            const PhaseTotals& totals = thread.phases[phase];
+            out << (phase ? ", " : "") << "\"" << PHASE_NAMES[phase] << "\": {\"calls\": " << totals.calls
+                << ", \"wall_ms\": " << double(totals.wall_ns) / 1e6 << ", \"cpu_ms\": " << double(totals.cpu_ns) / 1e6;
+            writePerf(out, totals.perf);
+            out << "}";
+        }
+        out << "}}" << (last ? "\n" : ",\n");
+    };
+    writeThread("main", main_thread_, workers_.empty());
+    for (size_t worker = 0; worker < workers_.size(); ++worker)
+        writeThread("worker " + std::to_string(worker), workers_[worker], worker + 1 == workers_.size());
+
+    out << "  ],\n  \"counters\": {\n";
+    for (int counter = 0; counter < int(MetricsCounter::Count); ++counter)
+        out << "    \"" << COUNTER_NAMES[counter] << "\": " << counters_[counter].load(std::memory_order_relaxed)
+            << (counter + 1 < int(MetricsCounter::Count) ? ",\n" : "\n");
+    out << "  }\n}\n";
+
+    out.close();
+    return !out.fail();
+}
@@ -0,0 +1,244 @@
+#include "preprocess.hpp"
+#include "thread_pool.hpp"
+#include "tpch_date.hpp"
+#include <algorithm>
+
+
+// Rows per preprocess morsel, a whole number of zone map blocks
+constexpr size_t PREPROCESS_MORSEL_ROWS = 16 * ZONE_MAP_BLOCK_ROWS;
+
+// Fill entries with select(begin, end, out) over rows [0, num_rows). On a pool every morsel
+// collects into its own vector and the vectors are concatenated in row order, so the result
+// is the same as one sequential scan
+template <typename Select>
+void collectEntries(ThreadPool* pool, size_t num_rows, std::vector<JoinIndex::Entry>& entries, Select select) {
+    entries.clear();
+    if (!pool || num_rows <= PREPROCESS_MORSEL_ROWS) {
+        select(size_t(0), num_rows, entries);
+        return;
+    }
+
+    size_t num_morsels = (num_rows + PREPROCESS_MORSEL_ROWS - 1) / PREPROCESS_MORSEL_ROWS;
+    std::vector<std::vector<JoinIndex::Entry>> parts(num_morsels);
+    pool->parallelFor(num_morsels, [&](size_t morsel, int) {
+        size_t begin = morsel * PREPROCESS_MORSEL_ROWS;
+        select(begin, std::min(begin + PREPROCESS_MORSEL_ROWS, num_rows), parts[morsel]);
+    });
+
+    appendConcatenated(pool, parts, entries);
+}
+
+
+// Preprocess involved tables to filter and create lookup structures for efficient query execution.
+// Returns false if a date is not in YYYY-MM-DD form
+bool preprocess(
+    const std::string& regionName,                           // Region filter name
+    const std::string& startDate,                            // Start date filter for orders (inclusive)
+    const std::string& endDate,                              // End date filter for orders (exclusive)
+    const std::vector<Customer>& customer_data,
+    const std::vector<Orders>& orders_data,
+    const std::vector<Supplier>& supplier_data,
+    const std::vector<Nation>& nation_data,
+    const std::vector<Region>& region_data,
+    const DateZoneMap* orders_zone_map,                      // Optional block min/max of O_ORDERDATE
+    PreprocessedData& processed_data,
+    ThreadPool* pool,
+    bool index_orders)
+{
+    std::vector<JoinIndex::Entry> entries;
+
+    // Convert the date range once, orders are then filtered with integer compares
+    if (!parseDate(startDate, processed_data.startDay) || !parseDate(endDate, processed_data.endDay))
+        return false;
+    const int startDay = processed_data.startDay;
+    const int endDay = processed_data.endDay;
+
+    // Select region keys matching the given region name
+    for (const Region& r : region_data)
+        if (r.R_NAME == regionName)
+            processed_data.regionKeys.push_back(r.R_REGIONKEY);
+
+    // Select nations belonging to the filtered regions, numbering them and recording their names
+    for (const Nation& n : nation_data)
+        if (std::find(processed_data.regionKeys.begin(), processed_data.regionKeys.end(), n.N_REGIONKEY)
+                != processed_data.regionKeys.end()
+            && processed_data.nationNames.size() < INT8_MAX) {
+            entries.push_back({n.N_NATIONKEY, int8_t(processed_data.nationNames.size())});
+            processed_data.nationNames.push_back(n.N_NAME);
+        }
+    processed_data.nationCodes.build(entries, nation_data.size());
+
+    // Select customers belonging to the selected nations and map customer -> nation code
+    collectEntries(pool, customer_data.size(), entries, [&](size_t begin, size_t end, std::vector<JoinIndex::Entry>& out) {
+        for (size_t row = begin; row < end; ++row) {
+            const Customer& c = customer_data[row];
+            int8_t code = processed_data.nationCodes.find(c.C_NATIONKEY);
+            if (code != JoinIndex::NOT_FOUND)
+                out.push_back({c.C_CUSTKEY, code});
+        }
+    });
+    processed_data.customerToNation.build(entries, customer_data.size(), pool);
+
+    // Select orders placed within the date range by filtered customers;
+    // map order -> customer's nation code for fast lookup.
+    // With a zone map, blocks entirely outside the range are skipped without touching their
+    // rows and blocks entirely inside it skip the per-row date compare
+    if (index_orders) {
+        collectEntries(pool, orders_data.size(), entries, [&](size_t begin, size_t end, std::vector<JoinIndex::Entry>& out) {
+            for (size_t block_start = begin; block_start < end; block_start += ZONE_MAP_BLOCK_ROWS) {
+                size_t block = block_start / ZONE_MAP_BLOCK_ROWS;
+                size_t block_end = std::min(block_start + ZONE_MAP_BLOCK_ROWS, end);
+                if (orders_zone_map && blockOutsideRange(*orders_zone_map, block, startDay, endDay))
+                    continue;
+                bool check_dates = !orders_zone_map || !blockInsideRange(*orders_zone_map, block, startDay, endDay);
+
+                for (size_t row = block_start; row < block_end; ++row) {
+                    const Orders& o = orders_data[row];
+                    if (check_dates && (o.O_ORDERDATE < startDay || o.O_ORDERDATE >= endDay))
+                        continue;
+                    int8_t code = processed_data.customerToNation.find(o.O_CUSTKEY);
+                    if (code != JoinIndex::NOT_FOUND)
+                        out.push_back({o.O_ORDERKEY, code});
+                }
+            }
+        });
+        processed_data.orderToCustomerNation.build(entries, orders_data.size(), pool);
+        processed_data.lineitemFilter.orders.build(entries, orders_data.size(), pool);
+    }
+
+    // Select suppliers in the filtered nations and map supplier -> nation code
+    collectEntries(pool, supplier_data.size(), entries, [&](size_t begin, size_t end, std::vector<JoinIndex::Entry>& out) {
+        for (size_t row = begin; row < end; ++row) {
+            const Supplier& s = supplier_data[row];
+            int8_t code = processed_data.nationCodes.find(s.S_NATIONKEY);
+            if (code != JoinIndex::NOT_FOUND)
+                out.push_back({s.S_SUPPKEY, code});
+        }
+    });
+    processed_data.supplierToNation.build(entries, supplier_data.size(), pool);
+    processed_data.lineitemFilter.suppliers.build(entries, supplier_data.size(), pool);
+
+    processed_data.ordersIndexed = index_orders;
+    return true;
+}
+
+
+// Build the combined annotation of a batch of queries, see BatchPreprocessedData
+bool preprocessBatch(
+    const std::vector<Query5Parameters>& queries,
+    const std::vector<Customer>& customer_data,
+    const std::vector<Orders>& orders_data,
+    const std::vector<Supplier>& supplier_data,
+    const std::vector<Nation>& nation_data,
+    const std::vector<Region>& region_data,
+    const DateZoneMap* orders_zone_map,
+    BatchPreprocessedData& batch_data,
+    ThreadPool* pool)
+{
+    if (queries.empty() || queries.size() > MAX_BATCH_QUERIES)
+        return false;
+
+    // Date ranges as day numbers, their union and the segment boundaries
+    std::vector<int> startDays(queries.size()), endDays(queries.size());
+    for (size_t q = 0; q < queries.size(); ++q) {
+        if (!parseDate(queries[q].start_date, startDays[q]) || !parseDate(queries[q].end_date, endDays[q]))
+            return false;
+        batch_data.segmentStarts.push_back(startDays[q]);
+        batch_data.segmentStarts.push_back(endDays[q]);
+    }
+    std::vector<int>& bounds = batch_data.segmentStarts;
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    batch_data.minDay = bounds.front();
+    batch_data.maxDay = bounds.back();
+    const int minDay = batch_data.minDay;
+    const int maxDay = batch_data.maxDay;
+
+    // Queries covering each date segment
+    std::vector<uint64_t> segmentQueries(batch_data.numSegments(), 0);
+    for (size_t segment = 0; segment < segmentQueries.size(); ++segment)
+        for (size_t q = 0; q < queries.size(); ++q)
+            if (startDays[q] <= bounds[segment] && bounds[segment + 1] <= endDays[q])
+                segmentQueries[segment] |= uint64_t(1) << q;
+
+    // Number every nation of a queried region and record which queries ask for it
+    std::vector<JoinIndex::Entry> entries;
+    std::vector<uint64_t> nationQueries;
+    for (const Nation& n : nation_data) {
+        uint64_t mask = 0;
+        for (const Region& r : region_data)
+            if (r.R_REGIONKEY == n.N_REGIONKEY)
+                for (size_t q = 0; q < queries.size(); ++q)
+                    if (r.R_NAME == queries[q].r_name)
+                        mask |= uint64_t(1) << q;
+        if (mask != 0 && batch_data.nationNames.size() < INT8_MAX) {
+            entries.push_back({n.N_NATIONKEY, int8_t(batch_data.nationNames.size())});
+            batch_data.nationNames.push_back(n.N_NAME);
+            nationQueries.push_back(mask);
+        }
+    }
+    JoinIndex nationCodes;
+    nationCodes.build(entries, nation_data.size());
+
+    batch_data.queryMasks.assign(nationQueries.size() * batch_data.numSegments(), 0);
+    for (size_t code = 0; code < nationQueries.size(); ++code)
+        for (size_t segment = 0; segment < segmentQueries.size(); ++segment)
+            batch_data.queryMasks[code * batch_data.numSegments() + segment] = nationQueries[code] & segmentQueries[segment];
+
+    // Customers in any of the nations
+    collectEntries(pool, customer_data.size(), entries, [&](size_t begin, size_t end, std::vector<JoinIndex::Entry>& out) {
+        for (size_t row = begin; row < end; ++row) {
+            int8_t code = nationCodes.find(customer_data[row].C_NATIONKEY);
+            if (code != JoinIndex::NOT_FOUND)
+                out.push_back({customer_data[row].C_CUSTKEY, code});
+        }
+    });
+    JoinIndex customerToNation;
+    customerToNation.build(entries, customer_data.size(), pool);
+
+    // Orders that belong to at least one query: the segment of their date must be covered by
+    // a query on their customer's nation. Each one adds a (key, code) entry directly followed
+    // by a (key, segment) entry, so both indexes come from one scan and are split apart below
+    collectEntries(pool, orders_data.size(), entries, [&](size_t begin, size_t end, std::vector<JoinIndex::Entry>& out) {
+        for (size_t block_start = begin; block_start < end; block_start += ZONE_MAP_BLOCK_ROWS) {
+            size_t block = block_start / ZONE_MAP_BLOCK_ROWS;
+            size_t block_end = std::min(block_start + ZONE_MAP_BLOCK_ROWS, end);
+            if (orders_zone_map && blockOutsideRange(*orders_zone_map, block, minDay, maxDay))
+                continue;
+
+            for (size_t row = block_start; row < block_end; ++row) {
+                const Orders& o = orders_data[row];
+                if (o.O_ORDERDATE < minDay || o.O_ORDERDATE >= maxDay)
+                    continue;
+                int8_t code = customerToNation.find(o.O_CUSTKEY);
+                if (code == JoinIndex::NOT_FOUND)
+                    continue;
+                int8_t segment = int8_t(std::upper_bound(bounds.begin(), bounds.end(), o.O_ORDERDATE) - bounds.begin() - 1);
+                if (batch_data.queryMask(code, segment) != 0) {
+                    out.push_back({o.O_ORDERKEY, code});
+                    out.push_back({o.O_ORDERKEY, segment});
+                }
+            }
+        }
+    });
+    std::vector<JoinIndex::Entry> segment_entries(entries.size() / 2);
+    for (size_t i = 0; i < segment_entries.size(); ++i) {
+        segment_entries[i] = entries[2 * i + 1];
+        entries[i] = entries[2 * i];
+    }
+    entries.resize(segment_entries.size());
+    batch_data.orderToCustomerNation.build(entries, orders_data.size(), pool);
+    batch_data.orderToDateSegment.build(segment_entries, orders_data.size(), pool);
+
+    // Suppliers in any of the nations
+    collectEntries(pool, supplier_data.size(), entries, [&](size_t begin, size_t end, std::vector<JoinIndex::Entry>& out) {
+        for (size_t row = begin; row < end; ++row) {
+            int8_t code = nationCodes.find(supplier_data[row].S_NATIONKEY);
+            if (code != JoinIndex::NOT_FOUND)
+                out.push_back({supplier_data[row].S_SUPPKEY, code});
+        }
+    });
+    batch_data.supplierToNation.build(entries, supplier_data.size(), pool);
+
+    return true;
+}
@@ -0,0 +1,330 @@
+#include "probe_kernels.hpp"
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TPCH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// Up to this many codes the vector kernels keep one accumulator register pair per code;
+// beyond it matching lanes are added one by one
+constexpr int MAX_VECTOR_CODES = 8;
+
+// The vector kernels add revenues into 64-bit lanes and move them to the 128-bit sums every
+// FLUSH_ROWS rows. No lane then takes more than 64 revenues, each below 10^17 for any
+// DECIMAL(15,2) price with a discount between 0 and 1, so lanes stay below 2^63.
+constexpr size_t FLUSH_ROWS = 512;
+
+inline int8_t lookupCode(const DenseCodeArray& array, int key) {
+    uint32_t slot = uint32_t(key) - uint32_t(array.min_key);
+    return slot < array.size ? array.codes[slot] : int8_t(-1);
+}
+
+// Reference kernel, also used for the rows left over after the last full vector
+void probeScalar(
+    const DenseCodeArray& order_codes,
+    const DenseCodeArray& supplier_codes,
+    const LineItemColumnRange& columns,
+    size_t begin_row,
+    RevenueSum* revenue_by_code)
+{
+    for (size_t row = begin_row; row < columns.rows; ++row) {
+        int8_t cust_code = lookupCode(order_codes, columns.order_keys[row]);
+        if (cust_code < 0) continue;
+        if (cust_code != lookupCode(supplier_codes, columns.supp_keys[row])) continue;
+        revenue_by_code[cust_code] += lineItemRevenue(columns.prices[row], columns.discounts[row]);
+    }
+}
+
+#ifdef TPCH_X86_KERNELS
+
+// ---------------- AVX2: 8 rows per iteration ----------------
+// Codes are fetched with 32-bit gathers at byte granularity and sign extended from the low byte
+
+// Low 64 bits of a * b per lane; AVX2 only multiplies 32-bit halves
+__attribute__((target("avx2")))
+inline __m256i mulLow64Avx2(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                     _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+void flushAvx2(__m256i (*accumulators)[2], int num_codes, RevenueSum* revenue_by_code) {
+    for (int code = 0; code < num_codes; ++code) {
+        alignas(32) int64_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), accumulators[code][0]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + 4), accumulators[code][1]);
+        for (int64_t lane : lanes)
+            revenue_by_code[code] += lane;
+        accumulators[code][0] = accumulators[code][1] = _mm256_setzero_si256();
+    }
+}
+
+__attribute__((target("avx2")))
+void probeAvx2(
+    const DenseCodeArray& order_codes,
+    const DenseCodeArray& supplier_codes,
+    const LineItemColumnRange& columns,
+    int num_codes,
+    RevenueSum* revenue_by_code)
+{
+    const __m256i minus_one = _mm256_set1_epi32(-1);
+    const __m256i order_min = _mm256_set1_epi32(order_codes.min_key);
+    const __m256i order_size = _mm256_set1_epi32(int(order_codes.size));
+    const __m256i supplier_min = _mm256_set1_epi32(supplier_codes.min_key);
+    const __m256i supplier_size = _mm256_set1_epi32(int(supplier_codes.size));
+    const __m256i scale = _mm256_set1_epi32(DECIMAL_SCALE);
+    const bool vector_codes = num_codes <= MAX_VECTOR_CODES;
+
+    __m256i accumulators[MAX_VECTOR_CODES][2];
+    for (int code = 0; code < MAX_VECTOR_CODES; ++code)
+        accumulators[code][0] = accumulators[code][1] = _mm256_setzero_si256();
+
+    size_t row = 0;
+    for (; row + 8 <= columns.rows; row += 8) {
+        if (vector_codes && row % FLUSH_ROWS == 0 && row != 0)
+            flushAvx2(accumulators, num_codes, revenue_by_code);
+
+        // Customer nation code per lane, -1 for keys outside the array or filtered out
+        __m256i order_slot = _mm256_sub_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns.order_keys + row)), order_min);
+        __m256i order_in_range = _mm256_and_si256(_mm256_cmpgt_epi32(order_slot, minus_one),
+                                                  _mm256_cmpgt_epi32(order_size, order_slot));
+        __m256i cust_code = _mm256_mask_i32gather_epi32(minus_one, reinterpret_cast<const int*>(order_codes.codes),
+                                                        order_slot, order_in_range, 1);
+        cust_code = _mm256_srai_epi32(_mm256_slli_epi32(cust_code, 24), 24);
+        __m256i valid = _mm256_cmpgt_epi32(cust_code, minus_one);
+        if (_mm256_testz_si256(valid, valid))
+            continue;                               // Most vectors end here: no qualifying order
+
+        // Supplier nation code, only gathered for lanes that still qualify
+        __m256i supplier_slot = _mm256_sub_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns.supp_keys + row)), supplier_min);
+        __m256i supplier_in_range = _mm256_and_si256(valid,
+            _mm256_and_si256(_mm256_cmpgt_epi32(supplier_slot, minus_one),
+                             _mm256_cmpgt_epi32(supplier_size, supplier_slot)));
+        __m256i supp_code = _mm256_mask_i32gather_epi32(minus_one, reinterpret_cast<const int*>(supplier_codes.codes),
+                                                        supplier_slot, supplier_in_range, 1);
+        supp_code = _mm256_srai_epi32(_mm256_slli_epi32(supp_code, 24), 24);
+
+        __m256i match = _mm256_and_si256(valid, _mm256_cmpeq_epi32(cust_code, supp_code));
+        if (_mm256_testz_si256(match, match))
+            continue;
+
+        // price * (100 - discount) for the low and high four lanes
+        __m256i multiplier = _mm256_sub_epi32(scale, _mm256_cvtepi16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns.discounts + row))));
+        __m256i revenue_low = mulLow64Avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns.prices + row)),
+                                           _mm256_cvtepi32_epi64(_mm256_castsi256_si128(multiplier)));
+        __m256i revenue_high = mulLow64Avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns.prices + row + 4)),
+                                            _mm256_cvtepi32_epi64(_mm256_extracti128_si256(multiplier, 1)));
+
+        if (vector_codes) {
+            // Masked add of each lane into its code's accumulators
+            for (int code = 0; code < num_codes; ++code) {
+                __m256i lanes = _mm256_and_si256(match, _mm256_cmpeq_epi32(cust_code, _mm256_set1_epi32(code)));
+                if (_mm256_testz_si256(lanes, lanes))
+                    continue;
+                __m256i mask_low = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(lanes));
+                __m256i mask_high = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(lanes, 1));
+                accumulators[code][0] = _mm256_add_epi64(accumulators[code][0], _mm256_and_si256(revenue_low, mask_low));
+                accumulators[code][1] = _mm256_add_epi64(accumulators[code][1], _mm256_and_si256(revenue_high, mask_high));
+            }
+        } else {
+            alignas(32) int codes[8];
+            alignas(32) int64_t revenue[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(codes), cust_code);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(revenue), revenue_low);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(revenue + 4), revenue_high);
+            for (int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(match)); lanes; lanes &= lanes - 1) {
+                int lane = __builtin_ctz(lanes);
+                revenue_by_code[codes[lane]] += revenue[lane];
+            }
+        }
+    }
+
+    if (vector_codes)
+        flushAvx2(accumulators, num_codes, revenue_by_code);
+
+    probeScalar(order_codes, supplier_codes, columns, row, revenue_by_code);
+}
+
+// ---------------- AVX-512: 16 rows per iteration ----------------
+// GCC 12 reports the _mm512_undefined_* operands its own intrinsics (shifts, multiplies,
+// conversions) start from as maybe uninitialized once they are inlined here; no value of ours is
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// Low 64 bits of a * b per lane; 64-bit multiplies need AVX512DQ, so build them from 32-bit halves
+__attribute__((target("avx512f")))
+inline __m512i mulLow64Avx512(__m512i a, __m512i b) {
+    __m512i cross = _mm512_add_epi64(_mm512_mul_epu32(_mm512_srli_epi64(a, 32), b),
+                                     _mm512_mul_epu32(a, _mm512_srli_epi64(b, 32)));
+    return _mm512_add_epi64(_mm512_mul_epu32(a, b), _mm512_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx512f")))
+void flushAvx512(__m512i (*accumulators)[2], int num_codes, RevenueSum* revenue_by_code) {
+    for (int code = 0; code < num_codes; ++code) {
+        alignas(64) int64_t lanes[16];
+        _mm512_store_si512(lanes, accumulators[code][0]);
+        _mm512_store_si512(lanes + 8, accumulators[code][1]);
+        for (int64_t lane : lanes)
+            revenue_by_code[code] += lane;
+        accumulators[code][0] = accumulators[code][1] = _mm512_setzero_si512();
+    }
+}
+
+__attribute__((target("avx512f")))
+void probeAvx512(
+    const DenseCodeArray& order_codes,
+    const DenseCodeArray& supplier_codes,
+    const LineItemColumnRange& columns,
+    int num_codes,
+    RevenueSum* revenue_by_code)
+{
+    const __m512i minus_one = _mm512_set1_epi32(-1);
+    const __m512i order_min = _mm512_set1_epi32(order_codes.min_key);
+    const __m512i order_size = _mm512_set1_epi32(int(order_codes.size));
+    const __m512i supplier_min = _mm512_set1_epi32(supplier_codes.min_key);
+    const __m512i supplier_size = _mm512_set1_epi32(int(supplier_codes.size));
+    const __m512i scale = _mm512_set1_epi32(DECIMAL_SCALE);
+    const bool vector_codes = num_codes <= MAX_VECTOR_CODES;
+
+    __m512i accumulators[MAX_VECTOR_CODES][2];
+    for (int code = 0; code < MAX_VECTOR_CODES; ++code)
+        accumulators[code][0] = accumulators[code][1] = _mm512_setzero_si512();
+
+    size_t row = 0;
+    for (; row + 16 <= columns.rows; row += 16) {
+        if (vector_codes && row % FLUSH_ROWS == 0 && row != 0)
+            flushAvx512(accumulators, num_codes, revenue_by_code);
+
+        __m512i order_slot = _mm512_sub_epi32(_mm512_loadu_si512(columns.order_keys + row), order_min);
+        __mmask16 order_in_range = _mm512_cmplt_epu32_mask(order_slot, order_size);
+        __m512i cust_code = _mm512_mask_i32gather_epi32(minus_one, order_in_range, order_slot, order_codes.codes, 1);
+        cust_code = _mm512_srai_epi32(_mm512_slli_epi32(cust_code, 24), 24);
+        __mmask16 valid = _mm512_cmpgt_epi32_mask(cust_code, minus_one);
+        if (!valid)
+            continue;
+
+        __m512i supplier_slot = _mm512_sub_epi32(_mm512_loadu_si512(columns.supp_keys + row), supplier_min);
+        __mmask16 supplier_in_range = _mm512_mask_cmplt_epu32_mask(valid, supplier_slot, supplier_size);
+        __m512i supp_code = _mm512_mask_i32gather_epi32(minus_one, supplier_in_range, supplier_slot, supplier_codes.codes, 1);
+        supp_code = _mm512_srai_epi32(_mm512_slli_epi32(supp_code, 24), 24);
+
+        __mmask16 match = _mm512_mask_cmpeq_epi32_mask(valid, cust_code, supp_code);
+        if (!match)
+            continue;
+
+        __m512i multiplier = _mm512_sub_epi32(scale, _mm512_cvtepi16_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns.discounts + row))));
+        __m512i revenue_low = mulLow64Avx512(_mm512_loadu_si512(columns.prices + row),
+                                             _mm512_cvtepi32_epi64(_mm512_castsi512_si256(multiplier)));
+        __m512i revenue_high = mulLow64Avx512(_mm512_loadu_si512(columns.prices + row + 8),
+                                              _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(multiplier, 1)));
+
+        if (vector_codes) {
+            for (int code = 0; code < num_codes; ++code) {
+                __mmask16 lanes = _mm512_mask_cmpeq_epi32_mask(match, cust_code, _mm512_set1_epi32(code));
+                if (!lanes)
+                    continue;
+                accumulators[code][0] = _mm512_mask_add_epi64(accumulators[code][0], __mmask8(lanes),
+                                                              accumulators[code][0], revenue_low);
+                accumulators[code][1] = _mm512_mask_add_epi64(accumulators[code][1], __mmask8(lanes >> 8),
+                                                              accumulators[code][1], revenue_high);
+            }
+        } else {
+            alignas(64) int codes[16];
+            alignas(64) int64_t revenue[16];
+            _mm512_store_si512(codes, cust_code);
+            _mm512_store_si512(revenue, revenue_low);
+            _mm512_store_si512(revenue + 8, revenue_high);
+            for (unsigned lanes = match; lanes; lanes &= lanes - 1) {
+                int lane = __builtin_ctz(lanes);
+                revenue_by_code[codes[lane]] += revenue[lane];
+            }
+        }
+    }
+
+    if (vector_codes)
+        flushAvx512(accumulators, num_codes, revenue_by_code);
+
+    probeScalar(order_codes, supplier_codes, columns, row, revenue_by_code);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // TPCH_X86_KERNELS
+
+} // namespace
+
+
+SimdLevel detectSimdLevel() {
+#ifdef TPCH_X86_KERNELS
+    static const SimdLevel level = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return SimdLevel::Avx512;
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::Avx2;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel resolveSimdLevel(SimdLevel requested) {
+    SimdLevel supported = detectSimdLevel();
+    if (requested == SimdLevel::Auto || int(requested) > int(supported))
+        return supported;
+    return requested;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Auto: return "auto";
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+void probeAggregate(
+    SimdLevel level,
+    const DenseCodeArray& order_codes,
+    const DenseCodeArray& supplier_codes,
+    const LineItemColumnRange& columns,
+    int num_codes,
+    RevenueSum* revenue_by_code)
+{
+    // Empty arrays cannot match, and the vector kernels compare slots as signed 32-bit values
+    if (order_codes.size == 0 || supplier_codes.size == 0)
+        return;
+    if (order_codes.size > INT32_MAX || supplier_codes.size > INT32_MAX)
+        level = SimdLevel::Scalar;
+
+    switch (resolveSimdLevel(level)) {
+#ifdef TPCH_X86_KERNELS
+        case SimdLevel::Avx512:
+            probeAvx512(order_codes, supplier_codes, columns, num_codes, revenue_by_code);
+            return;
+        case SimdLevel::Avx2:
+            probeAvx2(order_codes, supplier_codes, columns, num_codes, revenue_by_code);
+            return;
+#endif
+        default:
+            probeScalar(order_codes, supplier_codes, columns, 0, revenue_by_code);
+    }
+}
@@ -1,11 +1,32 @@
 #include "query5.hpp"
+#include "compressed_columns.hpp"
+#include "cpu_topology.hpp"
+#include "group_aggregate.hpp"
+#include "join_index.hpp"
+#include "mapped_file.hpp"
+#include "metrics.hpp"
+#include "pipeline.hpp"
+#include "preprocess.hpp"
+#include "table_input.hpp"
+#include "table_scan.hpp"
+#include "spill_file.hpp"
+#include "table_snapshot.hpp"
+#include "tbl_parser.hpp"
+#include "thread_pool.hpp"
 #include <iostream>
 #include <fstream>
-#include <thread>
 #include <vector>
-#include <unordered_set>
-#include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <climits>
+#include <bit>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <utility>
 
 
 // Helper function to check if a string is numeric (all digits)
@@ -25,23 +46,62 @@ bool isNumber(const std::string& s) {
     return true;
 }
 
+// Parse a byte count with an optional K, M or G suffix (powers of 1024), e.g. 512M
+bool parseByteSize(const std::string& s, size_t& bytes) {
+    size_t digits = 0;
+    while (digits < s.size() && s[digits] >= '0' && s[digits] <= '9')
+        ++digits;
+    if (digits == 0 || digits > 18 || s.size() > digits + 1)
+        return false;
+
+    int shift = 0;
+    if (s.size() > digits) {
+        switch (s[digits]) {
+        case 'K': case 'k': shift = 10; break;
+        case 'M': case 'm': shift = 20; break;
+        case 'G': case 'g': shift = 30; break;
+        default: return false;
+        }
+    }
+    unsigned long long value = std::stoull(s.substr(0, digits));
+    if (value > (SIZE_MAX >> shift))
+        return false;                       // does not fit in size_t
+    bytes = size_t(value) << shift;
+    return true;
+}
+
 // Function to parse command line arguments
 // Example expected arguments:
 // --r_name ASIA --start_date 1994-01-01 --end_date 1995-01-01 --threads 4 --table_path /path --result_path /output
+// Optional: --loader mmap|stream|async --cache_dir /path/to/snapshots --execution materialize|stream
+//           --layout rows|columns|compressed --simd auto|avx512|avx2|scalar --pushdown on|off
+//           --join auto|index|merge|radix
+//           --serve /path/to/socket|-   (query parameters then come from the socket or stdin)
+//           --batch_file /path/to/queries   (query parameters then come from the file)
+//           --cube_path /path/to/cube --refresh N --result_cache /path/to/results
+//           --metrics_path /path/to/metrics.json --affinity compact|scatter|0-3,8-11
+//           --memory_limit 512M --spill_dir /path/to/scratch
+//           --query 5|7|10 --nation1 FRANCE --nation2 GERMANY   (Q7 nations; Q10 reads --start_date)
+// Fails on unknown options and on options the chosen mode (--query 7/10, --serve, --batch_file,
+// --result_cache) does not implement
 bool parseArgs(int argc, char* argv[], 
                std::string& r_name,        // region name
                std::string& start_date,    // query start date
                std::string& end_date,      // query end date
                int& num_threads,           // number of threads to use
                std::string& table_path,    // input data directory
-               std::string& result_path)   // output file path
+               std::string& result_path,   // output file path
+               ExecutionOptions& options)  // optional execution settings
 {
+    std::vector<std::string> given_keys;    // Options present on the command line, for the mode checks below
+
     // Loop over arguments in pairs: option name and its value
     for (int argument_index = 1; argument_index < argc; argument_index += 2) {
         if (argument_index + 1 >= argc) break;  // prevent reading beyond argc
 
         std::string key = argv[argument_index];        // current option name
         std::string val = argv[argument_index + 1];    // current option value
+        given_keys.push_back(key);
 
         // Match keys to parameters
         if (key == "--r_name") 
@@ -53,14 +113,128 @@ bool parseArgs(int argc, char* argv[],
         else if (key == "--threads") {
             if(!isNumber(val)) return false;         // not a valid thread count
             num_threads = std::stoi(val);            // convert thread count string to integer
+            if (num_threads < 1) return false;       // at least one worker is required
         }
         else if (key == "--table_path") 
             table_path = val;
         else if (key == "--result_path") 
             result_path = val;
+        else if (key == "--cache_dir")
+            options.cache_dir = val;
+        else if (key == "--execution") {
+            if (val == "materialize")
+                options.execution_mode = ExecutionMode::Materialize;
+            else if (val == "stream")
+                options.execution_mode = ExecutionMode::Streaming;
+            else
+                return false;                        // unknown execution mode
+        }
+        else if (key == "--layout") {
+            if (val == "rows")
+                options.lineitem_layout = LineItemLayout::Rows;
+            else if (val == "columns")
+                options.lineitem_layout = LineItemLayout::Columns;
+            else if (val == "compressed")
+                options.lineitem_layout = LineItemLayout::Compressed;
+            else
+                return false;                        // unknown lineitem layout
+        }
+        else if (key == "--join") {
+            if (val == "auto")
+                options.join_strategy = JoinStrategy::Auto;
+            else if (val == "index")
+                options.join_strategy = JoinStrategy::Index;
+            else if (val == "merge")
+                options.join_strategy = JoinStrategy::Merge;
+            else if (val == "radix")
+                options.join_strategy = JoinStrategy::Radix;
+            else
+                return false;                        // unknown join strategy
+        }
+        else if (key == "--simd") {
+            if (val == "auto")
+                options.simd_level = SimdLevel::Auto;
+            else if (val == "avx512")
+                options.simd_level = SimdLevel::Avx512;
+            else if (val == "avx2")
+                options.simd_level = SimdLevel::Avx2;
+            else if (val == "scalar")
+                options.simd_level = SimdLevel::Scalar;
+            else
+                return false;                        // unknown instruction set
+        }
+        else if (key == "--loader") {
+            if (val == "mmap")
+                options.loader_mode = LoaderMode::Mmap;
+            else if (val == "stream")
+                options.loader_mode = LoaderMode::Stream;
+            else if (val == "async")
+                options.loader_mode = LoaderMode::Async;
+            else
+                return false;                        // unknown loader mode
+        }
+        else if (key == "--pushdown") {
+            if (val == "on")
+                options.pushdown_filter = true;
+            else if (val == "off")
+                options.pushdown_filter = false;
+            else
+                return false;                        // expected on or off
+        }
+        else if (key == "--serve")
+            options.serve_path = val;
+        else if (key == "--batch_file")
+            options.batch_file = val;
+        else if (key == "--cube_path")
+            options.cube_path = val;
+        else if (key == "--result_cache")
+            options.result_cache = val;
+        else if (key == "--refresh") {
+            if (!isNumber(val)) return false;        // not a valid refresh set number
+            options.refresh_set = std::stoi(val);
+            if (options.refresh_set < 1) return false;  // dbgen numbers refresh sets from 1
+        }
+        else if (key == "--metrics_path")
+            options.metrics_path = val;
+        else if (key == "--affinity") {
+            std::vector<int> cpus;
+            if (!affinityCpus(val, cpus)) return false;     // unknown mode or unavailable CPU
+            options.affinity = val;
+        }
+        else if (key == "--memory_limit") {
+            if (!parseByteSize(val, options.memory_limit)) return false;   // expected bytes with an optional K, M or G
+        }
+        else if (key == "--spill_dir")
+            options.spill_dir = val;
+        else if (key == "--query") {
+            if (val != "5" && val != "7" && val != "10") return false;     // unsupported query
+            options.query = std::stoi(val);
+        }
+        else if (key == "--nation1")
+            options.nation1 = val;
+        else if (key == "--nation2")
+            options.nation2 = val;
         else
             return false;  // unknown argument key - invalid input
     }
+
+    // Reject flags the chosen mode does not implement instead of ignoring them
+    auto givenAny = [&](std::initializer_list<const char*> keys) {
+        for (const char* key : keys)
+            if (std::find(given_keys.begin(), given_keys.end(), key) != given_keys.end())
+                return true;
+        return false;
+    };
+    if (options.query != 5 && givenAny({"--layout", "--simd", "--join", "--pushdown", "--execution", "--serve",
+                                        "--batch_file", "--cube_path", "--refresh", "--result_cache", "--memory_limit"}))
+        return false;   // Q7 and Q10 always run as pipelines over the text tables
+    if (!options.serve_path.empty() && givenAny({"--execution", "--pushdown", "--batch_file", "--cube_path",
+                                                 "--result_cache", "--memory_limit"}))
+        return false;   // the server keeps every table resident for any query
+    if (!options.batch_file.empty() && givenAny({"--join", "--execution", "--pushdown", "--memory_limit", "--result_cache"}))
+        return false;   // the batch scan has its own join and loads lineitem whole
+    if (!options.result_cache.empty() && givenAny({"--join", "--execution", "--pushdown", "--memory_limit", "--cube_path"}))
+        return false;   // cache misses are computed by the batch scan, outside any memory budget
     return true;  // all arguments processed successfully
 }
 
@@ -84,11 +258,21 @@ std::vector<std::string> splitStringByDelimiter(const std::string& input, char d
     return tokens;
 }
 
+// Rough bytes per row of dbgen output, used to reserve vector capacity up front and to
+// estimate memory use from file sizes for --memory_limit
+constexpr size_t ORDERS_BYTES_PER_ROW = 110;
+constexpr size_t LINEITEM_BYTES_PER_ROW = 125;
+constexpr size_t CUSTOMER_BYTES_PER_ROW = 160;
+constexpr size_t SUPPLIER_BYTES_PER_ROW = 140;
+
+// Bytes of a dbgen lineitem row in CompressedLineItems with some headroom; they pack into about 6
+constexpr size_t COMPRESSED_LINEITEM_BYTES = 8;
+
 // ---------------- Sequential Loaders for smaller tables ----------------
 
 // Function to load the Region table from a file into a vector of Region structs
 bool loadRegion(const std::string &filepath, std::vector<Region> &region_data) {
-    std::ifstream file(filepath);  // Open the file for reading
+    TableTextStream file(filepath);  // Open the file for reading, decompressing .gz and .zst tables
 
     if (!file.is_open())            
         return false;               // Error Opening File
@@ -109,12 +293,12 @@ bool loadRegion(const std::string &filepath, std::vector<Region> &region_data) {
         region_data.emplace_back(std::stoi(tokens[0]), tokens[1]);
     }
 
-    return true;                    // Return true if loading succeeded
+    return !file.bad();             // Return true if loading succeeded, false if a compressed table is damaged
 }
 
 // Function to load the Nation table from a file into a vector of Nation structs
 bool loadNation(const std::string &filepath, std::vector<Nation> &nation_data) {
-    std::ifstream file(filepath);  // Open the file for reading
+    TableTextStream file(filepath);  // Open the file for reading, decompressing .gz and .zst tables
 
     if (!file.is_open())            
         return false;               // Error Opening File
@@ -132,12 +316,12 @@ bool loadNation(const std::string &filepath, std::vector<Nation> &nation_data) {
         // convert and push INTEGER N_NATIONKEY, STRING N_NAME, INTEGER N_REGIONKEY
         nation_data.emplace_back(std::stoi(tokens[0]), tokens[1], std::stoi(tokens[2]));
     }
-    return true;                  // Return true if loading succeeded
+    return !file.bad();           // Return true if loading succeeded, false if a compressed table is damaged
 }
 
 // Function to load the Customer table from a file into a vector of Customer structs
 bool loadCustomer(const std::string &filepath, std::vector<Customer> &customer_data) {
-    std::ifstream file(filepath);  // Open the file for reading
+    TableTextStream file(filepath);  // Open the file for reading, decompressing .gz and .zst tables
 
     if (!file.is_open())            
         return false;               // Error Opening File
@@ -157,12 +341,12 @@ bool loadCustomer(const std::string &filepath, std::vector<Customer> &customer_d
         
         customer_data.emplace_back(std::stoi(tokens[0]), std::stoi(tokens[3])); //convert and push INTEGER C_CUSTKEY, INTEGER C_NATIONKEY
     }
-    return true;
+    return !file.bad();             // A damaged compressed table sets badbit
 }
 
 // Function to load the Supplier table from a file into a vector of Supplier structs
 bool loadSupplier(const std::string &filepath, std::vector<Supplier> &supplier_data) {
-    std::ifstream file(filepath);  // Open the file for reading
+    TableTextStream file(filepath);  // Open the file for reading, decompressing .gz and .zst tables
 
     if (!file.is_open())            
         return false;               // Error Opening File
@@ -182,72 +366,120 @@ bool loadSupplier(const std::string &filepath, std::vector<Supplier> &supplier_d
     
         supplier_data.emplace_back(std::stoi(tokens[0]), std::stoi(tokens[3]));    //convert and push INTEGER S_SUPPKEY, INTEGER S_SUPPKEY
     }
-    return true;
+    return !file.bad();             // A damaged compressed table sets badbit
 }
 
 // Function to load the Orders table from a file into a vector of Orders structs
 bool loadOrders(const std::string &filepath, std::vector<Orders> &orders_data) {
-    std::ifstream file(filepath);  // Open the file for reading
+    TableTextStream file(filepath);  // Open the file for reading, decompressing .gz and .zst tables
 
     if (!file.is_open())            
         return false;               // Error Opening File
 
     std::string line;   
+    uint64_t lines = 0, malformed = 0;
+    orders_data.reserve(orders_data.size() + fileSizeOrZero(filepath) / ORDERS_BYTES_PER_ROW);
 
     // Read each line until End Of File
     while (std::getline(file, line)) {
         std::vector<std::string> tokens = splitStringByDelimiter(line);  // Split line by delimiter ('|')
+        ++lines;
+
+        int order_date;
+        if (tokens.size() < 9                                   // Verify required columns and accommodate dummy or empty values
+            || !isNumber(tokens[0]) || !isNumber(tokens[1])     // O_ORDERKEY or O_CUSTKEY should be a valid numbers
+            || !parseDate(tokens[4], order_date)) {             // O_ORDERDATE should be a valid YYYY-MM-DD date
+            ++malformed;
+            continue;
+        }
 
-        if (tokens.size() < 9)    // Verify required columns and accommodate dummy or empty values
-            continue;             
-
-        if (!isNumber(tokens[0]) || !isNumber(tokens[1]))   // O_ORDERKEY or O_CUSTKEY should be a valid numbers
-            continue;             
+        orders_data.emplace_back(std::stoi(tokens[0]), std::stoi(tokens[1]), order_date);    //convert and push INTEGER O_ORDERKEY, INTEGER O_CUSTKEY, DATE O_ORDERDATE
+    }
 
-    
-        orders_data.emplace_back(std::stoi(tokens[0]), std::stoi(tokens[1]), tokens[4]);    //convert and push INTEGER O_ORDERKEY, INTEGER O_CUSTKEY, STRING O_ORDERDATE
+    if (Metrics* metrics = activeMetrics()) {
+        metrics->add(MetricsCounter::OrdersLines, lines);
+        metrics->add(MetricsCounter::OrdersMalformed, malformed);
     }
-    return true;
+    return !file.bad();             // A damaged compressed table sets badbit
 }
 
 
 // ---------------- Multithreaded load for LineItem Chunk ----------------
+// Lineitem lines seen by one loader morsel, added to the active Metrics once at its end
+struct LoaderRowCounts {
+    uint64_t lines = 0;
+    uint64_t malformed = 0;
+    uint64_t pushdown_rejected = 0;
+
+    void flush(Metrics& metrics) const {
+        metrics.add(MetricsCounter::LineItemLines, lines);
+        metrics.add(MetricsCounter::LineItemMalformed, malformed);
+        metrics.add(MetricsCounter::LineItemPushdownRejected, pushdown_rejected);
+    }
+};
+
+// Work granularity on the shared thread pool: loaders take TEXT_MORSEL_BYTES of text per
+// morsel (see table_scan.hpp), the probe takes at most 64K rows per morsel
+constexpr size_t PROBE_MORSEL_ROWS = size_t(1) << 16;
+
+// Chunks that encode rows as they are added complete their last block once the morsel is loaded
+inline void finishChunk(std::vector<LineItem> &) {}
+inline void finishChunk(LineItemColumns &) {}
+inline void finishChunk(CompressedLineItems &chunk) { chunk.finish(); }
+
+// Chunk is std::vector<LineItem>, LineItemColumns or CompressedLineItems; rows rejected by the optional filter are dropped
+template <typename Chunk>
 void loadLineItemChunk(
     const std::string &filepath,
     size_t start_offset,
     size_t end_offset,
-    std::vector<LineItem> &lineitem_data)
+    Chunk &lineitem_data,
+    const LineItemFilter *filter)
 {
     std::ifstream file(filepath);
     if (!file.is_open()) {
         return;
     }
 
-    // Move file read cursor to the specified start offset
-    file.seekg(start_offset);
-
     if (start_offset != 0) {
-        // If start_offset is not zero, it may be in middle of a line,
-        // so discard the partial line by reading to the next newline
+        // A line belongs to the chunk its first byte lies in. Start one byte early and
+        // discard up to the next newline: if start_offset is exactly a line start only
+        // the previous line's '\n' is consumed, otherwise the partial line is skipped
+        file.seekg(start_offset - 1);
         std::string dummy;
         std::getline(file, dummy);
     }
 
+    // A filtered load keeps few rows, let the chunk grow on demand instead
+    if (!filter)
+        lineitem_data.reserve((end_offset - start_offset) / LINEITEM_BYTES_PER_ROW);
+
     std::string line;
+    LoaderRowCounts counts;
 
     std::streampos current_pos = file.tellg();      // Track current reading position in the file
 
     // Read each line until End Of File
     while (current_pos < (std::streampos)end_offset && std::getline(file, line)) {
         std::vector<std::string> tokens = splitStringByDelimiter(line);  // Split line by delimiter ('|')
+        ++counts.lines;
 
-        if (tokens.size() < 16)    // Verify required columns and accommodate dummy or empty values
-            continue;     
-
-        if (!isNumber(tokens[0]) || !isNumber(tokens[2]) || !isNumber(tokens[5]) || !isNumber(tokens[6]))   // L_ORDERKEY or L_SUPPKEY or L_EXTENDEDPRICE or L_DISCOUNT should be a valid numbers
-            continue;             
-
-        lineitem_data.emplace_back(std::stoi(tokens[0]),std::stoi(tokens[2]),std::stod(tokens[5]),std::stod(tokens[6]));    //convert and push INTEGER L_ORDERKEY, INTEGER L_SUPPKEY, DECIMAL L_EXTENDEDPRICE, DECIMAL L_DISCOUNT
+        if (tokens.size() < 16                                                  // Verify required columns and accommodate dummy or empty values
+            || !isNumber(tokens[0]) || !isNumber(tokens[2]) || !isNumber(tokens[5]) || !isNumber(tokens[6])) {   // L_ORDERKEY or L_SUPPKEY or L_EXTENDEDPRICE or L_DISCOUNT should be a valid numbers
+            ++counts.malformed;
+        }
+        else {
+            int order_key = std::stoi(tokens[0]);
+            int supp_key = std::stoi(tokens[2]);
+            // Rows whose keys can not join are dropped before the decimals are converted
+            int64_t price, discount;
+            if (filter && !(filter->orders.mayContain(order_key) && filter->suppliers.mayContain(supp_key)))
+                ++counts.pushdown_rejected;
+            else if (parseHundredths(tokens[5], price) && parseHundredths(tokens[6], discount) && discount <= INT16_MAX)
+                lineitem_data.push_back(LineItem{order_key,supp_key,price,int16_t(discount)});    //convert and push INTEGER L_ORDERKEY, INTEGER L_SUPPKEY, DECIMAL L_EXTENDEDPRICE and L_DISCOUNT in hundredths
+            else
+                ++counts.malformed;
+        }
 
         current_pos = file.tellg();
 
@@ -255,13 +487,18 @@ void loadLineItemChunk(
 
     }   
 
+    if (Metrics* metrics = activeMetrics())
+        counts.flush(*metrics);
 }
 
-// Function to load the Lineitem table from a file into a vector of vector of Lineitem structs using given no. of threads
+// Function to load the Lineitem table from a file into a vector of vector of Lineitem structs using given no. of threads.
+// The file is cut into TEXT_MORSEL_BYTES morsels scheduled on the shared pool, one chunk per morsel
+template <typename Chunk>
 bool loadLineItemMultithreaded(
     const std::string &filepath,
-    std::vector<std::vector<LineItem>> &lineitem_data,
-    int num_threads) 
+    std::vector<Chunk> &lineitem_data,
+    int num_threads,
+    const LineItemFilter *filter) 
 {
     // Open file in text mode with get pointer initially at the end (to get file size)
     std::ifstream file(filepath, std::ios::ate);
@@ -270,233 +507,2174 @@ bool loadLineItemMultithreaded(
     }
 
     size_t file_size = file.tellg();                   // Get total size of the file (from end position)
-    size_t chunk_size = (file_size  + num_threads - 1 )/ num_threads;       // Calculate chunk size per thread
+    size_t num_morsels = (file_size + TEXT_MORSEL_BYTES - 1) / TEXT_MORSEL_BYTES;
+    lineitem_data.resize(num_morsels);                 // One chunk of lineitem per morsel
 
-    std::vector<std::thread> threads(num_threads);     // Create thread objects container of size num_threads
-    lineitem_data.resize(num_threads);                  // Creating chunks of lineitem of size num_threads
+    // Each morsel loads byte range [start_offset, end_offset) into its own chunk
+    sharedThreadPool(num_threads).parallelFor(num_morsels, [&](size_t morsel, int) {
+        size_t start_offset = morsel * TEXT_MORSEL_BYTES;
+        size_t end_offset = std::min(start_offset + TEXT_MORSEL_BYTES, file_size);
+        loadLineItemChunk(filepath, start_offset, end_offset, lineitem_data[morsel], filter);
+        finishChunk(lineitem_data[morsel]);
+    });
 
-    // Launch threads to load chunks of the file
-    for (int i = 0; i < num_threads; ++i) {
-        size_t start_offset = i * chunk_size;          // Compute starting byte offset for current chunk
-        size_t end_offset = std::min(start_offset + chunk_size, file_size);  //Compute ending byte offset for current chunk
+    return true;   // Indicate successful loading
+}
 
-        // Start thread to load chunk [start_offset, end_offset) into its portion of lineitem_data
-        threads[i] = std::thread(loadLineItemChunk, filepath, start_offset, end_offset,
-                                 std::ref(lineitem_data[i]));
-    }
 
-    // Wait for all threads to finish loading their respective chunks
-    for (std::thread &t : threads)
-        t.join();
 
-    return true;   // Indicate successful loading
+// ---------------- Memory mapped loaders for Orders and LineItem ----------------
+enum class LineParse {
+    Parsed,
+    Malformed,          // A column is missing or not a number
+    Rejected            // A key can not join according to the filter
+};
+
+// '|' delimiters of a lineitem line up to the one closing L_DISCOUNT (column 6)
+constexpr int LINEITEM_PARSED_DELIMITERS = 7;
+
+// Parse one lineitem line in place; only L_ORDERKEY, L_SUPPKEY, L_EXTENDEDPRICE and L_DISCOUNT are read.
+// delimiters[0 .. found) are the line's first '|' positions from findLineFields(), so the skipped
+// columns are never searched. With a filter the row is rejected as soon as a key can not join,
+// before the decimals are parsed
+inline LineParse parseLineItemRow(const char* line, const char* line_end, const char* const* delimiters, int found,
+                                  LineItem& row, const LineItemFilter* filter = nullptr) {
+    const char* cursor = line;
+    if (!parseIntField(cursor, line_end, row.L_ORDERKEY))                  // column 0
+        return LineParse::Malformed;
+    if (filter && !filter->orders.mayContain(row.L_ORDERKEY))
+        return LineParse::Rejected;
+    cursor = found >= 2 ? delimiters[1] + 1 : line_end;                    // skip L_PARTKEY
+    if (!parseIntField(cursor, line_end, row.L_SUPPKEY))                   // column 2
+        return LineParse::Malformed;
+    if (filter && !filter->suppliers.mayContain(row.L_SUPPKEY))
+        return LineParse::Rejected;
+    cursor = found >= 5 ? delimiters[4] + 1 : line_end;                    // skip L_LINENUMBER, L_QUANTITY
+    if (!parseDecimalField(cursor, line_end, row.L_EXTENDEDPRICE)          // column 5
+        || !parseDecimalField(cursor, line_end, row.L_DISCOUNT))           // column 6
+        return LineParse::Malformed;
+    return LineParse::Parsed;
 }
 
+// Parse O_ORDERKEY, O_CUSTKEY and O_ORDERDATE of one orders line in place
+inline bool parseOrdersRow(const char* cursor, const char* line_end, Orders& row) {
+    return parseIntField(cursor, line_end, row.O_ORDERKEY)            // column 0
+        && parseIntField(cursor, line_end, row.O_CUSTKEY)             // column 1
+        && skipFields(cursor, line_end, 2)                            // O_ORDERSTATUS, O_TOTALPRICE
+        && parseDateField(cursor, line_end, row.O_ORDERDATE);         // column 4
+}
 
+// Parse the orders rows whose first byte lies in [start_offset, end_offset) of the text [begin, end)
+// into orders_data; rows with missing or malformed columns are skipped like the stream loader does
+void loadOrdersRangeText(const char* begin, const char* end, size_t start_offset, size_t end_offset, std::vector<Orders> &orders_data) {
+    const char* cursor = alignToLineStart(begin, begin + start_offset, end);
+    const char* chunk_end = begin + end_offset;
+    orders_data.reserve((end_offset - start_offset) / ORDERS_BYTES_PER_ROW);
+    uint64_t lines = 0, malformed = 0;
+
+    Orders row;
+    while (cursor < chunk_end) {
+        const char* line_end = findLineEnd(cursor, end);
+        if (parseOrdersRow(cursor, line_end, row))
+            orders_data.push_back(row);
+        else
+            ++malformed;
 
-// Function to read all TPCH tables from specified path into vectors
-bool readTPCHData(
-    const std::string& table_path, 
-    std::vector<Customer> &customer_data,
-    std::vector<Orders> &orders_data,
-    std::vector<std::vector<LineItem>> &lineitem_data,
-    std::vector<Supplier> &supplier_data,
-    std::vector<Nation> &nation_data,
-    std::vector<Region> &region_data,
-    const int num_threads)
-{
-    // Load small tables sequentially, return false if any fail
-    if (!loadRegion(table_path + "/region.tbl", region_data) ||
-        !loadNation(table_path + "/nation.tbl", nation_data) ||
-        !loadCustomer(table_path + "/customer.tbl", customer_data) ||
-        !loadOrders(table_path + "/orders.tbl", orders_data) ||
-        !loadSupplier(table_path + "/supplier.tbl", supplier_data)) {
-        return false;
+        ++lines;
+        cursor = line_end + 1;
     }
 
-    // Load the large lineitem table using multithreading, 
-    // storing data in multiple chunks (vectors) per thread
-    if (!loadLineItemMultithreaded(table_path + "/lineitem.tbl", lineitem_data, num_threads)) {
-        return false;
+    if (Metrics* metrics = activeMetrics()) {
+        metrics->add(MetricsCounter::OrdersLines, lines);
+        metrics->add(MetricsCounter::OrdersMalformed, malformed);
     }
-
-    return true;  // All tables loaded successfully
 }
 
+// Function to load the Orders table by scanning the mapped file in place. Every
+// TEXT_MORSEL_BYTES morsel is parsed on the shared pool into its own vector and the
+// vectors are joined in file order, so the result matches a sequential scan
+bool loadOrdersMapped(const std::string &filepath, std::vector<Orders> &orders_data, int num_threads) {
+    MappedFile file;
+    if (!file.open(filepath))
+        return false;               // Error Opening File
 
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    size_t file_size = file.size();
+    size_t num_morsels = (file_size + TEXT_MORSEL_BYTES - 1) / TEXT_MORSEL_BYTES;
+    std::vector<std::vector<Orders>> parts(num_morsels);
+    pool.parallelFor(num_morsels, [&](size_t morsel, int) {
+        size_t start_offset = morsel * TEXT_MORSEL_BYTES;
+        size_t end_offset = std::min(start_offset + TEXT_MORSEL_BYTES, file_size);
+        loadOrdersRangeText(file.data(), file.data() + file_size, start_offset, end_offset, parts[morsel]);
+    });
+
+    appendConcatenated(&pool, parts, orders_data);
+    return true;
+}
 
+// Parse the lineitem rows whose first byte lies in [start_offset, end_offset) of the text [begin, end)
+// and hand each one to sink(row); malformed rows and rows rejected by the optional filter are skipped.
+// Lines are only counted into counts in the COUNT_ROWS instantiation
+template <bool COUNT_ROWS, typename RowSink>
+void scanLineItemTextCounted(const char* begin, const char* end, size_t start_offset, size_t end_offset,
+                             const LineItemFilter *filter, RowSink &sink, LoaderRowCounts &counts) {
+    const char* cursor = alignToLineStart(begin, begin + start_offset, end);
+    const char* chunk_end = begin + end_offset;
+
+    LineItem row;
+    const char* delimiters[LINEITEM_PARSED_DELIMITERS];
+    int found;
+    while (cursor < chunk_end) {
+        const char* line_end = findLineFields(cursor, end, delimiters, LINEITEM_PARSED_DELIMITERS, found);
+        LineParse parsed = parseLineItemRow(cursor, line_end, delimiters, found, row, filter);
+        if (parsed == LineParse::Parsed)
+            sink(row);
+        if constexpr (COUNT_ROWS) {
+            ++counts.lines;
+            counts.malformed += parsed == LineParse::Malformed;
+            counts.pushdown_rejected += parsed == LineParse::Rejected;
+        }
+        cursor = line_end + 1;
+    }
+}
 
-// Stores filtered keys and mappings for efficient query processing
-struct PreprocessedData {
-    std::unordered_set<int> regionKeys;                     // Region keys matching filter
-    std::unordered_set<int> nationKeys;                     // Nation keys within selected regions
-    std::unordered_map<int, std::string> nationNames;       // Nation key -> Nation name map
-    std::unordered_set<int> customerKeys;                   // Customers belonging to selected nations
-    std::unordered_map<int, int> customerToNation;          // Customer key -> Nation key map
-    std::unordered_set<int> orderKeys;                      // Orders filtered by date and customer
-    std::unordered_map<int, int> orderToCustomerNation;     // Order key -> Customer's nation key
-    std::unordered_set<int> supplierKeys;                   // Suppliers in selected nations
-    std::unordered_map<int, int> supplierToNation;          // Supplier key -> Nation key map
-};
+template <typename RowSink>
+void scanLineItemText(const char* begin, const char* end, size_t start_offset, size_t end_offset,
+                      const LineItemFilter *filter, RowSink &&sink) {
+    LoaderRowCounts counts;
+    if (Metrics* metrics = activeMetrics()) {
+        scanLineItemTextCounted<true>(begin, end, start_offset, end_offset, filter, sink, counts);
+        counts.flush(*metrics);
+    }
+    else
+        scanLineItemTextCounted<false>(begin, end, start_offset, end_offset, filter, sink, counts);
+}
 
-// Preprocess involved tables to filter and create lookup structures for efficient query execution
-PreprocessedData preprocess(
-    const std::string& regionName,                           // Region filter name
-    const std::string& startDate,                            // Start date filter for orders (inclusive)
-    const std::string& endDate,                              // End date filter for orders (exclusive)
-    const std::vector<Customer>& customer_data,
-    const std::vector<Orders>& orders_data,
-    const std::vector<Supplier>& supplier_data,
-    const std::vector<Nation>& nation_data,
-    const std::vector<Region>& region_data)
+// Load the lineitem rows whose first byte lies in [start_offset, end_offset) of the text [begin, end)
+template <typename Chunk>
+void loadLineItemChunkText(
+    const char *begin,
+    const char *end,
+    size_t start_offset,
+    size_t end_offset,
+    Chunk &lineitem_data,
+    const LineItemFilter *filter)
 {
-    PreprocessedData processed_data;
+    // A filtered load keeps few rows, let the chunk grow on demand instead
+    if (!filter)
+        lineitem_data.reserve((end_offset - start_offset) / LINEITEM_BYTES_PER_ROW);
+    scanLineItemText(begin, end, start_offset, end_offset, filter,
+                     [&](const LineItem& row) { lineitem_data.push_back(row); });
+}
 
-    // Select region keys matching the given region name
-    for (const Region& r : region_data)
-        if (r.R_NAME == regionName)
-            processed_data.regionKeys.insert(r.R_REGIONKEY);
+// Function to load the Lineitem table from a mapped file, one chunk per TEXT_MORSEL_BYTES morsel
+template <typename Chunk>
+bool loadLineItemMapped(
+    const std::string &filepath,
+    std::vector<Chunk> &lineitem_data,
+    int num_threads,
+    const LineItemFilter *filter)
+{
+    MappedFile file;
+    if (!file.open(filepath))
+        return false;                                  // Error Opening File
 
-    // Select nation keys belonging to the filtered regions and record nation names
-    for (const Nation& n : nation_data)
-        if (processed_data.regionKeys.count(n.N_REGIONKEY)) {
-            processed_data.nationKeys.insert(n.N_NATIONKEY);
-            processed_data.nationNames[n.N_NATIONKEY] = n.N_NAME;
-        }
+    size_t file_size = file.size();
+    size_t num_morsels = (file_size + TEXT_MORSEL_BYTES - 1) / TEXT_MORSEL_BYTES;
+    lineitem_data.resize(num_morsels);
+
+    sharedThreadPool(num_threads).parallelFor(num_morsels, [&](size_t morsel, int) {
+        size_t start_offset = morsel * TEXT_MORSEL_BYTES;
+        size_t end_offset = std::min(start_offset + TEXT_MORSEL_BYTES, file_size);
+        loadLineItemChunkText(file.data(), file.data() + file_size, start_offset, end_offset, lineitem_data[morsel], filter);
+        finishChunk(lineitem_data[morsel]);
+    });
+
+    return true;
+}
 
-    // Select customers belonging to the selected nations and map customer -> nation
-    for (const Customer& c : customer_data)
-        if (processed_data.nationKeys.count(c.C_NATIONKEY)) {
-            processed_data.customerKeys.insert(c.C_CUSTKEY);
-            processed_data.customerToNation[c.C_CUSTKEY] = c.C_NATIONKEY;
-        }
 
-    // Select orders placed within the date range by filtered customers;
-    // map order -> customer's nation key for fast lookup
-    for (const Orders& o : orders_data)
-        if (o.O_ORDERDATE >= startDate && o.O_ORDERDATE < endDate 
-            && processed_data.customerKeys.count(o.O_CUSTKEY)) {
-            processed_data.orderKeys.insert(o.O_ORDERKEY);
-            processed_data.orderToCustomerNation[o.O_ORDERKEY] = processed_data.customerToNation[o.O_CUSTKEY];
-        }
 
-    // Select suppliers in the filtered nations and map supplier -> nation
-    for (const Supplier& s : supplier_data)
-        if (processed_data.nationKeys.count(s.S_NATIONKEY)) {
-            processed_data.supplierKeys.insert(s.S_SUPPKEY);
-            processed_data.supplierToNation[s.S_SUPPKEY] = s.S_NATIONKEY;
+// ---------------- Buffered loaders for LineItem and Orders ----------------
+// Used for lineitem with --loader async, and for compressed lineitem and orders tables with any
+// loader but stream. A TableTextReader reads or decompresses the next buffers of the table while
+// the pool parses the current one.
+
+// Parse the text of reader buffer by buffer into parts, in file order. The complete lines of a
+// buffer are cut into TEXT_MORSEL_BYTES morsels and parse_text(begin, end, start_offset,
+// end_offset, part) parses each one on the pool into a new part. A line cut by the end of a
+// buffer is carried over and parsed into the last part of the buffer it starts in, so that part
+// is only passed to finish_part(part) once the next buffer has added parts after it
+template <typename Part, typename ParseText, typename FinishPart>
+bool parseTextBuffers(TableTextReader &reader, ThreadPool &pool, std::vector<Part> &parts,
+                      ParseText parse_text, FinishPart finish_part)
+{
+    bool read = forEachCompleteLines(reader, [&](const char* begin, const char* end, bool carried) {
+        size_t text_size = end - begin;
+        if (carried) {
+            if (parts.empty())
+                parts.emplace_back();
+            parse_text(begin, end, 0, text_size, parts.back());
+            return;
         }
 
-    return processed_data;
+        size_t num_morsels = (text_size + TEXT_MORSEL_BYTES - 1) / TEXT_MORSEL_BYTES;
+        size_t first_part = parts.size();
+        if (first_part)
+            finish_part(parts[first_part - 1]);
+        parts.resize(first_part + num_morsels);
+
+        pool.parallelFor(num_morsels, [&](size_t morsel, int) {
+            size_t start_offset = morsel * TEXT_MORSEL_BYTES;
+            size_t end_offset = std::min(start_offset + TEXT_MORSEL_BYTES, text_size);
+            Part& part = parts[first_part + morsel];
+            parse_text(begin, end, start_offset, end_offset, part);
+            if (morsel + 1 < num_morsels)
+                finish_part(part);
+        });
+    });
+
+    if (!parts.empty())
+        finish_part(parts.back());
+    return read;
+}
+
+// Function to load the Lineitem table buffer by buffer, one chunk per morsel of every buffer
+template <typename Chunk>
+bool loadLineItemBuffered(
+    const std::string &filepath,
+    std::vector<Chunk> &lineitem_data,
+    int num_threads,
+    const LineItemFilter *filter)
+{
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    TableTextReader reader;
+    if (!reader.open(filepath, textBufferBytes(pool), &pool))
+        return false;                                  // Error Opening File
+
+    lineitem_data.clear();
+    return parseTextBuffers(reader, pool, lineitem_data,
+        [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, Chunk& chunk) {
+            loadLineItemChunkText(begin, end, start_offset, end_offset, chunk, filter);
+        },
+        [](Chunk& chunk) { finishChunk(chunk); });
 }
 
+// Function to load the Orders table buffer by buffer; the parts are joined in file order like loadOrdersMapped does
+bool loadOrdersBuffered(const std::string &filepath, std::vector<Orders> &orders_data, int num_threads) {
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    TableTextReader reader;
+    if (!reader.open(filepath, textBufferBytes(pool), &pool))
+        return false;                                  // Error Opening File
 
-// ---------------- Threaded Query Processing ----------------
-void threadProcessLineitems(
-    const PreprocessedData& processed_data,                 // Pre-filtered data and mappings for efficient lookup
-    const std::vector<LineItem>& lineitem_data,             // Chunk of LineItem rows assigned to this thread
-    std::unordered_map<std::string, double>& threadResult) {          // Per-thread aggregated result map (nation -> revenue)
+    std::vector<std::vector<Orders>> parts;
+    if (!parseTextBuffers(reader, pool, parts, loadOrdersRangeText, [](std::vector<Orders>&) {}))
+        return false;
+    appendConcatenated(&pool, parts, orders_data);
+    return true;
+}
 
-    // Iterate over each LineItem in this thread's chunk
-    for (int line_index = 0; line_index < lineitem_data.size(); ++line_index) {
-        const LineItem& row = lineitem_data[line_index];
 
-        // Filter: skip if order key is not in the preprocessed set (filtered orders)
-        if (!processed_data.orderKeys.count(row.L_ORDERKEY)) continue;
 
-        // Filter: skip if supplier key is not in the preprocessed set (filtered suppliers)
-        if (!processed_data.supplierKeys.count(row.L_SUPPKEY)) continue;
 
-        // Lookup customer and supplier nations via preprocessed maps
-        int custNation = processed_data.orderToCustomerNation.at(row.L_ORDERKEY);
-        int suppNation = processed_data.supplierToNation.at(row.L_SUPPKEY);
+// ---------------- Sharded loaders for LineItem and Orders ----------------
+// dbgen -C N -S i writes the i-th shard of orders and the lineitem rows of exactly those orders
+// to orders.tbl.i and lineitem.tbl.i. Shards are handed to workers by their index the same way
+// for both tables (see shardMorsels), so the worker that parses orders shard i also parses
+// lineitem shard i, and probeWorkerStarts() gives it the lineitem chunks of that shard.
 
-        // Include only if customer and supplier nations are the same
-        if (custNation == suppNation) {
-            // Calculate revenue for this line item after discount
-            double revenue = row.L_EXTENDEDPRICE * (1.0 - row.L_DISCOUNT);
+// Parse all the text of reader into part on the calling thread
+template <typename Part, typename ParseText>
+bool parseTextSequential(TableTextReader &reader, Part &part, ParseText parse_text) {
+    return forEachCompleteLines(reader, [&](const char* begin, const char* end, bool) {
+        parse_text(begin, end, 0, size_t(end - begin), part);
+    });
+}
+
+// Function to load the Lineitem table from its shards, one chunk per shard morsel (see shardMorsels)
+template <typename Chunk>
+bool loadLineItemShards(
+    const std::vector<std::string> &paths,
+    std::vector<Chunk> &lineitem_data,
+    int num_threads,
+    const LineItemFilter *filter,
+    LoaderMode loader_mode)
+{
+    TableShards shards;
+    if (!shards.open(paths, loader_mode != LoaderMode::Stream))
+        return false;
+
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    std::vector<ShardMorsel> morsels = shardMorsels(shards.sizes, shards.splittable(), pool.size());
+    lineitem_data.clear();
+    lineitem_data.resize(morsels.size());
+    std::atomic<bool> loaded{true};
+    pool.parallelFor(morsels.size(), [&](size_t morsel, int) {
+        const ShardMorsel& text = morsels[morsel];
+        Chunk& chunk = lineitem_data[morsel];
+        if (text.shard == PADDING_SHARD) {
+            finishChunk(chunk);
+            return;
+        }
+        if (shards.compressed[text.shard]) {
+            TableTextReader reader;
+            if (!reader.open(shards.paths[text.shard], SHARD_BUFFER_BYTES)
+                || !parseTextSequential(reader, chunk,
+                       [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, Chunk& part) {
+                           loadLineItemChunkText(begin, end, start_offset, end_offset, part, filter);
+                       }))
+                loaded = false;
+        }
+        else if (loader_mode == LoaderMode::Stream)
+            loadLineItemChunk(shards.paths[text.shard], text.start_offset, text.end_offset, chunk, filter);
+        else {
+            const MappedFile& file = shards.files[text.shard];
+            loadLineItemChunkText(file.data(), file.data() + file.size(), text.start_offset, text.end_offset, chunk, filter);
+        }
+        finishChunk(chunk);
+    });
+    return loaded;
+}
 
-            // Get supplier nation name for aggregation key
-            const std::string& nationName = processed_data.nationNames.at(suppNation);
+// Function to load the Orders table from its shards in parallel, each morsel on the worker its
+// lineitem counterpart goes to; the parts are joined in shard order
+bool loadOrdersShards(const std::vector<std::string> &paths, std::vector<Orders> &orders_data, int num_threads) {
+    TableShards shards;
+    if (!shards.open(paths, true))
+        return false;
 
-            // Accumulate revenue in thread-local result map
-            threadResult[nationName] += revenue;
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    std::vector<ShardMorsel> morsels = shardMorsels(shards.sizes, shards.splittable(), pool.size());
+    std::vector<std::vector<Orders>> parts(morsels.size());
+    std::atomic<bool> loaded{true};
+    pool.parallelFor(morsels.size(), [&](size_t morsel, int) {
+        const ShardMorsel& text = morsels[morsel];
+        if (text.shard == PADDING_SHARD)
+            return;
+        if (shards.compressed[text.shard]) {
+            TableTextReader reader;
+            if (!reader.open(shards.paths[text.shard], SHARD_BUFFER_BYTES)
+                || !parseTextSequential(reader, parts[morsel], loadOrdersRangeText))
+                loaded = false;
+            return;
         }
+        const MappedFile& file = shards.files[text.shard];
+        loadOrdersRangeText(file.data(), file.data() + file.size(), text.start_offset, text.end_offset, parts[morsel]);
+    });
+    if (!loaded)
+        return false;
+    appendConcatenated(&pool, parts, orders_data);
+    return true;
+}
+
+
+
+// ---------------- Zone maps ----------------
+inline int orderKeyAt(const std::vector<LineItem> &chunk, size_t row) { return chunk[row].L_ORDERKEY; }
+inline int orderKeyAt(const LineItemColumns &chunk, size_t row) { return chunk.L_ORDERKEY[row]; }
+inline LineItem lineItemAt(const std::vector<LineItem> &chunk, size_t row) { return chunk[row]; }
+inline LineItem lineItemAt(const LineItemColumns &chunk, size_t row) {
+    return LineItem{chunk.L_ORDERKEY[row], chunk.L_SUPPKEY[row], chunk.L_EXTENDEDPRICE[row], chunk.L_DISCOUNT[row]};
+}
+
+// Call visit(row, order_key) for every row of a chunk in order
+template <typename Chunk, typename Visit>
+void forEachOrderKey(const Chunk &chunk, Visit visit) {
+    for (size_t row = 0; row < chunk.size(); ++row)
+        visit(row, orderKeyAt(chunk, row));
+}
+
+// Compressed chunks have no random access to L_ORDERKEY, the runs are expanded block by block
+template <typename Visit>
+void forEachOrderKey(const CompressedLineItems &chunk, Visit visit) {
+    int order_keys[COMPRESSED_BLOCK_ROWS];
+    size_t first_row = 0;
+    for (size_t block = 0; block < chunk.numBlocks(); ++block) {
+        size_t rows = chunk.blockRows(block);
+        chunk.decodeOrderKeys(block, order_keys);
+        for (size_t i = 0; i < rows; ++i)
+            visit(first_row + i, order_keys[i]);
+        first_row += rows;
     }
 }
 
+// Order keys of the rows of one zone map block [block_start, block_end) of a chunk: a pointer
+// into the chunk where they are stored contiguously, else copied or decoded into buffer
+inline const int* blockOrderKeys(const std::vector<LineItem> &chunk, size_t block_start, size_t block_end, int *buffer) {
+    for (size_t row = block_start; row < block_end; ++row)
+        buffer[row - block_start] = chunk[row].L_ORDERKEY;
+    return buffer;
+}
+inline const int* blockOrderKeys(const LineItemColumns &chunk, size_t block_start, size_t, int *) {
+    return chunk.L_ORDERKEY.data() + block_start;
+}
+inline const int* blockOrderKeys(const CompressedLineItems &chunk, size_t block_start, size_t, int *buffer) {
+    chunk.decodeOrderKeys(block_start / COMPRESSED_BLOCK_ROWS, buffer);
+    return buffer;
+}
 
-// Function to execute TPCH Query 5 using multithreading
-bool executeQuery5(
-    const std::string &r_name,
-    const std::string &start_date,
-    const std::string &end_date,
-    int num_threads,
-    const std::vector<Customer> &customer_data,
+// A row whose order key was already read with blockOrderKeys
+template <typename Chunk>
+LineItem joinedLineItem(const Chunk &chunk, size_t row, int) { return lineItemAt(chunk, row); }
+inline LineItem joinedLineItem(const CompressedLineItems &chunk, size_t row, int order_key) {
+    return chunk.row(row / COMPRESSED_BLOCK_ROWS, row % COMPRESSED_BLOCK_ROWS, order_key);
+}
+
+// Min/max O_ORDERDATE of every block of orders_data
+void buildOrdersZoneMap(const std::vector<Orders> &orders_data, DateZoneMap &zone_map) {
+    size_t num_blocks = (orders_data.size() + ZONE_MAP_BLOCK_ROWS - 1) / ZONE_MAP_BLOCK_ROWS;
+    zone_map.min_date.assign(num_blocks, INT_MAX);
+    zone_map.max_date.assign(num_blocks, INT_MIN);
+    for (size_t row = 0; row < orders_data.size(); ++row) {
+        size_t block = row / ZONE_MAP_BLOCK_ROWS;
+        zone_map.min_date[block] = std::min(zone_map.min_date[block], orders_data[row].O_ORDERDATE);
+        zone_map.max_date[block] = std::max(zone_map.max_date[block], orders_data[row].O_ORDERDATE);
+    }
+}
+
+// Min/max order date of the orders referenced by every block of every lineitem chunk.
+// The order dates are joined through a direct addressed orderkey -> date array, which is only
+// built when orderkeys are dense; otherwise zone_maps is left empty and no lineitem block is skipped.
+// Rows whose order does not exist can never join, so they do not widen a block's range.
+template <typename Chunk>
+void buildLineItemZoneMaps(
     const std::vector<Orders> &orders_data,
-    const std::vector<std::vector<LineItem>> &lineitem_data,
-    const std::vector<Supplier> &supplier_data,
-    const std::vector<Nation> &nation_data,
-    const std::vector<Region> &region_data,
-    std::vector<Nation_Revenue> &results) 
+    const std::vector<Chunk> &lineitem_data,
+    ThreadPool &pool,
+    std::vector<DateZoneMap> &zone_maps)
 {
-    // Preprocess data (apply filters, prepare lookup tables)
-    PreprocessedData processed_data = preprocess(r_name, start_date, end_date, 
-                                       customer_data, orders_data,
-                                       supplier_data, nation_data, region_data);
+    zone_maps.clear();
+    if (orders_data.empty())
+        return;
+
+    int min_key = INT_MAX, max_key = INT_MIN;
+    for (const Orders& o : orders_data) {
+        min_key = std::min(min_key, o.O_ORDERKEY);
+        max_key = std::max(max_key, o.O_ORDERKEY);
+    }
+    uint64_t key_range = uint64_t(int64_t(max_key) - min_key) + 1;
+    if (key_range > 16 * orders_data.size())
+        return;                                     // Too sparse for a direct addressed array
 
-    std::vector<std::unordered_map<std::string, double>> partial_results(num_threads);  // Thread-local results
-    std::vector<std::thread> threads(num_threads);
+    constexpr int NO_ORDER = INT_MIN;
+    std::vector<int> order_dates(key_range, NO_ORDER);
+    for (const Orders& o : orders_data)
+        order_dates[uint32_t(o.O_ORDERKEY) - uint32_t(min_key)] = o.O_ORDERDATE;
+
+    zone_maps.resize(lineitem_data.size());
+    pool.parallelFor(lineitem_data.size(), [&](size_t chunk, int) {
+        const Chunk& rows = lineitem_data[chunk];
+        DateZoneMap& zone_map = zone_maps[chunk];
+        size_t num_blocks = (rows.size() + ZONE_MAP_BLOCK_ROWS - 1) / ZONE_MAP_BLOCK_ROWS;
+        zone_map.min_date.assign(num_blocks, INT_MAX);
+        zone_map.max_date.assign(num_blocks, INT_MIN);
+        forEachOrderKey(rows, [&](size_t row, int order_key) {
+            uint32_t slot = uint32_t(order_key) - uint32_t(min_key);
+            if (slot >= key_range || order_dates[slot] == NO_ORDER)
+                return;
+            size_t block = row / ZONE_MAP_BLOCK_ROWS;
+            zone_map.min_date[block] = std::min(zone_map.min_date[block], order_dates[slot]);
+            zone_map.max_date[block] = std::max(zone_map.max_date[block], order_dates[slot]);
+        });
+    });
+}
+
+// True if orders_data and the lineitem chunks taken in order both ascend by order key, as dbgen
+// writes them, so executeQuery5 can merge join them
+template <typename Chunk>
+bool sortedByOrderKey(const std::vector<Orders> &orders_data, const std::vector<Chunk> &lineitem_data, ThreadPool &pool) {
+    std::atomic<bool> orders_sorted{true};
+    forEachRange(&pool, orders_data.size(), PROBE_MORSEL_ROWS, [&](size_t begin, size_t end) {
+        for (size_t row = std::max<size_t>(begin, 1); row < end; ++row)
+            if (orders_data[row].O_ORDERKEY < orders_data[row - 1].O_ORDERKEY) {
+                orders_sorted.store(false, std::memory_order_relaxed);
+                return;
+            }
+    });
+    if (!orders_sorted.load())
+        return false;
 
-    // Launch threads to process LineItem chunks in parallel
-    for (int thread_id = 0; thread_id < num_threads; ++thread_id) {
-        threads[thread_id] = std::thread(threadProcessLineitems, processed_data, lineitem_data[thread_id], 
-                                 std::ref(partial_results[thread_id]));
+    // Each chunk must be sorted and start at or after the last key of the chunk before it
+    struct ChunkKeys {
+        bool empty = true;
+        bool sorted = true;
+        int first = 0;
+        int last = 0;
+    };
+    std::vector<ChunkKeys> chunk_keys(lineitem_data.size());
+    pool.parallelFor(lineitem_data.size(), [&](size_t chunk, int) {
+        ChunkKeys& keys = chunk_keys[chunk];
+        forEachOrderKey(lineitem_data[chunk], [&](size_t, int key) {
+            if (keys.empty)
+                keys.first = key;
+            else if (key < keys.last)
+                keys.sorted = false;
+            keys.empty = false;
+            keys.last = key;
+        });
+    });
+
+    int previous_key = INT_MIN;
+    for (const ChunkKeys& keys : chunk_keys) {
+        if (keys.empty)
+            continue;
+        if (!keys.sorted || keys.first < previous_key)
+            return false;
+        previous_key = keys.last;
     }
+    return true;
+}
 
-    for (std::thread &th : threads) th.join();   // Wait for threads to finish
 
-    // Merge partial thread results into one aggregated map
-    std::unordered_map<std::string, double> merged_results;
-    for (const std::unordered_map<std::string, double> &partial_result : partial_results)
-        for (const std::pair<const std::string, double> & cur_result : partial_result)
-            merged_results[cur_result.first] += cur_result.second;
+// Load one table from its snapshot in options.cache_dir when it is still valid, otherwise
+// parse it with load() and refresh the snapshot. A snapshot that cannot be written only warns.
+template <typename Table, typename Loader>
+bool loadCachedTable(const ExecutionOptions &options, const std::string &filepath, Table &table_data, Loader load) {
+    if (options.cache_dir.empty())
+        return load(filepath, table_data);
 
-    // Convert map to vector for sorting
-    for (const std::pair<const std::string, double> &nation_revenue : merged_results)
-        // push nation,revenue into result
-        results.emplace_back(nation_revenue.first, nation_revenue.second);
+    if (readSnapshot(options.cache_dir, filepath, table_data))
+        return true;
 
-    // Sort results by revenue descending
-    std::sort(results.begin(), results.end(),
-              [&](const Nation_Revenue &a, const Nation_Revenue &b) {
-                  return a.REVENUE > b.REVENUE;
-              });
+    if (!load(filepath, table_data))
+        return false;
 
-    // Output results with high precision
-    std::cout.precision(13);
-    for (const Nation_Revenue& nation_revenue : results)
-        std::cout << nation_revenue.NATION << "|" << nation_revenue.REVENUE << "\n";
+    if (!writeSnapshot(options.cache_dir, filepath, table_data))
+        std::cerr << "Warning: could not write snapshot for " << filepath << "\n";
+    return true;
+}
 
+// Load table name with loadCachedTable, appending its shards in order when it is split into
+// several files; each shard has its own snapshot
+template <typename Table, typename Loader>
+bool loadTableShards(const ExecutionOptions &options, const std::string &table_path, const char *name, Table &table_data, Loader load) {
+    std::vector<std::string> paths = tableShardPaths(table_path, name);
+    if (paths.size() == 1)
+        return loadCachedTable(options, paths[0], table_data, load);
+
+    for (const std::string& path : paths) {
+        Table shard_data;
+        if (!loadCachedTable(options, path, shard_data, load))
+            return false;
+        table_data.insert(table_data.end(), std::make_move_iterator(shard_data.begin()), std::make_move_iterator(shard_data.end()));
+    }
     return true;
 }
 
+// Start loading region, nation, customer and supplier on their own threads. They are small
+// and mostly parse strings, so they run next to the pool loading orders and lineitem.
+// The returned future must be waited on before any of the four tables is used.
+std::future<bool> loadSmallTablesAsync(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const ExecutionOptions &options)
+{
+    return std::async(std::launch::async, [&, table_path]() {
+        std::future<bool> customers = std::async(std::launch::async, [&]() {
+            return loadTableShards(options, table_path, "customer", customer_data, loadCustomer);
+        });
+        bool loaded = loadTableShards(options, table_path, "region", region_data, loadRegion) &&
+                      loadTableShards(options, table_path, "nation", nation_data, loadNation) &&
+                      loadTableShards(options, table_path, "supplier", supplier_data, loadSupplier);
+        return customers.get() && loaded;
+    });
+}
+
+bool readSmallTables(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const ExecutionOptions &options)
+{
+    return loadSmallTablesAsync(table_path, customer_data, supplier_data, nation_data, region_data, options).get();
+}
 
+// Load the Orders table, mapped and in parallel on the shared pool unless the stream loader is used.
+// Sharded orders are loaded shard by shard by the stream loader, otherwise in parallel without snapshots
+bool loadOrdersTable(const std::string &table_path, std::vector<Orders> &orders_data, int num_threads,
+                     const ExecutionOptions &options)
+{
+    if (options.loader_mode != LoaderMode::Stream) {
+        std::vector<std::string> paths = tableShardPaths(table_path, "orders");
+        if (paths.size() > 1)
+            return loadOrdersShards(paths, orders_data, num_threads);
+    }
+    return loadTableShards(options, table_path, "orders", orders_data,
+        [&](const std::string &filepath, std::vector<Orders> &data) {
+            if (options.loader_mode == LoaderMode::Stream)
+                return loadOrders(filepath, data);
+            return compressedTable(filepath) ? loadOrdersBuffered(filepath, data, num_threads)
+                                             : loadOrdersMapped(filepath, data, num_threads);
+        });
+}
 
-// Function to output results to the specified path
-bool outputResults(const std::string& result_path, const std::vector<Nation_Revenue>& results) {
-    // TODO: Implement outputting results to a file
-    std::ofstream output_file(result_path);
-    if(!output_file){
+// Load every table except lineitem, return false if any fail
+bool readDimensionTables(
+    const std::string& table_path,
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    int num_threads,
+    const ExecutionOptions &options)
+{
+    std::future<bool> small_tables = loadSmallTablesAsync(table_path, customer_data, supplier_data, nation_data, region_data, options);
+    bool orders_loaded = loadOrdersTable(table_path, orders_data, num_threads, options);
+    return small_tables.get() && orders_loaded;
+}
+
+// Read all tables with lineitem chunks of type Chunk
+template <typename Chunk>
+bool readTPCHDataInto(
+    const std::string& table_path, 
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<Chunk> &lineitem_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const int num_threads,
+    const ExecutionOptions &options,
+    ZoneMaps *zone_maps,
+    const LineItemPushdown *pushdown)
+{
+    MetricsPhaseScope phase(MetricsPhase::Load);
+    const std::vector<std::string> lineitem_paths = tableShardPaths(table_path, "lineitem");
+    const std::string& lineitem_path = lineitem_paths[0];
+    const bool sharded = lineitem_paths.size() > 1;
+
+    // The small tables load next to orders and, unless the lineitem filter needs them
+    // first, next to lineitem as well
+    std::future<bool> small_tables = loadSmallTablesAsync(table_path, customer_data, supplier_data, nation_data, region_data, options);
+    if (!loadOrdersTable(table_path, orders_data, num_threads, options)) {
+        small_tables.wait();
         return false;
     }
 
-    // Print results
-    output_file.precision(13);
-    for (const Nation_Revenue& nation_revenue: results) {
-        output_file<<nation_revenue.NATION<<"|"<<nation_revenue.REVENUE<<"\n";
+    // A snapshot must hold the whole table, so the pushdown filter only applies when lineitem
+    // is parsed from text without a cache directory. Its join indexes go to pushdown->processed
+    // when given, so the query does not build them again
+    PreprocessedData local_processed;
+    PreprocessedData& processed_data = pushdown && pushdown->processed ? *pushdown->processed : local_processed;
+    processed_data = PreprocessedData();
+    const LineItemFilter *filter = nullptr;
+    if (pushdown && options.pushdown_filter && options.cache_dir.empty()) {
+        MetricsPhaseScope preprocess_phase(MetricsPhase::Preprocess);
+        if (!small_tables.get() || !preprocess(pushdown->r_name, pushdown->start_date, pushdown->end_date, customer_data, orders_data,
+                        supplier_data, nation_data, region_data, nullptr, processed_data,
+                        &sharedThreadPool(num_threads)))
+            return false;
+        filter = &processed_data.lineitemFilter;
     }
 
-    output_file.close();
-    return true;
-} 
\ No newline at end of file
+    // Reuse a lineitem snapshot if there is a valid one, otherwise load the large lineitem
+    // table using multithreading, storing data in multiple chunks (vectors).
+    // Compressed chunks are always encoded from the text, they have no snapshot format; nor do
+    // sharded tables, a snapshot belongs to one file
+    constexpr bool has_snapshots = !std::is_same_v<Chunk, CompressedLineItems>;
+    const bool use_snapshots = has_snapshots && !sharded && !options.cache_dir.empty();
+    bool from_snapshot = false;
+    if constexpr (has_snapshots)
+        from_snapshot = use_snapshots
+            && readSnapshot(options.cache_dir, lineitem_path, lineitem_data, sharedThreadPool(num_threads));
+    if (!from_snapshot) {
+        // Compressed text can only be read front to back, whatever the loader
+        bool loaded = sharded ? loadLineItemShards(lineitem_paths, lineitem_data, num_threads, filter, options.loader_mode)
+                    : options.loader_mode == LoaderMode::Async || compressedTable(lineitem_path)
+                        ? loadLineItemBuffered(lineitem_path, lineitem_data, num_threads, filter)
+                    : options.loader_mode == LoaderMode::Mmap ? loadLineItemMapped(lineitem_path, lineitem_data, num_threads, filter)
+                    : loadLineItemMultithreaded(lineitem_path, lineitem_data, num_threads, filter);
+        if (!loaded)
+            return false;
+
+        if constexpr (has_snapshots)
+            if (use_snapshots && !writeSnapshot(options.cache_dir, lineitem_path, lineitem_data))
+                std::cerr << "Warning: could not write snapshot for " << lineitem_path << "\n";
+    }
+
+    if (!filter && !small_tables.get())
+        return false;
+
+    if (zone_maps) {
+        buildOrdersZoneMap(orders_data, zone_maps->orders);
+        buildLineItemZoneMaps(orders_data, lineitem_data, sharedThreadPool(num_threads), zone_maps->lineitem);
+        zone_maps->sorted_by_orderkey = sortedByOrderKey(orders_data, lineitem_data, sharedThreadPool(num_threads));
+    }
+
+    return true;  // All tables loaded successfully
+}
+
+// Function to read all TPCH tables from specified path into vectors
+bool readTPCHData(
+    const std::string& table_path, 
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<std::vector<LineItem>> &lineitem_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const int num_threads,
+    const ExecutionOptions &options,
+    ZoneMaps *zone_maps,
+    const LineItemPushdown *pushdown)
+{
+    return readTPCHDataInto(table_path, customer_data, orders_data, lineitem_data, supplier_data,
+                            nation_data, region_data, num_threads, options, zone_maps, pushdown);
+}
+
+// Function to read all TPCH tables with lineitem as structure-of-arrays chunks
+bool readTPCHData(
+    const std::string& table_path, 
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<LineItemColumns> &lineitem_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const int num_threads,
+    const ExecutionOptions &options,
+    ZoneMaps *zone_maps,
+    const LineItemPushdown *pushdown)
+{
+    return readTPCHDataInto(table_path, customer_data, orders_data, lineitem_data, supplier_data,
+                            nation_data, region_data, num_threads, options, zone_maps, pushdown);
+}
+
+// Function to read all TPCH tables with lineitem as compressed chunks
+bool readTPCHData(
+    const std::string& table_path, 
+    std::vector<Customer> &customer_data,
+    std::vector<Orders> &orders_data,
+    std::vector<CompressedLineItems> &lineitem_data,
+    std::vector<Supplier> &supplier_data,
+    std::vector<Nation> &nation_data,
+    std::vector<Region> &region_data,
+    const int num_threads,
+    const ExecutionOptions &options,
+    ZoneMaps *zone_maps,
+    const LineItemPushdown *pushdown)
+{
+    return readTPCHDataInto(table_path, customer_data, orders_data, lineitem_data, supplier_data,
+                            nation_data, region_data, num_threads, options, zone_maps, pushdown);
+}
+
+
+
+
+// ---------------- Threaded Query Processing ----------------
+// Probe rows of one morsel by the filter that dropped them, added to the active Metrics
+// once at the end of the morsel
+struct ProbeRowCounts {
+    uint64_t rows = 0;
+    uint64_t zone_map_skipped = 0;
+    uint64_t order_rejected = 0;
+    uint64_t nation_mismatch = 0;
+    uint64_t aggregated = 0;
+
+    void flush(Metrics& metrics) const {
+        metrics.add(MetricsCounter::ProbeRows, rows);
+        metrics.add(MetricsCounter::ProbeZoneMapSkipped, zone_map_skipped);
+        metrics.add(MetricsCounter::ProbeOrderRejected, order_rejected);
+        metrics.add(MetricsCounter::ProbeNationMismatch, nation_mismatch);
+        metrics.add(MetricsCounter::ProbeAggregated, aggregated);
+    }
+};
+
+// Rows are only counted into counts in the COUNT_ROWS instantiation
+template <bool COUNT_ROWS>
+void threadProcessLineitems(
+    const PreprocessedData& processed_data,                 // Pre-filtered data and mappings for efficient lookup
+    const std::vector<LineItem>& lineitem_data,             // Chunk holding the LineItem rows of this morsel
+    size_t begin_row,                                       // First row of the morsel within the chunk
+    size_t end_row,                                         // One past the last row of the morsel
+    const DateZoneMap* zone_map,                            // Optional joined order date min/max per block of the chunk
+    RevenueSum* revenue_by_code,                            // Per-worker revenue per nation code
+    ProbeRowCounts& counts) {
+
+    if constexpr (COUNT_ROWS)
+        counts.rows += end_row - begin_row;
+
+    // Iterate over each LineItem in this morsel
+    for (size_t line_index = begin_row; line_index < end_row; ++line_index) {
+        // Skip a whole block at its first row if none of its orders can be in the date range
+        if (zone_map && line_index % ZONE_MAP_BLOCK_ROWS == 0
+            && blockOutsideRange(*zone_map, line_index / ZONE_MAP_BLOCK_ROWS, processed_data.startDay, processed_data.endDay)) {
+            if constexpr (COUNT_ROWS)
+                counts.zone_map_skipped += std::min(line_index + ZONE_MAP_BLOCK_ROWS, end_row) - line_index;
+            line_index = std::min(line_index + ZONE_MAP_BLOCK_ROWS, end_row) - 1;
+            continue;
+        }
+
+        const LineItem& row = lineitem_data[line_index];
+
+        // Filter: skip if the order is not in the preprocessed index (filtered orders)
+        int8_t custNation = processed_data.orderToCustomerNation.find(row.L_ORDERKEY);
+        if (custNation == JoinIndex::NOT_FOUND) {
+            if constexpr (COUNT_ROWS)
+                ++counts.order_rejected;
+            continue;
+        }
+
+        // Include only if the supplier was selected and is in the customer's nation
+        int8_t suppNation = processed_data.supplierToNation.find(row.L_SUPPKEY);
+        if (custNation == suppNation) {
+            // Accumulate revenue after discount, exact in units of 1e-4, under the nation code;
+            // names are only attached to the codes after the merge
+            revenue_by_code[suppNation] += lineItemRevenue(row.L_EXTENDEDPRICE, row.L_DISCOUNT);
+            if constexpr (COUNT_ROWS)
+                ++counts.aggregated;
+        }
+        else if constexpr (COUNT_ROWS)
+            ++counts.nation_mismatch;
+    }
+}
+
+
+// Probe the columns of one morsel. Dense join indexes go through the SIMD kernel selected by
+// simd_level, block by block so zone-mapped blocks outside the date range are skipped;
+// a sparse (hashed) index falls back to the row at a time filters
+void threadProcessLineitemColumns(
+    const PreprocessedData& processed_data,
+    const LineItemColumns& lineitem_data,
+    size_t begin_row,
+    size_t end_row,
+    const DateZoneMap* zone_map,
+    SimdLevel simd_level,
+    RevenueSum* revenue_by_code,                            // Per-worker revenue per nation code
+    ProbeRowCounts* counts)                                 // Row counts when instrumented, else nullptr
+{
+    const JoinIndex& orders = processed_data.orderToCustomerNation;
+    const JoinIndex& suppliers = processed_data.supplierToNation;
+    if (counts)
+        counts->rows += end_row - begin_row;
+
+    if (!orders.isDense() || !suppliers.isDense()) {
+        for (size_t row = begin_row; row < end_row; ++row) {
+            int8_t custNation = orders.find(lineitem_data.L_ORDERKEY[row]);
+            if (custNation == JoinIndex::NOT_FOUND) {
+                if (counts) ++counts->order_rejected;
+                continue;
+            }
+            if (custNation != suppliers.find(lineitem_data.L_SUPPKEY[row])) {
+                if (counts) ++counts->nation_mismatch;
+                continue;
+            }
+            revenue_by_code[custNation] += lineItemRevenue(lineitem_data.L_EXTENDEDPRICE[row], lineitem_data.L_DISCOUNT[row]);
+            if (counts) ++counts->aggregated;
+        }
+        return;
+    }
+
+    // The kernels do not report which filter dropped a row, only skipped blocks are counted
+
+    DenseCodeArray order_codes{orders.denseCodes(), orders.minKey(), orders.denseSize()};
+    DenseCodeArray supplier_codes{suppliers.denseCodes(), suppliers.minKey(), suppliers.denseSize()};
+
+    for (size_t block_start = begin_row; block_start < end_row; block_start += ZONE_MAP_BLOCK_ROWS) {
+        size_t block_end = std::min(block_start + ZONE_MAP_BLOCK_ROWS, end_row);
+        if (zone_map && blockOutsideRange(*zone_map, block_start / ZONE_MAP_BLOCK_ROWS,
+                                          processed_data.startDay, processed_data.endDay)) {
+            if (counts) counts->zone_map_skipped += block_end - block_start;
+            continue;
+        }
+        LineItemColumnRange range{lineitem_data.L_ORDERKEY.data() + block_start, lineitem_data.L_SUPPKEY.data() + block_start,
+                                  lineitem_data.L_EXTENDEDPRICE.data() + block_start, lineitem_data.L_DISCOUNT.data() + block_start,
+                                  block_end - block_start};
+        probeAggregate(simd_level, order_codes, supplier_codes, range,
+                       int(processed_data.nationNames.size()), revenue_by_code);
+    }
+}
+
+// Probe one morsel of a compressed chunk. Morsels start on block boundaries; each block not
+// skipped by the zone map is probed one L_ORDERKEY run at a time, so the orders index is read
+// once per order, and the other columns are only unpacked for the rows of joined orders
+void threadProcessLineitemsCompressed(
+    const PreprocessedData& processed_data,
+    const CompressedLineItems& lineitem_data,
+    size_t begin_row,
+    size_t end_row,
+    const DateZoneMap* zone_map,
+    RevenueSum* revenue_by_code,                            // Per-worker revenue per nation code
+    ProbeRowCounts* counts)                                 // Row counts when instrumented, else nullptr
+{
+    const JoinIndex& orders = processed_data.orderToCustomerNation;
+    const JoinIndex& suppliers = processed_data.supplierToNation;
+    if (counts)
+        counts->rows += end_row - begin_row;
+
+    int run_keys[COMPRESSED_BLOCK_ROWS];
+    uint32_t run_lengths[COMPRESSED_BLOCK_ROWS];
+    for (size_t block_start = begin_row; block_start < end_row; block_start += COMPRESSED_BLOCK_ROWS) {
+        size_t block = block_start / COMPRESSED_BLOCK_ROWS;
+        if (zone_map && blockOutsideRange(*zone_map, block, processed_data.startDay, processed_data.endDay)) {
+            if (counts) counts->zone_map_skipped += lineitem_data.blockRows(block);
+            continue;
+        }
+        size_t runs = lineitem_data.decodeOrderKeyRuns(block, run_keys, run_lengths);
+        size_t run_start = 0;
+        for (size_t run = 0; run < runs; run_start += run_lengths[run++]) {
+            int8_t custNation = orders.find(run_keys[run]);
+            if (custNation == JoinIndex::NOT_FOUND) {
+                if (counts) counts->order_rejected += run_lengths[run];
+                continue;
+            }
+            for (size_t row = run_start; row < run_start + run_lengths[run]; ++row) {
+                if (custNation != suppliers.find(lineitem_data.suppKey(block, row))) {
+                    if (counts) ++counts->nation_mismatch;
+                    continue;
+                }
+                revenue_by_code[custNation] += lineItemRevenue(lineitem_data.price(block, row), lineitem_data.discount(block, row));
+                if (counts) ++counts->aggregated;
+            }
+        }
+    }
+}
+
+
+void roundNationRevenue(const std::vector<NationRevenueSum> &sums, std::vector<Nation_Revenue> &results) {
+    for (const NationRevenueSum &sum : sums)
+        if (sum.REVENUE != 0)
+            results.push_back(Nation_Revenue{sum.NATION, revenueToDouble(sum.REVENUE)});
+
+    // Ties by nation so the order is deterministic too
+    std::sort(results.begin(), results.end(),
+              [&](const Nation_Revenue &a, const Nation_Revenue &b) {
+                  return a.REVENUE != b.REVENUE ? a.REVENUE > b.REVENUE : a.NATION < b.NATION;
+              });
+}
+
+// Merge the workers' per-code sums and name them. Group g is nation code g % num_codes of
+// results[g / num_codes], so a batch keeps one result list per query in a single aggregate.
+// Each list is sorted by revenue descending; revenue is only rounded to double here, and the
+// exact sums are kept in exact_results when it is given
+void collectNationRevenue(
+    const GroupAggregate &aggregate,
+    ThreadPool &pool,
+    const std::vector<std::string> &nation_names,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    std::vector<std::vector<NationRevenueSum>> *exact_results = nullptr)
+{
+    std::vector<std::pair<uint64_t, RevenueSum>> groups;
+    aggregate.merge(&pool, groups);
+
+    // Nations without qualifying rows have no group and are left out
+    const size_t num_codes = nation_names.size();
+    std::vector<std::vector<NationRevenueSum>> sums(results.size());
+    for (const std::pair<uint64_t, RevenueSum> &group : groups)
+        sums[group.first / num_codes].push_back(NationRevenueSum{nation_names[group.first % num_codes], group.second});
+
+    for (size_t query = 0; query < results.size(); ++query)
+        roundNationRevenue(sums[query], results[query]);
+    if (exact_results)
+        *exact_results = std::move(sums);
+}
+
+// Single query form of collectNationRevenue
+void collectNationRevenue(
+    const GroupAggregate &aggregate,
+    ThreadPool &pool,
+    const std::vector<std::string> &nation_names,
+    std::vector<Nation_Revenue> &results)
+{
+    std::vector<std::vector<Nation_Revenue>> query_results(1);
+    collectNationRevenue(aggregate, pool, nation_names, query_results);
+    results.insert(results.end(), query_results[0].begin(), query_results[0].end());
+}
+
+
+// Range of rows [begin_row, end_row) of one lineitem chunk processed as a unit of work
+struct ProbeMorsel {
+    size_t chunk;
+    size_t begin_row;
+    size_t end_row;
+};
+
+// Split every chunk into morsels of at most PROBE_MORSEL_ROWS rows
+template <typename Chunk>
+std::vector<ProbeMorsel> splitIntoProbeMorsels(const std::vector<Chunk> &lineitem_data) {
+    std::vector<ProbeMorsel> morsels;
+    for (size_t chunk = 0; chunk < lineitem_data.size(); ++chunk)
+        for (size_t begin_row = 0; begin_row < lineitem_data[chunk].size(); begin_row += PROBE_MORSEL_ROWS)
+            morsels.push_back({chunk, begin_row, std::min(begin_row + PROBE_MORSEL_ROWS, lineitem_data[chunk].size())});
+    return morsels;
+}
+
+// First probe morsel of every worker, as parallelFor's worker_starts. The morsels of chunk c
+// start on the worker whose equal share of the load morsels held c, the worker that filled
+// the chunk, so with --affinity a chunk is probed on the node its pages were first touched on
+std::vector<size_t> probeWorkerStarts(const std::vector<ProbeMorsel> &morsels, size_t num_chunks, int num_workers) {
+    std::vector<size_t> starts(num_workers + 1, morsels.size());
+    for (int worker = 0; worker < num_workers; ++worker) {
+        size_t first_chunk = num_chunks * worker / num_workers;
+        starts[worker] = std::lower_bound(morsels.begin(), morsels.end(), first_chunk,
+                                          [](const ProbeMorsel &morsel, size_t chunk) { return morsel.chunk < chunk; })
+                         - morsels.begin();
+    }
+    return starts;
+}
+
+// Stores the time since the previous lap into one phase of a QueryPhaseTimings; does nothing without one
+class PhaseClock {
+public:
+    explicit PhaseClock(QueryPhaseTimings* timings) : timings_(timings), last_(std::chrono::steady_clock::now()) {}
+
+    void lap(double QueryPhaseTimings::*phase) {
+        if (!timings_)
+            return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        timings_->*phase = std::chrono::duration<double, std::milli>(now - last_).count();
+        last_ = now;
+    }
+
+private:
+    QueryPhaseTimings* timings_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+
+// ---------------- Merge and radix joins ----------------
+// Order keys covered by one radix join partition: its dense orders index takes 256 KB, within
+// the L2 cache of current cores
+constexpr int RADIX_PARTITION_KEY_BITS = 18;
+// At most 2^RADIX_MAX_FANOUT_BITS partitions; a wider key range gets wider partitions instead,
+// so the scatter keeps few enough write targets for the TLB
+constexpr int RADIX_MAX_FANOUT_BITS = 10;
+// dbgen spreads order keys over about four times as many values as there are orders, and a
+// dense orders index holds one byte per value
+constexpr size_t ORDER_INDEX_BYTES_PER_ORDER = 4;
+// Orders index size above which Auto partitions unsorted input. Partitioning only pays off
+// once probes of the one byte per key index miss the last level cache (SF 5 and up)
+constexpr size_t RADIX_AUTO_INDEX_BYTES = size_t(32) << 20;
+
+// Join of one query: Auto merges sorted input and partitions unsorted input whose orders index
+// would not fit the last level cache; Merge without sorted input is decided like Auto
+JoinStrategy resolveJoinStrategy(JoinStrategy requested, const std::vector<Orders> &orders_data, const ZoneMaps *zone_maps) {
+    bool sorted = zone_maps && zone_maps->sorted_by_orderkey;
+    if (requested == JoinStrategy::Index || requested == JoinStrategy::Radix)
+        return requested;
+    if (sorted)
+        return JoinStrategy::Merge;
+    return orders_data.size() * ORDER_INDEX_BYTES_PER_ORDER > RADIX_AUTO_INDEX_BYTES
+        ? JoinStrategy::Radix : JoinStrategy::Index;
+}
+
+// Customer nation code of an order placed in the date range by a customer of the region, else NOT_FOUND
+inline int8_t orderNationCode(const PreprocessedData &processed_data, const Orders &order) {
+    if (order.O_ORDERDATE < processed_data.startDay || order.O_ORDERDATE >= processed_data.endDay)
+        return JoinIndex::NOT_FOUND;
+    return processed_data.customerToNation.find(order.O_CUSTKEY);
+}
+
+// First row at or after from of orders_data sorted by O_ORDERKEY whose key is not below key.
+// Galloping from the previous position costs O(log distance), so a merge over rows that the
+// pushdown filter or a zone map thinned out does not walk every order in between
+size_t seekOrder(const std::vector<Orders> &orders_data, size_t from, int key) {
+    size_t low = from, high = from, step = 1;
+    while (high < orders_data.size() && orders_data[high].O_ORDERKEY < key) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    high = std::min(high, orders_data.size());
+    return std::lower_bound(orders_data.begin() + low, orders_data.begin() + high, key,
+                            [](const Orders &o, int k) { return o.O_ORDERKEY < k; })
+           - orders_data.begin();
+}
+
+// Order keys a merge join block spreads over a direct addressed window of nation codes; a
+// block of dbgen lineitem rows spans about a quarter of this
+constexpr size_t MERGE_WINDOW_KEYS = 4 * ZONE_MAP_BLOCK_ROWS;
+
+// Write the nation code of every order key in [first_key, last_key] to window[key - first_key],
+// NOT_FOUND where there is no qualifying order; order_row is the first order with a key >= first_key
+void fillMergeWindow(const PreprocessedData &processed_data, const std::vector<Orders> &orders_data, size_t order_row,
+                     int first_key, int last_key, int8_t *window) {
+    std::fill_n(window, size_t(int64_t(last_key) - first_key) + 1, JoinIndex::NOT_FOUND);
+    for (size_t o = order_row; o < orders_data.size() && orders_data[o].O_ORDERKEY <= last_key; ++o)
+        window[uint32_t(orders_data[o].O_ORDERKEY) - uint32_t(first_key)] = orderNationCode(processed_data, orders_data[o]);
+}
+
+// Merge join of one morsel, whose rows ascend by order key. Block by block, the orders of the
+// block's key range are found by galloping forward through orders_data and their nation codes
+// written to a window indexed by key - first key of the block, which the rows then read like a
+// join index; compressed blocks read it once per order key run. Blocks spanning more keys than
+// the window merge row by row. Only rows of qualifying orders are read beyond their order key
+template <typename Chunk>
+void threadMergeJoinLineitems(
+    const PreprocessedData& processed_data,
+    const std::vector<Orders>& orders_data,                 // Sorted by O_ORDERKEY
+    const Chunk& lineitem_data,
+    size_t begin_row,
+    size_t end_row,
+    const DateZoneMap* zone_map,
+    RevenueSum* revenue_by_code,                            // Per-worker revenue per nation code
+    ProbeRowCounts* counts)                                 // Row counts when instrumented, else nullptr
+{
+    const JoinIndex& suppliers = processed_data.supplierToNation;
+    if (counts)
+        counts->rows += end_row - begin_row;
+
+    int key_buffer[ZONE_MAP_BLOCK_ROWS];
+    uint32_t run_lengths[ZONE_MAP_BLOCK_ROWS];                  // Compressed chunks only
+    int8_t window[MERGE_WINDOW_KEYS];
+    size_t order_row = 0;                                   // First order with a key >= the current block's first key
+    for (size_t block_start = begin_row; block_start < end_row; block_start += ZONE_MAP_BLOCK_ROWS) {
+        size_t block_end = std::min(block_start + ZONE_MAP_BLOCK_ROWS, end_row);
+        if (zone_map && blockOutsideRange(*zone_map, block_start / ZONE_MAP_BLOCK_ROWS,
+                                          processed_data.startDay, processed_data.endDay)) {
+            if (counts) counts->zone_map_skipped += block_end - block_start;
+            continue;
+        }
+
+        if constexpr (std::is_same_v<Chunk, CompressedLineItems>) {
+            // Runs of a compressed block give every order key once, so the window is read per order
+            size_t block = block_start / COMPRESSED_BLOCK_ROWS;
+            size_t runs = lineitem_data.decodeOrderKeyRuns(block, key_buffer, run_lengths);
+            uint64_t key_span = uint64_t(int64_t(key_buffer[runs - 1]) - key_buffer[0]) + 1;
+            if (key_span <= MERGE_WINDOW_KEYS) {
+                order_row = seekOrder(orders_data, order_row, key_buffer[0]);
+                fillMergeWindow(processed_data, orders_data, order_row, key_buffer[0], key_buffer[runs - 1], window);
+                size_t run_start = 0;
+                for (size_t run = 0; run < runs; run_start += run_lengths[run++]) {
+                    int8_t code = window[uint32_t(key_buffer[run]) - uint32_t(key_buffer[0])];
+                    if (code == JoinIndex::NOT_FOUND) {
+                        if (counts) counts->order_rejected += run_lengths[run];
+                        continue;
+                    }
+                    for (size_t row = run_start; row < run_start + run_lengths[run]; ++row) {
+                        if (code != suppliers.find(lineitem_data.suppKey(block, row))) {
+                            if (counts) ++counts->nation_mismatch;
+                            continue;
+                        }
+                        revenue_by_code[code] += lineItemRevenue(lineitem_data.price(block, row), lineitem_data.discount(block, row));
+                        if (counts) ++counts->aggregated;
+                    }
+                }
+                continue;
+            }
+        }
+
+        const size_t rows = block_end - block_start;
+        const int* keys = blockOrderKeys(lineitem_data, block_start, block_end, key_buffer);
+        const int first_key = keys[0];
+        order_row = seekOrder(orders_data, order_row, first_key);
+
+        auto joinRow = [&](size_t i, int8_t code) {
+            if (code == JoinIndex::NOT_FOUND) {
+                if (counts) ++counts->order_rejected;
+                return;
+            }
+            const LineItem row = joinedLineItem(lineitem_data, block_start + i, keys[i]);
+            if (code != suppliers.find(row.L_SUPPKEY)) {
+                if (counts) ++counts->nation_mismatch;
+                return;
+            }
+            revenue_by_code[code] += lineItemRevenue(row.L_EXTENDEDPRICE, row.L_DISCOUNT);
+            if (counts) ++counts->aggregated;
+        };
+
+        uint64_t key_span = uint64_t(int64_t(keys[rows - 1]) - first_key) + 1;
+        if (key_span <= MERGE_WINDOW_KEYS) {
+            fillMergeWindow(processed_data, orders_data, order_row, first_key, keys[rows - 1], window);
+            for (size_t i = 0; i < rows; ++i)
+                joinRow(i, window[uint32_t(keys[i]) - uint32_t(first_key)]);
+        }
+        else {
+            size_t o = order_row;
+            int8_t code = JoinIndex::NOT_FOUND;
+            for (size_t i = 0; i < rows; ++i) {
+                if (i == 0 || keys[i] != keys[i - 1]) {
+                    o = seekOrder(orders_data, o, keys[i]);
+                    code = o < orders_data.size() && orders_data[o].O_ORDERKEY == keys[i]
+                        ? orderNationCode(processed_data, orders_data[o]) : JoinIndex::NOT_FOUND;
+                }
+                joinRow(i, code);
+            }
+        }
+    }
+}
+
+// A lineitem row in a radix join partition, kept only if its supplier is in the region
+struct RadixProbeRow {
+    int order_key;
+    int8_t supplier_code;
+    int64_t revenue;
+};
+
+// Radix join of every chunk with the qualifying orders. Both sides are scattered into
+// partitions by the high bits of order key - smallest qualifying key, worker by worker; then
+// every partition builds a dense index of its orders, small enough to stay in cache, and
+// probes its lineitem rows. Only probe rows, zone map skips and aggregated rows are counted
+template <typename Chunk>
+void radixJoinLineItems(
+    const PreprocessedData& processed_data,
+    const std::vector<Orders>& orders_data,
+    const std::vector<Chunk>& lineitem_data,
+    const ZoneMaps* zone_maps,
+    ThreadPool& pool,
+    GroupAggregate& aggregate)
+{
+    const size_t num_workers = pool.size();
+    const DateZoneMap* orders_zone_map = zone_maps ? &zone_maps->orders : nullptr;
+
+    // Qualifying orders and their key range
+    std::vector<std::vector<JoinIndex::Entry>> worker_orders(num_workers);
+    std::vector<int> worker_min(num_workers, INT_MAX), worker_max(num_workers, INT_MIN);
+    size_t num_order_morsels = (orders_data.size() + PROBE_MORSEL_ROWS - 1) / PROBE_MORSEL_ROWS;
+    pool.parallelFor(num_order_morsels, [&](size_t morsel, int worker) {
+        size_t end = std::min((morsel + 1) * PROBE_MORSEL_ROWS, orders_data.size());
+        for (size_t block_start = morsel * PROBE_MORSEL_ROWS; block_start < end; block_start += ZONE_MAP_BLOCK_ROWS) {
+            if (orders_zone_map && blockOutsideRange(*orders_zone_map, block_start / ZONE_MAP_BLOCK_ROWS,
+                                                     processed_data.startDay, processed_data.endDay))
+                continue;
+            for (size_t row = block_start; row < std::min(block_start + ZONE_MAP_BLOCK_ROWS, end); ++row) {
+                int8_t code = orderNationCode(processed_data, orders_data[row]);
+                if (code == JoinIndex::NOT_FOUND)
+                    continue;
+                worker_orders[worker].push_back({orders_data[row].O_ORDERKEY, code});
+                worker_min[worker] = std::min(worker_min[worker], orders_data[row].O_ORDERKEY);
+                worker_max[worker] = std::max(worker_max[worker], orders_data[row].O_ORDERKEY);
+            }
+        }
+    });
+    int min_key = *std::min_element(worker_min.begin(), worker_min.end());
+    int max_key = *std::max_element(worker_max.begin(), worker_max.end());
+    if (min_key > max_key)
+        return;                                     // No order qualifies
+
+    uint64_t key_range = uint64_t(int64_t(max_key) - min_key) + 1;
+    int partition_bits = std::max(RADIX_PARTITION_KEY_BITS, int(std::bit_width(key_range - 1)) - RADIX_MAX_FANOUT_BITS);
+    size_t num_partitions = size_t((key_range - 1) >> partition_bits) + 1;
+
+    // Build side: [worker][partition]
+    std::vector<std::vector<std::vector<JoinIndex::Entry>>> order_parts(num_workers);
+    pool.parallelFor(num_workers, [&](size_t part, int) {
+        order_parts[part].resize(num_partitions);
+        for (const JoinIndex::Entry& entry : worker_orders[part])
+            order_parts[part][(uint32_t(entry.key) - uint32_t(min_key)) >> partition_bits].push_back(entry);
+        std::vector<JoinIndex::Entry>().swap(worker_orders[part]);
+    });
+
+    // Probe side: lineitem rows of the region's suppliers within the key range, [worker][partition]
+    const JoinIndex& suppliers = processed_data.supplierToNation;
+    bool use_lineitem_zone_maps = zone_maps && zone_maps->lineitem.size() == lineitem_data.size();
+    std::vector<ProbeMorsel> morsels = splitIntoProbeMorsels(lineitem_data);
+    std::vector<std::vector<std::vector<RadixProbeRow>>> probe_parts(
+        num_workers, std::vector<std::vector<RadixProbeRow>>(num_partitions));
+    pool.parallelFor(morsels.size(), probeWorkerStarts(morsels, lineitem_data.size(), pool.size()),
+                     [&](size_t morsel_index, int worker) {
+        const ProbeMorsel& morsel = morsels[morsel_index];
+        const DateZoneMap* zone_map = use_lineitem_zone_maps ? &zone_maps->lineitem[morsel.chunk] : nullptr;
+        std::vector<std::vector<RadixProbeRow>>& parts = probe_parts[worker];
+        int key_buffer[ZONE_MAP_BLOCK_ROWS];
+        ProbeRowCounts counts;
+        counts.rows = morsel.end_row - morsel.begin_row;
+        for (size_t block_start = morsel.begin_row; block_start < morsel.end_row; block_start += ZONE_MAP_BLOCK_ROWS) {
+            size_t block_end = std::min(block_start + ZONE_MAP_BLOCK_ROWS, morsel.end_row);
+            if (zone_map && blockOutsideRange(*zone_map, block_start / ZONE_MAP_BLOCK_ROWS,
+                                              processed_data.startDay, processed_data.endDay)) {
+                counts.zone_map_skipped += block_end - block_start;
+                continue;
+            }
+            const int* keys = blockOrderKeys(lineitem_data[morsel.chunk], block_start, block_end, key_buffer);
+            for (size_t i = 0; i < block_end - block_start; ++i) {
+                uint32_t offset = uint32_t(keys[i]) - uint32_t(min_key);
+                if (offset >= key_range)
+                    continue;
+                const LineItem row = joinedLineItem(lineitem_data[morsel.chunk], block_start + i, keys[i]);
+                int8_t code = suppliers.find(row.L_SUPPKEY);
+                if (code != JoinIndex::NOT_FOUND)
+                    parts[offset >> partition_bits].push_back(
+                        {row.L_ORDERKEY, code, lineItemRevenue(row.L_EXTENDEDPRICE, row.L_DISCOUNT)});
+            }
+        }
+        if (Metrics* metrics = activeMetrics())
+            counts.flush(*metrics);
+    });
+
+    // Join partition by partition
+    pool.parallelFor(num_partitions, [&](size_t partition, int worker) {
+        std::vector<JoinIndex::Entry> entries;
+        for (size_t part = 0; part < num_workers; ++part)
+            entries.insert(entries.end(), order_parts[part][partition].begin(), order_parts[part][partition].end());
+        if (entries.empty())
+            return;
+        JoinIndex orders;
+        orders.build(entries, size_t(1) << partition_bits);
+
+        RevenueSum* revenue_by_code = aggregate.denseSums(worker);
+        uint64_t aggregated = 0;
+        for (size_t part = 0; part < num_workers; ++part)
+            for (const RadixProbeRow& row : probe_parts[part][partition])
+                if (orders.find(row.order_key) == row.supplier_code) {
+                    revenue_by_code[row.supplier_code] += row.revenue;
+                    ++aggregated;
+                }
+        if (Metrics* metrics = activeMetrics())
+            metrics->add(MetricsCounter::ProbeAggregated, aggregated);
+    });
+}
+
+// Q5 with the Merge or Radix join. Both select the qualifying orders themselves, so
+// preprocess does not build the orders index
+template <typename Chunk>
+bool executeQuery5Join(
+    JoinStrategy join,
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<Chunk> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps,
+    QueryPhaseTimings *timings,
+    const PreprocessedData *preprocessed)
+{
+    PhaseClock clock(timings);
+    ThreadPool& pool = sharedThreadPool(num_threads);
+
+    // Indexes the loader built for its pushdown filter cover these joins as well
+    const bool reuse = preprocessed && preprocessed->ordersIndexed;
+    MetricsPhaseScope phase(reuse ? MetricsPhase::Probe : MetricsPhase::Preprocess);
+    PreprocessedData local_data;
+    if (!reuse && !preprocess(r_name, start_date, end_date, customer_data, orders_data,
+                              supplier_data, nation_data, region_data,
+                              zone_maps ? &zone_maps->orders : nullptr, local_data, &pool, false))
+        return false;
+    const PreprocessedData& processed_data = reuse ? *preprocessed : local_data;
+    clock.lap(&QueryPhaseTimings::preprocess_ms);
+
+    GroupAggregate aggregate(pool.size(), processed_data.nationNames.size());
+    if (!reuse)
+        phase.next(MetricsPhase::Probe);
+    if (join == JoinStrategy::Merge) {
+        bool use_lineitem_zone_maps = zone_maps && zone_maps->lineitem.size() == lineitem_data.size();
+        std::vector<ProbeMorsel> morsels = splitIntoProbeMorsels(lineitem_data);
+        NodeReplicas<PreprocessedData> replicas(pool, processed_data);
+        pool.parallelFor(morsels.size(), probeWorkerStarts(morsels, lineitem_data.size(), pool.size()),
+                         [&](size_t morsel_index, int worker) {
+            const ProbeMorsel& morsel = morsels[morsel_index];
+            Metrics* metrics = activeMetrics();
+            ProbeRowCounts counts;
+            threadMergeJoinLineitems(replicas.forWorker(worker), orders_data, lineitem_data[morsel.chunk],
+                                     morsel.begin_row, morsel.end_row,
+                                     use_lineitem_zone_maps ? &zone_maps->lineitem[morsel.chunk] : nullptr,
+                                     aggregate.denseSums(worker), metrics ? &counts : nullptr);
+            if (metrics)
+                counts.flush(*metrics);
+        });
+    }
+    else
+        radixJoinLineItems(processed_data, orders_data, lineitem_data, zone_maps, pool, aggregate);
+    clock.lap(&QueryPhaseTimings::probe_ms);
+
+    phase.next(MetricsPhase::Merge);
+    collectNationRevenue(aggregate, pool, processed_data.nationNames, results);
+    clock.lap(&QueryPhaseTimings::merge_ms);
+    return true;
+}
+
+// Function to execute TPCH Query 5 using multithreading, over lineitem chunks of any layout.
+// Only the probe kernel differs between the layouts; columns also take the SIMD level
+template <typename Chunk>
+bool executeQuery5Into(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<Chunk> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps,
+    SimdLevel simd_level,
+    QueryPhaseTimings *timings,
+    JoinStrategy join_strategy,
+    const PreprocessedData *preprocessed)
+{
+    JoinStrategy join = resolveJoinStrategy(join_strategy, orders_data, zone_maps);
+    if (join != JoinStrategy::Index)
+        return executeQuery5Join(join, r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                                 supplier_data, nation_data, region_data, results, zone_maps, timings, preprocessed);
+
+    PhaseClock clock(timings);
+    ThreadPool& pool = sharedThreadPool(num_threads);
+
+    // Preprocess data (apply filters, prepare lookup tables), unless the loader already did for its pushdown filter
+    const bool reuse = preprocessed && preprocessed->ordersIndexed;
+    MetricsPhaseScope phase(reuse ? MetricsPhase::Probe : MetricsPhase::Preprocess);
+    PreprocessedData local_data;
+    if (!reuse && !preprocess(r_name, start_date, end_date, customer_data, orders_data,
+                              supplier_data, nation_data, region_data,
+                              zone_maps ? &zone_maps->orders : nullptr, local_data, &pool))
+        return false;
+    const PreprocessedData& processed_data = reuse ? *preprocessed : local_data;
+    clock.lap(&QueryPhaseTimings::preprocess_ms);
+
+    // Lineitem zone maps are only usable if they describe exactly these chunks
+    bool use_lineitem_zone_maps = zone_maps && zone_maps->lineitem.size() == lineitem_data.size();
+    std::vector<ProbeMorsel> morsels = splitIntoProbeMorsels(lineitem_data);
+
+    // Resolve the kernel once instead of per morsel
+    if constexpr (std::is_same_v<Chunk, LineItemColumns>)
+        simd_level = resolveSimdLevel(simd_level);
+
+    GroupAggregate aggregate(pool.size(), processed_data.nationNames.size());  // Worker-local sums per nation code
+
+    // Process morsels in parallel; workers read their node's copy of processed_data and the chunks by reference
+    if (!reuse)
+        phase.next(MetricsPhase::Probe);
+    NodeReplicas<PreprocessedData> replicas(pool, processed_data);
+    pool.parallelFor(morsels.size(), probeWorkerStarts(morsels, lineitem_data.size(), pool.size()),
+                     [&](size_t morsel_index, int worker) {
+        const ProbeMorsel& morsel = morsels[morsel_index];
+        const PreprocessedData& local_data = replicas.forWorker(worker);
+        const Chunk& chunk = lineitem_data[morsel.chunk];
+        const DateZoneMap* zone_map = use_lineitem_zone_maps ? &zone_maps->lineitem[morsel.chunk] : nullptr;
+        Metrics* metrics = activeMetrics();
+        ProbeRowCounts counts;
+        if constexpr (std::is_same_v<Chunk, LineItemColumns>)
+            threadProcessLineitemColumns(local_data, chunk, morsel.begin_row, morsel.end_row, zone_map,
+                                         simd_level, aggregate.denseSums(worker), metrics ? &counts : nullptr);
+        else if constexpr (std::is_same_v<Chunk, CompressedLineItems>)
+            threadProcessLineitemsCompressed(local_data, chunk, morsel.begin_row, morsel.end_row, zone_map,
+                                             aggregate.denseSums(worker), metrics ? &counts : nullptr);
+        else if (metrics)
+            threadProcessLineitems<true>(local_data, chunk, morsel.begin_row, morsel.end_row,
+                                         zone_map, aggregate.denseSums(worker), counts);
+        else
+            threadProcessLineitems<false>(local_data, chunk, morsel.begin_row, morsel.end_row,
+                                          zone_map, aggregate.denseSums(worker), counts);
+        if (metrics)
+            counts.flush(*metrics);
+    });
+    clock.lap(&QueryPhaseTimings::probe_ms);
+
+    phase.next(MetricsPhase::Merge);
+    collectNationRevenue(aggregate, pool, processed_data.nationNames, results);
+    clock.lap(&QueryPhaseTimings::merge_ms);
+    return true;
+}
+
+bool executeQuery5(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<std::vector<LineItem>> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps,
+    QueryPhaseTimings *timings,
+    JoinStrategy join_strategy,
+    const PreprocessedData *preprocessed)
+{
+    return executeQuery5Into(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                             supplier_data, nation_data, region_data, results, zone_maps, SimdLevel::Auto,
+                             timings, join_strategy, preprocessed);
+}
+
+bool executeQuery5(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<LineItemColumns> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps,
+    SimdLevel simd_level,
+    QueryPhaseTimings *timings,
+    JoinStrategy join_strategy,
+    const PreprocessedData *preprocessed)
+{
+    return executeQuery5Into(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                             supplier_data, nation_data, region_data, results, zone_maps, simd_level,
+                             timings, join_strategy, preprocessed);
+}
+
+bool executeQuery5(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<CompressedLineItems> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<Nation_Revenue> &results,
+    const ZoneMaps *zone_maps,
+    QueryPhaseTimings *timings,
+    JoinStrategy join_strategy,
+    const PreprocessedData *preprocessed)
+{
+    return executeQuery5Into(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                             supplier_data, nation_data, region_data, results, zone_maps, SimdLevel::Auto,
+                             timings, join_strategy, preprocessed);
+}
+
+
+// ---------------- Refresh sets ----------------
+// Function to read one dbgen refresh set for the revenue cube
+bool readRefreshSet(
+    const std::string& table_path,
+    int set_number,
+    std::vector<Orders> &new_orders,
+    std::vector<LineItem> &new_lineitems,
+    std::vector<int> &deleted_orderkeys)
+{
+    const std::string suffix = std::to_string(set_number);
+    bool found = false;
+
+    // RF1: new orders and their lineitems, same format as the base tables
+    found |= loadOrders(table_path + "/orders.tbl.u" + suffix, new_orders);
+
+    std::ifstream lineitem_file(table_path + "/lineitem.tbl.u" + suffix, std::ios::ate);
+    if (lineitem_file.is_open()) {
+        loadLineItemChunk(table_path + "/lineitem.tbl.u" + suffix, 0, size_t(lineitem_file.tellg()), new_lineitems, nullptr);
+        found = true;
+    }
+
+    // RF2: one "orderkey|" line per deleted order
+    std::ifstream delete_file(table_path + "/delete." + suffix);
+    if (delete_file.is_open()) {
+        std::string line;
+        while (std::getline(delete_file, line)) {
+            std::vector<std::string> tokens = splitStringByDelimiter(line);
+            if (isNumber(tokens[0]))
+                deleted_orderkeys.push_back(std::stoi(tokens[0]));
+        }
+        found = true;
+    }
+    return found;
+}
+
+
+
+// ---------------- Shared-scan batch execution ----------------
+// Parse a REGION|START_DATE|END_DATE line
+bool parseQueryParameters(const std::string& line, Query5Parameters& query) {
+    std::vector<std::string> tokens = splitStringByDelimiter(line);
+    if (tokens.size() != 3 || tokens[0].empty())
+        return false;
+    query = Query5Parameters{tokens[0], tokens[1], tokens[2]};
+    return true;
+}
+
+// Read the parameter sets of a --batch_file
+bool readQueryBatch(const std::string& filepath, std::vector<Query5Parameters>& queries) {
+    std::ifstream file(filepath);
+    if (!file.is_open())
+        return false;               // Error Opening File
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        Query5Parameters query;
+        if (!parseQueryParameters(line, query))
+            return false;
+        queries.push_back(query);
+    }
+    return !queries.empty();
+}
+
+// Probe one morsel for every query of a batch: a row whose customer and supplier nation
+// match adds its revenue to revenue[query * num_codes + code] for each query in its mask
+template <typename Chunk>
+void threadProcessLineitemsBatch(
+    const BatchPreprocessedData& batch_data,
+    const Chunk& lineitem_data,
+    size_t begin_row,
+    size_t end_row,
+    const DateZoneMap* zone_map,                            // Optional joined order date min/max per block of the chunk
+    RevenueSum* revenue)
+{
+    const size_t num_codes = batch_data.nationNames.size();
+    for (size_t line_index = begin_row; line_index < end_row; ++line_index) {
+        // Skip a whole block if none of its orders can be in any query's date range
+        if (zone_map && line_index % ZONE_MAP_BLOCK_ROWS == 0
+            && blockOutsideRange(*zone_map, line_index / ZONE_MAP_BLOCK_ROWS, batch_data.minDay, batch_data.maxDay)) {
+            line_index = std::min(line_index + ZONE_MAP_BLOCK_ROWS, end_row) - 1;
+            continue;
+        }
+
+        const LineItem row = lineItemAt(lineitem_data, line_index);
+        int8_t custNation = batch_data.orderToCustomerNation.find(row.L_ORDERKEY);
+        if (custNation == JoinIndex::NOT_FOUND || custNation != batch_data.supplierToNation.find(row.L_SUPPKEY))
+            continue;
+
+        uint64_t queries = batch_data.queryMask(custNation, batch_data.orderToDateSegment.find(row.L_ORDERKEY));
+        int64_t row_revenue = lineItemRevenue(row.L_EXTENDEDPRICE, row.L_DISCOUNT);
+        for (; queries != 0; queries &= queries - 1)
+            revenue[size_t(std::countr_zero(queries)) * num_codes + custNation] += row_revenue;
+    }
+}
+
+// Same as above for a compressed chunk, one L_ORDERKEY run at a time like threadProcessLineitemsCompressed
+void threadProcessLineitemsBatch(
+    const BatchPreprocessedData& batch_data,
+    const CompressedLineItems& lineitem_data,
+    size_t begin_row,
+    size_t end_row,
+    const DateZoneMap* zone_map,
+    RevenueSum* revenue)
+{
+    const size_t num_codes = batch_data.nationNames.size();
+    int run_keys[COMPRESSED_BLOCK_ROWS];
+    uint32_t run_lengths[COMPRESSED_BLOCK_ROWS];
+    for (size_t block_start = begin_row; block_start < end_row; block_start += COMPRESSED_BLOCK_ROWS) {
+        size_t block = block_start / COMPRESSED_BLOCK_ROWS;
+        if (zone_map && blockOutsideRange(*zone_map, block, batch_data.minDay, batch_data.maxDay))
+            continue;
+
+        size_t runs = lineitem_data.decodeOrderKeyRuns(block, run_keys, run_lengths);
+        size_t run_start = 0;
+        for (size_t run = 0; run < runs; run_start += run_lengths[run++]) {
+            int8_t custNation = batch_data.orderToCustomerNation.find(run_keys[run]);
+            if (custNation == JoinIndex::NOT_FOUND)
+                continue;
+            uint64_t run_queries = batch_data.queryMask(custNation, batch_data.orderToDateSegment.find(run_keys[run]));
+
+            for (size_t row = run_start; row < run_start + run_lengths[run]; ++row) {
+                if (custNation != batch_data.supplierToNation.find(lineitem_data.suppKey(block, row)))
+                    continue;
+                int64_t row_revenue = lineItemRevenue(lineitem_data.price(block, row), lineitem_data.discount(block, row));
+                for (uint64_t queries = run_queries; queries != 0; queries &= queries - 1)
+                    revenue[size_t(std::countr_zero(queries)) * num_codes + custNation] += row_revenue;
+            }
+        }
+    }
+}
+
+// Run one group of at most MAX_BATCH_QUERIES queries with a single scan over the chunks
+template <typename Chunk>
+bool executeQuery5BatchGroup(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<Chunk> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps,
+    std::vector<std::vector<NationRevenueSum>> *exact_results)
+{
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    MetricsPhaseScope phase(MetricsPhase::Preprocess);
+    BatchPreprocessedData batch_data;
+    if (!preprocessBatch(queries, customer_data, orders_data, supplier_data, nation_data, region_data,
+                         zone_maps ? &zone_maps->orders : nullptr, batch_data, &pool))
+        return false;
+
+    bool use_lineitem_zone_maps = zone_maps && zone_maps->lineitem.size() == lineitem_data.size();
+    std::vector<ProbeMorsel> morsels = splitIntoProbeMorsels(lineitem_data);
+
+    const size_t num_codes = batch_data.nationNames.size();
+    GroupAggregate aggregate(pool.size(), queries.size() * num_codes);
+    phase.next(MetricsPhase::Probe);
+    NodeReplicas<BatchPreprocessedData> replicas(pool, batch_data);
+    pool.parallelFor(morsels.size(), probeWorkerStarts(morsels, lineitem_data.size(), pool.size()),
+                     [&](size_t morsel_index, int worker) {
+        const ProbeMorsel& morsel = morsels[morsel_index];
+        threadProcessLineitemsBatch(replicas.forWorker(worker), lineitem_data[morsel.chunk], morsel.begin_row, morsel.end_row,
+                                    use_lineitem_zone_maps ? &zone_maps->lineitem[morsel.chunk] : nullptr,
+                                    aggregate.denseSums(worker));
+        if (Metrics* metrics = activeMetrics())
+            metrics->add(MetricsCounter::ProbeRows, morsel.end_row - morsel.begin_row);
+    });
+
+    phase.next(MetricsPhase::Merge);
+    results.assign(queries.size(), {});
+    collectNationRevenue(aggregate, pool, batch_data.nationNames, results, exact_results);
+    return true;
+}
+
+// Split the batch into groups of MAX_BATCH_QUERIES, one lineitem scan per group
+template <typename Chunk>
+bool executeQuery5BatchInto(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<Chunk> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps,
+    std::vector<std::vector<NationRevenueSum>> *exact_results)
+{
+    results.clear();
+    if (exact_results)
+        exact_results->clear();
+    for (size_t first = 0; first < queries.size(); first += MAX_BATCH_QUERIES) {
+        std::vector<Query5Parameters> group(queries.begin() + first,
+                                            queries.begin() + std::min(first + MAX_BATCH_QUERIES, queries.size()));
+        std::vector<std::vector<Nation_Revenue>> group_results;
+        std::vector<std::vector<NationRevenueSum>> group_exact_results;
+        if (!executeQuery5BatchGroup(group, num_threads, customer_data, orders_data, lineitem_data,
+                                     supplier_data, nation_data, region_data, group_results, zone_maps,
+                                     exact_results ? &group_exact_results : nullptr))
+            return false;
+        std::move(group_results.begin(), group_results.end(), std::back_inserter(results));
+        if (exact_results)
+            std::move(group_exact_results.begin(), group_exact_results.end(), std::back_inserter(*exact_results));
+    }
+    return true;
+}
+
+bool executeQuery5Batch(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<std::vector<LineItem>> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps,
+    std::vector<std::vector<NationRevenueSum>> *exact_results)
+{
+    return executeQuery5BatchInto(queries, num_threads, customer_data, orders_data, lineitem_data,
+                                  supplier_data, nation_data, region_data, results, zone_maps, exact_results);
+}
+
+bool executeQuery5Batch(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<LineItemColumns> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps,
+    std::vector<std::vector<NationRevenueSum>> *exact_results)
+{
+    return executeQuery5BatchInto(queries, num_threads, customer_data, orders_data, lineitem_data,
+                                  supplier_data, nation_data, region_data, results, zone_maps, exact_results);
+}
+
+bool executeQuery5Batch(
+    const std::vector<Query5Parameters> &queries,
+    int num_threads,
+    const std::vector<Customer> &customer_data,
+    const std::vector<Orders> &orders_data,
+    const std::vector<CompressedLineItems> &lineitem_data,
+    const std::vector<Supplier> &supplier_data,
+    const std::vector<Nation> &nation_data,
+    const std::vector<Region> &region_data,
+    std::vector<std::vector<Nation_Revenue>> &results,
+    const ZoneMaps *zone_maps,
+    std::vector<std::vector<NationRevenueSum>> *exact_results)
+{
+    return executeQuery5BatchInto(queries, num_threads, customer_data, orders_data, lineitem_data,
+                                  supplier_data, nation_data, region_data, results, zone_maps, exact_results);
+}
+
+
+
+// ---------------- Streaming execution ----------------
+// Rows of the streaming Q5 pipelines: the parsed columns plus the nation code a probe attached
+struct Q5OrderRow {
+    Orders order;
+    int8_t customer_code;
+};
+
+struct Q5LineItemRow {
+    LineItem item;
+    int8_t customer_code;
+};
+
+// Function to execute TPCH Query 5 without materializing orders or lineitem, as two pipelines
+// (see pipeline.hpp) over the table text after the small tables are loaded and preprocessed:
+//   orders.tbl    -> filter order date -> probe customers -> build order key -> customer nation
+//   lineitem.tbl  -> probe orders -> filter supplier nation == customer nation -> aggregate
+// Peak memory is bounded by the small tables and the orders join index.
+bool executeQuery5Streaming(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Nation_Revenue> &results)
+{
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    std::vector<Customer> customer_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    MetricsPhaseScope phase(MetricsPhase::Load);
+    if (!loadSmallTablesAsync(table_path, customer_data, supplier_data, nation_data, region_data, options).get())
+        return false;
+
+    // Customers and suppliers are indexed here, orders by the first pipeline
+    phase.next(MetricsPhase::Preprocess);
+    PreprocessedData processed_data;
+    if (!preprocess(r_name, start_date, end_date, customer_data, std::vector<Orders>(),
+                    supplier_data, nation_data, region_data, nullptr, processed_data, &pool))
+        return false;
+
+    // Only the join indexes are needed from here on, release the raw tables before the scans
+    std::vector<Customer>().swap(customer_data);
+    std::vector<Supplier>().swap(supplier_data);
+
+    const std::vector<std::string> orders_paths = tableShardPaths(table_path, "orders");
+    const std::vector<std::string> lineitem_paths = tableShardPaths(table_path, "lineitem");
+
+    pipeline::JoinBuild<JoinIndex> order_build(pool);
+    size_t orders_lines;
+    if (!pipeline::forEachMorsel(pool, orders_paths, orders_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+        uint64_t malformed = 0;
+        auto parse = [&](const char* cursor, const char* line_end, Q5OrderRow& row) {
+            bool parsed = parseOrdersRow(cursor, line_end, row.order);
+            malformed += !parsed;
+            return parsed;
+        };
+        size_t lines = pipeline::scanRows<Q5OrderRow>(begin, end, start_offset, end_offset, parse,
+            pipeline::filter([&](const Q5OrderRow& row) {
+                    return row.order.O_ORDERDATE >= processed_data.startDay && row.order.O_ORDERDATE < processed_data.endDay;
+                },
+            pipeline::probe(processed_data.customerToNation,
+                [](const Q5OrderRow& row) { return row.order.O_CUSTKEY; },
+                [](Q5OrderRow& row, int8_t code) { row.customer_code = code; },
+            pipeline::insert(order_build, worker,
+                [](const Q5OrderRow& row) { return row.order.O_ORDERKEY; },
+                [](const Q5OrderRow& row) { return row.customer_code; }))));
+
+        if (Metrics* metrics = activeMetrics()) {
+            metrics->add(MetricsCounter::OrdersLines, lines);
+            metrics->add(MetricsCounter::OrdersMalformed, malformed);
+        }
+        return lines;
+    }))
+        return false;                                  // Error Reading File
+    std::vector<JoinIndex::Entry> order_entries = order_build.entries(pool);
+    processed_data.orderToCustomerNation.build(order_entries, orders_lines, &pool);
+    processed_data.lineitemFilter.orders.build(order_entries, orders_lines, &pool);
+    std::vector<JoinIndex::Entry>().swap(order_entries);
+
+    GroupAggregate aggregate(pool.size(), processed_data.nationNames.size());
+
+    phase.next(MetricsPhase::Probe);
+    NodeReplicas<PreprocessedData> replicas(pool, processed_data);
+    size_t lineitem_lines;
+    if (!pipeline::forEachMorsel(pool, lineitem_paths, lineitem_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+        const PreprocessedData& local_data = replicas.forWorker(worker);
+        Metrics* metrics = activeMetrics();
+        ProbeRowCounts counts;
+        uint64_t order_matched = 0;
+
+        auto chain =
+            pipeline::probe(local_data.orderToCustomerNation,
+                [](const Q5LineItemRow& row) { return row.item.L_ORDERKEY; },
+                [](Q5LineItemRow& row, int8_t code) { row.customer_code = code; },
+            pipeline::count(metrics ? &order_matched : nullptr,
+            pipeline::filter([&](const Q5LineItemRow& row) {
+                    return local_data.supplierToNation.find(row.item.L_SUPPKEY) == row.customer_code;
+                },
+            pipeline::count(metrics ? &counts.aggregated : nullptr,
+            pipeline::aggregate(aggregate, worker,
+                [](const Q5LineItemRow& row) { return uint64_t(row.customer_code); },
+                [](const Q5LineItemRow& row) { return lineItemRevenue(row.item.L_EXTENDEDPRICE, row.item.L_DISCOUNT); })))));
+
+        // The lineitem loader is the source; its key filters drop most non-joining rows before
+        // their decimals are parsed
+        const LineItemFilter* filter = options.pushdown_filter ? &local_data.lineitemFilter : nullptr;
+        scanLineItemText(begin, end, start_offset, end_offset, filter, [&](const LineItem& item) {
+            Q5LineItemRow row{item, JoinIndex::NOT_FOUND};
+            chain.push(row);
+            if (metrics) ++counts.rows;
+        });
+        if (metrics) {
+            counts.order_rejected = counts.rows - order_matched;
+            counts.nation_mismatch = order_matched - counts.aggregated;
+            counts.flush(*metrics);
+        }
+        return size_t(0);
+    }))
+        return false;                                  // Error Reading File
+
+    phase.next(MetricsPhase::Merge);
+    collectNationRevenue(aggregate, pool, processed_data.nationNames, results);
+    return true;
+}
+
+
+
+// ---------------- Out-of-core execution ----------------
+// Lineitem row spilled once its supplier joined: only what the order join and the sum still need
+struct SpilledLineItem {
+    int64_t price;              // L_EXTENDEDPRICE in cents
+    int32_t order_key;
+    int16_t discount;           // L_DISCOUNT in hundredths
+    int8_t supplier_code;       // Nation code of the supplier
+};
+
+// Bytes one order of a partition takes while it is joined: the spilled entry read back plus
+// its share of the join index, which is at most four 8 byte hash slots per entry
+constexpr size_t PARTITION_BYTES_PER_ORDER = sizeof(JoinIndex::Entry) + 32;
+constexpr size_t SPILL_BUFFER_BYTES = size_t(64) << 10;     // Per partition and worker while spilling
+constexpr size_t MIN_SPILL_BUFFER_BYTES = size_t(4) << 10;
+constexpr size_t MAX_SPILL_PARTITIONS = 1024;               // Two open files per partition
+constexpr size_t SPILL_READ_ROWS = TEXT_MORSEL_BYTES / sizeof(SpilledLineItem);
+
+// Spill partition of an order key: the top partition_bits of a murmur3 finalizer. A different
+// hash than JoinIndex's multiplicative one, so the keys of one partition still spread over
+// every slot of the partition's join index
+inline size_t spillPartition(int order_key, int partition_bits) {
+    uint32_t hash = uint32_t(order_key);
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return partition_bits ? hash >> (32 - partition_bits) : 0;
+}
+
+// Bytes of text of all the files of table name, every shard of a sharded table, compressed
+// files counted by their decompressed size
+size_t tableBytes(const std::string &table_path, const char *name) {
+    size_t bytes = 0;
+    for (const std::string& filepath : tableShardPaths(table_path, name))
+        bytes += tableTextBytes(filepath);
+    return bytes;
+}
+
+// Customer and supplier rows with their join indexes, the part of a query that stays in memory
+size_t estimateDimensionMemory(const std::string &table_path) {
+    size_t customer_rows = tableBytes(table_path, "customer") / CUSTOMER_BYTES_PER_ROW;
+    size_t supplier_rows = tableBytes(table_path, "supplier") / SUPPLIER_BYTES_PER_ROW;
+    return customer_rows * (sizeof(Customer) + 1) + supplier_rows * (sizeof(Supplier) + 1);
+}
+
+size_t estimateQueryMemory(const std::string &table_path, const ExecutionOptions &options) {
+    // dbgen leaves gaps in the order keys, a dense orders index spans about four keys per row
+    size_t orders_rows = tableBytes(table_path, "orders") / ORDERS_BYTES_PER_ROW;
+    size_t bytes = estimateDimensionMemory(table_path) + orders_rows * (sizeof(Orders) + 4);
+    if (options.execution_mode == ExecutionMode::Materialize)
+        bytes += tableBytes(table_path, "lineitem") / LINEITEM_BYTES_PER_ROW
+                 * (options.lineitem_layout == LineItemLayout::Compressed ? COMPRESSED_LINEITEM_BYTES : sizeof(LineItem));
+    return bytes;
+}
+
+// Function to execute TPCH Query 5 in a fixed memory budget. Only the dimension tables are loaded.
+// Orders and lineitem are scanned once from their files; the orders that pass the date and
+// customer filters and the lineitem rows whose supplier joined are appended to spill partitions
+// by order key. Each partition then builds its own orders index and probes its lineitem rows.
+// Pages of the mapped files are clean and can be dropped by the kernel, so they are not counted.
+bool executeQuery5OutOfCore(
+    const std::string &r_name,
+    const std::string &start_date,
+    const std::string &end_date,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Nation_Revenue> &results)
+{
+    ThreadPool& pool = sharedThreadPool(num_threads);
+
+    // The dimension tables and one read buffer per worker stay resident. Three quarters of
+    // the rest hold one partition of orders, one quarter the workers' spill buffers
+    size_t resident_bytes = estimateDimensionMemory(table_path) + pool.size() * TEXT_MORSEL_BYTES;
+    if (options.memory_limit <= resident_bytes) {
+        std::cerr << "--memory_limit must be larger than " << resident_bytes << " bytes for these tables." << std::endl;
+        return false;
+    }
+    size_t free_bytes = options.memory_limit - resident_bytes;
+    size_t orders_bytes = tableBytes(table_path, "orders") / ORDERS_BYTES_PER_ROW * PARTITION_BYTES_PER_ORDER;
+    size_t partition_budget = free_bytes / 4 * 3;
+    size_t num_partitions = std::bit_ceil(std::max<size_t>((orders_bytes + partition_budget - 1) / partition_budget, 1));
+    if (num_partitions > MAX_SPILL_PARTITIONS) {
+        std::cerr << "--memory_limit is too small to partition the orders in " << table_path << "." << std::endl;
+        return false;
+    }
+    const int partition_bits = std::countr_zero(num_partitions);
+    const size_t buffer_bytes = std::clamp(free_bytes / 4 / (pool.size() * num_partitions),
+                                           MIN_SPILL_BUFFER_BYTES, SPILL_BUFFER_BYTES);
+
+    std::vector<Customer> customer_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    MetricsPhaseScope phase(MetricsPhase::Load);
+    if (!loadSmallTablesAsync(table_path, customer_data, supplier_data, nation_data, region_data, options).get())
+        return false;
+
+    // The orders index is built per partition below, preprocess only selects customers and suppliers
+    phase.next(MetricsPhase::Preprocess);
+    PreprocessedData processed_data;
+    if (!preprocess(r_name, start_date, end_date, customer_data, std::vector<Orders>(),
+                    supplier_data, nation_data, region_data, nullptr, processed_data, &pool))
+        return false;
+    std::vector<Customer>().swap(customer_data);
+    std::vector<Supplier>().swap(supplier_data);
+
+    const std::string spill_dir = options.spill_dir.empty() ? std::filesystem::temp_directory_path().string()
+                                                            : options.spill_dir;
+    SpillPartitions orders_spill, lineitem_spill;
+    if (!orders_spill.open(spill_dir, num_partitions) || !lineitem_spill.open(spill_dir, num_partitions)) {
+        std::cerr << "Failed to create spill files in " << spill_dir << "." << std::endl;
+        return false;
+    }
+
+    // Partition pass: orders first, then lineitem, each a morsel driven scan of all its files
+    phase.next(MetricsPhase::Load);
+    std::atomic<bool> spilled{true};
+    if (!forEachTableMorsel(pool, tableShardPaths(table_path, "orders"),
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int) {
+        std::vector<Orders> orders_rows;
+        loadOrdersRangeText(begin, end, start_offset, end_offset, orders_rows);
+
+        // Same order filters as preprocess
+        SpillBuffers<JoinIndex::Entry> buffers(orders_spill, buffer_bytes);
+        for (const Orders& o : orders_rows) {
+            if (o.O_ORDERDATE < processed_data.startDay || o.O_ORDERDATE >= processed_data.endDay)
+                continue;
+            int8_t code = processed_data.customerToNation.find(o.O_CUSTKEY);
+            if (code != JoinIndex::NOT_FOUND)
+                buffers.add(spillPartition(o.O_ORDERKEY, partition_bits), {o.O_ORDERKEY, code});
+        }
+        if (!buffers.flush())
+            spilled.store(false, std::memory_order_relaxed);
+    }))
+        return false;                                  // Error Reading File
+
+    if (!forEachTableMorsel(pool, tableShardPaths(table_path, "lineitem"),
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int) {
+        SpillBuffers<SpilledLineItem> buffers(lineitem_spill, buffer_bytes);
+        scanLineItemText(begin, end, start_offset, end_offset, nullptr, [&](const LineItem& row) {
+            int8_t code = processed_data.supplierToNation.find(row.L_SUPPKEY);
+            if (code != JoinIndex::NOT_FOUND)
+                buffers.add(spillPartition(row.L_ORDERKEY, partition_bits),
+                            {row.L_EXTENDEDPRICE, row.L_ORDERKEY, row.L_DISCOUNT, code});
+        });
+        if (!buffers.flush())
+            spilled.store(false, std::memory_order_relaxed);
+    }))
+        return false;                                  // Error Reading File
+    if (!spilled.load()) {
+        std::cerr << "Failed to write spill files in " << spill_dir << "." << std::endl;
+        return false;
+    }
+
+    // Join pass: one partition at a time, its lineitem rows probed in parallel blocks
+    phase.next(MetricsPhase::Probe);
+    GroupAggregate aggregate(pool.size(), processed_data.nationNames.size());
+    std::vector<JoinIndex::Entry> entries;
+    for (size_t partition = 0; partition < num_partitions; ++partition) {
+        entries.resize(orders_spill.partitionBytes(partition) / sizeof(JoinIndex::Entry));
+        if (!orders_spill.read(partition, 0, entries.data(), entries.size() * sizeof(JoinIndex::Entry)))
+            return false;
+        JoinIndex orders_index;
+        orders_index.build(entries, entries.size(), &pool);
+
+        size_t num_rows = lineitem_spill.partitionBytes(partition) / sizeof(SpilledLineItem);
+        std::atomic<bool> read{true};
+        pool.parallelFor((num_rows + SPILL_READ_ROWS - 1) / SPILL_READ_ROWS, [&](size_t block, int worker) {
+            size_t begin_row = block * SPILL_READ_ROWS;
+            std::vector<SpilledLineItem> rows(std::min(SPILL_READ_ROWS, num_rows - begin_row));
+            if (!lineitem_spill.read(partition, begin_row * sizeof(SpilledLineItem), rows.data(), rows.size() * sizeof(SpilledLineItem))) {
+                read.store(false, std::memory_order_relaxed);
+                return;
+            }
+
+            RevenueSum* revenue_by_code = aggregate.denseSums(worker);
+            Metrics* metrics = activeMetrics();
+            ProbeRowCounts counts;
+            for (const SpilledLineItem& row : rows) {
+                int8_t custNation = orders_index.find(row.order_key);
+                if (custNation == JoinIndex::NOT_FOUND) {
+                    if (metrics) ++counts.order_rejected;
+                    continue;
+                }
+                if (custNation != row.supplier_code) {
+                    if (metrics) ++counts.nation_mismatch;
+                    continue;
+                }
+                revenue_by_code[custNation] += lineItemRevenue(row.price, row.discount);
+                if (metrics) ++counts.aggregated;
+            }
+            if (metrics) {
+                counts.rows = rows.size();
+                counts.flush(*metrics);
+            }
+        });
+        if (!read.load())
+            return false;
+    }
+
+    phase.next(MetricsPhase::Merge);
+    collectNationRevenue(aggregate, pool, processed_data.nationNames, results);
+    return true;
+}
+
+
+
+// Function to output results to the specified path
+bool outputResults(const std::string& result_path, const std::vector<Nation_Revenue>& results) {
+    // TODO: Implement outputting results to a file
+    std::ofstream output_file(result_path);
+    if(!output_file){
+        return false;
+    }
+
+    // Print results
+    output_file.precision(13);
+    for (const Nation_Revenue& nation_revenue: results) {
+        output_file<<nation_revenue.NATION<<"|"<<nation_revenue.REVENUE<<"\n";
+    }
+
+    output_file.close();
+    return true;
+} 
+// Function to output batch results, every row prefixed with the parameters of its query
+bool outputBatchResults(const std::string& result_path, const std::vector<Query5Parameters>& queries,
+                        const std::vector<std::vector<Nation_Revenue>>& results)
+{
+    std::ofstream output_file(result_path);
+    if (!output_file)
+        return false;
+
+    output_file.precision(13);
+    for (size_t query = 0; query < queries.size() && query < results.size(); ++query)
+        for (const Nation_Revenue& nation_revenue : results[query])
+            output_file << queries[query].r_name << "|" << queries[query].start_date << "|" << queries[query].end_date
+                        << "|" << nation_revenue.NATION << "|" << nation_revenue.REVENUE << "\n";
+    return true;
+}
@@ -0,0 +1,192 @@
+#include "query_server.hpp"
+#include "tpch_date.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+QueryServer::QueryServer(int num_threads, const ExecutionOptions& options)
+    : num_threads_(num_threads), options_(options) {}
+
+// Every table is kept whole: the pushdown filter depends on the query and is not applied
+bool QueryServer::load(const std::string& table_path) {
+    if (options_.lineitem_layout == LineItemLayout::Columns)
+        return readTPCHData(table_path, customer_data_, orders_data_, lineitem_columns_, supplier_data_,
+                            nation_data_, region_data_, num_threads_, options_, &zone_maps_);
+    if (options_.lineitem_layout == LineItemLayout::Compressed)
+        return readTPCHData(table_path, customer_data_, orders_data_, lineitem_compressed_, supplier_data_,
+                            nation_data_, region_data_, num_threads_, options_, &zone_maps_);
+    return readTPCHData(table_path, customer_data_, orders_data_, lineitem_rows_, supplier_data_,
+                        nation_data_, region_data_, num_threads_, options_, &zone_maps_);
+}
+
+bool QueryServer::execute(const std::string& r_name, const std::string& start_date, const std::string& end_date,
+                          std::vector<Nation_Revenue>& results)
+{
+    if (options_.lineitem_layout == LineItemLayout::Columns)
+        return executeQuery5(r_name, start_date, end_date, num_threads_, customer_data_, orders_data_,
+                             lineitem_columns_, supplier_data_, nation_data_, region_data_, results,
+                             &zone_maps_, options_.simd_level, nullptr, options_.join_strategy);
+    if (options_.lineitem_layout == LineItemLayout::Compressed)
+        return executeQuery5(r_name, start_date, end_date, num_threads_, customer_data_, orders_data_,
+                             lineitem_compressed_, supplier_data_, nation_data_, region_data_, results, &zone_maps_,
+                             nullptr, options_.join_strategy);
+    return executeQuery5(r_name, start_date, end_date, num_threads_, customer_data_, orders_data_,
+                         lineitem_rows_, supplier_data_, nation_data_, region_data_, results, &zone_maps_,
+                         nullptr, options_.join_strategy);
+}
+
+bool QueryServer::handleRequest(const std::string& request, std::string& response) {
+    // Tolerate CRLF clients
+    std::string line = request;
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+
+    if (line.empty())
+        return true;
+    if (line == "QUIT")
+        return false;
+    if (line == "SHUTDOWN") {
+        shutdown_ = true;
+        return false;
+    }
+
+    Query5Parameters query;
+    if (!parseQueryParameters(line, query)) {
+        response += "ERROR expected REGION|START_DATE|END_DATE\n";
+        return true;
+    }
+
+    // Check what execute would only report as a failure, so the client learns which part is wrong
+    int day;
+    if (!parseDate(query.start_date, day) || !parseDate(query.end_date, day)) {
+        response += "ERROR invalid date, expected YYYY-MM-DD\n";
+        return true;
+    }
+    if (std::none_of(region_data_.begin(), region_data_.end(),
+                     [&](const Region& region) { return region.R_NAME == query.r_name; })) {
+        response += "ERROR unknown region " + query.r_name + "\n";
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Nation_Revenue> results;
+    try {
+        if (!execute(query.r_name, query.start_date, query.end_date, results)) {
+            response += "ERROR query execution failed\n";
+            return true;
+        }
+    } catch (const std::exception& error) {
+        response += std::string("ERROR query execution failed: ") + error.what() + "\n";
+        return true;
+    }
+    std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - start;
+
+    // Same format as the result file
+    char buffer[64];
+    for (const Nation_Revenue& nation_revenue : results) {
+        std::snprintf(buffer, sizeof(buffer), "|%.13g\n", nation_revenue.REVENUE);
+        response += nation_revenue.NATION;
+        response += buffer;
+    }
+    std::snprintf(buffer, sizeof(buffer), "OK %zu %.3f\n", results.size(), latency.count());
+    response += buffer;
+    return true;
+}
+
+void QueryServer::serveStream(std::istream& in, std::ostream& out) {
+    std::string line, response;
+    while (std::getline(in, line)) {
+        response.clear();
+        bool more = handleRequest(line, response);
+        out << response << std::flush;
+        if (!more)
+            break;
+    }
+}
+
+// Write all of data, false if the client went away
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t written = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+            return false;
+        sent += size_t(written);
+    }
+    return true;
+}
+
+bool QueryServer::serveSocket(const std::string& socket_path) {
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path))
+        return false;                                   // Path does not fit sockaddr_un
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // Replace a stale socket left by an earlier run, but never any other kind of file
+    struct stat info;
+    if (::stat(socket_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        ::unlink(socket_path.c_str());
+
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+        return false;
+    if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(listen_fd, 16) != 0) {
+        ::close(listen_fd);
+        return false;
+    }
+
+    std::string pending, response;
+    char buffer[4096];
+    bool served = true;
+    while (!shutdown_) {
+        int client_fd = ::accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // Out of descriptors or memory: wait for resources to be freed instead of spinning
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            std::cerr << "accept on " << socket_path << " failed: " << std::strerror(errno) << std::endl;
+            served = false;
+            break;
+        }
+
+        // Split the byte stream into lines, answering each complete one
+        pending.clear();
+        bool open = true;
+        while (open) {
+            ssize_t received = ::recv(client_fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                break;
+            pending.append(buffer, size_t(received));
+
+            size_t line_start = 0, line_end;
+            while (open && (line_end = pending.find('\n', line_start)) != std::string::npos) {
+                response.clear();
+                open = handleRequest(pending.substr(line_start, line_end - line_start), response);
+                open = sendAll(client_fd, response) && open;
+                line_start = line_end + 1;
+            }
+            pending.erase(0, line_start);
+        }
+        ::close(client_fd);
+    }
+
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+    return served;
+}
@@ -0,0 +1,280 @@
+#include "read_ahead_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#define TPCH_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+
+#ifdef TPCH_HAVE_IO_URING
+
+// Minimal io_uring driven through the raw system calls, so no liburing is needed.
+// Only one thread submits and reaps, and at most one read per buffer is in flight,
+// so the queues never overflow.
+struct ReadAheadFile::Ring {
+    int fd = -1;
+    void* sq_map = MAP_FAILED;
+    size_t sq_map_bytes = 0;
+    void* cq_map = MAP_FAILED;
+    size_t cq_map_bytes = 0;
+    void* sqe_map = MAP_FAILED;
+    size_t sqe_map_bytes = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    ~Ring() {
+        if (sqe_map != MAP_FAILED)
+            munmap(sqe_map, sqe_map_bytes);
+        if (cq_map != MAP_FAILED && cq_map != sq_map)
+            munmap(cq_map, cq_map_bytes);
+        if (sq_map != MAP_FAILED)
+            munmap(sq_map, sq_map_bytes);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // Create the ring and map its queues; fails where io_uring is missing or disabled
+    bool setup(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+            return false;
+
+        sq_map_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_map)
+            sq_map_bytes = cq_map_bytes = std::max(sq_map_bytes, cq_map_bytes);
+
+        sq_map = mmap(nullptr, sq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED)
+            return false;
+        cq_map = single_map ? sq_map
+                            : mmap(nullptr, cq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED)
+            return false;
+        sqe_map_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqe_map = mmap(nullptr, sqe_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED)
+            return false;
+
+        char* sq = static_cast<char*>(sq_map);
+        char* cq = static_cast<char*>(cq_map);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Queue one read and hand it to the kernel; false if the kernel did not take it
+    bool submitRead(int file_fd, char* data, size_t bytes, size_t offset, uint64_t user_data) {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file_fd;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = unsigned(bytes);
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        long submitted;
+        do
+            submitted = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+        while (submitted < 0 && errno == EINTR);
+        if (submitted == 1)
+            return true;
+
+        // An entry the kernel did not consume must be taken back, or the next submit would
+        // hand it over again along with its own. One it did consume still completes normally
+        if (__atomic_load_n(sq_head, __ATOMIC_ACQUIRE) != tail + 1) {
+            __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        return true;
+    }
+
+    // Block until a read completes; result is its byte count or -errno
+    bool waitCompletion(uint64_t& user_data, long& result) {
+        for (;;) {
+            unsigned head = *cq_head;
+            if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                user_data = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                return false;
+        }
+    }
+};
+
+#else
+
+struct ReadAheadFile::Ring {
+    bool setup(unsigned) { return false; }
+    bool submitRead(int, char*, size_t, size_t, uint64_t) { return false; }
+    bool waitCompletion(uint64_t&, long&) { return false; }
+};
+
+#endif
+
+
+ReadAheadFile::ReadAheadFile() = default;
+
+ReadAheadFile::~ReadAheadFile() {
+    close();
+}
+
+bool ReadAheadFile::open(const std::string& filepath, size_t buffer_bytes, int depth) {
+    close();
+
+    fd_ = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+        return false;               // Error Opening File
+
+    struct stat file_stat;
+    if (fstat(fd_, &file_stat) != 0) {
+        close();
+        return false;
+    }
+
+    // The file is read once front to back, let the kernel read ahead aggressively
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    file_size_ = file_stat.st_size;
+    buffer_bytes_ = std::max<size_t>(buffer_bytes, 1);
+    num_reads_ = (file_size_ + buffer_bytes_ - 1) / buffer_bytes_;
+    buffers_.resize(std::min(num_reads_, size_t(std::max(depth, 1))));
+    for (Buffer& buffer : buffers_)
+        buffer.data = std::make_unique_for_overwrite<char[]>(buffer_bytes_);
+
+    ring_ = std::make_unique<Ring>();
+    if (buffers_.empty() || !ring_->setup(unsigned(buffers_.size())))
+        ring_.reset();
+
+    for (size_t buffer = 0; buffer < buffers_.size(); ++buffer)
+        startRead(buffer, buffer);
+    return true;
+}
+
+// Start reading buffer number sequence of the file into buffers_[buffer]
+void ReadAheadFile::startRead(size_t buffer, size_t sequence) {
+    Buffer& target = buffers_[buffer];
+    target.offset = sequence * buffer_bytes_;
+    target.bytes = std::min(buffer_bytes_, file_size_ - target.offset);
+    target.result = 0;
+    target.pending = ring_ && ring_->submitRead(fd_, target.data.get(), target.bytes, target.offset, buffer);
+    if (!ring_)
+        posix_fadvise(fd_, off_t(target.offset), off_t(target.bytes), POSIX_FADV_WILLNEED);
+}
+
+// Wait for the read of buffer to complete. Whatever the ring did not read, because the read was
+// never queued, came back short or failed (kernels before 5.6 lack IORING_OP_READ), is read with pread
+bool ReadAheadFile::finishRead(Buffer& buffer) {
+    while (buffer.pending) {
+        uint64_t completed;
+        long result;
+        if (!ring_->waitCompletion(completed, result))
+            return false;
+        buffers_[completed].result = result;
+        buffers_[completed].pending = false;
+    }
+
+    size_t done = buffer.result > 0 ? size_t(buffer.result) : 0;
+    while (done < buffer.bytes) {
+        ssize_t bytes_read = pread(fd_, buffer.data.get() + done, buffer.bytes - done, off_t(buffer.offset + done));
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            return false;           // Read error, or the file shrank since open
+        done += size_t(bytes_read);
+    }
+    buffer.result = long(done);
+    return true;
+}
+
+bool ReadAheadFile::next(const char*& data, size_t& size) {
+    const size_t depth = buffers_.size();
+    if (holding_) {
+        // The caller is done with the previous buffer, refill it with the first unread part
+        size_t sequence = next_read_ - 1 + depth;
+        if (sequence < num_reads_)
+            startRead((next_read_ - 1) % depth, sequence);
+        holding_ = false;
+    }
+    if (failed_ || next_read_ >= num_reads_)
+        return false;
+
+    Buffer& buffer = buffers_[next_read_ % depth];
+    if (!finishRead(buffer)) {
+        failed_ = true;
+        return false;
+    }
+    data = buffer.data.get();
+    size = buffer.bytes;
+    ++next_read_;
+    holding_ = true;
+    return true;
+}
+
+void ReadAheadFile::close() {
+    // Reads still queued write into the buffers, wait for them before the buffers go away
+    if (ring_) {
+        bool drained = true;
+        for (Buffer& buffer : buffers_)
+            while (drained && buffer.pending) {
+                uint64_t completed;
+                long result;
+                drained = ring_->waitCompletion(completed, result);
+                if (drained)
+                    buffers_[completed].pending = false;
+            }
+
+        // When completions can no longer be reaped the kernel may still write into the buffers
+        // of unfinished reads, so those are deliberately leaked rather than freed under it
+        if (!drained)
+            for (Buffer& buffer : buffers_)
+                if (buffer.pending)
+                    static_cast<void>(buffer.data.release());
+    }
+    ring_.reset();
+    buffers_.clear();
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    file_size_ = 0;
+    num_reads_ = 0;
+    next_read_ = 0;
+    failed_ = false;
+    holding_ = false;
+}
@@ -0,0 +1,273 @@
+#include "result_cache.hpp"
+#include "compressed_columns.hpp"
+#include "table_input.hpp"
+#include "tpch_date.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char CACHE_HEADER[] = "TPCH Q5 result cache 1";
+
+// Tables whose files make up the input fingerprint
+const char* const CACHE_SOURCES[] = {"region", "nation", "customer", "orders", "supplier", "lineitem"};
+
+// 64-bit FNV-1a over the name, size and modification time of every table file
+bool fingerprintTables(const std::string& table_path, std::string& fingerprint) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&](const void* data, size_t size) {
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 0x100000001b3ull;
+    };
+    for (const char* table : CACHE_SOURCES)
+        for (const std::string& filepath : tableShardPaths(table_path, table)) {
+            struct stat source_stat;
+            if (stat(filepath.c_str(), &source_stat) != 0)
+                return false;
+            std::string name = std::filesystem::path(filepath).filename().string();
+            uint64_t size = source_stat.st_size;
+            int64_t mtime_ns = int64_t(source_stat.st_mtim.tv_sec) * 1000000000 + source_stat.st_mtim.tv_nsec;
+            mix(name.data(), name.size() + 1);
+            mix(&size, sizeof(size));
+            mix(&mtime_ns, sizeof(mtime_ns));
+        }
+
+    char text[17];
+    for (int digit = 0; digit < 16; ++digit)
+        text[digit] = "0123456789abcdef"[(hash >> (60 - 4 * digit)) & 0xf];
+    text[16] = '\0';
+    fingerprint = text;
+    return true;
+}
+
+std::string entryKey(const Query5Parameters& query) {
+    return query.r_name + "|" + query.start_date + "|" + query.end_date;
+}
+
+// Revenue sums are written as exact decimal integers in units of 1e-4
+std::string revenueText(RevenueSum revenue) {
+    unsigned __int128 value = revenue < 0 ? -static_cast<unsigned __int128>(revenue) : revenue;
+    std::string text;
+    do {
+        text += char('0' + int(value % 10));
+        value /= 10;
+    } while (value);
+    if (revenue < 0)
+        text += '-';
+    std::reverse(text.begin(), text.end());
+    return text;
+}
+
+bool parseRevenueText(const std::string& text, RevenueSum& revenue) {
+    size_t first = !text.empty() && text[0] == '-';
+    if (first == text.size() || text.size() - first > 38)
+        return false;
+    RevenueSum value = 0;
+    for (size_t i = first; i < text.size(); ++i) {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+        value = value * 10 + (text[i] - '0');
+    }
+    revenue = first ? -value : value;
+    return true;
+}
+
+// Split a line at '|' into fields
+std::vector<std::string> splitFields(const std::string& line) {
+    std::vector<std::string> fields(1);
+    for (char c : line) {
+        if (c == '|')
+            fields.emplace_back();
+        else
+            fields.back() += c;
+    }
+    return fields;
+}
+
+// Load the tables in layout Chunk and answer every piece with one batch scan. The pieces all
+// lie inside one range of one region, so lineitem is filtered on load like a single query over that range
+template <typename Chunk>
+bool computePieces(const std::vector<Query5Parameters>& pieces, int num_threads, const std::string& table_path,
+                   const ExecutionOptions& options, std::vector<std::vector<NationRevenueSum>>& sums)
+{
+    std::vector<Customer> customer_data;
+    std::vector<Orders> orders_data;
+    std::vector<Chunk> lineitem_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    ZoneMaps zone_maps;
+    const LineItemPushdown pushdown{pieces.front().r_name, pieces.front().start_date, pieces.back().end_date};
+    if (!readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data,
+                      region_data, num_threads, options, &zone_maps, &pushdown)) {
+        std::cerr << "Failed to read TPCH data." << std::endl;
+        return false;
+    }
+
+    std::vector<std::vector<Nation_Revenue>> results;
+    return executeQuery5Batch(pieces, num_threads, customer_data, orders_data, lineitem_data, supplier_data,
+                              nation_data, region_data, results, &zone_maps, &sums);
+}
+
+} // namespace
+
+
+bool ResultCache::open(const std::string& cache_dir, const std::string& table_path) {
+    std::string fingerprint;
+    if (!fingerprintTables(table_path, fingerprint))
+        return false;
+    std::error_code error;
+    std::filesystem::create_directories(cache_dir, error);
+    if (error)
+        return false;
+    path_ = cache_dir + "/q5-" + fingerprint + ".cache";
+    entries_.clear();
+    modified_ = false;
+
+    // A missing file is an empty cache; a damaged one is read up to the first bad line
+    std::ifstream file(path_);
+    std::string line;
+    if (!std::getline(file, line) || line != CACHE_HEADER)
+        return true;
+    while (std::getline(file, line)) {
+        // REGION|START|END, then NATION|REVENUE for every nation with revenue
+        std::vector<std::string> fields = splitFields(line);
+        if (fields.size() < 3 || fields.size() % 2 == 0)
+            return true;
+        std::vector<NationRevenueSum> sums;
+        for (size_t field = 3; field < fields.size(); field += 2) {
+            RevenueSum revenue;
+            if (!parseRevenueText(fields[field + 1], revenue))
+                return true;
+            sums.push_back(NationRevenueSum{fields[field], revenue});
+        }
+        entries_[entryKey(Query5Parameters{fields[0], fields[1], fields[2]})] = std::move(sums);
+    }
+    return true;
+}
+
+bool ResultCache::splitIntoPieces(const Query5Parameters& query, std::vector<Query5Parameters>& pieces) {
+    int start_day, end_day;
+    if (!parseDate(query.start_date, start_day) || !parseDate(query.end_date, end_day))
+        return false;
+
+    pieces.clear();
+    for (int day = start_day; day < end_day;) {
+        int year, month, month_day;
+        civilFromDays(day, year, month, month_day);
+        int next_month = month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, month + 1, 1);
+        int piece_end = std::min(next_month, end_day);
+        pieces.push_back(Query5Parameters{query.r_name, formatDate(day), formatDate(piece_end)});
+        day = piece_end;
+    }
+    return true;
+}
+
+bool ResultCache::find(const Query5Parameters& query, std::vector<NationRevenueSum>& sums) const {
+    auto entry = entries_.find(entryKey(query));
+    if (entry == entries_.end())
+        return false;
+    sums = entry->second;
+    return true;
+}
+
+void ResultCache::store(const Query5Parameters& query, const std::vector<NationRevenueSum>& sums) {
+    if (query.r_name.find_first_of("|\n") != std::string::npos)
+        return;
+    std::vector<NationRevenueSum>& entry = entries_[entryKey(query)];
+    entry.clear();
+    for (const NationRevenueSum& sum : sums)
+        if (sum.REVENUE != 0)
+            entry.push_back(sum);
+    modified_ = true;
+}
+
+bool ResultCache::save() const {
+    if (!modified_)
+        return true;
+
+    // Written aside and renamed over the old file, so a concurrent run reads one or the other
+    std::string temp_path = path_ + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        if (!out)
+            return false;
+        out << CACHE_HEADER << "\n";
+        for (const auto& [key, sums] : entries_) {
+            out << key;
+            for (const NationRevenueSum& sum : sums)
+                out << "|" << sum.NATION << "|" << revenueText(sum.REVENUE);
+            out << "\n";
+        }
+        if (!out)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path_, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+bool executeQuery5Cached(const Query5Parameters& query, int num_threads, const std::string& table_path,
+                         const ExecutionOptions& options, std::vector<Nation_Revenue>& results)
+{
+    ResultCache cache;
+    if (!cache.open(options.result_cache, table_path)) {
+        std::cerr << "Failed to open the result cache in " << options.result_cache << "." << std::endl;
+        return false;
+    }
+
+    std::vector<NationRevenueSum> total;
+    if (!cache.find(query, total)) {
+        std::vector<Query5Parameters> pieces, missing;
+        if (!ResultCache::splitIntoPieces(query, pieces))
+            return false;
+
+        // Sum the known pieces, compute the others in one scan
+        std::map<std::string, RevenueSum> nation_sums;
+        for (const Query5Parameters& piece : pieces) {
+            std::vector<NationRevenueSum> sums;
+            if (!cache.find(piece, sums)) {
+                missing.push_back(piece);
+                continue;
+            }
+            for (const NationRevenueSum& sum : sums)
+                nation_sums[sum.NATION] += sum.REVENUE;
+        }
+
+        if (!missing.empty()) {
+            std::vector<std::vector<NationRevenueSum>> missing_sums;
+            bool computed = options.lineitem_layout == LineItemLayout::Columns
+                    ? computePieces<LineItemColumns>(missing, num_threads, table_path, options, missing_sums)
+                : options.lineitem_layout == LineItemLayout::Compressed
+                    ? computePieces<CompressedLineItems>(missing, num_threads, table_path, options, missing_sums)
+                    : computePieces<std::vector<LineItem>>(missing, num_threads, table_path, options, missing_sums);
+            if (!computed)
+                return false;
+            for (size_t piece = 0; piece < missing.size(); ++piece) {
+                cache.store(missing[piece], missing_sums[piece]);
+                for (const NationRevenueSum& sum : missing_sums[piece])
+                    nation_sums[sum.NATION] += sum.REVENUE;
+            }
+        }
+
+        for (const auto& [nation, revenue] : nation_sums)
+            total.push_back(NationRevenueSum{nation, revenue});
+        cache.store(query, total);
+    }
+
+    roundNationRevenue(total, results);
+    if (!cache.save())
+        std::cerr << "Warning: could not write the result cache in " << options.result_cache << "\n";
+    return true;
+}
@@ -0,0 +1,436 @@
+#include "revenue_cube.hpp"
+#include "group_aggregate.hpp"
+#include "join_index.hpp"
+#include "table_input.hpp"
+#include "tpch_date.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char CUBE_MAGIC[8] = {'T', 'P', 'C', 'H', 'C', 'U', 'B', 'E'};
+constexpr uint32_t CUBE_VERSION = 3;
+
+// Base tables whose files are stamped into the cube file
+const char* const CUBE_SOURCES[] = {"region", "nation", "customer", "orders", "supplier", "lineitem"};
+constexpr size_t CUBE_SOURCE_COUNT = sizeof(CUBE_SOURCES) / sizeof(CUBE_SOURCES[0]);
+
+// The files a table was read from (see tableShardPaths): a plain or compressed file, or every shard
+struct SourceStamp {
+    uint64_t size;              // Total bytes of the files
+    uint64_t files_hash;        // 64-bit FNV-1a over the name, size and modification time of each file
+};
+
+struct CubeHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nation_count;
+    uint32_t region_count;
+    uint32_t refresh_count;
+    int32_t first_day;
+    int32_t num_days;
+    uint64_t order_count;
+    SourceStamp sources[CUBE_SOURCE_COUNT];
+};
+
+struct StoredOrderRevenue {
+    int32_t key;
+    int32_t day;
+    int32_t nation;
+    int32_t padding;
+    int64_t revenue;
+};
+
+bool stampSources(const std::string& table_path, SourceStamp (&stamps)[CUBE_SOURCE_COUNT]) {
+    for (size_t i = 0; i < CUBE_SOURCE_COUNT; ++i) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto mix = [&](const void* data, size_t size) {
+            for (size_t byte = 0; byte < size; ++byte)
+                hash = (hash ^ static_cast<const unsigned char*>(data)[byte]) * 0x100000001b3ull;
+        };
+        stamps[i].size = 0;
+        for (const std::string& filepath : tableShardPaths(table_path, CUBE_SOURCES[i])) {
+            struct stat source_stat;
+            if (stat(filepath.c_str(), &source_stat) != 0)
+                return false;
+            std::string name = std::filesystem::path(filepath).filename().string();
+            uint64_t size = source_stat.st_size;
+            int64_t mtime_ns = int64_t(source_stat.st_mtim.tv_sec) * 1000000000 + source_stat.st_mtim.tv_nsec;
+            mix(name.data(), name.size() + 1);
+            mix(&size, sizeof(size));
+            mix(&mtime_ns, sizeof(mtime_ns));
+            stamps[i].size += size;
+        }
+        stamps[i].files_hash = hash;
+    }
+    return true;
+}
+
+template <typename T>
+void writeArray(std::ofstream& out, const std::vector<T>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readArray(std::ifstream& in, std::vector<T>& values, size_t count) {
+    values.resize(count);
+    return bool(in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T)));
+}
+
+void writeStrings(std::ofstream& out, const std::vector<std::string>& values) {
+    for (const std::string& value : values) {
+        uint32_t length = value.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(value.data(), length);
+    }
+}
+
+bool readStrings(std::ifstream& in, std::vector<std::string>& values, size_t count) {
+    values.resize(count);
+    for (std::string& value : values) {
+        uint32_t length;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > (1u << 20))
+            return false;
+        value.resize(length);
+        if (!in.read(value.data(), length))
+            return false;
+    }
+    return true;
+}
+
+// Nation key -> nation slot
+JoinIndex buildNationSlots(const std::vector<int>& nation_keys) {
+    std::vector<JoinIndex::Entry> entries;
+    for (size_t slot = 0; slot < nation_keys.size(); ++slot)
+        entries.push_back({nation_keys[slot], int8_t(slot)});
+    JoinIndex index;
+    index.build(entries, nation_keys.size());
+    return index;
+}
+
+// Key -> nation slot for the rows of a table whose nation has a slot
+template <typename Row, typename KeyOf, typename NationOf>
+JoinIndex buildKeyToSlot(const std::vector<Row>& rows, const JoinIndex& nation_slots, KeyOf key_of, NationOf nation_of,
+                         ThreadPool* pool) {
+    std::vector<JoinIndex::Entry> entries;
+    entries.reserve(rows.size());
+    for (const Row& row : rows) {
+        int8_t slot = nation_slots.find(nation_of(row));
+        if (slot != JoinIndex::NOT_FOUND)
+            entries.push_back({key_of(row), slot});
+    }
+    JoinIndex index;
+    index.build(entries, rows.size(), pool);
+    return index;
+}
+
+} // namespace
+
+
+void RevenueCube::build(const std::vector<Customer>& customer_data,
+                        const std::vector<Orders>& orders_data,
+                        const std::vector<std::vector<LineItem>>& lineitem_data,
+                        const std::vector<Supplier>& supplier_data,
+                        const std::vector<Nation>& nation_data,
+                        const std::vector<Region>& region_data,
+                        ThreadPool& pool)
+{
+    *this = RevenueCube();
+
+    // Nation slots follow the nation table, codes of a JoinIndex hold at most INT8_MAX of them
+    for (const Nation& n : nation_data) {
+        if (nation_keys_.size() == INT8_MAX)
+            break;
+        nation_keys_.push_back(n.N_NATIONKEY);
+        nation_names_.push_back(n.N_NAME);
+        nation_regions_.push_back(n.N_REGIONKEY);
+    }
+    for (const Region& r : region_data) {
+        region_keys_.push_back(r.R_REGIONKEY);
+        region_names_.push_back(r.R_NAME);
+    }
+
+    JoinIndex nation_slots = buildNationSlots(nation_keys_);
+    JoinIndex customer_slots = buildKeyToSlot(customer_data, nation_slots,
+        [](const Customer& c) { return c.C_CUSTKEY; }, [](const Customer& c) { return c.C_NATIONKEY; }, &pool);
+    JoinIndex supplier_slots = buildKeyToSlot(supplier_data, nation_slots,
+        [](const Supplier& s) { return s.S_SUPPKEY; }, [](const Supplier& s) { return s.S_NATIONKEY; }, &pool);
+    JoinIndex order_slots = buildKeyToSlot(orders_data, customer_slots,
+        [](const Orders& o) { return o.O_ORDERKEY; }, [](const Orders& o) { return o.O_CUSTKEY; }, &pool);
+
+    // Revenue of the lineitems whose supplier shares the customer's nation, grouped by order key
+    // relative to the smallest key. Only those rows reach the aggregate, which switches to its
+    // partitioned hash form when the key range is too wide for flat per worker arrays
+    int min_key = 0, max_key = -1;
+    if (!orders_data.empty()) {
+        auto [first, last] = std::minmax_element(orders_data.begin(), orders_data.end(),
+            [](const Orders& a, const Orders& b) { return a.O_ORDERKEY < b.O_ORDERKEY; });
+        min_key = first->O_ORDERKEY;
+        max_key = last->O_ORDERKEY;
+    }
+    GroupAggregate aggregate(pool.size(), uint64_t(int64_t(max_key) - min_key + 1));
+    pool.parallelFor(lineitem_data.size(), [&](size_t chunk, int worker) {
+        for (const LineItem& row : lineitem_data[chunk]) {
+            int8_t slot = order_slots.find(row.L_ORDERKEY);
+            if (slot != JoinIndex::NOT_FOUND && slot == supplier_slots.find(row.L_SUPPKEY))
+                aggregate.add(worker, uint64_t(int64_t(row.L_ORDERKEY) - min_key),
+                              lineItemRevenue(row.L_EXTENDEDPRICE, row.L_DISCOUNT));
+        }
+    });
+    std::vector<std::pair<uint64_t, RevenueSum>> revenue_by_order;
+    aggregate.merge(&pool, revenue_by_order);
+
+    // Nation and date of every contributing order, then the cells over their date span
+    order_revenue_.reserve(revenue_by_order.size());
+    for (const std::pair<uint64_t, RevenueSum>& order : revenue_by_order) {
+        int key = int(int64_t(order.first) + min_key);
+        order_revenue_[key] = OrderRevenue{0, order_slots.find(key), int64_t(order.second)};
+    }
+    for (const Orders& o : orders_data) {
+        auto order = order_revenue_.find(o.O_ORDERKEY);
+        if (order != order_revenue_.end())
+            order->second.day = o.O_ORDERDATE;
+    }
+    if (!order_revenue_.empty()) {
+        auto [first, last] = std::minmax_element(order_revenue_.begin(), order_revenue_.end(),
+            [](const auto& a, const auto& b) { return a.second.day < b.second.day; });
+        ensureDay(first->second.day);
+        ensureDay(last->second.day);
+    }
+    for (const std::pair<const int, OrderRevenue>& order : order_revenue_)
+        addRevenue(order.second.day, order.second.nation, order.second.revenue);
+}
+
+void RevenueCube::ensureDay(int day) {
+    if (num_days_ > 0 && day >= first_day_ && day < first_day_ + num_days_)
+        return;
+
+    // Grow the date axis to cover day, re-laying out every nation's row of cells
+    int first_day = num_days_ > 0 ? std::min(first_day_, day) : day;
+    int last_day = num_days_ > 0 ? std::max(first_day_ + num_days_ - 1, day) : day;
+    int num_days = last_day - first_day + 1;
+    std::vector<int64_t> cells(nation_keys_.size() * size_t(num_days), 0);
+    for (size_t nation = 0; nation < nation_keys_.size(); ++nation)
+        for (int offset = 0; offset < num_days_; ++offset)
+            cells[nation * num_days + (first_day_ - first_day) + offset] = cells_[nation * num_days_ + offset];
+    cells_.swap(cells);
+    first_day_ = first_day;
+    num_days_ = num_days;
+}
+
+void RevenueCube::addRevenue(int day, int nation, int64_t revenue) {
+    ensureDay(day);
+    cells_[size_t(nation) * num_days_ + (day - first_day_)] += revenue;
+}
+
+bool RevenueCube::query(const std::string& r_name, const std::string& start_date, const std::string& end_date,
+                        std::vector<Nation_Revenue>& results) const
+{
+    int start_day, end_day;
+    if (!parseDate(start_date, start_day) || !parseDate(end_date, end_day))
+        return false;
+
+    // Clamp the date range to the cells
+    int first = std::max(start_day, first_day_) - first_day_;
+    int last = std::min(end_day, first_day_ + num_days_) - first_day_;
+
+    for (size_t nation = 0; nation < nation_keys_.size(); ++nation) {
+        bool in_region = false;
+        for (size_t region = 0; region < region_keys_.size(); ++region)
+            in_region |= region_keys_[region] == nation_regions_[nation] && region_names_[region] == r_name;
+        if (!in_region)
+            continue;
+
+        RevenueSum revenue = 0;
+        for (int day = first; day < last; ++day)
+            revenue += cells_[nation * num_days_ + day];
+        if (revenue != 0)
+            results.push_back(Nation_Revenue{nation_names_[nation], revenueToDouble(revenue)});
+    }
+
+    // Same order as the scan paths
+    std::sort(results.begin(), results.end(), [](const Nation_Revenue& a, const Nation_Revenue& b) {
+        return a.REVENUE != b.REVENUE ? a.REVENUE > b.REVENUE : a.NATION < b.NATION;
+    });
+    return true;
+}
+
+void RevenueCube::applyRefresh(int set_number,
+                               const std::vector<Orders>& new_orders,
+                               const std::vector<LineItem>& new_lineitems,
+                               const std::vector<int>& deleted_orderkeys,
+                               const std::vector<Customer>& customer_data,
+                               const std::vector<Supplier>& supplier_data)
+{
+    JoinIndex nation_slots = buildNationSlots(nation_keys_);
+    JoinIndex customer_slots = buildKeyToSlot(customer_data, nation_slots,
+        [](const Customer& c) { return c.C_CUSTKEY; }, [](const Customer& c) { return c.C_NATIONKEY; }, nullptr);
+    JoinIndex supplier_slots = buildKeyToSlot(supplier_data, nation_slots,
+        [](const Supplier& s) { return s.S_SUPPKEY; }, [](const Supplier& s) { return s.S_NATIONKEY; }, nullptr);
+
+    // RF1: revenue of the new lineitems per new order, then one cell update per order
+    std::unordered_map<int, OrderRevenue> added;
+    for (const Orders& o : new_orders) {
+        int8_t slot = customer_slots.find(o.O_CUSTKEY);
+        if (slot != JoinIndex::NOT_FOUND)
+            added[o.O_ORDERKEY] = OrderRevenue{o.O_ORDERDATE, slot, 0};
+    }
+    for (const LineItem& row : new_lineitems) {
+        auto order = added.find(row.L_ORDERKEY);
+        if (order != added.end() && order->second.nation == supplier_slots.find(row.L_SUPPKEY))
+            order->second.revenue += lineItemRevenue(row.L_EXTENDEDPRICE, row.L_DISCOUNT);
+    }
+    for (const std::pair<const int, OrderRevenue>& order : added) {
+        if (order.second.revenue == 0)
+            continue;
+        OrderRevenue& stored = order_revenue_[order.first];
+        if (stored.revenue != 0)
+            addRevenue(stored.day, stored.nation, -stored.revenue);     // Key reused, replace the old order
+        stored = order.second;
+        addRevenue(stored.day, stored.nation, stored.revenue);
+    }
+
+    // RF2: take deleted orders back out of their cells
+    for (int key : deleted_orderkeys) {
+        auto order = order_revenue_.find(key);
+        if (order == order_revenue_.end())
+            continue;
+        addRevenue(order->second.day, order->second.nation, -order->second.revenue);
+        order_revenue_.erase(order);
+    }
+
+    refresh_sets_.push_back(set_number);
+}
+
+bool RevenueCube::hasRefresh(int set_number) const {
+    return std::find(refresh_sets_.begin(), refresh_sets_.end(), set_number) != refresh_sets_.end();
+}
+
+// Written to a temporary file and renamed into place like the table snapshots
+bool RevenueCube::save(const std::string& cube_path, const std::string& table_path) const {
+    CubeHeader header{};
+    std::memcpy(header.magic, CUBE_MAGIC, sizeof(header.magic));
+    header.version = CUBE_VERSION;
+    header.nation_count = nation_keys_.size();
+    header.region_count = region_keys_.size();
+    header.refresh_count = refresh_sets_.size();
+    header.first_day = first_day_;
+    header.num_days = num_days_;
+    header.order_count = order_revenue_.size();
+    if (!stampSources(table_path, header.sources))
+        return false;
+
+    std::vector<StoredOrderRevenue> orders;
+    orders.reserve(order_revenue_.size());
+    for (const std::pair<const int, OrderRevenue>& order : order_revenue_)
+        orders.push_back({order.first, order.second.day, order.second.nation, 0, order.second.revenue});
+
+    std::string temp_path = cube_path + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeArray(out, nation_keys_);
+        writeArray(out, nation_regions_);
+        writeStrings(out, nation_names_);
+        writeArray(out, region_keys_);
+        writeStrings(out, region_names_);
+        writeArray(out, refresh_sets_);
+        writeArray(out, cells_);
+        writeArray(out, orders);
+        if (!out)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cube_path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+bool RevenueCube::load(const std::string& cube_path, const std::string& table_path) {
+    std::ifstream in(cube_path, std::ios::binary);
+    CubeHeader header;
+    if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+
+    SourceStamp stamps[CUBE_SOURCE_COUNT];
+    if (std::memcmp(header.magic, CUBE_MAGIC, sizeof(CUBE_MAGIC)) != 0 || header.version != CUBE_VERSION
+        || header.nation_count > INT8_MAX || header.num_days < 0 || !stampSources(table_path, stamps))
+        return false;
+    for (size_t i = 0; i < CUBE_SOURCE_COUNT; ++i)
+        if (stamps[i].size != header.sources[i].size || stamps[i].files_hash != header.sources[i].files_hash)
+            return false;                           // Base tables changed, the cube is stale
+
+    RevenueCube cube;
+    std::vector<StoredOrderRevenue> orders;
+    if (!readArray(in, cube.nation_keys_, header.nation_count)
+        || !readArray(in, cube.nation_regions_, header.nation_count)
+        || !readStrings(in, cube.nation_names_, header.nation_count)
+        || !readArray(in, cube.region_keys_, header.region_count)
+        || !readStrings(in, cube.region_names_, header.region_count)
+        || !readArray(in, cube.refresh_sets_, header.refresh_count)
+        || !readArray(in, cube.cells_, size_t(header.nation_count) * header.num_days)
+        || !readArray(in, orders, header.order_count))
+        return false;
+
+    cube.first_day_ = header.first_day;
+    cube.num_days_ = header.num_days;
+    cube.order_revenue_.reserve(orders.size());
+    for (const StoredOrderRevenue& order : orders)
+        cube.order_revenue_[order.key] = OrderRevenue{order.day, order.nation, order.revenue};
+
+    *this = std::move(cube);
+    return true;
+}
+
+bool openRevenueCube(const std::string& table_path, int num_threads, const ExecutionOptions& options, RevenueCube& cube) {
+    bool changed = false;
+    std::vector<Customer> customer_data;
+    std::vector<Orders> orders_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+
+    if (!cube.load(options.cube_path, table_path)) {
+        std::vector<std::vector<LineItem>> lineitem_data;
+        if (!readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data,
+                          nation_data, region_data, num_threads, options))
+            return false;
+        cube.build(customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data,
+                   sharedThreadPool(num_threads));
+        changed = true;
+    }
+
+    if (options.refresh_set > 0 && !cube.hasRefresh(options.refresh_set)) {
+        std::vector<Orders> new_orders;
+        std::vector<LineItem> new_lineitems;
+        std::vector<int> deleted_orderkeys;
+        if (!readRefreshSet(table_path, options.refresh_set, new_orders, new_lineitems, deleted_orderkeys))
+            return false;
+
+        // Customers and suppliers place the new rows in their nations
+        if (customer_data.empty()
+            && !readDimensionTables(table_path, customer_data, orders_data, supplier_data, nation_data,
+                                    region_data, num_threads, options))
+            return false;
+
+        cube.applyRefresh(options.refresh_set, new_orders, new_lineitems, deleted_orderkeys, customer_data, supplier_data);
+        changed = true;
+    }
+
+    if (changed && !cube.save(options.cube_path, table_path))
+        std::cerr << "Warning: could not write revenue cube " << options.cube_path << "\n";
+    return true;
+}
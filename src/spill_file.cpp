@@ -0,0 +1,57 @@
+#include "spill_file.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+SpillPartitions::~SpillPartitions() {
+    for (Partition& partition : partitions_)
+        if (partition.fd >= 0)
+            ::close(partition.fd);
+}
+
+bool SpillPartitions::open(const std::string& directory, size_t num_partitions) {
+    partitions_ = std::vector<Partition>(num_partitions);
+    for (Partition& partition : partitions_) {
+        std::string path = directory + "/tpch_spill_XXXXXX";
+        partition.fd = mkstemp(path.data());
+        if (partition.fd < 0)
+            return false;
+        unlink(path.c_str());           // Removed with the last descriptor
+    }
+    return true;
+}
+
+bool SpillPartitions::append(size_t partition, const void* data, size_t bytes) {
+    Partition& target = partitions_[partition];
+    std::lock_guard<std::mutex> lock(target.mutex);
+    const char* cursor = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t written = pwrite(target.fd, cursor, bytes, off_t(target.bytes));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        cursor += written;
+        bytes -= size_t(written);
+        target.bytes += size_t(written);
+    }
+    return true;
+}
+
+bool SpillPartitions::read(size_t partition, size_t offset, void* out, size_t bytes) const {
+    const Partition& source = partitions_[partition];
+    char* cursor = static_cast<char*>(out);
+    while (bytes > 0) {
+        ssize_t got = pread(source.fd, cursor, bytes, off_t(offset));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        cursor += got;
+        offset += size_t(got);
+        bytes -= size_t(got);
+    }
+    return true;
+}
@@ -0,0 +1,437 @@
+#include "table_input.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <ios>
+#include <vector>
+
+#ifdef TPCH_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef TPCH_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace {
+
+// Buffers the plain reader keeps in flight, see ReadAheadFile
+constexpr int READ_AHEAD_DEPTH = 4;
+
+// Largest zstd frame decompressed in one piece by a pool worker; each worker holds one such frame
+constexpr unsigned long long ZSTD_PARALLEL_FRAME_BYTES = 64ull << 20;
+
+// Decompressed text per underflow of TableTextStream
+constexpr size_t STREAM_BUFFER_BYTES = size_t(1) << 20;
+
+const char* const COMPRESSION_SUFFIXES[] = {"", ".gz", ".zst"};
+
+// First of base, base.gz and base.zst that exists, empty if none does
+std::string existingTableFile(const std::string& base) {
+    for (const char* suffix : COMPRESSION_SUFFIXES) {
+        std::string candidate = base + suffix;
+        std::error_code error;
+        if (std::filesystem::exists(candidate, error))
+            return candidate;
+    }
+    return {};
+}
+
+} // namespace
+
+std::string tableFilePath(const std::string& table_path, const std::string& name) {
+    std::string filepath = existingTableFile(table_path + "/" + name + ".tbl");
+    return filepath.empty() ? table_path + "/" + name + ".tbl" : filepath;
+}
+
+std::vector<std::string> tableShardPaths(const std::string& table_path, const std::string& name) {
+    const std::string base = table_path + "/" + name + ".tbl";
+    std::string filepath = existingTableFile(base);
+    if (!filepath.empty())
+        return {filepath};
+
+    std::vector<std::string> shards;
+    for (size_t shard = 1;; ++shard) {
+        filepath = existingTableFile(base + "." + std::to_string(shard));
+        if (filepath.empty())
+            break;
+        shards.push_back(filepath);
+    }
+    if (shards.empty())
+        shards.push_back(base);
+    return shards;
+}
+
+TableCompression detectTableCompression(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    unsigned char magic[4] = {};
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    if (file.gcount() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return TableCompression::Gzip;
+    // Zstd frames start with 0xFD2FB528 little endian, skippable frames with 0x184D2A5?
+    if (file.gcount() == 4 && magic[1] == 0x2a && magic[2] == 0x4d && magic[3] == 0x18 && (magic[0] & 0xf0) == 0x50)
+        return TableCompression::Zstd;
+    if (file.gcount() == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return TableCompression::Zstd;
+    return TableCompression::None;
+}
+
+bool tableCompressionSupported(TableCompression compression) {
+    switch (compression) {
+        case TableCompression::None: return true;
+#ifdef TPCH_HAVE_ZLIB
+        case TableCompression::Gzip: return true;
+#endif
+#ifdef TPCH_HAVE_ZSTD
+        case TableCompression::Zstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+size_t tableTextBytes(const std::string& filepath) {
+    std::error_code error;
+    const uint64_t file_bytes = std::filesystem::file_size(filepath, error);
+    if (error)
+        return 0;
+    const uint64_t estimate = file_bytes * COMPRESSED_TEXT_RATIO;
+
+    switch (detectTableCompression(filepath)) {
+        case TableCompression::Gzip: {
+            std::ifstream file(filepath, std::ios::binary);
+            unsigned char trailer[4] = {};
+            if (file_bytes < 18 || !file.seekg(-4, std::ios::end) || !file.read(reinterpret_cast<char*>(trailer), 4))
+                return estimate;
+            const uint64_t isize = uint64_t(trailer[0]) | uint64_t(trailer[1]) << 8 | uint64_t(trailer[2]) << 16
+                                 | uint64_t(trailer[3]) << 24;
+            const uint64_t wraps = estimate > isize ? (estimate - isize + (1ull << 31)) >> 32 : 0;
+            const uint64_t text_bytes = isize + (wraps << 32);
+            return text_bytes < file_bytes ? estimate : text_bytes;    // Below it: only the last of several members
+        }
+        case TableCompression::Zstd: {
+#ifdef TPCH_HAVE_ZSTD
+            MappedFile file;
+            if (!file.open(filepath))
+                return estimate;
+            uint64_t text_bytes = 0;
+            for (size_t offset = 0; offset < file.size();) {
+                size_t compressed_size = ZSTD_findFrameCompressedSize(file.data() + offset, file.size() - offset);
+                if (ZSTD_isError(compressed_size))
+                    return text_bytes + (file.size() - offset) * COMPRESSED_TEXT_RATIO;
+                unsigned long long content_size = ZSTD_getFrameContentSize(file.data() + offset, compressed_size);
+                text_bytes += content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR
+                            ? compressed_size * COMPRESSED_TEXT_RATIO : content_size;
+                offset += compressed_size;
+            }
+            return text_bytes;
+#else
+            return estimate;
+#endif
+        }
+        default:
+            return file_bytes;
+    }
+}
+
+
+// ---------------- gzip ----------------
+#ifdef TPCH_HAVE_ZLIB
+
+// Two buffers: the caller parses one while a std::async task inflates the next into the other.
+// gzread also handles files of several concatenated gzip members
+struct TableTextReader::Gzip {
+    gzFile file = nullptr;
+    size_t buffer_bytes = 0;
+    std::unique_ptr<char[]> buffers[2];
+    int filling = 0;                    // Buffer the pending task inflates into
+    std::future<long> pending;          // Bytes inflated, -1 on error; invalid after the last buffer
+    bool failed = false;
+
+    ~Gzip() {
+        if (pending.valid())
+            pending.wait();
+        if (file)
+            gzclose(file);
+    }
+
+    bool open(const std::string& filepath, size_t bytes) {
+        file = gzopen(filepath.c_str(), "rb");
+        if (!file)
+            return false;
+        gzbuffer(file, 1 << 20);
+        buffer_bytes = bytes;
+        buffers[0] = std::make_unique_for_overwrite<char[]>(buffer_bytes);
+        buffers[1] = std::make_unique_for_overwrite<char[]>(buffer_bytes);
+        startFill();
+        return true;
+    }
+
+    void startFill() {
+        char* buffer = buffers[filling].get();
+        pending = std::async(std::launch::async, [this, buffer]() { return fill(buffer); });
+    }
+
+    // Inflate until the buffer is full or the input ends; a truncated stream counts as an error
+    long fill(char* buffer) {
+        size_t filled = 0;
+        while (filled < buffer_bytes) {
+            int bytes_read = gzread(file, buffer + filled, unsigned(std::min<size_t>(buffer_bytes - filled, INT_MAX)));
+            if (bytes_read < 0)
+                return -1;
+            if (bytes_read == 0) {
+                int error = Z_OK;
+                gzerror(file, &error);
+                if (error != Z_OK)
+                    return -1;
+                break;
+            }
+            filled += size_t(bytes_read);
+        }
+        return long(filled);
+    }
+
+    bool next(const char*& data, size_t& size) {
+        if (!pending.valid())
+            return false;
+        long filled = pending.get();
+        if (filled <= 0) {
+            failed = filled < 0;
+            return false;
+        }
+        data = buffers[filling].get();
+        size = size_t(filled);
+        // A short buffer is the last one, otherwise inflate the next into the other buffer
+        filling = 1 - filling;
+        if (size == buffer_bytes)
+            startFill();
+        return true;
+    }
+};
+
+#else
+
+struct TableTextReader::Gzip {
+    bool failed = false;
+    bool open(const std::string&, size_t) { return false; }
+    bool next(const char*&, size_t&) { return false; }
+};
+
+#endif
+
+
+// ---------------- zstd ----------------
+#ifdef TPCH_HAVE_ZSTD
+
+// The compressed file is mapped. Runs of frames small enough to decompress in one piece are
+// decompressed in batches of one frame per pool worker and handed out in order; any other
+// frame is decompressed as a stream into one buffer at a time
+struct TableTextReader::Zstd {
+    struct Frame {
+        std::unique_ptr<char[]> data;
+        size_t compressed_offset;
+        size_t compressed_size;
+        size_t size;
+    };
+
+    MappedFile file;
+    ThreadPool* pool = nullptr;
+    size_t buffer_bytes = 0;
+    size_t offset = 0;                  // First compressed byte not handed to a decompressor yet
+    std::vector<Frame> batch;
+    size_t next_frame = 0;              // Next frame of batch to return
+    ZSTD_DStream* stream = nullptr;
+    size_t stream_end = 0;              // End of the frame being streamed, 0 when none is
+    std::unique_ptr<char[]> stream_buffer;
+    bool failed = false;
+
+    ~Zstd() {
+        if (stream)
+            ZSTD_freeDStream(stream);
+    }
+
+    bool open(const std::string& filepath, size_t bytes, ThreadPool* thread_pool) {
+        if (!file.open(filepath))
+            return false;
+        stream = ZSTD_createDStream();
+        if (!stream)
+            return false;
+        pool = thread_pool;
+        buffer_bytes = bytes;
+        stream_buffer = std::make_unique_for_overwrite<char[]>(buffer_bytes);
+        return true;
+    }
+
+    // Collect the frames from offset on that record a content size of at most
+    // ZSTD_PARALLEL_FRAME_BYTES, up to one per worker, and decompress them in parallel
+    bool decompressBatch() {
+        const size_t max_frames = pool ? size_t(pool->size()) : 1;
+        batch.clear();
+        next_frame = 0;
+        while (batch.size() < max_frames && offset < file.size()) {
+            const char* frame = file.data() + offset;
+            size_t remaining = file.size() - offset;
+            size_t compressed_size = ZSTD_findFrameCompressedSize(frame, remaining);
+            if (ZSTD_isError(compressed_size))
+                return false;
+            unsigned long long content_size = ZSTD_getFrameContentSize(frame, remaining);
+            if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR
+                || content_size > ZSTD_PARALLEL_FRAME_BYTES) {
+                if (batch.empty()) {            // Stream this frame instead
+                    ZSTD_DCtx_reset(stream, ZSTD_reset_session_only);
+                    stream_end = offset + compressed_size;
+                }
+                break;
+            }
+            batch.push_back(Frame{nullptr, offset, compressed_size, size_t(content_size)});
+            offset += compressed_size;
+        }
+
+        std::atomic<bool> ok{true};
+        auto decompress = [&](size_t index, int) {
+            Frame& frame = batch[index];
+            frame.data = std::make_unique_for_overwrite<char[]>(std::max<size_t>(frame.size, 1));
+            size_t decompressed = ZSTD_decompress(frame.data.get(), frame.size,
+                                                  file.data() + frame.compressed_offset, frame.compressed_size);
+            if (ZSTD_isError(decompressed) || decompressed != frame.size)
+                ok = false;
+        };
+        if (pool && batch.size() > 1)
+            pool->parallelFor(batch.size(), decompress);
+        else
+            for (size_t index = 0; index < batch.size(); ++index)
+                decompress(index, 0);
+        return ok;
+    }
+
+    // Decompress the next buffer of the frame being streamed
+    bool decompressStream(size_t& size) {
+        ZSTD_inBuffer in{file.data(), stream_end, offset};
+        ZSTD_outBuffer out{stream_buffer.get(), buffer_bytes, 0};
+        size_t hint = 1;
+        while (out.pos < out.size && hint != 0) {
+            hint = ZSTD_decompressStream(stream, &out, &in);
+            if (ZSTD_isError(hint) || (hint != 0 && in.pos == in.size && out.pos < out.size))
+                return false;           // Corrupt or truncated frame
+        }
+        offset = in.pos;
+        if (hint == 0)
+            stream_end = 0;
+        size = out.pos;
+        return true;
+    }
+
+    bool next(const char*& data, size_t& size) {
+        while (!failed) {
+            if (next_frame < batch.size()) {
+                Frame& frame = batch[next_frame++];
+                if (frame.size == 0)
+                    continue;           // Empty or skippable frame
+                data = frame.data.get();
+                size = frame.size;
+                return true;
+            }
+            if (stream_end) {
+                failed = !decompressStream(size);
+                if (!failed && size > 0) {
+                    data = stream_buffer.get();
+                    return true;
+                }
+                continue;
+            }
+            if (offset >= file.size())
+                return false;
+            failed = !decompressBatch();
+        }
+        return false;
+    }
+};
+
+#else
+
+struct TableTextReader::Zstd {
+    bool failed = false;
+    bool open(const std::string&, size_t, ThreadPool*) { return false; }
+    bool next(const char*&, size_t&) { return false; }
+};
+
+#endif
+
+
+// ---------------- TableTextReader ----------------
+TableTextReader::TableTextReader() = default;
+
+TableTextReader::~TableTextReader() = default;
+
+bool TableTextReader::open(const std::string& filepath, size_t buffer_bytes, ThreadPool* pool) {
+    close();
+    compression_ = detectTableCompression(filepath);
+    switch (compression_) {
+        case TableCompression::None:
+            return plain_.open(filepath, buffer_bytes, READ_AHEAD_DEPTH);
+        case TableCompression::Gzip:
+            gzip_ = std::make_unique<Gzip>();
+            return gzip_->open(filepath, buffer_bytes);
+        case TableCompression::Zstd:
+            zstd_ = std::make_unique<Zstd>();
+            return zstd_->open(filepath, buffer_bytes, pool);
+    }
+    return false;
+}
+
+bool TableTextReader::next(const char*& data, size_t& size) {
+    if (gzip_)
+        return gzip_->next(data, size);
+    if (zstd_)
+        return zstd_->next(data, size);
+    return plain_.next(data, size);
+}
+
+void TableTextReader::close() {
+    plain_.close();
+    gzip_.reset();
+    zstd_.reset();
+    compression_ = TableCompression::None;
+}
+
+bool TableTextReader::failed() const {
+    if (gzip_)
+        return gzip_->failed;
+    if (zstd_)
+        return zstd_->failed;
+    return plain_.failed();
+}
+
+
+// ---------------- TableTextStream ----------------
+TableTextStream::TableTextStream(const std::string& filepath) : std::istream(nullptr) {
+    if (detectTableCompression(filepath) == TableCompression::None) {
+        open_ = file_.open(filepath, std::ios::in) != nullptr;
+        rdbuf(&file_);
+    }
+    else {
+        open_ = decompressed_.reader.open(filepath, STREAM_BUFFER_BYTES);
+        rdbuf(&decompressed_);
+    }
+    if (!open_)
+        setstate(std::ios::failbit);
+}
+
+TableTextStream::DecompressedBuffer::int_type TableTextStream::DecompressedBuffer::underflow() {
+    const char* data;
+    size_t size;
+    if (!reader.next(data, size)) {
+        // std::istream turns the exception into badbit, which the loaders check
+        if (reader.failed())
+            throw std::ios_base::failure("corrupt or truncated compressed table");
+        return traits_type::eof();
+    }
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+    return traits_type::to_int_type(*begin);
+}
@@ -0,0 +1,79 @@
+#include "table_scan.hpp"
+#include <filesystem>
+#include <iostream>
+
+
+size_t fileSizeOrZero(const std::string& filepath) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(filepath, error);
+    return error ? 0 : size_t(size);
+}
+
+bool compressedTable(const std::string& filepath) {
+    TableCompression compression = detectTableCompression(filepath);
+    if (!tableCompressionSupported(compression))
+        std::cerr << "Error: " << filepath << " is " << (compression == TableCompression::Gzip ? "gzip" : "zstd")
+                  << " compressed, but this build has no " << (compression == TableCompression::Gzip ? "zlib" : "libzstd") << "\n";
+    return compression != TableCompression::None;
+}
+
+size_t textBufferBytes(const ThreadPool& pool) {
+    return std::max<size_t>(pool.size(), 4) * TEXT_MORSEL_BYTES;
+}
+
+std::vector<ShardMorsel> shardMorsels(const std::vector<size_t>& shard_sizes, const std::vector<bool>& splittable,
+                                      int num_workers) {
+    const size_t num_shards = shard_sizes.size();
+    const size_t workers = size_t(std::max(num_workers, 1));
+    std::vector<std::vector<ShardMorsel>> worker_morsels(workers);
+    auto addText = [&](size_t worker, size_t shard, size_t start_offset, size_t end_offset) {
+        do {
+            size_t morsel_end = splittable[shard] ? std::min(start_offset + TEXT_MORSEL_BYTES, end_offset) : end_offset;
+            worker_morsels[worker].push_back({shard, start_offset, morsel_end});
+            start_offset = morsel_end;
+        } while (start_offset < end_offset);
+    };
+
+    for (size_t shard = 0; shard < num_shards; ++shard) {
+        size_t first_worker = workers * shard / num_shards;
+        size_t shard_workers = splittable[shard] ? std::max<size_t>(workers * (shard + 1) / num_shards - first_worker, 1) : 1;
+        for (size_t worker = 0; worker < shard_workers; ++worker)
+            addText(first_worker + worker, shard, shard_sizes[shard] * worker / shard_workers,
+                    shard_sizes[shard] * (worker + 1) / shard_workers);
+    }
+
+    size_t per_worker = 0;
+    for (const std::vector<ShardMorsel>& own : worker_morsels)
+        per_worker = std::max(per_worker, own.size());
+    std::vector<ShardMorsel> morsels;
+    morsels.reserve(per_worker * workers);
+    for (std::vector<ShardMorsel>& own : worker_morsels) {
+        own.resize(per_worker, ShardMorsel{PADDING_SHARD, 0, 0});
+        morsels.insert(morsels.end(), own.begin(), own.end());
+    }
+    return morsels;
+}
+
+bool TableShards::open(const std::vector<std::string>& shard_paths, bool map_files) {
+    paths = shard_paths;
+    files = std::vector<MappedFile>(paths.size());
+    sizes.assign(paths.size(), 0);
+    compressed.assign(paths.size(), false);
+    for (size_t shard = 0; shard < paths.size(); ++shard) {
+        compressed[shard] = compressedTable(paths[shard]);
+        if (compressed[shard] || !map_files)
+            sizes[shard] = fileSizeOrZero(paths[shard]);
+        else if (files[shard].open(paths[shard]))
+            sizes[shard] = files[shard].size();
+        else
+            return false;               // Error Opening File
+    }
+    return true;
+}
+
+std::vector<bool> TableShards::splittable() const {
+    std::vector<bool> result(compressed.size());
+    for (size_t shard = 0; shard < compressed.size(); ++shard)
+        result[shard] = !compressed[shard];
+    return result;
+}
@@ -0,0 +1,461 @@
+#include "table_snapshot.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = {'T', 'P', 'C', 'H', 'S', 'N', 'A', 'P'};
+constexpr size_t COLUMN_ALIGNMENT = 64;     // Columns start on cache line boundaries
+constexpr size_t SNAPSHOT_CHUNK_ROWS = size_t(1) << 16;
+
+// Identity of the .tbl file a snapshot was built from
+struct SourceStamp {
+    uint64_t size;
+    int64_t mtime_ns;
+};
+
+// Fixed size file header, followed by chunk_count chunk row counts and column_count ColumnEntry records
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t column_count;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t row_count;
+    uint64_t chunk_count;
+};
+
+struct ColumnEntry {
+    uint64_t offset;    // Byte offset of the column from the start of the file
+    uint64_t bytes;     // Column length in bytes
+};
+
+// Column to be written: a contiguous array of plain values
+struct ColumnView {
+    const void* data;
+    size_t bytes;
+};
+
+// Strings are stored as two columns: rows + 1 end offsets and the concatenated characters
+struct StringColumn {
+    std::vector<uint64_t> offsets;
+    std::string chars;
+};
+
+bool statSource(const std::string& source_path, SourceStamp& stamp) {
+    struct stat source_stat;
+    if (stat(source_path.c_str(), &source_stat) != 0)
+        return false;
+    stamp.size = source_stat.st_size;
+    stamp.mtime_ns = int64_t(source_stat.st_mtim.tv_sec) * 1000000000 + source_stat.st_mtim.tv_nsec;
+    return true;
+}
+
+size_t alignUp(size_t value) {
+    return (value + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+}
+
+// Write header, chunk sizes and columns to a temporary file, then rename it into place
+// so a concurrent or interrupted run never sees a half written snapshot
+bool writeColumns(const std::string& cache_dir, const std::string& source_path,
+                  uint64_t row_count, const std::vector<uint64_t>& chunk_rows,
+                  const std::vector<ColumnView>& columns)
+{
+    SourceStamp stamp;
+    if (!statSource(source_path, stamp))
+        return false;
+
+    std::error_code error;
+    std::filesystem::create_directories(cache_dir, error);
+    if (error)
+        return false;
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.column_count = columns.size();
+    header.source_size = stamp.size;
+    header.source_mtime_ns = stamp.mtime_ns;
+    header.row_count = row_count;
+    header.chunk_count = chunk_rows.size();
+
+    // Lay the columns out after the directory
+    std::vector<ColumnEntry> entries(columns.size());
+    size_t offset = alignUp(sizeof(SnapshotHeader) + chunk_rows.size() * sizeof(uint64_t)
+                            + columns.size() * sizeof(ColumnEntry));
+    for (size_t i = 0; i < columns.size(); ++i) {
+        entries[i] = {offset, columns[i].bytes};
+        offset = alignUp(offset + columns[i].bytes);
+    }
+
+    std::string final_path = snapshotPath(cache_dir, source_path);
+    std::string temp_path = final_path + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(chunk_rows.data()), chunk_rows.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(ColumnEntry));
+
+        const char padding[COLUMN_ALIGNMENT] = {};
+        for (size_t i = 0; i < columns.size(); ++i) {
+            out.write(padding, entries[i].offset - size_t(out.tellp()));
+            out.write(static_cast<const char*>(columns[i].data), columns[i].bytes);
+        }
+        if (!out)
+            return false;
+    }
+
+    std::filesystem::rename(temp_path, final_path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+// Mapped snapshot with validated header and column directory
+class SnapshotReader {
+public:
+    // Map the snapshot for source_path; fails if it is missing, stale, from another version or malformed
+    bool open(const std::string& cache_dir, const std::string& source_path, uint32_t expected_columns) {
+        SourceStamp stamp;
+        if (!statSource(source_path, stamp) || !file_.open(snapshotPath(cache_dir, source_path)))
+            return false;
+        if (file_.size() < sizeof(SnapshotHeader))
+            return false;
+
+        header_ = reinterpret_cast<const SnapshotHeader*>(file_.data());
+        if (std::memcmp(header_->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+            || header_->version != SNAPSHOT_VERSION
+            || header_->column_count != expected_columns
+            || header_->source_size != stamp.size
+            || header_->source_mtime_ns != stamp.mtime_ns)
+            return false;
+
+        size_t directory_end = sizeof(SnapshotHeader) + header_->chunk_count * sizeof(uint64_t)
+                             + header_->column_count * sizeof(ColumnEntry);
+        if (file_.size() < directory_end)
+            return false;
+
+        chunk_rows_ = reinterpret_cast<const uint64_t*>(file_.data() + sizeof(SnapshotHeader));
+        entries_ = reinterpret_cast<const ColumnEntry*>(chunk_rows_ + header_->chunk_count);
+        for (uint32_t i = 0; i < header_->column_count; ++i)
+            if (entries_[i].offset + entries_[i].bytes > file_.size())
+                return false;
+        return true;
+    }
+
+    uint64_t rows() const { return header_->row_count; }
+
+    // Typed view of a column holding count values of T, nullptr if the stored size does not match
+    template <typename T>
+    const T* column(uint32_t index, uint64_t count) const {
+        if (entries_[index].bytes != count * sizeof(T))
+            return nullptr;
+        return reinterpret_cast<const T*>(file_.data() + entries_[index].offset);
+    }
+
+    // Read string column stored at [index, index + 1] into out, one string per row
+    bool strings(uint32_t index, std::vector<std::string>& out) const {
+        const uint64_t* offsets = column<uint64_t>(index, rows() + 1);
+        if (!offsets || offsets[rows()] != entries_[index + 1].bytes)
+            return false;
+        const char* chars = file_.data() + entries_[index + 1].offset;
+        out.resize(rows());
+        for (uint64_t row = 0; row < rows(); ++row)
+            out[row].assign(chars + offsets[row], offsets[row + 1] - offsets[row]);
+        return true;
+    }
+
+private:
+    MappedFile file_;
+    const SnapshotHeader* header_ = nullptr;
+    const uint64_t* chunk_rows_ = nullptr;
+    const ColumnEntry* entries_ = nullptr;
+};
+
+// Gather one member of every row into a contiguous column
+template <typename Row, typename Value>
+std::vector<Value> gatherColumn(const std::vector<Row>& rows, Value Row::*member) {
+    std::vector<Value> values(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+        values[i] = rows[i].*member;
+    return values;
+}
+
+template <typename Row>
+StringColumn gatherStrings(const std::vector<Row>& rows, std::string Row::*member) {
+    StringColumn column;
+    column.offsets.reserve(rows.size() + 1);
+    column.offsets.push_back(0);
+    for (const Row& row : rows) {
+        column.chars += row.*member;
+        column.offsets.push_back(column.chars.size());
+    }
+    return column;
+}
+
+template <typename Value>
+ColumnView view(const std::vector<Value>& values) {
+    return {values.data(), values.size() * sizeof(Value)};
+}
+
+ColumnView view(const std::string& chars) {
+    return {chars.data(), chars.size()};
+}
+
+} // namespace
+
+
+std::string snapshotPath(const std::string& cache_dir, const std::string& source_path) {
+    return cache_dir + "/" + std::filesystem::path(source_path).filename().string() + ".snap";
+}
+
+
+// ---------------- Readers ----------------
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Region>& region_data) {
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 3))
+        return false;
+
+    const int* keys = snapshot.column<int>(0, snapshot.rows());
+    std::vector<std::string> names;
+    if (!keys || !snapshot.strings(1, names))
+        return false;
+
+    region_data.clear();
+    region_data.reserve(snapshot.rows());
+    for (uint64_t row = 0; row < snapshot.rows(); ++row)
+        region_data.emplace_back(keys[row], std::move(names[row]));
+    return true;
+}
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Nation>& nation_data) {
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 4))
+        return false;
+
+    const int* keys = snapshot.column<int>(0, snapshot.rows());
+    const int* region_keys = snapshot.column<int>(3, snapshot.rows());
+    std::vector<std::string> names;
+    if (!keys || !region_keys || !snapshot.strings(1, names))
+        return false;
+
+    nation_data.clear();
+    nation_data.reserve(snapshot.rows());
+    for (uint64_t row = 0; row < snapshot.rows(); ++row)
+        nation_data.emplace_back(keys[row], std::move(names[row]), region_keys[row]);
+    return true;
+}
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Customer>& customer_data) {
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 2))
+        return false;
+
+    const int* keys = snapshot.column<int>(0, snapshot.rows());
+    const int* nation_keys = snapshot.column<int>(1, snapshot.rows());
+    if (!keys || !nation_keys)
+        return false;
+
+    customer_data.resize(snapshot.rows());
+    for (uint64_t row = 0; row < snapshot.rows(); ++row)
+        customer_data[row] = {keys[row], nation_keys[row]};
+    return true;
+}
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Supplier>& supplier_data) {
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 2))
+        return false;
+
+    const int* keys = snapshot.column<int>(0, snapshot.rows());
+    const int* nation_keys = snapshot.column<int>(1, snapshot.rows());
+    if (!keys || !nation_keys)
+        return false;
+
+    supplier_data.resize(snapshot.rows());
+    for (uint64_t row = 0; row < snapshot.rows(); ++row)
+        supplier_data[row] = {keys[row], nation_keys[row]};
+    return true;
+}
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path, std::vector<Orders>& orders_data) {
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 3))
+        return false;
+
+    const int* keys = snapshot.column<int>(0, snapshot.rows());
+    const int* cust_keys = snapshot.column<int>(1, snapshot.rows());
+    const int* dates = snapshot.column<int>(2, snapshot.rows());
+    if (!keys || !cust_keys || !dates)
+        return false;
+
+    orders_data.resize(snapshot.rows());
+    for (uint64_t row = 0; row < snapshot.rows(); ++row)
+        orders_data[row] = {keys[row], cust_keys[row], dates[row]};
+    return true;
+}
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path,
+                  std::vector<std::vector<LineItem>>& lineitem_data, ThreadPool& pool)
+{
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 4))
+        return false;
+
+    const uint64_t rows = snapshot.rows();
+    const int* order_keys = snapshot.column<int>(0, rows);
+    const int* supp_keys = snapshot.column<int>(1, rows);
+    const int64_t* prices = snapshot.column<int64_t>(2, rows);
+    const int16_t* discounts = snapshot.column<int16_t>(3, rows);
+    if (!order_keys || !supp_keys || !prices || !discounts)
+        return false;
+
+    // Rebuild the chunks in parallel, each morsel faults in and copies its own slice of the columns
+    size_t num_chunks = (rows + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS;
+    lineitem_data.assign(num_chunks, {});
+    pool.parallelFor(num_chunks, [&](size_t chunk, int) {
+        uint64_t begin = chunk * SNAPSHOT_CHUNK_ROWS;
+        uint64_t end = std::min<uint64_t>(begin + SNAPSHOT_CHUNK_ROWS, rows);
+        std::vector<LineItem>& out = lineitem_data[chunk];
+        out.resize(end - begin);
+        for (uint64_t row = begin; row < end; ++row)
+            out[row - begin] = {order_keys[row], supp_keys[row], prices[row], discounts[row]};
+    });
+    return true;
+}
+
+bool readSnapshot(const std::string& cache_dir, const std::string& source_path,
+                  std::vector<LineItemColumns>& lineitem_data, ThreadPool& pool)
+{
+    SnapshotReader snapshot;
+    if (!snapshot.open(cache_dir, source_path, 4))
+        return false;
+
+    const uint64_t rows = snapshot.rows();
+    const int* order_keys = snapshot.column<int>(0, rows);
+    const int* supp_keys = snapshot.column<int>(1, rows);
+    const int64_t* prices = snapshot.column<int64_t>(2, rows);
+    const int16_t* discounts = snapshot.column<int16_t>(3, rows);
+    if (!order_keys || !supp_keys || !prices || !discounts)
+        return false;
+
+    // Same layout on both sides, so every chunk column is a straight copy of a slice
+    size_t num_chunks = (rows + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS;
+    lineitem_data.assign(num_chunks, {});
+    pool.parallelFor(num_chunks, [&](size_t chunk, int) {
+        uint64_t begin = chunk * SNAPSHOT_CHUNK_ROWS;
+        uint64_t end = std::min<uint64_t>(begin + SNAPSHOT_CHUNK_ROWS, rows);
+        LineItemColumns& out = lineitem_data[chunk];
+        out.L_ORDERKEY.assign(order_keys + begin, order_keys + end);
+        out.L_SUPPKEY.assign(supp_keys + begin, supp_keys + end);
+        out.L_EXTENDEDPRICE.assign(prices + begin, prices + end);
+        out.L_DISCOUNT.assign(discounts + begin, discounts + end);
+    });
+    return true;
+}
+
+
+// ---------------- Writers ----------------
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Region>& region_data) {
+    std::vector<int> keys = gatherColumn(region_data, &Region::R_REGIONKEY);
+    StringColumn names = gatherStrings(region_data, &Region::R_NAME);
+    return writeColumns(cache_dir, source_path, region_data.size(), {region_data.size()},
+                        {view(keys), view(names.offsets), view(names.chars)});
+}
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Nation>& nation_data) {
+    std::vector<int> keys = gatherColumn(nation_data, &Nation::N_NATIONKEY);
+    StringColumn names = gatherStrings(nation_data, &Nation::N_NAME);
+    std::vector<int> region_keys = gatherColumn(nation_data, &Nation::N_REGIONKEY);
+    return writeColumns(cache_dir, source_path, nation_data.size(), {nation_data.size()},
+                        {view(keys), view(names.offsets), view(names.chars), view(region_keys)});
+}
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Customer>& customer_data) {
+    std::vector<int> keys = gatherColumn(customer_data, &Customer::C_CUSTKEY);
+    std::vector<int> nation_keys = gatherColumn(customer_data, &Customer::C_NATIONKEY);
+    return writeColumns(cache_dir, source_path, customer_data.size(), {customer_data.size()},
+                        {view(keys), view(nation_keys)});
+}
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Supplier>& supplier_data) {
+    std::vector<int> keys = gatherColumn(supplier_data, &Supplier::S_SUPPKEY);
+    std::vector<int> nation_keys = gatherColumn(supplier_data, &Supplier::S_NATIONKEY);
+    return writeColumns(cache_dir, source_path, supplier_data.size(), {supplier_data.size()},
+                        {view(keys), view(nation_keys)});
+}
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path, const std::vector<Orders>& orders_data) {
+    std::vector<int> keys = gatherColumn(orders_data, &Orders::O_ORDERKEY);
+    std::vector<int> cust_keys = gatherColumn(orders_data, &Orders::O_CUSTKEY);
+    std::vector<int> dates = gatherColumn(orders_data, &Orders::O_ORDERDATE);
+    return writeColumns(cache_dir, source_path, orders_data.size(), {orders_data.size()},
+                        {view(keys), view(cust_keys), view(dates)});
+}
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path,
+                   const std::vector<std::vector<LineItem>>& lineitem_data)
+{
+    // Concatenate the chunks column by column, remembering each chunk's row count
+    std::vector<uint64_t> chunk_rows;
+    size_t rows = 0;
+    for (const std::vector<LineItem>& chunk : lineitem_data) {
+        chunk_rows.push_back(chunk.size());
+        rows += chunk.size();
+    }
+
+    std::vector<int> order_keys, supp_keys;
+    std::vector<int64_t> prices;
+    std::vector<int16_t> discounts;
+    order_keys.reserve(rows);
+    supp_keys.reserve(rows);
+    prices.reserve(rows);
+    discounts.reserve(rows);
+    for (const std::vector<LineItem>& chunk : lineitem_data)
+        for (const LineItem& row : chunk) {
+            order_keys.push_back(row.L_ORDERKEY);
+            supp_keys.push_back(row.L_SUPPKEY);
+            prices.push_back(row.L_EXTENDEDPRICE);
+            discounts.push_back(row.L_DISCOUNT);
+        }
+
+    return writeColumns(cache_dir, source_path, rows, chunk_rows,
+                        {view(order_keys), view(supp_keys), view(prices), view(discounts)});
+}
+
+bool writeSnapshot(const std::string& cache_dir, const std::string& source_path,
+                   const std::vector<LineItemColumns>& lineitem_data)
+{
+    std::vector<uint64_t> chunk_rows;
+    size_t rows = 0;
+    for (const LineItemColumns& chunk : lineitem_data) {
+        chunk_rows.push_back(chunk.size());
+        rows += chunk.size();
+    }
+
+    LineItemColumns all;
+    all.reserve(rows);
+    for (const LineItemColumns& chunk : lineitem_data) {
+        all.L_ORDERKEY.insert(all.L_ORDERKEY.end(), chunk.L_ORDERKEY.begin(), chunk.L_ORDERKEY.end());
+        all.L_SUPPKEY.insert(all.L_SUPPKEY.end(), chunk.L_SUPPKEY.begin(), chunk.L_SUPPKEY.end());
+        all.L_EXTENDEDPRICE.insert(all.L_EXTENDEDPRICE.end(), chunk.L_EXTENDEDPRICE.begin(), chunk.L_EXTENDEDPRICE.end());
+        all.L_DISCOUNT.insert(all.L_DISCOUNT.end(), chunk.L_DISCOUNT.begin(), chunk.L_DISCOUNT.end());
+    }
+
+    return writeColumns(cache_dir, source_path, rows, chunk_rows,
+                        {view(all.L_ORDERKEY), view(all.L_SUPPKEY), view(all.L_EXTENDEDPRICE), view(all.L_DISCOUNT)});
+}
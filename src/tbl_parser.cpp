@@ -0,0 +1,83 @@
+#include "tbl_parser.hpp"
+#include "probe_kernels.hpp"
+#include <algorithm>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TPCH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+using FindLineFields = const char* (*)(const char*, const char*, const char**, int, int&);
+
+// Reference scan, also used for the bytes after the last full vector
+const char* findLineFieldsScalar(const char* cursor, const char* end, const char** delimiters, int max_fields, int& found) {
+    for (; cursor < end; ++cursor) {
+        if (*cursor == '\n')
+            return cursor;
+        if (*cursor == '|' && found < max_fields)
+            delimiters[found++] = cursor;
+    }
+    return end;
+}
+
+#ifdef TPCH_X86_KERNELS
+
+// Compare the first 64 bytes of the line against '|' and '\n'. The fields a parser needs lie at the
+// start of the line, so their delimiters are read off the bar bitmask in one loop whose trip count
+// is the same for every well-formed line; the rest of the line is only searched for its newline.
+// Never loads past end, the mapped file may end on a page boundary
+__attribute__((target("avx2")))
+const char* findLineFieldsAvx2(const char* cursor, const char* end, const char** delimiters, int max_fields, int& found) {
+    if (end - cursor < 64)
+        return findLineFieldsScalar(cursor, end, delimiters, max_fields, found);
+
+    const __m256i bar = _mm256_set1_epi8('|');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor + 32));
+    uint64_t bars = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, bar)))
+                  | uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, bar)))) << 32;
+    uint64_t newlines = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)))
+                      | uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)))) << 32;
+    if (newlines)
+        bars &= (newlines & -newlines) - 1;        // Only the delimiters before the line end
+
+    int count = std::min(__builtin_popcountll(bars), max_fields);
+    for (; found < count; ++found, bars &= bars - 1)
+        delimiters[found] = cursor + __builtin_ctzll(bars);
+    if (newlines)
+        return cursor + __builtin_ctzll(newlines);
+    if (found < max_fields)                         // Long fields, the wanted delimiters continue past the window
+        return findLineFieldsScalar(cursor + 64, end, delimiters, max_fields, found);
+
+    const char* tail = cursor + 64;
+    for (; end - tail >= 32; tail += 32) {
+        uint32_t tail_newlines = uint32_t(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail)), newline)));
+        if (tail_newlines)
+            return tail + __builtin_ctz(tail_newlines);
+    }
+    return findLineEnd(tail, end);
+}
+
+#endif
+
+FindLineFields resolveFindLineFields() {
+#ifdef TPCH_X86_KERNELS
+    if (detectSimdLevel() != SimdLevel::Scalar)
+        return findLineFieldsAvx2;
+#endif
+    return findLineFieldsScalar;
+}
+
+} // namespace
+
+const char* findLineFields(const char* cursor, const char* end, const char** delimiters, int max_fields, int& found) {
+    static const FindLineFields find_line_fields = resolveFindLineFields();
+    found = 0;
+    return find_line_fields(cursor, end, delimiters, max_fields, found);
+}
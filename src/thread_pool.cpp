@@ -0,0 +1,174 @@
+#include "thread_pool.hpp"
+#include "cpu_topology.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+
+
+namespace {
+// Pool and worker id of the calling thread while it runs a job, so nested jobs can be detected
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_worker = 0;
+}
+
+ThreadPool::ThreadPool(int num_workers, std::vector<int> cpus)
+    : ranges_(new MorselRange[std::max(num_workers, 1)]), cpus_(std::move(cpus))
+{
+    num_workers = std::max(num_workers, 1);
+    worker_nodes_.assign(num_workers, 0);
+    if (!cpus_.empty()) {
+        for (int worker = 0; worker < num_workers; ++worker) {
+            worker_nodes_[worker] = numaNodeOfCpu(cpus_[worker % cpus_.size()]);
+            num_nodes_ = std::max(num_nodes_, worker_nodes_[worker] + 1);
+        }
+    }
+
+    workers_.reserve(num_workers);
+    for (int worker = 0; worker < num_workers; ++worker)
+        workers_.emplace_back(&ThreadPool::workerLoop, this, worker);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (std::thread& worker : workers_)
+        worker.join();
+}
+
+// A job issued from inside a job of this pool can not wait for the workers, one of which is
+// the caller itself, so it runs all its morsels on the calling worker instead
+bool ThreadPool::runNested(size_t num_morsels, const MorselFunction& body) const {
+    if (current_pool != this)
+        return false;
+    for (size_t morsel = 0; morsel < num_morsels; ++morsel)
+        body(morsel, current_worker);
+    return true;
+}
+
+void ThreadPool::parallelFor(size_t num_morsels, const MorselFunction& body) {
+    if (num_morsels == 0 || runNested(num_morsels, body))
+        return;
+
+    // Hand every worker an equal contiguous share of the morsels
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+    const size_t num_workers = workers_.size();
+    for (size_t worker = 0; worker < num_workers; ++worker) {
+        ranges_[worker].next.store(num_morsels * worker / num_workers, std::memory_order_relaxed);
+        ranges_[worker].end = num_morsels * (worker + 1) / num_workers;
+    }
+    runJob(body, true);
+}
+
+void ThreadPool::parallelFor(size_t num_morsels, const std::vector<size_t>& worker_starts, const MorselFunction& body) {
+    if (num_morsels == 0 || runNested(num_morsels, body))
+        return;
+
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+    for (size_t worker = 0; worker < workers_.size(); ++worker) {
+        ranges_[worker].next.store(worker_starts[worker], std::memory_order_relaxed);
+        ranges_[worker].end = worker_starts[worker + 1];
+    }
+    runJob(body, true);
+}
+
+void ThreadPool::forEachWorker(const std::function<void(int worker)>& body) {
+    if (current_pool == this) {
+        for (int worker = 0; worker < size(); ++worker)
+            body(worker);
+        return;
+    }
+
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+    for (size_t worker = 0; worker < workers_.size(); ++worker) {
+        ranges_[worker].next.store(worker, std::memory_order_relaxed);
+        ranges_[worker].end = worker + 1;
+    }
+    runJob([&](size_t, int worker) { body(worker); }, false);
+}
+
+// Start the job described by ranges_ on every worker and wait for it; the caller holds job_mutex_
+void ThreadPool::runJob(const MorselFunction& body, bool steal) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    body_ = &body;
+    steal_ = steal;
+    error_ = nullptr;
+    active_workers_ = size();
+    ++generation_;
+    job_ready_.notify_all();
+
+    job_done_.wait(lock, [this]() { return active_workers_ == 0; });
+    body_ = nullptr;
+
+    if (error_)
+        std::rethrow_exception(error_);
+}
+
+void ThreadPool::workerLoop(int worker) {
+    if (!cpus_.empty())
+        pinCurrentThread(cpus_[worker % cpus_.size()]);
+    current_pool = this;
+    current_worker = worker;
+
+    size_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_ready_.wait(lock, [&]() { return stopping_ || generation_ != seen_generation; });
+            if (stopping_)
+                return;
+            seen_generation = generation_;
+        }
+
+        // Per worker time and hardware counters of the job when instrumentation is on
+        if (Metrics* metrics = activeMetrics()) {
+            Metrics::ThreadSample start = Metrics::sampleThread();
+            runMorsels(worker);
+            metrics->addWorkerJob(worker, start, Metrics::sampleThread());
+        }
+        else
+            runMorsels(worker);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_workers_ == 0)
+            job_done_.notify_one();
+    }
+}
+
+// Drain this worker's own share first, then steal from the others in round robin order
+void ThreadPool::runMorsels(int worker) {
+    const int num_workers = size();
+    const int num_shares = steal_ ? num_workers : 1;
+    for (int offset = 0; offset < num_shares; ++offset) {
+        MorselRange& range = ranges_[(worker + offset) % num_workers];
+        size_t morsel;
+        while ((morsel = range.next.fetch_add(1, std::memory_order_relaxed)) < range.end) {
+            try {
+                (*body_)(morsel, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+        }
+    }
+}
+
+namespace {
+std::mutex shared_pool_mutex;
+std::unique_ptr<ThreadPool> shared_pool;
+std::vector<int> shared_pool_cpus;
+}
+
+ThreadPool& sharedThreadPool(int num_threads) {
+    std::lock_guard<std::mutex> lock(shared_pool_mutex);
+    if (!shared_pool || shared_pool->size() != std::max(num_threads, 1) || shared_pool->cpus() != shared_pool_cpus)
+        shared_pool = std::make_unique<ThreadPool>(num_threads, shared_pool_cpus);
+    return *shared_pool;
+}
+
+void setSharedThreadPoolCpus(const std::vector<int>& cpus) {
+    std::lock_guard<std::mutex> lock(shared_pool_mutex);
+    shared_pool_cpus = cpus;
+}
@@ -0,0 +1,275 @@
+#include "tpch_generator.hpp"
+#include "tpch_date.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <string_view>
+
+
+namespace {
+
+// splitmix64; unlike the std distributions it yields the same sequence on every platform
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [low, high]
+    int64_t between(int64_t low, int64_t high) {
+        return low + int64_t(next() % uint64_t(high - low + 1));
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Buffered writer of one .tbl file; like dbgen every field ends with '|' and every row with '\n'
+class TableWriter {
+public:
+    bool open(const std::string& path) {
+        file_.open(path, std::ios::binary | std::ios::trunc);
+        buffer_.reserve(FLUSH_BYTES + 1024);
+        return bool(file_);
+    }
+
+    TableWriter& field(int64_t value) {
+        char digits[24];
+        buffer_.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+        buffer_ += '|';
+        return *this;
+    }
+
+    TableWriter& field(std::string_view text) {
+        buffer_ += text;
+        buffer_ += '|';
+        return *this;
+    }
+
+    // Fixed-point value in hundredths, 12345 is written as 123.45
+    TableWriter& decimal(int64_t hundredths) {
+        if (hundredths < 0) {
+            buffer_ += '-';
+            hundredths = -hundredths;
+        }
+        char digits[24];
+        buffer_.append(digits, std::to_chars(digits, digits + sizeof(digits), hundredths / 100).ptr);
+        buffer_ += '.';
+        buffer_ += char('0' + hundredths % 100 / 10);
+        buffer_ += char('0' + hundredths % 10);
+        buffer_ += '|';
+        return *this;
+    }
+
+    TableWriter& date(int days) {
+        return field(formatDate(days));
+    }
+
+    // Name#000000042 style keyed text
+    TableWriter& keyed(std::string_view prefix, int64_t key) {
+        char digits[24];
+        std::to_chars_result end = std::to_chars(digits, digits + sizeof(digits), key);
+        buffer_ += prefix;
+        buffer_.append(std::max<ptrdiff_t>(0, 9 - (end.ptr - digits)), '0');
+        buffer_.append(digits, end.ptr);
+        buffer_ += '|';
+        return *this;
+    }
+
+    void endRow() {
+        buffer_ += '\n';
+        if (buffer_.size() >= FLUSH_BYTES)
+            flush();
+    }
+
+    bool close() {
+        flush();
+        file_.close();
+        return !file_.fail();
+    }
+
+private:
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+    void flush() {
+        file_.write(buffer_.data(), std::streamsize(buffer_.size()));
+        buffer_.clear();
+    }
+
+    std::ofstream file_;
+    std::string buffer_;
+};
+
+const char* const REGION_NAMES[] = {"AFRICA", "AMERICA", "ASIA", "EUROPE", "MIDDLE EAST"};
+
+struct NationRow {
+    const char* name;
+    int region;
+};
+
+// The 25 nations of the specification, in N_NATIONKEY order
+const NationRow NATIONS[] = {
+    {"ALGERIA", 0}, {"ARGENTINA", 1}, {"BRAZIL", 1}, {"CANADA", 1}, {"EGYPT", 4},
+    {"ETHIOPIA", 0}, {"FRANCE", 3}, {"GERMANY", 3}, {"INDIA", 2}, {"INDONESIA", 2},
+    {"IRAN", 4}, {"IRAQ", 4}, {"JAPAN", 2}, {"JORDAN", 4}, {"KENYA", 0},
+    {"MOROCCO", 0}, {"MOZAMBIQUE", 0}, {"PERU", 1}, {"CHINA", 2}, {"ROMANIA", 3},
+    {"SAUDI ARABIA", 4}, {"VIETNAM", 2}, {"RUSSIA", 3}, {"UNITED KINGDOM", 3}, {"UNITED STATES", 1},
+};
+constexpr int NATION_COUNT = sizeof(NATIONS) / sizeof(NATIONS[0]);
+
+const char* const SEGMENTS[] = {"AUTOMOBILE", "BUILDING", "FURNITURE", "HOUSEHOLD", "MACHINERY"};
+const char* const PRIORITIES[] = {"1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED", "5-LOW"};
+const char* const INSTRUCTIONS[] = {"DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN"};
+const char* const SHIP_MODES[] = {"REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB"};
+
+constexpr int START_DAY = daysFromCivil(1992, 1, 1);
+constexpr int END_DAY = daysFromCivil(1998, 12, 31);
+constexpr int CURRENT_DAY = daysFromCivil(1995, 6, 17);    // Splits shipped from open lineitems
+
+int64_t scaledRows(int64_t rows_per_sf, double scale_factor) {
+    return std::max<int64_t>(1, std::llround(double(rows_per_sf) * scale_factor));
+}
+
+// P_RETAILPRICE of a part in cents, as dbgen computes it
+int64_t retailPrice(int64_t partkey) {
+    return 90000 + (partkey / 10) % 20001 + 100 * (partkey % 1000);
+}
+
+std::string phone(Random& random, int nation) {
+    return std::to_string(10 + nation) + "-" + std::to_string(random.between(100, 999)) + "-"
+         + std::to_string(random.between(100, 999)) + "-" + std::to_string(random.between(1000, 9999));
+}
+
+struct LineRow {
+    int64_t partkey;
+    int64_t suppkey;
+    int64_t quantity;
+    int64_t price;              // cents
+    int64_t discount;           // hundredths
+    int64_t tax;                // hundredths
+    int ship_day;
+    int commit_day;
+    int receipt_day;
+};
+
+} // namespace
+
+
+bool generateTPCHData(const std::string& table_path, double scale_factor, uint64_t seed) {
+    if (!(scale_factor > 0))
+        return false;
+
+    const int64_t num_customers = scaledRows(GENERATOR_CUSTOMERS_PER_SF, scale_factor);
+    const int64_t num_suppliers = scaledRows(GENERATOR_SUPPLIERS_PER_SF, scale_factor);
+    const int64_t num_parts = scaledRows(GENERATOR_PARTS_PER_SF, scale_factor);
+    const int64_t num_orders = scaledRows(GENERATOR_ORDERS_PER_SF, scale_factor);
+    Random random(seed);
+
+    TableWriter region;
+    if (!region.open(table_path + "/region.tbl"))
+        return false;
+    for (int key = 0; key < 5; ++key) {
+        region.field(key).field(REGION_NAMES[key]).field("generated region");
+        region.endRow();
+    }
+    if (!region.close())
+        return false;
+
+    TableWriter nation;
+    if (!nation.open(table_path + "/nation.tbl"))
+        return false;
+    for (int key = 0; key < NATION_COUNT; ++key) {
+        nation.field(key).field(NATIONS[key].name).field(NATIONS[key].region).field("generated nation");
+        nation.endRow();
+    }
+    if (!nation.close())
+        return false;
+
+    TableWriter customer;
+    if (!customer.open(table_path + "/customer.tbl"))
+        return false;
+    for (int64_t key = 1; key <= num_customers; ++key) {
+        int nation_key = int(random.between(0, NATION_COUNT - 1));
+        customer.field(key).keyed("Customer#", key).field("address").field(nation_key)
+                .field(phone(random, nation_key)).decimal(random.between(-99999, 999999))
+                .field(SEGMENTS[random.between(0, 4)]).field("generated customer");
+        customer.endRow();
+    }
+    if (!customer.close())
+        return false;
+
+    TableWriter supplier;
+    if (!supplier.open(table_path + "/supplier.tbl"))
+        return false;
+    for (int64_t key = 1; key <= num_suppliers; ++key) {
+        int nation_key = int(random.between(0, NATION_COUNT - 1));
+        supplier.field(key).keyed("Supplier#", key).field("address").field(nation_key)
+                .field(phone(random, nation_key)).decimal(random.between(-99999, 999999)).field("generated supplier");
+        supplier.endRow();
+    }
+    if (!supplier.close())
+        return false;
+
+    // Orders and their lineitems are generated together; an order's status and total depend on its lines
+    TableWriter orders, lineitem;
+    if (!orders.open(table_path + "/orders.tbl") || !lineitem.open(table_path + "/lineitem.tbl"))
+        return false;
+    LineRow lines[7];
+    for (int64_t order = 0; order < num_orders; ++order) {
+        // dbgen keys are sparse: 8 used keys out of every 32
+        int64_t order_key = order / 8 * 32 + order % 8 + 1;
+
+        // Like dbgen, a third of the customers never place an order
+        int64_t cust_key;
+        do {
+            cust_key = random.between(1, num_customers);
+        } while (num_customers >= 3 && cust_key % 3 == 0);
+
+        int order_day = int(random.between(START_DAY, END_DAY - 151));
+        int num_lines = int(random.between(1, 7));
+        int shipped_lines = 0;
+        int64_t total_price = 0;
+        for (int line = 0; line < num_lines; ++line) {
+            LineRow& row = lines[line];
+            row.partkey = random.between(1, num_parts);
+            // One of the part's four suppliers, dbgen's PARTSUPP formula
+            int64_t supplier_index = random.between(0, 3);
+            row.suppkey = (row.partkey + supplier_index * (num_suppliers / 4 + (row.partkey - 1) / num_suppliers))
+                          % num_suppliers + 1;
+            row.quantity = random.between(1, 50);
+            row.price = row.quantity * retailPrice(row.partkey);
+            row.discount = random.between(0, 10);
+            row.tax = random.between(0, 8);
+            row.ship_day = order_day + int(random.between(1, 121));
+            row.commit_day = order_day + int(random.between(30, 90));
+            row.receipt_day = row.ship_day + int(random.between(1, 30));
+            shipped_lines += row.ship_day <= CURRENT_DAY;
+            total_price += row.price * (100 + row.tax) * (100 - row.discount) / 10000;
+        }
+
+        char status = shipped_lines == num_lines ? 'F' : shipped_lines == 0 ? 'O' : 'P';
+        orders.field(order_key).field(cust_key).field(std::string_view(&status, 1)).decimal(total_price)
+              .date(order_day).field(PRIORITIES[random.between(0, 4)]).keyed("Clerk#", random.between(1, 1000))
+              .field(0).field("generated order");
+        orders.endRow();
+
+        for (int line = 0; line < num_lines; ++line) {
+            const LineRow& row = lines[line];
+            const char* return_flag = row.receipt_day <= CURRENT_DAY ? (random.next() & 1 ? "R" : "A") : "N";
+            lineitem.field(order_key).field(row.partkey).field(row.suppkey).field(line + 1)
+                    .field(row.quantity).decimal(row.price).decimal(row.discount).decimal(row.tax)
+                    .field(return_flag).field(row.ship_day <= CURRENT_DAY ? "F" : "O")
+                    .date(row.ship_day).date(row.commit_day).date(row.receipt_day)
+                    .field(INSTRUCTIONS[random.between(0, 3)]).field(SHIP_MODES[random.between(0, 6)])
+                    .field("generated lineitem");
+            lineitem.endRow();
+        }
+    }
+    return orders.close() && lineitem.close();
+}
@@ -0,0 +1,334 @@
+#include "tpch_queries.hpp"
+#include "group_aggregate.hpp"
+#include "join_index.hpp"
+#include "metrics.hpp"
+#include "pipeline.hpp"
+#include "table_input.hpp"
+#include "tbl_parser.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <fstream>
+
+
+namespace {
+
+// Rows of the Q7 pipelines: parsed columns plus the nation codes the probes attach
+struct Q7OrderRow {
+    int orderkey;
+    int custkey;
+    int8_t customer_code;
+};
+
+struct Q7LineItemRow {
+    int orderkey;
+    int suppkey;
+    int64_t price;
+    int16_t discount;
+    int shipdate;
+    int8_t supplier_code;
+    int8_t customer_code;
+};
+
+// Rows of the Q10 pipelines
+struct Q10OrderRow {
+    int orderkey;
+    int custkey;
+    int orderdate;
+};
+
+struct Q10LineItemRow {
+    int orderkey;
+    int64_t price;
+    int16_t discount;
+    char returnflag;
+    int custkey;
+};
+
+bool parseQ7Order(const char* cursor, const char* line_end, Q7OrderRow& row) {
+    return parseIntField(cursor, line_end, row.orderkey)              // O_ORDERKEY
+        && parseIntField(cursor, line_end, row.custkey);              // O_CUSTKEY
+}
+
+bool parseQ7LineItem(const char* cursor, const char* line_end, Q7LineItemRow& row) {
+    return parseIntField(cursor, line_end, row.orderkey)              // L_ORDERKEY
+        && skipFields(cursor, line_end, 1)                            // L_PARTKEY
+        && parseIntField(cursor, line_end, row.suppkey)               // L_SUPPKEY
+        && skipFields(cursor, line_end, 2)                            // L_LINENUMBER, L_QUANTITY
+        && parseDecimalField(cursor, line_end, row.price)             // L_EXTENDEDPRICE
+        && parseDecimalField(cursor, line_end, row.discount)          // L_DISCOUNT
+        && skipFields(cursor, line_end, 3)                            // L_TAX, L_RETURNFLAG, L_LINESTATUS
+        && parseDateField(cursor, line_end, row.shipdate);            // L_SHIPDATE
+}
+
+bool parseQ10Order(const char* cursor, const char* line_end, Q10OrderRow& row) {
+    return parseIntField(cursor, line_end, row.orderkey)              // O_ORDERKEY
+        && parseIntField(cursor, line_end, row.custkey)               // O_CUSTKEY
+        && skipFields(cursor, line_end, 2)                            // O_ORDERSTATUS, O_TOTALPRICE
+        && parseDateField(cursor, line_end, row.orderdate);           // O_ORDERDATE
+}
+
+bool parseQ10LineItem(const char* cursor, const char* line_end, Q10LineItemRow& row) {
+    std::string_view returnflag;
+    if (!parseIntField(cursor, line_end, row.orderkey)                // L_ORDERKEY
+        || !skipFields(cursor, line_end, 4)                           // L_PARTKEY .. L_QUANTITY
+        || !parseDecimalField(cursor, line_end, row.price)            // L_EXTENDEDPRICE
+        || !parseDecimalField(cursor, line_end, row.discount)         // L_DISCOUNT
+        || !skipFields(cursor, line_end, 1)                           // L_TAX
+        || !readField(cursor, line_end, returnflag) || returnflag.size() != 1)  // L_RETURNFLAG
+        return false;
+    row.returnflag = returnflag[0];
+    return true;
+}
+
+// Index of every row of table whose nation has a code, key -> that code
+template <typename Row, typename KeyOf, typename NationOf>
+void buildNationIndex(const std::vector<Row> &table, const JoinIndex &nation_codes, KeyOf key_of, NationOf nation_of,
+                      ThreadPool &pool, JoinIndex &index) {
+    std::vector<JoinIndex::Entry> entries;
+    for (const Row& row : table) {
+        int8_t code = nation_codes.find(nation_of(row));
+        if (code != JoinIndex::NOT_FOUND)
+            entries.push_back({key_of(row), code});
+    }
+    index.build(entries, table.size(), &pool);
+}
+
+} // namespace
+
+
+bool executeQuery7(
+    const std::string &nation1,
+    const std::string &nation2,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Query7Result> &results)
+{
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    std::vector<Customer> customer_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    MetricsPhaseScope phase(MetricsPhase::Load);
+    if (!readSmallTables(table_path, customer_data, supplier_data, nation_data, region_data, options))
+        return false;
+
+    // nation1 is code 0 and nation2 code 1; customers and suppliers of other nations are dropped
+    phase.next(MetricsPhase::Preprocess);
+    const std::string nation_names[2] = {nation1, nation2};
+    std::vector<JoinIndex::Entry> nation_entries;
+    for (const Nation& n : nation_data)
+        for (int8_t code = 0; code < 2; ++code)
+            if (n.N_NAME == nation_names[code] && nation_entries.size() < 2)
+                nation_entries.push_back({n.N_NATIONKEY, code});
+    JoinIndex nation_codes, customers, suppliers;
+    nation_codes.build(nation_entries, nation_data.size());
+    buildNationIndex(customer_data, nation_codes, [](const Customer& c) { return c.C_CUSTKEY; },
+                     [](const Customer& c) { return c.C_NATIONKEY; }, pool, customers);
+    buildNationIndex(supplier_data, nation_codes, [](const Supplier& s) { return s.S_SUPPKEY; },
+                     [](const Supplier& s) { return s.S_NATIONKEY; }, pool, suppliers);
+    std::vector<Customer>().swap(customer_data);
+    std::vector<Supplier>().swap(supplier_data);
+
+    const std::vector<std::string> orders_paths = tableShardPaths(table_path, "orders");
+    const std::vector<std::string> lineitem_paths = tableShardPaths(table_path, "lineitem");
+
+    // orders.tbl -> probe customers -> build order key -> customer nation code
+    pipeline::JoinBuild<JoinIndex> order_build(pool);
+    size_t orders_lines;
+    if (!pipeline::forEachMorsel(pool, orders_paths, orders_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+        return pipeline::scanRows<Q7OrderRow>(begin, end, start_offset, end_offset, parseQ7Order,
+            pipeline::probe(customers,
+                [](const Q7OrderRow& row) { return row.custkey; },
+                [](Q7OrderRow& row, int8_t code) { row.customer_code = code; },
+            pipeline::insert(order_build, worker,
+                [](const Q7OrderRow& row) { return row.orderkey; },
+                [](const Q7OrderRow& row) { return row.customer_code; })));
+    }))
+        return false;                                  // Error Reading File
+    JoinIndex orders;
+    orders.build(order_build.entries(pool), orders_lines, &pool);
+
+    // lineitem.tbl -> filter ship date -> probe suppliers -> probe orders -> filter nations differ -> aggregate.
+    // Group (supplier code * 2 + customer code) * 2 + year - 1995
+    const int first_day = daysFromCivil(1995, 1, 1);
+    const int second_year = daysFromCivil(1996, 1, 1);
+    const int last_day = daysFromCivil(1996, 12, 31);
+    GroupAggregate aggregate(pool.size(), 8);
+
+    phase.next(MetricsPhase::Probe);
+    size_t lineitem_lines;
+    if (!pipeline::forEachMorsel(pool, lineitem_paths, lineitem_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+        return pipeline::scanRows<Q7LineItemRow>(begin, end, start_offset, end_offset, parseQ7LineItem,
+            pipeline::filter([&](const Q7LineItemRow& row) { return row.shipdate >= first_day && row.shipdate <= last_day; },
+            pipeline::probe(suppliers,
+                [](const Q7LineItemRow& row) { return row.suppkey; },
+                [](Q7LineItemRow& row, int8_t code) { row.supplier_code = code; },
+            pipeline::probe(orders,
+                [](const Q7LineItemRow& row) { return row.orderkey; },
+                [](Q7LineItemRow& row, int8_t code) { row.customer_code = code; },
+            pipeline::filter([](const Q7LineItemRow& row) { return row.supplier_code != row.customer_code; },
+            pipeline::aggregate(aggregate, worker,
+                [&](const Q7LineItemRow& row) {
+                    return uint64_t((row.supplier_code * 2 + row.customer_code) * 2 + (row.shipdate >= second_year));
+                },
+                [](const Q7LineItemRow& row) { return lineItemRevenue(row.price, row.discount); }))))));
+    }))
+        return false;                                  // Error Reading File
+
+    phase.next(MetricsPhase::Merge);
+    std::vector<std::pair<uint64_t, RevenueSum>> groups;
+    aggregate.merge(&pool, groups);
+    for (const std::pair<uint64_t, RevenueSum>& group : groups)
+        results.push_back(Query7Result{nation_names[group.first / 4], nation_names[group.first / 2 % 2],
+                                       int(1995 + group.first % 2), revenueToDouble(group.second)});
+    std::sort(results.begin(), results.end(), [](const Query7Result& a, const Query7Result& b) {
+        if (a.SUPP_NATION != b.SUPP_NATION) return a.SUPP_NATION < b.SUPP_NATION;
+        if (a.CUST_NATION != b.CUST_NATION) return a.CUST_NATION < b.CUST_NATION;
+        return a.L_YEAR < b.L_YEAR;
+    });
+    return true;
+}
+
+bool executeQuery10(
+    const std::string &start_date,
+    int num_threads,
+    const std::string &table_path,
+    const ExecutionOptions &options,
+    std::vector<Query10Result> &results)
+{
+    int start_day;
+    if (!parseDate(start_date, start_day))
+        return false;
+    const int end_day = addMonths(start_day, 3);
+
+    ThreadPool& pool = sharedThreadPool(num_threads);
+    std::vector<Customer> customer_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    MetricsPhaseScope phase(MetricsPhase::Load);
+    if (!readSmallTables(table_path, customer_data, supplier_data, nation_data, region_data, options))
+        return false;
+
+    const std::vector<std::string> orders_paths = tableShardPaths(table_path, "orders");
+    const std::vector<std::string> lineitem_paths = tableShardPaths(table_path, "lineitem");
+
+    // orders.tbl -> filter order date -> build order key -> customer key
+    phase.next(MetricsPhase::Preprocess);
+    using CustomerKeyIndex = BasicJoinIndex<int32_t>;
+    pipeline::JoinBuild<CustomerKeyIndex> order_build(pool);
+    size_t orders_lines;
+    if (!pipeline::forEachMorsel(pool, orders_paths, orders_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+        return pipeline::scanRows<Q10OrderRow>(begin, end, start_offset, end_offset, parseQ10Order,
+            pipeline::filter([&](const Q10OrderRow& row) { return row.orderdate >= start_day && row.orderdate < end_day; },
+            pipeline::insert(order_build, worker,
+                [](const Q10OrderRow& row) { return row.orderkey; },
+                [](const Q10OrderRow& row) { return int32_t(row.custkey); })));
+    }))
+        return false;                                  // Error Reading File
+    CustomerKeyIndex orders;
+    orders.build(order_build.entries(pool), orders_lines, &pool);
+
+    // lineitem.tbl -> filter returned -> probe orders -> aggregate by customer key
+    int max_custkey = 0;
+    for (const Customer& c : customer_data)
+        max_custkey = std::max(max_custkey, c.C_CUSTKEY);
+    GroupAggregate aggregate(pool.size(), uint64_t(max_custkey) + 1);
+
+    phase.next(MetricsPhase::Probe);
+    size_t lineitem_lines;
+    if (!pipeline::forEachMorsel(pool, lineitem_paths, lineitem_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int worker) {
+        return pipeline::scanRows<Q10LineItemRow>(begin, end, start_offset, end_offset, parseQ10LineItem,
+            pipeline::filter([](const Q10LineItemRow& row) { return row.returnflag == 'R'; },
+            pipeline::probe(orders,
+                [](const Q10LineItemRow& row) { return row.orderkey; },
+                [](Q10LineItemRow& row, int32_t custkey) { row.custkey = custkey; },
+            pipeline::aggregate(aggregate, worker,
+                [](const Q10LineItemRow& row) { return uint64_t(row.custkey); },
+                [](const Q10LineItemRow& row) { return lineItemRevenue(row.price, row.discount); }))));
+    }))
+        return false;                                  // Error Reading File
+
+    // Top 20 by revenue, ties by customer key so the order is deterministic
+    phase.next(MetricsPhase::Merge);
+    std::vector<std::pair<uint64_t, RevenueSum>> groups;
+    aggregate.merge(&pool, groups);
+    auto by_revenue = [](const std::pair<uint64_t, RevenueSum>& a, const std::pair<uint64_t, RevenueSum>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    size_t top = std::min<size_t>(groups.size(), 20);
+    std::partial_sort(groups.begin(), groups.begin() + top, groups.end(), by_revenue);
+    groups.resize(top);
+
+    // The descriptive customer columns are only read for these customers
+    for (const std::pair<uint64_t, RevenueSum>& group : groups)
+        results.push_back(Query10Result{int(group.first), "", revenueToDouble(group.second), "", "", "", "", ""});
+    size_t customer_lines;
+    if (!pipeline::forEachMorsel(pool, tableShardPaths(table_path, "customer"), customer_lines,
+            [&](const char* begin, const char* end, size_t start_offset, size_t end_offset, int) {
+        const char* cursor = alignToLineStart(begin, begin + start_offset, end);
+        size_t lines = 0;
+        for (; cursor < begin + end_offset; cursor = findLineEnd(cursor, end) + 1, ++lines) {
+            const char* line_end = findLineEnd(cursor, end);
+            const char* field = cursor;
+            int custkey, nationkey;
+            if (!parseIntField(field, line_end, custkey))
+                continue;
+            auto result = std::find_if(results.begin(), results.end(),
+                                       [&](const Query10Result& r) { return r.C_CUSTKEY == custkey; });
+            std::string_view name, address, phone, acctbal, segment, comment;
+            if (result == results.end()
+                || !readField(field, line_end, name) || !readField(field, line_end, address)
+                || !parseIntField(field, line_end, nationkey) || !readField(field, line_end, phone)
+                || !readField(field, line_end, acctbal) || !readField(field, line_end, segment)
+                || !readField(field, line_end, comment))
+                continue;
+            // Customer keys are unique, so no other morsel writes this result
+            result->C_NAME = name;
+            result->C_ADDRESS = address;
+            result->C_PHONE = phone;
+            result->C_ACCTBAL = acctbal;
+            result->C_COMMENT = comment;
+            for (const Nation& n : nation_data)
+                if (n.N_NATIONKEY == nationkey)
+                    result->N_NAME = n.N_NAME;
+        }
+        return lines;
+    }))
+        return false;                                  // Error Reading File
+    return true;
+}
+
+void writeQuery7Results(std::ostream& out, const std::vector<Query7Result>& results) {
+    out.precision(13);
+    for (const Query7Result& row : results)
+        out << row.SUPP_NATION << "|" << row.CUST_NATION << "|" << row.L_YEAR << "|" << row.REVENUE << "\n";
+}
+
+bool outputQuery7Results(const std::string& result_path, const std::vector<Query7Result>& results) {
+    std::ofstream output_file(result_path);
+    if (!output_file)
+        return false;
+    writeQuery7Results(output_file, results);
+    return true;
+}
+
+void writeQuery10Results(std::ostream& out, const std::vector<Query10Result>& results) {
+    out.precision(13);
+    for (const Query10Result& row : results)
+        out << row.C_CUSTKEY << "|" << row.C_NAME << "|" << row.REVENUE << "|" << row.C_ACCTBAL << "|" << row.N_NAME
+            << "|" << row.C_ADDRESS << "|" << row.C_PHONE << "|" << row.C_COMMENT << "\n";
+}
+
+bool outputQuery10Results(const std::string& result_path, const std::vector<Query10Result>& results) {
+    std::ofstream output_file(result_path);
+    if (!output_file)
+        return false;
+    writeQuery10Results(output_file, results);
+    return true;
+}
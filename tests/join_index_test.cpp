@@ -0,0 +1,61 @@
+// JoinIndex: dense and hashed layouts, sequential and pooled builds, and keys that were never inserted
+#include "join_index.hpp"
+#include "test_check.hpp"
+#include "thread_pool.hpp"
+#include <set>
+#include <vector>
+
+
+namespace {
+
+// Build an index from entries, on pool when given, and look up every key and its neighbours
+template <typename Index>
+void checkIndex(const std::vector<typename Index::Entry>& entries, size_t domain_keys, ThreadPool* pool,
+                bool expect_dense) {
+    Index index;
+    index.build(entries, domain_keys, pool);
+    CHECK(index.isDense() == expect_dense);
+    CHECK(index.size() == entries.size());
+
+    std::set<int> keys;
+    for (const typename Index::Entry& entry : entries)
+        keys.insert(entry.key);
+    for (const typename Index::Entry& entry : entries) {
+        CHECK(index.find(entry.key) == entry.code);
+        for (int neighbour : {entry.key - 1, entry.key + 1})
+            if (!keys.count(neighbour))
+                CHECK(index.find(neighbour) == Index::NOT_FOUND);
+    }
+}
+
+} // namespace
+
+
+int main() {
+    ThreadPool pool(4);
+
+    // Dense keys: every third key of a 1..300000 domain
+    std::vector<JoinIndex::Entry> dense;
+    for (int key = 1; key <= 300000; key += 3)
+        dense.push_back({key, int8_t(key % 25)});
+    checkIndex<JoinIndex>(dense, 300000, nullptr, true);
+    checkIndex<JoinIndex>(dense, 300000, &pool, true);
+
+    // Sparse keys over a range far larger than the domain fall back to hashing
+    std::vector<JoinIndex::Entry> sparse;
+    for (int key = 0; key < 100000; ++key)
+        sparse.push_back({key * 4099 + 17, int8_t(key % 25)});
+    checkIndex<JoinIndex>(sparse, 1000, nullptr, false);
+    checkIndex<JoinIndex>(sparse, 1000, &pool, false);
+
+    // Wide codes carry a key through the join
+    std::vector<BasicJoinIndex<int32_t>::Entry> keys;
+    for (int key = 10; key < 20000; key += 2)
+        keys.push_back({key, key * 7});
+    checkIndex<BasicJoinIndex<int32_t>>(keys, 20000, &pool, true);
+
+    JoinIndex empty;
+    empty.build({}, 100);
+    CHECK(empty.find(0) == JoinIndex::NOT_FOUND && empty.find(1) == JoinIndex::NOT_FOUND);
+    return testExitCode();
+}
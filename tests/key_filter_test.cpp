@@ -0,0 +1,46 @@
+// KeyFilter: the exact bitmap for dense keys, the Bloom filter for sparse ones
+#include "key_filter.hpp"
+#include "test_check.hpp"
+#include "thread_pool.hpp"
+#include <set>
+#include <vector>
+
+
+int main() {
+    ThreadPool pool(4);
+
+    // Dense keys use an exact bitmap
+    std::vector<JoinIndex::Entry> dense;
+    std::set<int> dense_keys;
+    for (int key = 1; key <= 200000; key += 5) {
+        dense.push_back({key, 0});
+        dense_keys.insert(key);
+    }
+    for (ThreadPool* build_pool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+        KeyFilter filter;
+        filter.build(dense, 200000, build_pool);
+        CHECK(filter.isBitmap());
+        for (int key = -10; key < 200010; ++key)
+            CHECK(filter.mayContain(key) == (dense_keys.count(key) != 0));
+    }
+
+    // Sparse keys use a Bloom filter: no false negatives and few false positives
+    std::vector<JoinIndex::Entry> sparse;
+    std::set<int> sparse_keys;
+    for (int key = 0; key < 50000; ++key) {
+        sparse.push_back({key * 40009 + 3, 0});
+        sparse_keys.insert(key * 40009 + 3);
+    }
+    for (ThreadPool* build_pool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+        KeyFilter filter;
+        filter.build(sparse, 50000, build_pool);
+        CHECK(!filter.isBitmap());
+        for (const JoinIndex::Entry& entry : sparse)
+            CHECK(filter.mayContain(entry.key));
+        size_t false_positives = 0, probes = 0;
+        for (int key = 1; key < 2000000000 - 1000; key += 1009, ++probes)
+            false_positives += !sparse_keys.count(key) && filter.mayContain(key);
+        CHECK(false_positives * 100 < probes * 2);      // Well under 2%
+    }
+    return testExitCode();
+}
@@ -0,0 +1,665 @@
+// End-to-end check of tpch_query5: generates a small dataset, computes the expected Q5, Q7 and Q10
+// answers straight from the .tbl text, then runs the binary in every mode below and compares each result
+// file byte for byte with them.
+// Usage: tpch_query5_modes_test /path/to/tpch_query5 /path/to/scratch
+#include "table_input.hpp"
+#include "tpch_generator.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#ifdef TPCH_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef TPCH_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace {
+
+struct Query {
+    std::string r_name;
+    std::string start_date;
+    std::string end_date;
+};
+
+const Query QUERIES[] = {
+    {"ASIA", "1994-01-01", "1995-01-01"},
+    {"EUROPE", "1995-06-01", "1996-03-01"},
+};
+
+// Q7 nation pairs, the first is the query's default
+struct NationPair {
+    std::string nation1;
+    std::string nation2;
+};
+
+const NationPair Q7_QUERIES[] = {
+    {"FRANCE", "GERMANY"},
+    {"JAPAN", "CHINA"},
+};
+
+// Q10 order date ranges, the three months from --start_date
+const Query Q10_QUERIES[] = {
+    {"", "1993-10-01", "1994-01-01"},
+    {"", "1995-02-01", "1995-05-01"},
+};
+
+// Flags of every run; each one runs with 1 and with 3 threads. {work} is the scratch directory
+const char* const MODES[] = {
+    "",
+    "--loader stream",
+    "--loader mmap",
+    "--cache_dir {work}/snapshots",                 // The first run writes the snapshots, later runs read them
+    "--execution stream",
+    "--execution stream --loader stream",
+    "--layout columns",
+    "--layout columns --loader stream",
+    "--layout columns --simd scalar",
+    "--layout columns --simd avx2",                 // Kernels the CPU lacks fall back to the best it has
+    "--layout columns --simd avx512",
+    "--pushdown off",
+    "--pushdown off --layout columns",
+    "--cube_path {work}/modes.cube",                // The first run builds the cube, later runs load it
+    "--metrics_path {work}/metrics.json",           // Checked below: each phase ran once
+    "--affinity compact",
+    "--affinity scatter --layout columns",
+    "--memory_limit 4M --spill_dir {work}",        // Past the budget: partitioned through spill files
+    "--memory_limit 1G",                            // Within the budget: runs in memory
+    "--layout compressed",
+    "--layout compressed --loader stream",
+    "--layout compressed --pushdown off",
+    "--layout compressed --cache_dir {work}/snapshots",
+    "--join index",
+    "--join merge",
+    "--join radix",
+    "--join merge --layout columns --pushdown off",
+    "--join radix --layout compressed --pushdown off",
+    "--join index --layout compressed",
+    "--loader async",
+    "--loader async --layout columns",
+    "--loader async --layout compressed --pushdown off",
+    "--loader async --join merge",
+    "--result_cache {work}/result_cache",           // The first run of a query fills the cache, later runs read it
+    "--result_cache {work}/result_cache --layout columns",
+};
+
+// Flags of every --serve - run, which answers QUERIES read from stdin
+const char* const SERVE_MODES[] = {
+    "",
+    "--layout columns",
+    "--affinity scatter",
+    "--layout compressed",
+    "--join radix",
+    "--join merge --layout columns",
+    "--loader async",
+};
+
+// Flags of every --query 7 and --query 10 run
+const char* const OTHER_QUERY_MODES[] = {
+    "",
+    "--loader stream",
+    "--cache_dir {work}/snapshots",
+    "--loader async",
+};
+
+// Flags of every --batch_file run, which answers QUERIES in one scan
+const char* const BATCH_MODES[] = {
+    "",
+    "--layout columns",
+    "--layout compressed",
+    "--loader async",
+    "--cube_path {work}/modes.cube",
+};
+
+// Flags of the Q5 runs over each compressed copy of the tables, see writeCompressedCopy
+const char* const COMPRESSED_MODES[] = {
+    "",
+    "--loader stream",
+    "--layout compressed",
+    "--execution stream",
+    "--memory_limit 4M --spill_dir {work}",        // Estimated from the decompressed sizes
+};
+
+// Flags of the Q5 runs over the sharded copy of the tables, see writeShardedCopy
+const char* const SHARDED_MODES[] = {
+    "",
+    "--loader stream",
+    "--loader async --layout columns",
+    "--layout compressed",
+    "--execution stream",
+    "--join merge",
+    "--cache_dir {work}/shard_snapshots",
+    "--memory_limit 4M --spill_dir {work}",        // Summed over the shards
+};
+
+// Flags of the Q7 and Q10 runs over each compressed and the sharded copy
+const char* const COPY_OTHER_QUERY_MODES[] = {
+    "",
+};
+
+// Flag combinations a mode does not implement; each must fail instead of being ignored
+const char* const REJECTED[] = {
+    "--batch_file {work}/batch.txt --join merge",
+    "--batch_file {work}/batch.txt --execution stream",
+    "--batch_file {work}/batch.txt --pushdown off",
+    "--batch_file {work}/batch.txt --memory_limit 4M",
+    "--serve - --execution stream",
+    "--r_name ASIA --start_date 1994-01-01 --end_date 1995-01-01 --result_cache {work}/result_cache --memory_limit 4M",
+    "--r_name ASIA --start_date 1994-01-01 --end_date 1995-01-01 --result_cache {work}/result_cache --execution stream",
+    "--query 7 --layout columns",
+    "--query 10 --layout compressed",
+};
+
+// ---------------- Reference answers ----------------
+// Computed from the .tbl text with nothing from the library: fields are split at '|', dates
+// compared as YYYY-MM-DD strings and prices parsed here, so a loader bug can not shift the
+// expected and the actual results together.
+
+using TableRows = std::vector<std::vector<std::string>>;
+
+// Fields of every line of a .tbl file; dbgen ends every field with '|'
+TableRows readTableText(const std::string& filepath) {
+    std::ifstream file(filepath);
+    TableRows rows;
+    for (std::string line; std::getline(file, line);) {
+        std::vector<std::string> fields;
+        std::string field;
+        for (char c : line) {
+            if (c == '|') {
+                fields.push_back(field);
+                field.clear();
+            }
+            else
+                field += c;
+        }
+        rows.push_back(fields);
+    }
+    return rows;
+}
+
+struct Tables {
+    TableRows region, nation, customer, supplier, orders, lineitem;
+};
+
+bool readTables(const std::string& table_path, Tables& tables) {
+    tables.region = readTableText(table_path + "/region.tbl");
+    tables.nation = readTableText(table_path + "/nation.tbl");
+    tables.customer = readTableText(table_path + "/customer.tbl");
+    tables.supplier = readTableText(table_path + "/supplier.tbl");
+    tables.orders = readTableText(table_path + "/orders.tbl");
+    tables.lineitem = readTableText(table_path + "/lineitem.tbl");
+    return !tables.region.empty() && !tables.nation.empty() && !tables.customer.empty()
+        && !tables.supplier.empty() && !tables.orders.empty() && !tables.lineitem.empty();
+}
+
+// DECIMAL(15,2) text such as 123.45, 0.4 or 7 in hundredths
+int64_t hundredths(const std::string& text) {
+    size_t point = text.find('.');
+    std::string whole = text.substr(0, point);
+    std::string fraction = point == std::string::npos ? "" : text.substr(point + 1);
+    fraction.resize(2, '0');
+    return (whole.empty() ? 0 : std::stoll(whole)) * 100 + std::stoll(fraction);
+}
+
+// L_EXTENDEDPRICE * (1 - L_DISCOUNT) of a lineitem row in units of 1e-4
+int64_t lineItemRevenue(const std::vector<std::string>& lineitem) {
+    return hundredths(lineitem[5]) * (100 - hundredths(lineitem[6]));
+}
+
+// Revenue printed like the query prints it: 13 significant digits of the exact sum
+std::string revenueText(int64_t revenue) {
+    std::ostringstream text;
+    text.precision(13);
+    text << double(revenue) / 10000.0;
+    return text.str();
+}
+
+// Q5 result lines NATION|REVENUE, by revenue descending, ties by nation
+std::vector<std::string> referenceQuery5(const Tables& tables, const Query& query) {
+    std::string regionkey;
+    for (const std::vector<std::string>& region : tables.region)
+        if (region[1] == query.r_name)
+            regionkey = region[0];
+    std::unordered_map<std::string, std::string> nation_names;     // Nations of the region
+    for (const std::vector<std::string>& nation : tables.nation)
+        if (nation[2] == regionkey)
+            nation_names[nation[0]] = nation[1];
+
+    std::unordered_map<std::string, std::string> customer_nations, supplier_nations, order_nations;
+    for (const std::vector<std::string>& customer : tables.customer)
+        customer_nations[customer[0]] = customer[3];
+    for (const std::vector<std::string>& supplier : tables.supplier)
+        supplier_nations[supplier[0]] = supplier[3];
+    for (const std::vector<std::string>& order : tables.orders) {
+        const std::string& nation = customer_nations[order[1]];
+        if (order[4] >= query.start_date && order[4] < query.end_date && nation_names.count(nation))
+            order_nations[order[0]] = nation;
+    }
+
+    std::map<std::string, int64_t> revenue;
+    for (const std::vector<std::string>& lineitem : tables.lineitem) {
+        auto order = order_nations.find(lineitem[0]);
+        if (order != order_nations.end() && supplier_nations[lineitem[2]] == order->second)
+            revenue[nation_names[order->second]] += lineItemRevenue(lineitem);
+    }
+
+    std::vector<std::pair<std::string, int64_t>> rows(revenue.begin(), revenue.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::vector<std::string> lines;
+    for (const auto& [nation, sum] : rows)
+        if (sum != 0)
+            lines.push_back(nation + "|" + revenueText(sum));
+    return lines;
+}
+
+// Q7 result lines SUPP_NATION|CUST_NATION|L_YEAR|REVENUE of lineitems shipped in 1995 and 1996
+// between the two nations, by supplier nation, customer nation and year
+std::vector<std::string> referenceQuery7(const Tables& tables, const NationPair& pair) {
+    std::unordered_map<std::string, std::string> nation_names;     // The pair's nations
+    for (const std::vector<std::string>& nation : tables.nation)
+        if (nation[1] == pair.nation1 || nation[1] == pair.nation2)
+            nation_names[nation[0]] = nation[1];
+
+    std::unordered_map<std::string, std::string> customer_nations, supplier_nations, order_nations;
+    for (const std::vector<std::string>& customer : tables.customer)
+        if (nation_names.count(customer[3]))
+            customer_nations[customer[0]] = nation_names[customer[3]];
+    for (const std::vector<std::string>& supplier : tables.supplier)
+        if (nation_names.count(supplier[3]))
+            supplier_nations[supplier[0]] = nation_names[supplier[3]];
+    for (const std::vector<std::string>& order : tables.orders) {
+        auto customer = customer_nations.find(order[1]);
+        if (customer != customer_nations.end())
+            order_nations[order[0]] = customer->second;
+    }
+
+    std::map<std::tuple<std::string, std::string, std::string>, int64_t> revenue;
+    for (const std::vector<std::string>& lineitem : tables.lineitem) {
+        const std::string& shipdate = lineitem[10];
+        auto supplier = supplier_nations.find(lineitem[2]);
+        auto order = order_nations.find(lineitem[0]);
+        if (shipdate >= "1995-01-01" && shipdate <= "1996-12-31" && supplier != supplier_nations.end()
+            && order != order_nations.end() && supplier->second != order->second)
+            revenue[{supplier->second, order->second, shipdate.substr(0, 4)}] += lineItemRevenue(lineitem);
+    }
+
+    std::vector<std::string> lines;
+    for (const auto& [group, sum] : revenue)
+        lines.push_back(std::get<0>(group) + "|" + std::get<1>(group) + "|" + std::get<2>(group) + "|" + revenueText(sum));
+    return lines;
+}
+
+// Q10 result lines C_CUSTKEY|C_NAME|REVENUE|C_ACCTBAL|N_NAME|C_ADDRESS|C_PHONE|C_COMMENT: the 20
+// customers with the most returned revenue of orders in the range, ties by customer key
+std::vector<std::string> referenceQuery10(const Tables& tables, const Query& query) {
+    std::unordered_map<std::string, std::string> nation_names;
+    for (const std::vector<std::string>& nation : tables.nation)
+        nation_names[nation[0]] = nation[1];
+    std::unordered_map<std::string, const std::vector<std::string>*> customers;
+    for (const std::vector<std::string>& customer : tables.customer)
+        customers[customer[0]] = &customer;
+    std::unordered_map<std::string, int64_t> order_customers;
+    for (const std::vector<std::string>& order : tables.orders)
+        if (order[4] >= query.start_date && order[4] < query.end_date)
+            order_customers[order[0]] = std::stoll(order[1]);
+
+    std::map<int64_t, int64_t> revenue;         // By customer key
+    for (const std::vector<std::string>& lineitem : tables.lineitem) {
+        auto order = order_customers.find(lineitem[0]);
+        if (lineitem[8] == "R" && order != order_customers.end())
+            revenue[order->second] += lineItemRevenue(lineitem);
+    }
+
+    std::vector<std::pair<int64_t, int64_t>> rows(revenue.begin(), revenue.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    rows.resize(std::min<size_t>(rows.size(), 20));
+    std::vector<std::string> lines;
+    for (const auto& [custkey, sum] : rows) {
+        const std::vector<std::string>& customer = *customers[std::to_string(custkey)];
+        lines.push_back(customer[0] + "|" + customer[1] + "|" + revenueText(sum) + "|" + customer[5] + "|"
+                        + nation_names[customer[3]] + "|" + customer[2] + "|" + customer[4] + "|" + customer[7]);
+    }
+    return lines;
+}
+
+// ---------------- Runs ----------------
+
+std::string readFile(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+std::string joinLines(const std::vector<std::string>& lines) {
+    std::string text;
+    for (const std::string& line : lines)
+        text += line + "\n";
+    return text;
+}
+
+std::string replaceAll(std::string text, const std::string& from, const std::string& to) {
+    for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size()))
+        text.replace(at, from.size(), to);
+    return text;
+}
+
+class Runner {
+public:
+    Runner(const std::string& binary, const std::string& work_path) : binary_(binary), work_path_(work_path) {}
+
+    // Run tpch_query5 with arguments and stdin from input_path when given. Standard output goes to
+    // outputPath(), errors to the log; returns the exit status
+    int run(const std::string& arguments, const std::string& input_path = "") {
+        std::string command = "\"" + binary_ + "\" " + replaceAll(arguments, "{work}", work_path_)
+                            + (input_path.empty() ? "" : " < \"" + input_path + "\"")
+                            + " > \"" + outputPath() + "\" 2> \"" + logPath() + "\"";
+        ++runs_;
+        return std::system(command.c_str());
+    }
+
+    // Report and count a run that failed or whose output differs from expected
+    void check(const std::string& description, int status, const std::string& actual, const std::string& expected) {
+        if (status == 0 && actual == expected)
+            return;
+        std::cerr << "FAIL: " << description << (status != 0 ? " (exit status " + std::to_string(status) + ")" : "")
+                  << "\n" << readFile(logPath());
+        ++failures_;
+    }
+
+    std::string outputPath() const { return work_path_ + "/run.out"; }
+    std::string logPath() const { return work_path_ + "/run.log"; }
+    int runs() const { return runs_; }
+    int failures() const { return failures_; }
+
+private:
+    std::string binary_;
+    std::string work_path_;
+    int runs_ = 0;
+    int failures_ = 0;
+};
+
+std::string query5Arguments(const Query& query, const std::string& table_path, int threads,
+                            const std::string& result_path) {
+    return "--r_name " + query.r_name + " --start_date " + query.start_date + " --end_date " + query.end_date
+         + " --threads " + std::to_string(threads) + " --table_path \"" + table_path + "\" --result_path \""
+         + result_path + "\"";
+}
+
+// Server responses without the latency: the result lines, then "OK <rows>" per request
+std::string withoutLatency(const std::string& responses) {
+    std::istringstream lines(responses);
+    std::string text;
+    for (std::string line; std::getline(lines, line);)
+        text += (line.compare(0, 3, "OK ") == 0 ? line.substr(0, line.find(' ', 3)) : line) + "\n";
+    return text;
+}
+
+// ---------------- Compressed copies ----------------
+
+const char* const TABLE_NAMES[] = {"region", "nation", "customer", "supplier", "orders", "lineitem"};
+
+// Frames of the .tbl.zst copy of lineitem, small enough to be decompressed in parallel
+constexpr size_t ZSTD_FRAME_BYTES = size_t(1) << 20;
+
+#ifdef TPCH_HAVE_ZLIB
+// Write text as gzip members of at most member_bytes each
+bool writeGzip(const std::string& text, const std::string& filepath, size_t member_bytes) {
+    for (size_t offset = 0; offset < text.size(); offset += member_bytes) {
+        gzFile file = gzopen(filepath.c_str(), offset == 0 ? "wb" : "ab");
+        if (!file)
+            return false;
+        size_t size = std::min(member_bytes, text.size() - offset);
+        bool written = gzwrite(file, text.data() + offset, unsigned(size)) == int(size);
+        if (gzclose(file) != Z_OK || !written)
+            return false;
+    }
+    return true;
+}
+#endif
+
+#ifdef TPCH_HAVE_ZSTD
+// Write text as zstd frames of at most frame_bytes each, recording their sizes only when asked to
+bool writeZstd(const std::string& text, const std::string& filepath, size_t frame_bytes, bool record_size) {
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    if (!context || ZSTD_isError(ZSTD_CCtx_setParameter(context, ZSTD_c_contentSizeFlag, record_size)))
+        return false;
+    std::ofstream file(filepath, std::ios::binary);
+    std::string frame;
+    bool written = true;
+    for (size_t offset = 0; offset < text.size() && written; offset += frame_bytes) {
+        size_t size = std::min(frame_bytes, text.size() - offset);
+        frame.resize(ZSTD_compressBound(size));
+        size_t compressed = ZSTD_compress2(context, frame.data(), frame.size(), text.data() + offset, size);
+        written = !ZSTD_isError(compressed) && file.write(frame.data(), compressed);
+    }
+    ZSTD_freeCCtx(context);
+    return written && bool(file);
+}
+#endif
+
+// Copy the tables of table_path compressed into copy_path. gzip: orders in two members. zstd:
+// lineitem in frames of ZSTD_FRAME_BYTES, orders in one frame without its size, so both zstd
+// readers run. Returns false if this build can not write or read the format
+bool writeCompressedCopy(const std::string& table_path, const std::string& copy_path, TableCompression compression) {
+    if (!tableCompressionSupported(compression))
+        return false;
+    std::error_code error;
+    std::filesystem::create_directories(copy_path, error);
+    bool written = !error;
+    for (const char* name : TABLE_NAMES) {
+        const std::string text = readFile(table_path + "/" + name + ".tbl");
+        const std::string table = name;
+#ifdef TPCH_HAVE_ZLIB
+        if (compression == TableCompression::Gzip)
+            written = written && writeGzip(text, copy_path + "/" + table + ".tbl.gz",
+                                           table == "orders" ? text.size() / 2 + 1 : text.size() + 1);
+#endif
+#ifdef TPCH_HAVE_ZSTD
+        if (compression == TableCompression::Zstd)
+            written = written && writeZstd(text, copy_path + "/" + table + ".tbl.zst",
+                                           table == "lineitem" ? ZSTD_FRAME_BYTES : text.size() + 1, table != "orders");
+#endif
+    }
+    return written;
+}
+
+// ---------------- Sharded copy ----------------
+
+// Copy the tables of table_path into copy_path split the way dbgen -C does, name.tbl.1 .. name.tbl.N
+// with consecutive rows: lineitem into 4 shards, orders into 3 and customer into 2, the rest
+// unsharded. The second lineitem shard is gzip compressed when the build reads gzip
+bool writeShardedCopy(const std::string& table_path, const std::string& copy_path) {
+    std::error_code error;
+    std::filesystem::create_directories(copy_path, error);
+    bool written = !error;
+    for (const char* name : TABLE_NAMES) {
+        const std::string table = name;
+        const size_t shards = table == "lineitem" ? 4 : table == "orders" ? 3 : table == "customer" ? 2 : 1;
+        if (shards == 1) {
+            std::filesystem::copy_file(table_path + "/" + table + ".tbl", copy_path + "/" + table + ".tbl", error);
+            written = written && !error;
+            continue;
+        }
+
+        std::vector<std::string> lines;
+        std::istringstream text(readFile(table_path + "/" + table + ".tbl"));
+        for (std::string line; std::getline(text, line);)
+            lines.push_back(line + "\n");
+        for (size_t shard = 0; shard < shards; ++shard) {
+            std::string shard_text;
+            for (size_t row = lines.size() * shard / shards; row < lines.size() * (shard + 1) / shards; ++row)
+                shard_text += lines[row];
+            const std::string shard_path = copy_path + "/" + table + ".tbl." + std::to_string(shard + 1);
+#ifdef TPCH_HAVE_ZLIB
+            if (table == "lineitem" && shard == 1) {
+                written = written && writeGzip(shard_text, shard_path + ".gz", shard_text.size() + 1);
+                continue;
+            }
+#endif
+            std::ofstream shard_file(shard_path, std::ios::binary);
+            written = written && shard_file.write(shard_text.data(), shard_text.size());
+        }
+    }
+    return written;
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " /path/to/tpch_query5 /path/to/scratch" << std::endl;
+        return 2;
+    }
+    const std::string work_path = argv[2];
+    const std::string table_path = work_path + "/tables";
+
+    std::error_code error;
+    std::filesystem::remove_all(work_path, error);
+    std::filesystem::create_directories(table_path, error);
+    Tables tables;
+    if (error || !generateTPCHData(table_path, 0.05) || !readTables(table_path, tables)) {
+        std::cerr << "Failed to generate tables in " << table_path << std::endl;
+        return 1;
+    }
+
+    Runner runner(argv[1], work_path);
+    const std::string result_path = work_path + "/result.txt";
+    for (const Query& query : QUERIES)
+        if (referenceQuery5(tables, query).empty()) {
+            std::cerr << "No reference result for " << query.r_name << " " << query.start_date << std::endl;
+            return 1;
+        }
+
+    // Q5 over the tables in tables_path in each mode, with 1 and 3 threads
+    auto checkQuery5 = [&](const std::string& tables_path, const auto& modes) {
+        for (const Query& query : QUERIES) {
+            std::string expected = joinLines(referenceQuery5(tables, query));
+            for (const char* mode : modes)
+                for (int threads : {1, 3}) {
+                    std::filesystem::remove(result_path, error);
+                    std::string arguments = query5Arguments(query, tables_path, threads, result_path) + " " + mode;
+                    int status = runner.run(arguments);
+                    runner.check(arguments, status, readFile(result_path), expected);
+                }
+        }
+    };
+
+    // Q7 and Q10 run as pipelines over the text tables
+    auto checkOtherQueries = [&](const std::string& tables_path, const auto& modes) {
+        for (const NationPair& pair : Q7_QUERIES) {
+            std::vector<std::string> expected = referenceQuery7(tables, pair);
+            for (const char* mode : modes)
+                for (int threads : {1, 3}) {
+                    std::filesystem::remove(result_path, error);
+                    std::string arguments = "--query 7 --nation1 " + pair.nation1 + " --nation2 " + pair.nation2
+                                          + " --threads " + std::to_string(threads) + " --table_path \"" + tables_path
+                                          + "\" --result_path \"" + result_path + "\" " + mode;
+                    int status = runner.run(arguments);
+                    runner.check(arguments, status, readFile(result_path), expected.empty() ? "no rows" : joinLines(expected));
+                }
+        }
+        for (const Query& query : Q10_QUERIES) {
+            std::vector<std::string> expected = referenceQuery10(tables, query);
+            for (const char* mode : modes)
+                for (int threads : {1, 3}) {
+                    std::filesystem::remove(result_path, error);
+                    std::string arguments = "--query 10 --start_date " + query.start_date + " --threads "
+                                          + std::to_string(threads) + " --table_path \"" + tables_path
+                                          + "\" --result_path \"" + result_path + "\" " + mode;
+                    int status = runner.run(arguments);
+                    runner.check(arguments, status, readFile(result_path), expected.empty() ? "no rows" : joinLines(expected));
+                }
+        }
+    };
+
+    checkQuery5(table_path, MODES);
+
+    // The last --metrics_path run timed each phase once
+    const std::string metrics = readFile(work_path + "/metrics.json");
+    for (const char* phase : {"load", "preprocess", "probe", "merge"})
+        runner.check(std::string("--metrics_path records ") + phase + " once", 0,
+                     metrics.find("\"" + std::string(phase) + "\": {\"calls\": 1,") == std::string::npos ? "missing" : "", "");
+
+    // A resident server answers every query from one load
+    const std::string requests_path = work_path + "/requests.txt";
+    std::string requests, expected_responses;
+    for (const Query& query : QUERIES) {
+        std::vector<std::string> expected = referenceQuery5(tables, query);
+        requests += query.r_name + "|" + query.start_date + "|" + query.end_date + "\n";
+        expected_responses += joinLines(expected) + "OK " + std::to_string(expected.size()) + "\n";
+    }
+    std::ofstream(requests_path) << requests << "QUIT\n";
+    const std::string batch_path = work_path + "/batch.txt";
+    std::ofstream(batch_path) << requests;
+    for (const char* mode : SERVE_MODES)
+        for (int threads : {1, 3}) {
+            int status = runner.run("--serve - --threads " + std::to_string(threads) + " --table_path \"" + table_path
+                                    + "\" " + mode, requests_path);
+            runner.check("--serve - --threads " + std::to_string(threads) + " " + mode, status,
+                         withoutLatency(readFile(runner.outputPath())), expected_responses);
+        }
+
+    // A batch file answers every query with one scan, rows prefixed by the query
+    std::string expected_batch;
+    for (const Query& query : QUERIES)
+        for (const std::string& line : referenceQuery5(tables, query))
+            expected_batch += query.r_name + "|" + query.start_date + "|" + query.end_date + "|" + line + "\n";
+    for (const char* mode : BATCH_MODES)
+        for (int threads : {1, 3}) {
+            std::filesystem::remove(result_path, error);
+            int status = runner.run("--batch_file \"" + batch_path + "\" --threads " + std::to_string(threads)
+                                    + " --table_path \"" + table_path + "\" --result_path \"" + result_path + "\" " + mode);
+            runner.check("--batch_file --threads " + std::to_string(threads) + " " + mode, status,
+                         readFile(result_path), expected_batch);
+        }
+
+    checkOtherQueries(table_path, OTHER_QUERY_MODES);
+
+    for (const char* arguments : REJECTED) {
+        int status = runner.run(std::string(arguments) + " --table_path \"" + table_path + "\" --result_path \""
+                                + result_path + "\"", requests_path);
+        runner.check(std::string(arguments) + " is rejected", status == 0 ? 1 : 0, "", "");
+    }
+
+    // The same tables compressed; a build without zlib or libzstd can not read them
+    for (TableCompression compression : {TableCompression::Gzip, TableCompression::Zstd}) {
+        const std::string copy_path = work_path + (compression == TableCompression::Gzip ? "/tables_gz" : "/tables_zst");
+        if (!writeCompressedCopy(table_path, copy_path, compression)) {
+            std::cout << "Skipped the runs over " << copy_path << ", this build can not read it" << std::endl;
+            continue;
+        }
+        checkQuery5(copy_path, COMPRESSED_MODES);
+        checkOtherQueries(copy_path, COPY_OTHER_QUERY_MODES);
+    }
+
+    // The same tables in shards
+    const std::string sharded_path = work_path + "/tables_sharded";
+    if (!writeShardedCopy(table_path, sharded_path)) {
+        std::cerr << "Failed to write the sharded tables in " << sharded_path << std::endl;
+        return 1;
+    }
+    checkQuery5(sharded_path, SHARDED_MODES);
+    checkOtherQueries(sharded_path, COPY_OTHER_QUERY_MODES);
+
+    if (runner.failures()) {
+        std::cerr << runner.failures() << " of " << runner.runs() << " runs differ from the reference result" << std::endl;
+        return 1;
+    }
+    std::filesystem::remove_all(work_path, error);
+    std::cout << "All " << runner.runs() << " runs match the reference result" << std::endl;
+    return 0;
+}
@@ -0,0 +1,144 @@
+// RevenueCube refresh: a cube built from base tables plus refresh set 1 (RF1 inserts, RF2 deletes)
+// answers like a scan over the tables the refresh leads to, both when built and when loaded back
+#include "query5.hpp"
+#include "revenue_cube.hpp"
+#include "test_check.hpp"
+#include "tpch_generator.hpp"
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+namespace {
+
+std::vector<std::string> readLines(const std::string& filepath) {
+    std::ifstream file(filepath);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+bool writeLines(const std::string& filepath, const std::vector<std::string>& lines) {
+    std::ofstream file(filepath, std::ios::trunc);
+    for (const std::string& line : lines)
+        file << line << "\n";
+    return bool(file);
+}
+
+int orderKeyOf(const std::string& line) {
+    return std::stoi(line.substr(0, line.find('|')));
+}
+
+// Turn generated tables in base_path into base tables plus refresh set 1, and write the tables the
+// refresh should lead to into expected_path. Every 50th order (with its lineitems) moves into RF1,
+// and a different 50th of the remaining orders is deleted by RF2
+bool writeRefreshSet(const std::string& base_path, const std::string& expected_path) {
+    std::vector<std::string> orders = readLines(base_path + "/orders.tbl");
+    std::vector<std::string> lineitems = readLines(base_path + "/lineitem.tbl");
+    if (orders.empty() || lineitems.empty())
+        return false;
+
+    std::set<int> inserted, deleted;
+    std::vector<std::string> base_orders, new_orders, expected_orders, deletes;
+    for (size_t row = 0; row < orders.size(); ++row) {
+        int orderkey = orderKeyOf(orders[row]);
+        if (row % 50 == 7) {
+            inserted.insert(orderkey);
+            new_orders.push_back(orders[row]);
+        }
+        else
+            base_orders.push_back(orders[row]);
+        if (row % 50 == 31) {
+            deleted.insert(orderkey);
+            deletes.push_back(std::to_string(orderkey) + "|");
+        }
+        else
+            expected_orders.push_back(orders[row]);
+    }
+
+    std::vector<std::string> base_lineitems, new_lineitems, expected_lineitems;
+    for (const std::string& line : lineitems) {
+        int orderkey = orderKeyOf(line);
+        (inserted.count(orderkey) ? new_lineitems : base_lineitems).push_back(line);
+        if (!deleted.count(orderkey))
+            expected_lineitems.push_back(line);
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(expected_path, error);
+    for (const char* table : {"region", "nation", "customer", "supplier"})
+        std::filesystem::copy_file(base_path + "/" + table + ".tbl", expected_path + "/" + table + ".tbl",
+                                   std::filesystem::copy_options::overwrite_existing, error);
+    return !error
+        && writeLines(base_path + "/orders.tbl", base_orders)
+        && writeLines(base_path + "/lineitem.tbl", base_lineitems)
+        && writeLines(base_path + "/orders.tbl.u1", new_orders)
+        && writeLines(base_path + "/lineitem.tbl.u1", new_lineitems)
+        && writeLines(base_path + "/delete.1", deletes)
+        && writeLines(expected_path + "/orders.tbl", expected_orders)
+        && writeLines(expected_path + "/lineitem.tbl", expected_lineitems);
+}
+
+bool sameResults(const std::vector<Nation_Revenue>& left, const std::vector<Nation_Revenue>& right) {
+    if (left.size() != right.size())
+        return false;
+    for (size_t row = 0; row < left.size(); ++row)
+        if (left[row].NATION != right[row].NATION || left[row].REVENUE != right[row].REVENUE)
+            return false;
+    return true;
+}
+
+} // namespace
+
+
+int main() {
+    const std::string work_path = (std::filesystem::temp_directory_path()
+                                   / ("tpch_revenue_cube_test." + std::to_string(::getpid()))).string();
+    const std::string base_path = work_path + "/base";
+    const std::string expected_path = work_path + "/expected";
+    std::error_code error;
+    std::filesystem::create_directories(base_path, error);
+    CHECK(!error && generateTPCHData(base_path, 0.01));
+    CHECK(writeRefreshSet(base_path, expected_path));
+
+    // The tables after RF1 and RF2, queried directly
+    std::vector<Customer> customer_data;
+    std::vector<Orders> orders_data;
+    std::vector<std::vector<LineItem>> lineitem_data;
+    std::vector<Supplier> supplier_data;
+    std::vector<Nation> nation_data;
+    std::vector<Region> region_data;
+    CHECK(readTPCHData(expected_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data,
+                       region_data, 2));
+
+    ExecutionOptions options;
+    options.cube_path = work_path + "/refresh.cube";
+    options.refresh_set = 1;
+    const Query5Parameters queries[] = {
+        {"ASIA", "1994-01-01", "1995-01-01"},
+        {"EUROPE", "1992-01-01", "1999-01-01"},
+        {"AMERICA", "1995-03-15", "1995-04-15"},
+    };
+
+    // Built from the base tables and refreshed, then loaded back from the saved cube
+    for (int pass = 0; pass < 2; ++pass) {
+        RevenueCube cube;
+        CHECK(openRevenueCube(base_path, 2, options, cube));
+        CHECK(cube.hasRefresh(1) && !cube.hasRefresh(2));
+        for (const Query5Parameters& query : queries) {
+            std::vector<Nation_Revenue> cube_results, expected_results;
+            CHECK(cube.query(query.r_name, query.start_date, query.end_date, cube_results));
+            CHECK(executeQuery5(query.r_name, query.start_date, query.end_date, 2, customer_data, orders_data,
+                                lineitem_data, supplier_data, nation_data, region_data, expected_results));
+            CHECK(!expected_results.empty());
+            CHECK(sameResults(cube_results, expected_results));
+        }
+    }
+
+    std::filesystem::remove_all(work_path, error);
+    return testExitCode();
+}
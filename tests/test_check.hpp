@@ -0,0 +1,32 @@
+#ifndef TEST_CHECK_HPP
+#define TEST_CHECK_HPP
+
+#include <iostream>
+
+
+// ---------------- Unit test checks ----------------
+// CHECK(condition) reports a failed condition with its file and line and carries on, so one run
+// lists every failure; testExitCode() turns the count into the test's exit status.
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+            ++checkFailures();                                                              \
+        }                                                                                   \
+    } while (0)
+
+inline int testExitCode() {
+    if (checkFailures()) {
+        std::cerr << checkFailures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif // TEST_CHECK_HPP
@@ -0,0 +1,30 @@
+// Packed dates: parseDate accepts exactly the YYYY-MM-DD dates of the calendar, leap days included
+#include "test_check.hpp"
+#include "tpch_date.hpp"
+
+
+int main() {
+    int days = -1;
+    CHECK(parseDate("1970-01-01", days) && days == 0);
+    CHECK(parseDate("1994-01-01", days) && days == daysFromCivil(1994, 1, 1));
+    CHECK(parseDate("1996-02-29", days) && days == daysFromCivil(1996, 3, 1) - 1);
+    CHECK(parseDate("2000-02-29", days));               // Divisible by 400: leap year
+    CHECK(!parseDate("1900-02-29", days));              // Divisible by 100 only: no leap year
+    CHECK(!parseDate("1995-02-29", days));
+    CHECK(!parseDate("1994-04-31", days));
+    CHECK(parseDate("1994-12-31", days));
+    CHECK(!parseDate("1994-13-01", days));
+    CHECK(!parseDate("1994-00-10", days));
+    CHECK(!parseDate("1994-01-00", days));
+    CHECK(!parseDate("1994-1-01", days));
+    CHECK(!parseDate("1994/01/01", days));
+    CHECK(!parseDate("1994-01-0a", days));
+    CHECK(!parseDate("", days));
+
+    // Every day of 1992-1998 survives a round trip through its calendar date
+    for (int day = daysFromCivil(1992, 1, 1); day < daysFromCivil(1999, 1, 1); ++day) {
+        int parsed = -1;
+        CHECK(parseDate(formatDate(day), parsed) && parsed == day);
+    }
+    return testExitCode();
+}
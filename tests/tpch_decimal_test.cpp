@@ -0,0 +1,46 @@
+// Exact revenue: DECIMAL(15,2) parsing, order-independent sums and their rounding into results
+#include "query5.hpp"
+#include "test_check.hpp"
+#include "tpch_decimal.hpp"
+#include <cstdint>
+#include <vector>
+
+
+int main() {
+    int64_t price;
+    CHECK(parseHundredths("12345.67", price) && price == 1234567);
+    CHECK(parseHundredths("0.4", price) && price == 40);
+    CHECK(parseHundredths("7", price) && price == 700);
+    CHECK(!parseHundredths("1.234", price));
+    CHECK(!parseHundredths(".", price));
+    CHECK(lineItemRevenue(1234567, 4) == 1234567 * 96);
+
+    // Sums are exact, so the order of the additions does not matter
+    std::vector<int64_t> revenues;
+    for (int i = 0; i < 1000; ++i)
+        revenues.push_back(lineItemRevenue(int64_t(i) * 7919 % 10000000, i % 11));
+    RevenueSum forward = 0, backward = 0;
+    for (size_t i = 0; i < revenues.size(); ++i) {
+        forward += revenues[i];
+        backward += revenues[revenues.size() - 1 - i];
+    }
+    CHECK(forward == backward);
+
+    CHECK(revenueToDouble(123456789) == 12345.6789);
+    CHECK(revenueToDouble(-5000) == -0.5);
+    CHECK(revenueToDouble(RevenueSum(1) << 70) == double(RevenueSum(1) << 70) / 10000.0);  // Past 64 bits
+
+    // Zero sums are dropped, the rest ordered by revenue descending, ties by nation
+    std::vector<NationRevenueSum> sums = {
+        {"JAPAN", 15000}, {"CHINA", 0}, {"INDIA", 25000}, {"INDONESIA", 15000}, {"VIETNAM", 1}};
+    std::vector<Nation_Revenue> results;
+    roundNationRevenue(sums, results);
+    CHECK(results.size() == 4);
+    if (results.size() == 4) {
+        CHECK(results[0].NATION == "INDIA" && results[0].REVENUE == 2.5);
+        CHECK(results[1].NATION == "INDONESIA" && results[1].REVENUE == 1.5);
+        CHECK(results[2].NATION == "JAPAN" && results[2].REVENUE == 1.5);
+        CHECK(results[3].NATION == "VIETNAM" && results[3].REVENUE == 0.0001);
+    }
+    return testExitCode();
+}